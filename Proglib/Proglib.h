@@ -18,3 +18,12 @@ void  print_version_info( char *version_string);
  *    */
 char* history_string( int ac, char* av[] );
 
+#include <volume_io.h>
+
+/*
+ * Bounding box of the voxels of a volume above a threshold
+ * (see volume_bbox.c).
+ */
+VIO_BOOL get_volume_bounding_box( VIO_Volume volume, VIO_Real threshold,
+                                  int v_min[], int v_max[],
+                                  VIO_Real w_min[], VIO_Real w_max[] );
@@ -0,0 +1,78 @@
+#include <config.h>
+#include <float.h>
+#include <limits.h>
+#include <volume_io.h>
+#include "Proglib.h"
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_volume_bounding_box
+@INPUT      : volume    - a 3D volume
+              threshold - real value
+@OUTPUT     : v_min,v_max - along each voxel axis, the first and last voxel
+                            with a value > threshold (INT_MAX and -INT_MAX
+                            when there is none)
+              w_min,w_max - the x,y,z world range of the centres of these
+                            voxels (DBL_MAX and -DBL_MAX when there is none);
+                            not computed when w_min is NULL
+@RETURNS    : TRUE if some voxel has a value > threshold
+@DESCRIPTION: the box computed by mincbbox, also used by minctracc to crop
+              its volumes (-crop_volumes).
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Thu Jun  2 10:21:00 EST 1994   Louis Collins (in mincbbox.c)
+@MODIFIED   : Oct 18, 2026  moved out of mincbbox.c
+---------------------------------------------------------------------------- */
+VIO_BOOL get_volume_bounding_box( VIO_Volume volume, VIO_Real threshold,
+                                  int v_min[], int v_max[],
+                                  VIO_Real w_min[], VIO_Real w_max[] )
+{
+  VIO_Real
+    voxel, value, 
+    world[3];
+  int
+    i,j,k,a,
+    index[3],
+    sizes[3];
+
+  get_volume_sizes(volume, sizes);
+
+  for(a=0; a<3; a++) {
+    v_min[a] = INT_MAX;
+    v_max[a] = -INT_MAX;
+    if (w_min != NULL) {
+      w_min[a] = DBL_MAX;
+      w_max[a] = -DBL_MAX;
+    }
+  }
+
+  for(i=0; i<sizes[0]; i++) {
+    for(j=0; j<sizes[1]; j++) {
+      for(k=0; k<sizes[2]; k++) {
+        GET_VOXEL_3D(voxel, volume, i,j,k);
+        value = CONVERT_VOXEL_TO_VALUE(volume, voxel);
+
+        if (value>threshold) {
+
+          index[0] = i; index[1] = j; index[2] = k;
+
+          for(a=0; a<3; a++) {
+            if (index[a]<v_min[a]) v_min[a] = index[a];
+            if (index[a]>v_max[a]) v_max[a] = index[a];
+          }
+
+          if (w_min != NULL) {
+            convert_3D_voxel_to_world(volume,(VIO_Real)i,(VIO_Real)j,(VIO_Real)k,
+                                      &world[0],&world[1],&world[2]);
+            for(a=0; a<3; a++) {
+              if (world[a]<w_min[a]) w_min[a] = world[a];
+              if (world[a]>w_max[a]) w_max[a] = world[a];
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return(v_max[0] >= v_min[0]);
+}
@@ -0,0 +1,55 @@
+#! /bin/sh
+set -e
+
+if [[ -z $XCORR_VOL ]];then
+  echo XCORR_VOL not set
+  exit 1
+fi
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+# linear fit: the lattice is rotated with respect to the target
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -bricked_volumes \
+     -clobber output.bricked.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.bricked.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.bricked.xfm ideal.bricked.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# nonlinear fit: the bricks give the same samples, so the same fit
+
+for layout in linear bricked; do
+  if [ $layout = bricked ]; then option=-bricked_volumes; else option=; fi
+
+  ${MINCTRACC} -iterations 10 \
+      -identity object1_dxyz.mnc object2_dxyz.mnc \
+      -est_center -debug  -step 10 10 10 -nonlin $option \
+      -clobber def_$layout.xfm 
+
+  mincresample object1.mnc -like object2.mnc -transform def_$layout.xfm object1_res_$layout.mnc -clob
+done
+
+corr_linear=`${XCORR_VOL} object1_res_linear.mnc object2.mnc|cut -c 1-7`
+corr_bricked=`${XCORR_VOL} object1_res_bricked.mnc object2.mnc|cut -c 1-7`
+echo $0 xcorr after\: $corr_linear \(linear\) $corr_bricked \(bricked\)
+
+if [ $corr_bricked != $corr_linear ];then
+  echo $0 Corr test after failed: the bricked volumes gave another fit
+  exit 1
+fi
+
+tresult=$(echo "$corr_bricked>=0.9860 && $corr_bricked<1.0" | bc)
+if [ $tresult != 1 ];then
+  echo $0 Corr test after failed 
+  echo corr_after=\"${corr_bricked}\"
+  exit 1
+fi
@@ -0,0 +1,37 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -bspline -perf_report perf_report.bspline.json \
+     -clobber output.bspline.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.bspline.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.bspline.xfm ideal.bspline.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the fit interpolated the B-spline coefficients of the volumes
+if ! grep -q '"name": "bspline_prefilter"' perf_report.bspline.json; then
+  echo >&2 $0 failed: the volumes were not prefiltered for -bspline.
+  exit 1
+fi
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -tricubic \
+     -clobber output.bspline_tricubic.xfm
+
+grep -v '^%' output.bspline.xfm          > bspline.txt
+grep -v '^%' output.bspline_tricubic.xfm > bspline_tricubic.txt
+if cmp -s bspline.txt bspline_tricubic.txt; then
+  echo >&2 $0 failed: -bspline gave the same transformation as -tricubic.
+  exit 1
+fi
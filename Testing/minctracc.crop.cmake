@@ -0,0 +1,57 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.crop.xfm
+
+# thresholds and masks at the mean gradient of the objects, so that
+# their boxes are smaller than the volumes
+
+mean1=`mincstats -quiet -mean object1_dxyz.mnc`
+mean2=`mincstats -quiet -mean object2_dxyz.mnc`
+
+# the volumes cropped to the box of their voxels above threshold
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -threshold $mean1 $mean2 -crop_volumes \
+     -clobber output.crop.xfm 2> crop.log
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.crop.xfm ideal.crop.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+for volume in Source Target; do
+  if ! grep -q "^$volume volume cropped to" crop.log; then
+    echo >&2 $0 failed: the $volume volume was not cropped to its threshold.
+    exit 1
+  fi
+done
+
+# and to the box of their masks
+
+mincmath -clobber -gt -const $mean1 object1_dxyz.mnc mask1_crop.mnc
+mincmath -clobber -gt -const $mean2 object2_dxyz.mnc mask2_crop.mnc
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -source_mask mask1_crop.mnc -model_mask mask2_crop.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -crop_volumes \
+     -clobber output.crop_masks.xfm 2> crop_masks.log
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.crop_masks.xfm ideal.crop.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results with masks.
+  exit 1
+fi
+
+for volume in Source Target; do
+  if ! grep -q "^$volume volume cropped to" crop_masks.log; then
+    echo >&2 $0 failed: the $volume volume was not cropped to its mask.
+    exit 1
+  fi
+done
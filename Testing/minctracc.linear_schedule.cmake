@@ -0,0 +1,29 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+# the blurring is done in memory, so the fit starts from the
+# unblurred objects
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -lsq6 \
+     -linear_schedule 8,8,10,0.01:4,4,4,0.005:0,4,2,0.002,zscore \
+     -perf_report perf_report.linear_schedule.json \
+     -clobber output.linear_schedule.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.linear_schedule.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.linear_schedule.xfm ideal.linear_schedule.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# one fit per level of the schedule
+levels=`grep -c '"name": "linear_level"' perf_report.linear_schedule.json || true`
+if [ "$levels" -ne 3 ]; then
+  echo >&2 $0 failed: $levels levels fitted instead of 3.
+  exit 1
+fi
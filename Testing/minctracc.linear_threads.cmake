@@ -0,0 +1,28 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+for n in 1 4; do
+  ${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+       -est_center -debug -simplex 10 -lsq6 -step 8 8 8 -threads $n \
+       -clobber output.linear_threads.$n.xfm
+done
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.linear_threads.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.linear_threads.4.xfm ideal.linear_threads.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the fit does not depend on the number of threads
+grep -v '^%' output.linear_threads.1.xfm > linear_threads.1.txt
+grep -v '^%' output.linear_threads.4.xfm > linear_threads.4.txt
+if ! cmp -s linear_threads.1.txt linear_threads.4.txt; then
+  echo >&2 $0 failed: -threads 4 gave a different transformation than -threads 1.
+  exit 1
+fi
@@ -0,0 +1,50 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+# masks of the objects where their gradient is above its mean: the
+# lattice rows are only walked inside them
+
+for i in 1 2; do
+  mean=`mincstats -quiet -mean object${i}_dxyz.mnc`
+  mincmath -clobber -gt -const $mean object${i}_dxyz.mnc mask${i}_dxyz.mnc
+done
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -source_mask mask1_dxyz.mnc -model_mask mask2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -perf_report perf_report.masks.json \
+     -clobber output.masks.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.masks.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.masks.xfm ideal.masks.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# each evaluation of the masked fit interpolates fewer samples than
+# one of the unmasked fit
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -perf_report perf_report.no_masks.json \
+     -clobber output.no_masks.xfm
+
+samples_per_evaluation() {
+  samples=`sed -n 's/.*"interpolated_samples": \([0-9]*\).*/\1/p' $1 | head -1`
+  evaluations=`sed -n 's/.*"objective_evaluations": \([0-9]*\).*/\1/p' $1 | head -1`
+  echo `expr $samples / $evaluations`
+}
+
+masked=`samples_per_evaluation perf_report.masks.json`
+unmasked=`samples_per_evaluation perf_report.no_masks.json`
+
+if [ "$masked" -le 0 ] || [ "$masked" -ge "$unmasked" ]; then
+  echo >&2 $0 failed: $masked samples per evaluation with the masks, $unmasked without.
+  exit 1
+fi
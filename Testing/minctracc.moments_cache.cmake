@@ -0,0 +1,34 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+rm -rf moments_cache
+mkdir moments_cache
+
+for pass in 1 2; do
+  ${MINCTRACC} object1_dxyz.mnc object2_dxyz.mnc \
+       -est_center -est_translations -debug -simplex 10 -lsq6 -step 4 4 4 \
+       -moments_cache moments_cache \
+       -clobber output.moments_cache${pass}.xfm
+done
+
+if [ `ls moments_cache | wc -l` -ne 2 ]; then
+  echo >&2 $0 failed: minctracc did not cache the moments of both volumes.
+  exit 1
+fi
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.moments_cache.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.moments_cache1.xfm ideal.moments_cache.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+if ! cmpxfm -linear_tolerance 0.0001 -translation_tolerance 0.0001 output.moments_cache2.xfm output.moments_cache1.xfm; then
+  echo >&2 $0 failed: cached moments changed the result.
+  exit 1
+fi
@@ -0,0 +1,28 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+for n in 1 4; do
+  ${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+       -est_center -debug -simplex 10 -lsq6 -step 8 8 8 -multistart 7 -threads $n \
+       -clobber output.multistart.$n.xfm
+done
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.multistart.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.multistart.4.xfm ideal.multistart.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the starting points are fitted in parallel, the choice does not depend on it
+grep -v '^%' output.multistart.1.xfm > multistart.1.txt
+grep -v '^%' output.multistart.4.xfm > multistart.4.txt
+if ! cmp -s multistart.1.txt multistart.4.txt; then
+  echo >&2 $0 failed: -threads 4 gave a different transformation than -threads 1.
+  exit 1
+fi
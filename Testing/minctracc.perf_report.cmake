@@ -0,0 +1,19 @@
+#! /bin/sh
+set -e
+
+minctracc -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -simplex 10 -lsq6 -step 8 8 8 \
+     -perf_report perf_report.json \
+     -clobber output.perf_report.xfm
+
+for phase in volume_load init_params lattice_setup optimizer output; do
+  if ! grep -q "\"name\": \"$phase\"" perf_report.json; then
+    echo >&2 $0 failed: no $phase phase in the perf report.
+    exit 1
+  fi
+done
+
+if ! grep -q '"objective_evaluations": [1-9]' perf_report.json; then
+  echo >&2 $0 failed: no objective function evaluations counted.
+  exit 1
+fi
@@ -0,0 +1,29 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -use_powell -simplex 10 -lsq6 -step 8 8 8 \
+     -perf_report perf_report.powell.json \
+     -clobber output.powell.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.powell.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.powell.xfm ideal.powell.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the evaluations were made by Powell's method, not by the simplex
+if ! grep -q '"powell_evaluations": [1-9]' perf_report.powell.json; then
+  echo >&2 $0 failed: no evaluations counted for -use_powell.
+  exit 1
+fi
+if grep -q '"amoeba_evaluations": [1-9]' perf_report.powell.json; then
+  echo >&2 $0 failed: -use_powell ran the simplex.
+  exit 1
+fi
@@ -0,0 +1,39 @@
+#! /bin/sh
+set -e
+
+if [[ -z $XCORR_VOL ]];then
+  echo XCORR_VOL not set
+  exit 1
+fi
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+corr_before=`${XCORR_VOL} object1.mnc object2.mnc|cut -c 1-7`
+echo $0 xcorr before\: $corr_before
+
+if [ $corr_before != 0.7231 ];then
+  echo $0 Corr test before failed 
+  exit 1
+fi
+
+# the blurring is done in memory, so the fit starts from the
+# unblurred objects
+${MINCTRACC} \
+    -identity object1.mnc object2.mnc \
+    -est_center -debug -nonlin \
+    -nonlinear_schedule 12,16,48,5:6,10,30,10 \
+    -clobber def_pyramid.xfm 
+
+mincresample object1.mnc -like object2.mnc -transform def_pyramid.xfm  object1_res_pyramid.mnc -clob
+
+corr_after=`${XCORR_VOL} object1_res_pyramid.mnc object2.mnc|cut -c 1-7`
+echo $0 xcorr after\: $corr_after
+tresult=$(echo "$corr_after>=0.9800 && $corr_after<1.0" | bc)
+if [ $tresult != 1 ];then
+  echo $0 Corr test after failed 
+  echo corr_after=\"${corr_after}\"
+  exit 1
+fi
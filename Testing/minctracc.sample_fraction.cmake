@@ -0,0 +1,29 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+for n in 1 2; do
+  ${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+       -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+       -sample_fraction 0.2 -sample_seed 1234 \
+       -clobber output.sample_fraction.$n.xfm
+done
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.sample_fraction.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.sample_fraction.1.xfm ideal.sample_fraction.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the same seed draws the same nodes
+grep -v '^%' output.sample_fraction.1.xfm > sample_fraction.1.txt
+grep -v '^%' output.sample_fraction.2.xfm > sample_fraction.2.txt
+if ! cmp -s sample_fraction.1.txt sample_fraction.2.txt; then
+  echo >&2 $0 failed: the same -sample_seed gave a different transformation.
+  exit 1
+fi
@@ -0,0 +1,33 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -sample_fraction 0.2 -sample_seed 1234 -sample_gradient \
+     -clobber output.sample_gradient.xfm
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.sample_gradient.xfm
+
+if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.sample_gradient.xfm ideal.sample_gradient.xfm; then
+  echo >&2 $0 failed: minctracc produced incorrect results.
+  exit 1
+fi
+
+# the same fraction and seed, drawn uniformly: other nodes are
+# sampled, so the fit ends elsewhere
+${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+     -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+     -sample_fraction 0.2 -sample_seed 1234 \
+     -clobber output.sample_uniform.xfm
+
+grep -v '^%' output.sample_gradient.xfm > sample_gradient.txt
+grep -v '^%' output.sample_uniform.xfm  > sample_uniform.txt
+if cmp -s sample_gradient.txt sample_uniform.txt; then
+  echo >&2 $0 failed: -sample_gradient drew the same nodes as the uniform draw.
+  exit 1
+fi
@@ -0,0 +1,49 @@
+#! /bin/sh
+set -e
+
+if [[ -z $XCORR_VOL ]];then
+  echo XCORR_VOL not set
+  exit 1
+fi
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+corr_before=`${XCORR_VOL} object1.mnc object2.mnc|cut -c 1-7`
+echo $0 xcorr before\: $corr_before
+
+if [ $corr_before != 0.7231 ];then
+  echo $0 Corr test before failed 
+  exit 1
+fi
+
+for n in 1 4; do
+  ${MINCTRACC} -iterations 10 \
+      -identity object1_dxyz.mnc object2_dxyz.mnc \
+      -est_center -debug  -step 10 10 10 -nonlin -threads $n \
+      -clobber def_threads.$n.xfm 
+done
+
+mincresample object1.mnc -like object2.mnc -transform def_threads.4.xfm  object1_res_threads.mnc -clob
+
+corr_after=`${XCORR_VOL} object1_res_threads.mnc object2.mnc|cut -c 1-7`
+echo $0 xcorr after\: $corr_after
+tresult=$(echo "$corr_after>=0.9860 && $corr_after<1.0" | bc)
+if [ $tresult != 1 ];then
+  echo $0 Corr test after failed 
+  echo corr_after=\"${corr_after}\"
+  exit 1
+fi
+
+# the deformation does not depend on the number of threads: same
+# transformation file (but for the name of its grid) and same grid
+for n in 1 4; do
+  grep -v '^%' def_threads.$n.xfm | sed "s/def_threads\.${n}_grid/def_threads_grid/" > def_threads.$n.txt
+  mincextract -double def_threads.${n}_grid_0.mnc > def_threads.$n.raw
+done
+if ! cmp -s def_threads.1.txt def_threads.4.txt || ! cmp -s def_threads.1.raw def_threads.4.raw; then
+  echo >&2 $0 failed: -threads 4 gave a different deformation than -threads 1.
+  exit 1
+fi
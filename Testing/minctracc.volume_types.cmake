@@ -0,0 +1,36 @@
+#! /bin/sh
+set -e
+
+if [[ -z $MINCTRACC ]];then
+  echo MINCTRACC not set
+  exit 1
+fi
+
+param2xfm -rotation -4 7 10 -translation  5 2 -6 -clobber ideal.volume_types.xfm
+
+for type in float short; do
+  ${MINCTRACC} -identity object1_dxyz.mnc object2_dxyz.mnc \
+       -est_center -debug -simplex 10 -lsq6 -step 4 4 4 \
+       -${type}_volumes \
+       -clobber output.${type}_volumes.xfm 2> volume_types.${type}.log
+
+  if ! cmpxfm -linear_tolerance 0.05 -translation_tolerance 0.05 output.${type}_volumes.xfm ideal.volume_types.xfm; then
+    echo >&2 $0 failed: minctracc produced incorrect results with -${type}_volumes.
+    exit 1
+  fi
+done
+
+# float voxels hold the real values, short voxels span the whole
+# range of the type and are scaled to the real values
+
+real=`sed -n 's/^Source min\/max real range = //p' volume_types.float.log`
+voxel=`sed -n 's/^Source min\/max voxel= //p' volume_types.float.log`
+if [ -z "$voxel" ] || [ "$voxel" != "$real" ]; then
+  echo >&2 $0 failed: -float_volumes read voxels $voxel for the real range $real.
+  exit 1
+fi
+
+if ! grep -q '^Source min/max voxel= -32768.000 32767.000' volume_types.short.log; then
+  echo >&2 $0 failed: -short_volumes did not read the source as short.
+  exit 1
+fi
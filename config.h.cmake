@@ -34,12 +34,21 @@
 /* Define to 1 if you have the <sys/types.h> header file. */
 #cmakedefine HAVE_SYS_TYPES_H 1
 
+/* Define to 1 if you have the <sys/time.h> header file. */
+#cmakedefine HAVE_SYS_TIME_H 1
+
+/* Define to 1 if you have the <sys/resource.h> header file. */
+#cmakedefine HAVE_SYS_RESOURCE_H 1
+
 /* Define to 1 if you have the <unistd.h> header file. */
 #cmakedefine HAVE_UNISTD_H 1
 
 /* Define to 1 if liblbfgs is available */
 #cmakedefine HAVE_LIBLBFGS 1
 
+/* Define to 1 if POSIX threads are available */
+#cmakedefine HAVE_PTHREAD 1
+
 /*Old behaviour, to be compatible with old releases, affects output of optimization*/
 #cmakedefine MNI_AUTOREG_OLD_AMOEBA_INIT 1
 
@@ -70,18 +70,14 @@ int main (int argc, char *argv[] )
   VIO_Volume
     data;
   VIO_Real
-    voxel, value, 
-    x,y,z,
+    w_min[3], w_max[3],
     minx, miny, minz,
     maxx, maxy, maxz;
   int
+    v_min[3], v_max[3],
     v_minx, v_miny, v_minz,
     v_maxx, v_maxy, v_maxz;
 
-  int
-    i,j,k, 
-    sizes[3];
-
   /* set default values */
   
   prog_name = argv[0];
@@ -131,44 +127,13 @@ int main (int argc, char *argv[] )
                  __FILE__, __LINE__, infilename, get_volume_n_dimensions(data),0,0,0);
   }
     
-  get_volume_sizes(data, sizes);
-
-  minx = miny = minz = DBL_MAX;
-  maxx = maxy = maxz = -DBL_MAX;
-
-  v_minx = v_miny = v_minz = INT_MAX;
-  v_maxx = v_maxy = v_maxz = -INT_MAX;
-
-  for(i=0; i<sizes[0]; i++) {
-    for(j=0; j<sizes[1]; j++) {
-      for(k=0; k<sizes[2]; k++) {
-        GET_VOXEL_3D(voxel, data, i,j,k);
-        value = CONVERT_VOXEL_TO_VALUE(data, voxel);
+  (void) get_volume_bounding_box(data, threshold, v_min, v_max, w_min, w_max);
 
-        if (value>threshold) {
+  v_minx = v_min[0]; v_miny = v_min[1]; v_minz = v_min[2];
+  v_maxx = v_max[0]; v_maxy = v_max[1]; v_maxz = v_max[2];
 
-          convert_3D_voxel_to_world(data,(VIO_Real)i,(VIO_Real)j,(VIO_Real)k, &x,&y,&z);
-          
-          if (x<minx) minx = x;
-          if (y<miny) miny = y;
-          if (z<minz) minz = z;
-
-          if (x>maxx) maxx = x;
-          if (y>maxy) maxy = y;
-          if (z>maxz) maxz = z;
-
-          if (i<v_minx) v_minx = i;
-          if (j<v_miny) v_miny = j;
-          if (k<v_minz) v_minz = k;
-
-          if (i>v_maxx) v_maxx = i;
-          if (j>v_maxy) v_maxy = j;
-          if (k>v_maxz) v_maxz = k;
-
-        }
-      }
-    }
-  }
+  minx = w_min[0]; miny = w_min[1]; minz = w_min[2];
+  maxx = w_max[0]; maxy = w_max[1]; maxz = w_max[2];
 
   
   if (minccrop) {
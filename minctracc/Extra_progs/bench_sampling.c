@@ -0,0 +1,218 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : bench_sampling.c
+@INPUT      : [size [n_samples [double|float|short]]]
+@OUTPUT     : samples/second for the scalar and the vectorized trilinear
+              sub-lattice sampling kernels (Volume/sampling_kernels.c),
+              with the voxels in their usual order and in bricks
+              (-bricked_volumes)
+@DESCRIPTION: builds a random size^3 volume (of double voxels, unless
+              given another type) and n_samples sub-lattice coordinates
+              inside it, either at random or on a lattice rotated with
+              respect to the volume and walked in order (as the lattice
+              of a linear fit, or a nonlinear fit of rotated volumes).
+              It then interpolates the n_samples values (in blocks of
+              SAMPLING_BLOCK_SIZE nodes, as done in
+              go_get_samples_with_offset()) with each kernel and layout,
+              and reports the time taken and the largest difference
+              between all the sets of samples.
+
+              The vectorized kernel is only used when the CPU has AVX2
+              (see vectorized_sampling_available()); otherwise both
+              timings measure the scalar code, and are labelled so.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "sampling_kernels.h"
+
+char *prog_name;
+
+#define N_DISPLACEMENTS 27
+
+typedef void (*Sampling_Kernel)(Voxel_Array *voxels, int offsets[],
+                                int n, float x[], float y[], float z[],
+                                VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                double samples[]);
+
+/* interpolate all n_samples nodes with kernel, block by block, and
+   return the time taken in seconds */
+
+static double time_kernel(Sampling_Kernel kernel,
+                          Voxel_Array *voxels, int offsets[],
+                          int n_samples, float x[], float y[], float z[],
+                          VIO_Real dx[], VIO_Real dy[], VIO_Real dz[],
+                          double samples[])
+{
+  clock_t start;
+  int     c, k, n;
+
+  start = clock();
+
+  for(k=0; k<N_DISPLACEMENTS; k++)
+    for(c=0; c<n_samples; c+=SAMPLING_BLOCK_SIZE) {
+      n = n_samples - c;
+      if (n > SAMPLING_BLOCK_SIZE) n = SAMPLING_BLOCK_SIZE;
+      (*kernel)(voxels, offsets, n, &x[c], &y[c], &z[c],
+                dx[k], dy[k], dz[k], &samples[c]);
+    }
+
+  return( (double)(clock() - start) / CLOCKS_PER_SEC );
+}
+
+int main(int argc, char *argv[])
+{
+  static VIO_STR dim_names[] = { MIzspace, MIyspace, MIxspace };
+  VIO_Volume  vol;
+  Voxel_Array voxels;
+  nc_type     type;
+  char        *type_name;
+  double      *reference_samples, *samples;
+  double      kernel_time, diff, max_diff, centre, angle, u, v, w, spacing;
+  float       *x, *y, *z;
+  VIO_Real    dx[N_DISPLACEMENTS], dy[N_DISPLACEMENTS], dz[N_DISPLACEMENTS];
+  int         sizes[3], offsets[3], size, n_samples, n_side, i, j, k;
+  int         rotated, bricked, vectorized;
+
+  prog_name = argv[0];
+
+  size      = (argc > 1) ? atoi(argv[1]) : 128;
+  n_samples = (argc > 2) ? atoi(argv[2]) : 1000000;
+  type_name = (argc > 3) ? argv[3] : "double";
+
+  if (strcmp(type_name, "double") == 0)
+    type = NC_DOUBLE;
+  else if (strcmp(type_name, "float") == 0)
+    type = NC_FLOAT;
+  else if (strcmp(type_name, "short") == 0)
+    type = NC_SHORT;
+  else
+    type = NC_UNSPECIFIED;
+
+  if (size < 4 || n_samples < 1 || type == NC_UNSPECIFIED) {
+    (void) fprintf(stderr, "usage: %s [size [n_samples [double|float|short]]]\n",
+                   prog_name);
+    exit(EXIT_FAILURE);
+  }
+
+  sizes[0] = sizes[1] = sizes[2] = size;
+  offsets[0] = offsets[1] = offsets[2] = 1;
+
+  vol = create_volume(3, dim_names, type, TRUE, 0.0, 0.0);
+  set_volume_sizes(vol, sizes);
+  alloc_volume_data(vol);
+  if (type == NC_SHORT)
+    set_volume_real_range(vol, 0.0, 1.0);
+
+  srand(1);
+  for(i=0; i<size; i++)
+    for(j=0; j<size; j++)
+      for(k=0; k<size; k++)
+        set_volume_real_value(vol, i, j, k, 0, 0, (double)rand() / RAND_MAX);
+
+  if (!get_voxel_array(vol, &voxels)) {
+    (void) fprintf(stderr, "%s: cannot sample a %s volume\n", prog_name, type_name);
+    exit(EXIT_FAILURE);
+  }
+
+  ALLOC(x, n_samples);
+  ALLOC(y, n_samples);
+  ALLOC(z, n_samples);
+  ALLOC(reference_samples, n_samples);
+  ALLOC(samples, n_samples);
+
+                                /* the 3x3x3 displacements of the
+                                   quadratic fit */
+  for(k=0; k<N_DISPLACEMENTS; k++) {
+    dx[k] = 0.5 * (k/9     - 1);
+    dy[k] = 0.5 * ((k/3)%3 - 1);
+    dz[k] = 0.5 * (k%3     - 1);
+  }
+
+  (void) printf("%s volume %d^3, %d samples x %d displacements\n",
+                type_name, size, n_samples, N_DISPLACEMENTS);
+
+  max_diff = 0.0;
+
+  for(rotated=0; rotated<2; rotated++) {
+
+    if (!rotated) {             /* a few nodes fall just outside the
+                                   volume, as they do in minctracc */
+      for(i=0; i<n_samples; i++) {
+        x[i] = (float)(-1.0 + (size + 1.0) * rand() / RAND_MAX);
+        y[i] = (float)(-1.0 + (size + 1.0) * rand() / RAND_MAX);
+        z[i] = (float)(-1.0 + (size + 1.0) * rand() / RAND_MAX);
+      }
+    }
+    else {                      /* a cubic lattice turned by 30 degrees
+                                   about the first axis and then about
+                                   the last one, in the middle of the
+                                   volume */
+      n_side  = (int)ceil(pow((double)n_samples, 1.0/3.0));
+      spacing = 0.6 * size / n_side;
+      centre  = 0.5 * (size - 1);
+      angle   = M_PI / 6.0;
+      for(i=0; i<n_samples; i++) {
+        u = spacing * (i / (n_side*n_side) - 0.5*n_side);
+        v = spacing * ((i / n_side) % n_side - 0.5*n_side);
+        w = spacing * (i % n_side - 0.5*n_side);
+        x[i] = (float)(centre + u);
+        y[i] = (float)(centre + cos(angle) * v - sin(angle) * w);
+        z[i] = (float)(centre + sin(angle) * v + cos(angle) * w);
+        u = x[i] - centre;
+        v = y[i] - centre;
+        x[i] = (float)(centre + cos(angle) * u - sin(angle) * v);
+        y[i] = (float)(centre + sin(angle) * u + cos(angle) * v);
+      }
+    }
+
+    for(bricked=0; bricked<2; bricked++) {
+
+      if (bricked && !make_bricked_volume(vol)) {
+        (void) fprintf(stderr, "%s: cannot brick the volume\n", prog_name);
+        exit(EXIT_FAILURE);
+      }
+      (void) get_voxel_array(vol, &voxels);
+
+      for(vectorized=0; vectorized<2; vectorized++) {
+
+        kernel_time = time_kernel(vectorized ? trilinear_samples_at_offset :
+                                               trilinear_samples_at_offset_scalar,
+                                  &voxels, offsets, n_samples, x, y, z,
+                                  dx, dy, dz,
+                                  (bricked || vectorized) ? samples : reference_samples);
+
+        if (bricked || vectorized)
+          for(i=0; i<n_samples; i++) {
+            diff = fabs(samples[i] - reference_samples[i]);
+            if (diff > max_diff) max_diff = diff;
+          }
+
+        (void) printf("%-7s %-7s %-6s: %8.3f s, %10.3g samples/s\n",
+                      rotated ? "rotated" : "random",
+                      bricked ? "bricked" : "linear",
+                      (vectorized && vectorized_sampling_available()) ? "avx2" : "scalar",
+                      kernel_time, n_samples * (double)N_DISPLACEMENTS / kernel_time);
+      }
+
+      if (bricked)
+        delete_bricked_volume(vol);
+    }
+  }
+
+  (void) printf("max difference: %g\n", max_diff);
+
+  FREE(x);
+  FREE(y);
+  FREE(z);
+  FREE(reference_samples);
+  FREE(samples);
+  delete_volume(vol);
+
+  return(EXIT_SUCCESS);
+}
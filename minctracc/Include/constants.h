@@ -56,6 +56,7 @@
 
 #define OPT_SIMPLEX       0
 #define OPT_BFGS		1
+#define OPT_POWELL        2
 
 #define SLICE_IND 0
 #define ROW_IND   1
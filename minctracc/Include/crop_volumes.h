@@ -0,0 +1,17 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : crop_volumes.h
+@DESCRIPTION: prototypes for Volume/crop_volumes.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_CROP_VOLUMES_H
+#define MINCTRACC_CROP_VOLUMES_H
+
+VIO_Volume make_cropped_volume(VIO_Volume volume, int first[], int last[]);
+
+VIO_BOOL crop_volume_and_mask(VIO_Volume *volume, VIO_Volume *mask,
+                              VIO_Real threshold,
+                              int margin, VIO_Real margin_mm);
+
+#endif
@@ -0,0 +1,74 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : deformation_field.h
+@DESCRIPTION: prototypes, data structure and inlined look-ups for
+              Optimize/deformation_field.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_DEFORMATION_FIELD_H
+#define MINCTRACC_DEFORMATION_FIELD_H
+
+                                /* a 3x4 affine map, rows X, Y, Z */
+typedef VIO_Real Affine_Map[VIO_N_DIMENSIONS][4];
+
+typedef struct {
+  int        count[VIO_N_DIMENSIONS]; /* # of nodes along X, Y, Z           */
+  float     *dx, *dy, *dz;            /* displacement of each node (mm),
+                                         X index varying fastest           */
+  VIO_BOOL   is_copy;                 /* TRUE: dx,dy,dz allocated here,
+                                         FALSE: they are the voxels of
+                                         the volume                        */
+  Affine_Map world_to_grid;           /* world (mm) -> node X, Y, Z index   */
+} Deformation_Field;
+
+void make_deformation_field(Deformation_Field *field, VIO_Volume displacement_volume);
+
+void update_deformation_field(Deformation_Field *field, VIO_Volume displacement_volume);
+
+void delete_deformation_field(Deformation_Field *field);
+
+VIO_BOOL get_linear_transform_maps(VIO_General_transform *transform,
+                                   Affine_Map forward,
+                                   Affine_Map inverse);
+
+/* same arithmetic as volume_io's transform_point() for an affine matrix */
+
+inline static void apply_affine_map(Affine_Map map,
+                                    VIO_Real x, VIO_Real y, VIO_Real z,
+                                    VIO_Real *tx, VIO_Real *ty, VIO_Real *tz)
+{
+  *tx = map[0][0] * x + map[0][1] * y + map[0][2] * z + map[0][3];
+  *ty = map[1][0] * x + map[1][1] * y + map[1][2] * z + map[1][3];
+  *tz = map[2][0] * x + map[2][1] * y + map[2][2] * z + map[2][3];
+}
+
+/* displacement of the node nearest to world position (wx,wy,wz); returns
+   FALSE, leaving def[] untouched, when the position is more than half a
+   node spacing outside the field */
+
+inline static VIO_BOOL nearest_deformation(Deformation_Field *field,
+                                           VIO_Real wx, VIO_Real wy, VIO_Real wz,
+                                           VIO_Real def[])
+{
+  VIO_Real vx, vy, vz;
+  long     n;
+
+  apply_affine_map(field->world_to_grid, wx, wy, wz, &vx, &vy, &vz);
+
+  if (vx < -0.5 || vx >= field->count[VIO_X]-0.5 ||
+      vy < -0.5 || vy >= field->count[VIO_Y]-0.5 ||
+      vz < -0.5 || vz >= field->count[VIO_Z]-0.5)
+    return(FALSE);
+
+  n = ((long)(vz+0.5) * field->count[VIO_Y] + (long)(vy+0.5)) * field->count[VIO_X] +
+      (long)(vx+0.5);
+
+  def[VIO_X] = field->dx[n];
+  def[VIO_Y] = field->dy[n];
+  def[VIO_Z] = field->dz[n];
+
+  return(TRUE);
+}
+
+#endif
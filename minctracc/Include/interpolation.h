@@ -7,12 +7,19 @@
 int trilinear_interpolant(VIO_Volume volume, 
                                  PointR *coord, double *result);
 
+int trilinear_interpolant_with_gradient(VIO_Volume volume, 
+                                        PointR *coord, double *result,
+                                        double gradient[]);
+
 int tricubic_interpolant(VIO_Volume volume, 
                                 PointR *coord, double *result);
 
-void do_Ncubic_interpolation(VIO_Volume volume, 
-                                    long index[], int cur_dim, 
-                                    double frac[], double *result);
+int bspline_interpolant(VIO_Volume volume, 
+                        PointR *coord, double *result);
+
+void prefilter_bspline_volume(VIO_Volume volume);
+
+void delete_bspline_coefficients(VIO_Volume volume);
 
 int nearest_neighbour_interpolant(VIO_Volume volume, 
                                          PointR *coord, double *result);
@@ -0,0 +1,53 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : lattice_samples.h
+@DESCRIPTION: prototypes and data structure for Optimize/lattice_samples.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_LATTICE_SAMPLES_H
+#define MINCTRACC_LATTICE_SAMPLES_H
+
+                                /* the nodes of the lattice of a linear
+                                   fit that survive the source mask, the
+                                   source volume bounds and (when the
+                                   objective allows it) the source
+                                   threshold, slice by slice          */
+typedef struct {
+  VIO_Volume          d1, m1;       /* the list is valid for these...    */
+  Objective_Function  obj_function; /* ...and this objective function    */
+  VIO_Real            start[3];     /* ...and this lattice               */
+  int                 count[3];
+  VIO_Real            step[3];
+  VectorR             directions[3];
+  VIO_Real            fraction;     /* ...subsampled this way            */
+  int                 seed;
+  VIO_BOOL            gradient;     /* ...weighted by the source gradient */
+
+  int                 n_slices;
+  int                *first;        /* points of slice s are first[s] to
+                                       first[s+1]-1                      */
+  long               *count1;       /* nodes in m1 and in d1, per slice  */
+  VIO_Real           *coords;       /* 3 per point: voxel coord. in d1   */
+  VIO_Real           *value1;       /* value of d1 at the point          */
+  int                *index1;       /* 8 per point: partial volume bins  */
+  VIO_Real           *fractions1;   /* 8 per point: and their weights    */
+  unsigned char      *n_bins1;      /* # of distinct bins of the point,
+                                       first in index1 and fractions1    */
+} Lattice_Samples;
+
+VIO_BOOL         lattice_samples_supported(Objective_Function obj_function);
+
+Lattice_Samples *build_lattice_samples(VIO_Volume d1,
+                                       VIO_Volume d2,
+                                       VIO_Volume m1,
+                                       Arg_Data *globals);
+
+VIO_BOOL         lattice_samples_match(Lattice_Samples *samples,
+                                       VIO_Volume d1,
+                                       VIO_Volume m1,
+                                       Arg_Data *globals);
+
+void             delete_lattice_samples(Lattice_Samples *samples);
+
+#endif
@@ -0,0 +1,51 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : mask_spans.h
+@DESCRIPTION: prototypes and data structure for Volume/mask_spans.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_MASK_SPANS_H
+#define MINCTRACC_MASK_SPANS_H
+
+#include <volume_io.h>
+#include "minctracc_point_vector.h"
+
+                                /* at most this many runs per lattice
+                                   row; further runs are merged into
+                                   the last one                        */
+#define MAX_MASK_ROW_RUNS 32
+
+                                /* the nodes of one lattice row that
+                                   may fall inside a mask, see
+                                   get_mask_row()                      */
+typedef struct {
+  int n_runs;
+  int run[MAX_MASK_ROW_RUNS][2]; /* nodes run[i][0] .. run[i][1]-1     */
+  int current;                   /* cursor of node_in_mask_row()       */
+} Mask_Row;
+
+VIO_BOOL make_mask_spans(VIO_Volume mask);
+
+void delete_mask_spans(VIO_Volume mask);
+
+VIO_BOOL get_mask_voxel(VIO_Volume mask,
+                        VIO_Real vx, VIO_Real vy, VIO_Real vz,
+                        VIO_BOOL *not_masked);
+
+void get_mask_row(VIO_Volume mask, VIO_BOOL world,
+                  PointR *start, VectorR *step, int n,
+                  Mask_Row *row);
+
+/* TRUE if node c of the row may be inside the mask; c must not
+   decrease from one call to the next on the same row. */
+
+inline static VIO_BOOL node_in_mask_row(Mask_Row *row, int c)
+{
+  while (row->current < row->n_runs && c >= row->run[row->current][1])
+    row->current++;
+
+  return(row->current < row->n_runs && c >= row->run[row->current][0]);
+}
+
+#endif
@@ -129,6 +129,10 @@ int get_mask_file(char *dst, char *key, char *nextArg);
 
 int get_nonlinear_objective(char *dst, char *key, char *nextArg);
 
+int get_nonlinear_schedule(char *dst, char *key, char *nextArg);
+
+int get_linear_schedule(char *dst, char *key, char *nextArg);
+
 int get_feature_volumes(char *dst, char *key, int argc, char **argv);
 
 void procrustes(int npoints, int ndim, 
@@ -147,8 +151,6 @@ void translation_to_homogeneous(int ndim, float *translation,
 void rotation_to_homogeneous(int ndim, float **rotation,
                                        float **transformation);
 
-float fit_function(float *x);        /* apply cross correlation to the data sets    */
-
 float zscore_function(float *x);     /* calculate rms z-score difference.           */
 
 float check_function(float *x);      /* calculate the squared error between points2 */
@@ -188,6 +190,18 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
 
 VIO_BOOL optimize_non_linear_transformation(Arg_Data *globals);
 
+VIO_BOOL optimize_non_linear_pyramid(VIO_Volume d1,
+                                     VIO_Volume d2,
+                                     VIO_Volume m1,
+                                     VIO_Volume m2, 
+                                     Arg_Data *globals);
+
+VIO_BOOL optimize_linear_schedule(VIO_Volume d1,
+                                  VIO_Volume d2,
+                                  VIO_Volume m1,
+                                  VIO_Volume m2, 
+                                  Arg_Data *globals);
+
 #include "objectives.h"
 
 float measure_fit(VIO_Volume d1,
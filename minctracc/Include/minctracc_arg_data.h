@@ -6,7 +6,7 @@
 typedef struct Arg_Data_struct Arg_Data;
 
 /* enums to define interpolants and objective functions */
-typedef enum { TRILINEAR, TRICUBIC, N_NEIGHBOUR } Interpolating_Type;
+typedef enum { TRILINEAR, TRICUBIC, N_NEIGHBOUR, BSPLINE } Interpolating_Type;
 typedef enum { XCORR, ZSCORE, SSC, VR, MUTUAL_INFORMATION, NORMALIZED_MUTUAL_INFORMATION } Objective_Type;
 
 
@@ -43,6 +43,8 @@ typedef struct {
   char *output_trans;
   char *measure_file;
   char *matlab_file;
+  char *perf_report;
+  char *moments_cache;
 } Program_Filenames;
 
 typedef struct {
@@ -88,6 +90,32 @@ typedef struct {
   int rotation_type;            /* type of rotation quaternion used or not */
 } Program_Transformation;
 
+typedef struct {
+  VIO_Real fwhm;                /* blurring of source and target (mm)        */
+  VIO_Real step;                /* spacing of the deformation field (mm)     */
+  VIO_Real lattice_width;       /* diameter (mm) of sub-lattice              */
+  int      iterations;
+} Pyramid_Level;
+
+typedef struct {
+  int            n_levels;      /* 0 = single resolution fit                 */
+  Pyramid_Level *level;         /* from coarse to fine                       */
+} Nonlinear_Pyramid;
+
+typedef struct {
+  VIO_Real fwhm;                /* blurring of source and target (mm)        */
+  VIO_Real step;                /* spacing of the sampling lattice (mm)      */
+  VIO_Real simplex;             /* radius of the simplex, as -simplex        */
+  VIO_Real tolerance;           /* stopping criteria, as -tol                */
+  VIO_Real sample_fraction;     /* as -sample_fraction, -1 = that of the run */
+  int      obj_function_type;   /* Objective_Type, -1 = the one of the run   */
+} Linear_Level;
+
+typedef struct {
+  int           n_levels;       /* 0 = single resolution fit                 */
+  Linear_Level *level;          /* from coarse to fine                       */
+} Linear_Schedule;
+
 struct Arg_Data_struct {
   Program_Filenames      filenames;    /* names of all data filename to be used      */
   Program_Flags          flags;               /* flags (debug, verbose etc...               */ 
@@ -111,6 +139,20 @@ struct Arg_Data_struct {
   double                 speckle;      /* percent noise speckle                      */
   int                    groups;       /* number of groups to use for ratio of variance */
   int                    blur_pdf;     /* number of voxels for blurring in -mi pdfs */
+  int                    threads;      /* number of threads for the objectives       */
+  double                 source_cache_size; /* MB kept for source sub-lattices    */
+  Nonlinear_Pyramid      pyramid;      /* levels given with -nonlinear_schedule  */
+  int                    progress_stride; /* lattice subsampling of the nonlinear
+                                             progress correlation              */
+  int                    multistart;   /* starting points of a linear fit       */
+  double                 sample_fraction; /* of the lattice nodes used by the
+                                             linear objectives                 */
+  int                    sample_seed;  /* to draw these nodes                   */
+  VIO_BOOL               sample_gradient; /* ...weighted by the source gradient */
+  Linear_Schedule        linear_schedule; /* levels given with -linear_schedule */
+  int                    volume_type;  /* nc_type of the source and target voxels */
+  VIO_BOOL               bricked_volumes; /* ...also held in 8x8x8 bricks    */
+  VIO_BOOL               crop_volumes; /* ...cropped to their lattice at load */
 };
 
 
@@ -0,0 +1,53 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : nonlin_context.h
+@DESCRIPTION: the per-thread state used to estimate the deformation of a
+              single node of the deformation field.
+
+              Each thread working in do_non_linear_optimization() owns
+              one of these (sub-lattices, source samples, ...), and
+              passes it down to the local objective functions in
+              def_obj_functions.c (through the amoeba's function_data
+              when using simplex).
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_NONLIN_CONTEXT_H
+#define MINCTRACC_NONLIN_CONTEXT_H
+
+#include "source_lattice_cache.h"
+
+typedef struct {
+  Arg_Data  *globals;          /* program data, read only while estimating  */
+
+  float     *SX, *SY, *SZ;     /* sample sub-lattice positions in source    */
+  float     *TX, *TY, *TZ;     /* sample sub-lattice positions in target    */
+  int        len;              /* # of samples in sub-lattice               */
+
+  float    **a1_features;      /* samples in source sub-lattice             */
+  VIO_BOOL **masked_samples_in_source; /* masked samples in source sub-lattice */
+  float     *sqrt_features;    /* normalization const for correlation       */
+
+  VIO_Real   simplex_size;     /* the radius of the local simplex           */
+  VIO_Real   cost_radius;      /* constant used in the cost function        */
+
+  int        target_sample_count; /* # of non-masked target samples         */
+
+  Source_Lattice_Cache *source_cache; /* shared by all threads, may be NULL */
+  int        node;             /* index of the node being estimated         */
+} Nonlin_Context;
+
+VIO_Real local_objective_function(Nonlin_Context *context, float *d);
+
+void local_objective_function_at_offsets(Nonlin_Context *context,
+                                         int n_offsets,
+                                         float d[][4],
+                                         VIO_Real r[]);
+
+VIO_Real amoeba_NL_obj_function(void *context, float d[]);
+
+VIO_BOOL get_cached_source_lattice(Nonlin_Context *context);
+
+void cache_source_lattice(Nonlin_Context *context);
+
+#endif
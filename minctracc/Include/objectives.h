@@ -1,3 +1,6 @@
+#ifndef MINCTRACC_OBJECTIVES_H
+#define MINCTRACC_OBJECTIVES_H
+
 float xcorr_objective(VIO_Volume d1,
                              VIO_Volume d2,
                              VIO_Volume m1,
@@ -34,4 +37,27 @@ float normalized_mutual_information_objective(VIO_Volume d1,
                            VIO_Volume m2, 
                            Arg_Data *globals);
 
+                                /* what the objective function of a
+                                   linear fit is evaluated on        */
+typedef struct {
+  Arg_Data   *globals;          /* parameters, weights and transformation */
+  VIO_Volume  data1, data2;     /* in the order of the objective function */
+  VIO_Volume  mask1, mask2;
+  VIO_BOOL    inverse_mapping;  /* data1 is the target                  */
+  int         ndim;             /* # of parameters being optimized      */
+} Fit_Data;
+
+float fit_function(Fit_Data *fit, float *params);
+
+float fit_function_quater(Fit_Data *fit, float *params);
+
+VIO_BOOL objective_gradient_supported(Objective_Function obj_function);
+
+float objective_with_gradient(VIO_Volume d1,
+                              VIO_Volume d2,
+                              VIO_Volume m1,
+                              VIO_Volume m2, 
+                              Arg_Data *globals,
+                              VIO_Real gradient[3][4]);
 
+#endif
@@ -0,0 +1,35 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : perf_report.h
+@DESCRIPTION: prototypes and counters for Optimize/perf_report.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_PERF_REPORT_H
+#define MINCTRACC_PERF_REPORT_H
+
+                                /* counters kept for the whole run, and
+                                   for each phase */
+typedef enum {
+  PERF_OBJECTIVE_EVALUATIONS,   /* calls of the similarity function       */
+  PERF_INTERPOLATED_SAMPLES,    /* lattice points visited by these calls  */
+  PERF_NODES_SEEN,              /* deformation nodes visited              */
+  PERF_NODES_TRIED,             /* ... estimated without a deformation    */
+  PERF_NODES_DONE,              /* ... estimated with a deformation       */
+  PERF_AMOEBA_EVALUATIONS,      /* function evaluations of the simplex    */
+  PERF_POWELL_EVALUATIONS,      /* ... and of -use_powell                 */
+  N_PERF_COUNTERS
+} Perf_Counter;
+
+void       start_perf_report(void);
+
+int        begin_perf_phase(char *name);
+
+void       end_perf_phase(int phase);
+
+void       add_to_perf_counter(Perf_Counter counter, long amount);
+
+VIO_Status write_perf_report(char *filename,
+                             char *source, char *target, int n_threads);
+
+#endif
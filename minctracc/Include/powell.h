@@ -0,0 +1,25 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : powell.h
+@DESCRIPTION: prototypes for Optimize/powell.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_POWELL_H
+#define MINCTRACC_POWELL_H
+
+#include <volume_io.h>
+
+                                /* the same as an amoeba_function */
+typedef  VIO_Real    (*powell_function) ( void *, float [] );
+
+int  minimize_powell(int              n_parameters,
+                     VIO_Real         parameters[],
+                     VIO_Real         parameter_delta,
+                     powell_function  function,
+                     void            *function_data,
+                     VIO_Real         tolerance,
+                     int              max_evaluations,
+                     VIO_Real        *value);
+
+#endif
@@ -0,0 +1,20 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : pyramid_volumes.h
+@DESCRIPTION: prototypes for Volume/pyramid_volumes.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_PYRAMID_VOLUMES_H
+#define MINCTRACC_PYRAMID_VOLUMES_H
+
+                                /* a pyramid level keeps at least this
+                                   many voxels per FWHM of its blurring
+                                   kernel along each axis */
+#define PYRAMID_SAMPLES_PER_FWHM 4.0
+
+void get_pyramid_subsampling(VIO_Volume volume, VIO_Real fwhm, int factor[]);
+
+VIO_Volume make_pyramid_volume(VIO_Volume volume, VIO_Real fwhm, int factor[]);
+
+#endif
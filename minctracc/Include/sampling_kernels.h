@@ -0,0 +1,68 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : sampling_kernels.h
+@DESCRIPTION: prototypes for Volume/sampling_kernels.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_SAMPLING_KERNELS_H
+#define MINCTRACC_SAMPLING_KERNELS_H
+
+                                /* number of sub-lattice nodes handled
+                                   per call by the callers in
+                                   sub_lattice.c */
+#define SAMPLING_BLOCK_SIZE 64
+
+                                /* -bricked_volumes stores the voxels in
+                                   bricks of BRICK_SIZE^3, see
+                                   make_bricked_volume()               */
+#define BRICK_BITS 3
+#define BRICK_SIZE (1 << BRICK_BITS)
+
+                                /* the voxels of a volume, as read by
+                                   the kernels */
+typedef struct {
+  int       type;               /* VIO_DOUBLE, VIO_FLOAT or
+                                   VIO_SIGNED_SHORT                    */
+  void      *data;              /* VOXEL_DATA() of the volume          */
+  int       sizes[3];
+  VIO_Real  value_scale;        /* real value = value_scale * voxel    */
+  VIO_Real  value_translation;  /*              + value_translation    */
+  void      *bricks;            /* the same voxels, brick by brick, or
+                                   NULL                                */
+  long      brick_strides[3];   /* voxels from one brick to the next
+                                   along each axis                     */
+} Voxel_Array;
+
+VIO_BOOL vectorized_sampling_available(void);
+
+VIO_BOOL get_voxel_array(VIO_Volume volume, Voxel_Array *voxels);
+
+VIO_BOOL make_bricked_volume(VIO_Volume volume);
+
+void delete_bricked_volume(VIO_Volume volume);
+
+VIO_BOOL get_bricked_neighbours(VIO_Volume volume,
+                                long ind0, long ind1, long ind2,
+                                VIO_Real values[]);
+
+void trilinear_samples_at_offset(Voxel_Array *voxels, int offsets[],
+                                 int n, float x[], float y[], float z[],
+                                 VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                 double samples[]);
+
+void trilinear_samples_at_offset_scalar(Voxel_Array *voxels, int offsets[],
+                                        int n, float x[], float y[], float z[],
+                                        VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                        double samples[]);
+
+void trilinear_samples_at_points(Voxel_Array *voxels,
+                                 int n, double x[], double y[], double z[],
+                                 double samples[]);
+
+void nearest_samples_at_offset(Voxel_Array *voxels,
+                               int n, float x[], float y[], float z[],
+                               VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                               double samples[]);
+
+#endif
@@ -0,0 +1,39 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : source_lattice_cache.h
+@DESCRIPTION: prototypes and data structure for
+              Optimize/source_lattice_cache.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_SOURCE_LATTICE_CACHE_H
+#define MINCTRACC_SOURCE_LATTICE_CACHE_H
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+typedef struct {
+  int             n_nodes;      /* # of nodes in the deformation field      */
+  int             len;          /* # of samples in every source sub-lattice */
+  int             n_features;
+  int             slot_floats;  /* size of one slot in values[]             */
+  int             n_slots;      /* # of slots that fit in the memory cap    */
+  int             slots_used;
+  int            *slot;         /* slot of each node, -1 if not cached      */
+  float          *values;       /* SX,SY,SZ, features and norms, per slot   */
+  unsigned char  *masked;       /* source mask flags, per slot              */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;         /* protects slots_used                      */
+#endif
+} Source_Lattice_Cache;
+
+void init_source_lattice_cache(Source_Lattice_Cache *cache,
+                               int n_nodes,
+                               int len,
+                               int n_features,
+                               VIO_Real max_megabytes);
+
+void delete_source_lattice_cache(Source_Lattice_Cache *cache);
+
+#endif
@@ -31,6 +31,21 @@ go_get_samples_with_offset(VIO_Volume data, VIO_Volume mask,
                            float sqrt_s1, float *a1, VIO_BOOL *m1,
                            VIO_BOOL use_nearest_neighbour);
 
+                                /* the 3x3x3 neighbourhood used by the
+                                   quadratic fit */
+#define MAX_SUB_LATTICE_OFFSETS 27
+
+void
+go_get_samples_with_offsets(VIO_Volume data, VIO_Volume mask,
+                            float *x, float *y, float *z,
+                            int n_offsets,
+                            VIO_Real dx[], VIO_Real dy[], VIO_Real dz[],
+                            int obj_func,
+                            int len,
+                            float sqrt_s1, float *a1, VIO_BOOL *m1,
+                            VIO_BOOL use_nearest_neighbour,
+                            float r[]);
+
 void    
 build_target_lattice(float px[], float py[], float pz[],
                      float tx[], float ty[], float tz[],
@@ -0,0 +1,24 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : thread_support.h
+@DESCRIPTION: prototypes for Optimize/thread_support.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_THREAD_SUPPORT_H
+#define MINCTRACC_THREAD_SUPPORT_H
+
+/* a unit of parallel work: process the items first..last-1, using the
+   per-thread storage indexed by thread (0 <= thread < n_threads) */
+
+typedef void (*Parallel_Function)(void *data, int thread, int first, int last);
+
+int  get_number_of_threads_to_use(int requested, int n_items);
+
+void run_in_parallel(int n_threads,
+                     int n_items,
+                     int chunk_size,
+                     Parallel_Function function,
+                     void *data);
+
+#endif
@@ -0,0 +1,43 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : volume_moments.h
+@DESCRIPTION: prototypes and data structure for Numerical/volume_moments.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_VOLUME_MOMENTS_H
+#define MINCTRACC_VOLUME_MOMENTS_H
+
+#include <volume_io.h>
+
+                                /* the intensity weighted moments of the
+                                   world coordinates of a volume, sampled
+                                   on its own lattice                  */
+typedef struct {
+  VIO_Real  mass;               /* sum of the intensities (0: no sample) */
+  VIO_Real  centroid[3];        /* x,y,z centre of gravity               */
+  VIO_Real  covariance[3][3];   /* about the centroid, divided by mass   */
+} Volume_Moments;
+
+void get_volume_moments(int n_volumes,
+                        VIO_Volume data[],
+                        VIO_Volume mask[],
+                        double *step,
+                        int n_threads,
+                        Volume_Moments moments[]);
+
+void get_cached_volume_moments(int n_volumes,
+                               VIO_Volume data[],
+                               VIO_Volume mask[],
+                               char *data_name[],
+                               char *mask_name[],
+                               double *step,
+                               int n_threads,
+                               char *cache_dir,
+                               Volume_Moments moments[]);
+
+void get_covariance_about(Volume_Moments *moments,
+                          float *center,
+                          float **covar);
+
+#endif
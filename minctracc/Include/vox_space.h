@@ -18,6 +18,14 @@ typedef struct {
    VIO_General_transform *voxel_to_voxel_space;
 } Voxel_space_struct;
 
+                                /* the same, with the voxel to voxel
+                                   transformation held by value      */
+typedef struct {
+   VIO_Real          start[3];
+   VectorR           directions[3];
+   VIO_Transform     voxel_to_voxel;
+} Linear_voxel_space;
+
 Voxel_space_struct* new_voxel_space_struct(void);
 
 void delete_voxel_space_struct( Voxel_space_struct *vox_space);
@@ -30,6 +38,10 @@ void get_into_voxel_space(Arg_Data *globals,
                                  Voxel_space_struct *vox,
                                  VIO_Volume v1, VIO_Volume v2);
 
+void get_into_linear_voxel_space(Arg_Data *globals,
+                                 Linear_voxel_space *vox,
+                                 VIO_Volume v1, VIO_Volume v2);
+
 void  my_homogenous_transform_point(VIO_Transform  *transform,
                                            VIO_Real       x,
                                            VIO_Real       y,
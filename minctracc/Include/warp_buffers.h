@@ -0,0 +1,35 @@
+/*------------------------------ MNI Header ----------------------------------
+@NAME       : warp_buffers.h
+@DESCRIPTION: prototypes and data structure for Optimize/warp_buffers.c
+@CREATED    : Oct 18, 2026
+@MODIFIED   : not yet!
+-----------------------------------------------------------------------------*/
+
+#ifndef MINCTRACC_WARP_BUFFERS_H
+#define MINCTRACC_WARP_BUFFERS_H
+
+                                /* the voxels of the displacement volume
+                                   of a GRID_TRANSFORM, addressed directly */
+typedef struct {
+  double *data;                       /* voxel [0][0][0][0]               */
+  int     count[VIO_N_DIMENSIONS];    /* # of nodes along X, Y, Z         */
+  long    stride[VIO_N_DIMENSIONS];   /* between nodes along X, Y, Z      */
+  long    vector_stride;              /* between the 3 components         */
+  long    n_values;                   /* 3 * # of nodes                   */
+} Warp_Buffer;
+
+VIO_BOOL get_warp_buffer(VIO_Volume displacement_volume, Warp_Buffer *buffer);
+
+void add_warp_buffers(Warp_Buffer *additional, Warp_Buffer *current,
+                      VIO_Real weight, int n_threads);
+
+void smooth_warp_buffer(Warp_Buffer *smoothed, Warp_Buffer *current,
+                        int start[], int end[],
+                        VIO_Real smoothing_weight, int n_threads);
+
+void extrapolate_warp_buffer(Warp_Buffer *current, Warp_Buffer *additional,
+                             VIO_Volume estimated_flag_vol,
+                             int start[], int end[], int n_threads,
+                             int *total, int *many, int *extrapolated);
+
+#endif
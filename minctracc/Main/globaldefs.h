@@ -67,6 +67,9 @@ ArgvInfo argTable[] = {
   {"-center", ARGV_FLOAT, (char *) 3, 
      (char *) main_argsX.trans_info.center,
      "Force center of rotation and scale."},
+  {"-moments_cache", ARGV_STRING, (char *) 0, 
+     (char *) &main_argsX.filenames.moments_cache,
+     "Directory where the volume moments of the PAT are saved and reused."},
   {NULL, ARGV_HELP, NULL, NULL,
      "\nOutput transformation type. Default = -procrustes."},
   {"-pat", ARGV_CONSTANT, (char *) TRANS_PAT, (char *) &main_argsX.trans_info.transform_type,
@@ -125,6 +128,27 @@ ArgvInfo argTable[] = {
   {"-nearest_neighbour", ARGV_CONSTANT, (char *) N_NEIGHBOUR,
      (char *) &main_argsX.interpolant_type,
      "Do nearest neighbour interpolation"},
+  {"-bspline", ARGV_CONSTANT, (char *) BSPLINE,
+     (char *) &main_argsX.interpolant_type,
+     "Do cubic B-spline interpolation (linear fits)"},
+  
+  {NULL, ARGV_HELP, NULL, NULL,
+     "\nVolume storage options. (Default = -double_volumes)"},
+  {"-double_volumes", ARGV_CONSTANT, (char *) NC_DOUBLE,
+     (char *) &main_argsX.volume_type,
+     "Hold the source and target volumes as doubles."},
+  {"-float_volumes", ARGV_CONSTANT, (char *) NC_FLOAT,
+     (char *) &main_argsX.volume_type,
+     "Hold the source and target volumes as floats (half the memory)."},
+  {"-short_volumes", ARGV_CONSTANT, (char *) NC_SHORT,
+     (char *) &main_argsX.volume_type,
+     "Hold the source and target volumes as scaled shorts (a quarter of the memory)."},
+  {"-bricked_volumes", ARGV_CONSTANT, (char *) TRUE,
+     (char *) &main_argsX.bricked_volumes,
+     "Also hold them in 8x8x8 bricks, for faster sampling of rotated lattices."},
+  {"-crop_volumes", ARGV_CONSTANT, (char *) TRUE,
+     (char *) &main_argsX.crop_volumes,
+     "Crop them to the box of their voxels above threshold and in the mask."},
   
   {NULL, ARGV_HELP, NULL, NULL,
      "\nLinear optimization objective functions. (default = -xcorr)"},
@@ -181,6 +205,23 @@ ArgvInfo argTable[] = {
      "Optimization weight of shears a,b and c."},
   {"-use_bfgs", ARGV_CONSTANT, (char *) FALSE, (char *) &main_argsX.trans_info.use_bfgs,
      "use BFGS optimizer instead of amoeba "},
+  {"-use_powell", ARGV_CONSTANT, (char *) OPT_POWELL, (char *) &main_argsX.optimize_type,
+     "use Powell's direction set method instead of amoeba "},
+  {"-multistart", ARGV_INT, (char *) 0, 
+     (char *) &main_argsX.multistart,
+     "Number of starting points fitted on a coarse lattice before the linear fit (default = 1)."},
+  {"-sample_fraction", ARGV_FLOAT, (char *) 0, 
+     (char *) &main_argsX.sample_fraction,
+     "Fraction of the lattice nodes used by the linear objective functions (default = 1)."},
+  {"-sample_seed", ARGV_INT, (char *) 0, 
+     (char *) &main_argsX.sample_seed,
+     "Seed used to draw the nodes of -sample_fraction (default = from the clock)."},
+  {"-sample_gradient", ARGV_CONSTANT, (char *) TRUE, 
+     (char *) &main_argsX.sample_gradient,
+     "Draw the nodes of -sample_fraction mostly where the source gradient is high."},
+  {"-linear_schedule", ARGV_FUNC, (char *) get_linear_schedule, 
+     (char *) &main_argsX.linear_schedule,
+     "Coarse to fine levels fwhm,step,simplex,tolerance[,objective][:...] (mm)."},
 
   {NULL, ARGV_HELP, NULL, NULL,
      "\nOptions for measurement comparison."},
@@ -260,15 +301,30 @@ ArgvInfo argTable[] = {
   {"-similarity_cost_ratio", ARGV_FLOAT, (char *) 0, 
      (char *) &similarity_cost_ratio,
      "Weighting factor for  r=similarity*w + cost(1*w)"},
+  {"-threads", ARGV_INT, (char *) 0, 
+     (char *) &main_argsX.threads,
+     "Number of threads used by the linear similarity functions and to estimate the deformation (default = 1)."},
+  {"-source_cache", ARGV_FLOAT, (char *) 0, 
+     (char *) &main_argsX.source_cache_size,
+     "Memory (MB) used to keep source sub-lattices between iterations (default = 512, 0 = off)."},
+  {"-nonlinear_schedule", ARGV_FUNC, (char *) get_nonlinear_schedule, 
+     (char *) &main_argsX.pyramid,
+     "Coarse to fine levels fwhm,step,lattice_diameter,iterations[:...] (mm)."},
 
   {NULL, ARGV_HELP, NULL, NULL,
      "\nOptions for logging progress. Default = -verbose 1."},
   {"-verbose", ARGV_INT, (char *) 0, (char *) &main_argsX.flags.verbose,
      "Write messages indicating progress"},
+  {"-progress_stride", ARGV_INT, (char *) 0, 
+     (char *) &main_argsX.progress_stride,
+     "Use every n'th lattice point for the nonlinear progress correlation (default = 1)."},
   {"-quiet", ARGV_CONSTANT, (char *) 0 , (char *) &main_argsX.flags.verbose,
      "Do not write log messages"},
   {"-debug", ARGV_CONSTANT, (char *) TRUE, (char *) &main_argsX.flags.debug,
      "Print out debug info."},
+  {"-perf_report", ARGV_STRING, (char *) 0, 
+     (char *) &main_argsX.filenames.perf_report,
+     "Save the time spent in each phase of the run, as JSON."},
   {"-version", ARGV_FUNC, (char *) print_version_info, (char *)MNI_AUTOREG_LONG_VERSION,
      "Print out version info and exit."},
   {NULL, ARGV_END, NULL, NULL, NULL}
@@ -278,7 +334,7 @@ ArgvInfo argTable[] = {
 
 
 Arg_Data main_argsX = {
-  {"","","","","","",""},        /* filenames           */
+  {"","","","","","","","",""},  /* filenames           */
   {1,FALSE},                        /* verbose, debug      */
   {                                /* transformation info */
     FALSE,                        /*   use identity tranformation to start */
@@ -326,7 +382,19 @@ Arg_Data main_argsX = {
   {0.0,0.0},                        /* lower limit of voxels considered                 */
   5.0,                                /* percent noise speckle                            */
   256,                                /* number of groups to use for ratio of variance    */
-  3                                /* pdf blurring size for -mi                        */
+  3,                                /* pdf blurring size for -mi                        */
+  1,                               /* number of threads for the objective functions    */
+  512.0,                           /* MB of source sub-lattices kept between iterations */
+  {0, NULL},                       /* single resolution nonlinear fit                   */
+  1,                               /* progress correlation over the whole lattice       */
+  1,                               /* single starting point for the linear fit          */
+  1.0,                             /* linear objectives use all lattice nodes           */
+  0,                               /* sample seed taken from the clock                  */
+  FALSE,                           /* sample nodes uniformly                            */
+  {0, NULL},                       /* single resolution linear fit                      */
+  NC_DOUBLE,                       /* source and target voxels held as doubles          */
+  FALSE,                           /* ...in their usual voxel order only                */
+  FALSE                            /* ...and not cropped                                */
 };
 
 Arg_Data *main_args = &main_argsX;
@@ -106,20 +106,11 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 
 extern Arg_Data *main_args;
 
-extern   VIO_Volume   Gdata1, Gdata2, Gmask1, Gmask2;
-extern   int      Ginverse_mapping_flag, Gndim;
 extern   double   simplex_size ;
 extern   Segment_Table  *segment_table;
 
-extern VIO_Real            **prob_hash_table; 
-extern VIO_Real            *prob_fn1;         
-extern VIO_Real            *prob_fn2;         
-
 extern int Matlab_num_steps;
 
-float fit_function(float *params);
-float fit_function_quater(float *params);
-
 void make_zscore_volume(VIO_Volume d1, VIO_Volume m1, 
                                VIO_Real *threshold); 
 
@@ -166,6 +157,8 @@ void make_matlab_data_file(VIO_Volume d1,
   double trans[3], quats[4], shears[3], scales[3],rots[3];
   VIO_Data_types
     data_type;
+  Fit_Data
+    fit;
 
   start = 0.0;
   if (globals->obj_function == zscore_objective) { /* replace volume d1 and d2 by zscore volume  */
@@ -229,10 +222,6 @@ void make_matlab_data_file(VIO_Volume d1,
         }
       }
 
-      ALLOC(   prob_fn1,   globals->groups);
-      ALLOC(   prob_fn2,   globals->groups);
-      VIO_ALLOC2D( prob_hash_table, globals->groups, globals->groups);
-
     } 
 
 
@@ -299,14 +288,15 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
-  Gndim = ndim;
-  Gdata1 = d1;
-  Gdata2 = d2;
-  Gmask1 = m1;
-  Gmask2 = m2;
-  Ginverse_mapping_flag = FALSE;
+  fit.globals = globals;
+  fit.ndim = ndim;
+  fit.data1 = d1;
+  fit.data2 = d2;
+  fit.mask1 = m1;
+  fit.mask2 = m2;
+  fit.inverse_mapping = FALSE;
 
 print ("trans: %10.5f %10.5f %10.5f \n",
        globals->trans_info.translations[0],globals->trans_info.translations[1],globals->trans_info.translations[2]);
@@ -386,7 +376,7 @@ print ("scale: %10.5f %10.5f %10.5f \n",
                                p,
                                globals->trans_info.weights);
     
-          (void)fprintf (ofd, "%f %f %f\n",i*step, start+i*step, fit_function(p));
+          (void)fprintf (ofd, "%f %f %f\n",i*step, start+i*step, fit_function(&fit,p));
         }
 
         (void)fprintf (ofd,"];\n"); 
@@ -469,14 +459,15 @@ if(globals->trans_info.rotation_type == TRANS_QUAT)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
-  Gndim = ndim;
-  Gdata1 = d1;
-  Gdata2 = d2;
-  Gmask1 = m1;
-  Gmask2 = m2;
-  Ginverse_mapping_flag = FALSE;
+  fit.globals = globals;
+  fit.ndim = ndim;
+  fit.data1 = d1;
+  fit.data2 = d2;
+  fit.mask1 = m1;
+  fit.mask2 = m2;
+  fit.inverse_mapping = FALSE;
 
 print ("trans: %10.5f %10.5f %10.5f \n",
        globals->trans_info.translations[0],globals->trans_info.translations[1],globals->trans_info.translations[2]);
@@ -559,7 +550,7 @@ print ("scale: %10.5f %10.5f %10.5f \n",
                                       p,
                                       globals->trans_info.weights);
     
-          (void)fprintf (ofd, "%f %f %f\n",i*step, start+i*step, fit_function_quater(p));
+          (void)fprintf (ofd, "%f %f %f\n",i*step, start+i*step, fit_function_quater(&fit,p));
         }
 
         (void)fprintf (ofd,"];\n"); 
@@ -580,14 +571,7 @@ print ("scale: %10.5f %10.5f %10.5f \n",
       (void)fprintf(stderr, "Can't free segment table.\n");
       (void)fprintf(stderr, "Error in line %d, file %s\n",__LINE__, __FILE__);
     }
-  } else
-  if (globals->obj_function == mutual_information_objective || globals->obj_function == normalized_mutual_information_objective )
-                                /* Collignon's mutual information */
-    {
-      FREE(   prob_fn1 );
-      FREE(   prob_fn2 );
-      VIO_FREE2D( prob_hash_table);
-    }
+  }
 
 
 
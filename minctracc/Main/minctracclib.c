@@ -20,10 +20,14 @@
 
 #include <config.h>
 #include <float.h>
+#include <time.h>
 #include <volume_io.h>
 #include <minctracc.h>
 #include <objectives.h>
 #include "local_macros.h"
+#include "perf_report.h"
+#include "mask_spans.h"
+#include "crop_volumes.h"
 #include "globaldefs.h"
 
 
@@ -34,6 +38,9 @@
  */
 static int obj_func0 = -1;
 
+static void make_feature_mask_spans(Feature_volumes *features);
+static void delete_feature_mask_spans(Feature_volumes *features);
+
 static char *default_dim_names[VIO_N_DIMENSIONS] = 
     { MIzspace, MIyspace, MIxspace };
 
@@ -46,7 +53,7 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	VIO_Status status;
 	VIO_General_transform tmp_invert;
 	
-	int parse_flag, measure_matlab_flag, sizes[3],i,num_features;
+	int parse_flag, measure_matlab_flag, sizes[3],i,num_features,perf_phase;
 	VIO_Real min_value, max_value, step[3];
   
  
@@ -60,6 +67,8 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	smoothing_weight = stiffness;
 	similarity_cost_ratio = similarity;
 	Diameter_of_local_lattice = sub_lattice;
+
+	start_perf_report();
 			
 	
 	// SET UP INPUT TRANSFORMATIONS
@@ -91,6 +100,9 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	case N_NEIGHBOUR:
 		args->interpolant = nearest_neighbour_interpolant;
 		break;
+	case BSPLINE:
+		args->interpolant = bspline_interpolant;
+		break;
 	default:
 		(void) fprintf(stderr, "Error determining interpolation type: %d\n",args->interpolant_type);
 		return NULL;
@@ -130,9 +142,17 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	get_volume_minimum_maximum_real_value(model, &min_value, &max_value);
 	get_volume_voxel_range(model, &min_value, &max_value);
 
+	perf_phase = begin_perf_phase("mask_spans");
+	(void)make_mask_spans(mask_data);
+	(void)make_mask_spans(mask_model);
+	make_feature_mask_spans(&(args->features));
+	end_perf_phase(perf_phase);
+
+	perf_phase = begin_perf_phase("init_params");
 	if (!init_params( data, model, mask_data, mask_model, args )) {
 		print_error_and_line_num("%s",__FILE__, __LINE__,"Could not initialize transformation parameters\n");
 	}
+	end_perf_phase(perf_phase);
 	
 	if (args->features.number_of_features == 0) {
 		num_features = allocate_a_new_feature(&(args->features));
@@ -175,12 +195,28 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	
 	// Go!
 	if (args->trans_info.transform_type != TRANS_PAT) {
+		perf_phase = begin_perf_phase("lattice_setup");
 		init_lattice( data, model, mask_data, mask_model, args );
+		end_perf_phase(perf_phase);
 
 		if (args->trans_info.transform_type == TRANS_NONLIN) {
-			build_default_deformation_field(args);
-			if ( !optimize_non_linear_transformation(args) ) {
-				print_error_and_line_num("Error in optimization of non-linear transformation\n", __FILE__, __LINE__);
+			if (args->pyramid.n_levels > 0) {
+				if ( !optimize_non_linear_pyramid(data, model, mask_data, mask_model, args) ) {
+					print_error_and_line_num("Error in optimization of non-linear transformation\n", __FILE__, __LINE__);
+				}
+			}
+			else {
+				perf_phase = begin_perf_phase("lattice_setup");
+				build_default_deformation_field(args);
+				end_perf_phase(perf_phase);
+				if ( !optimize_non_linear_transformation(args) ) {
+					print_error_and_line_num("Error in optimization of non-linear transformation\n", __FILE__, __LINE__);
+				}
+			}
+		}
+		else if (args->linear_schedule.n_levels > 0) {
+			if ( !optimize_linear_schedule(data, model, mask_data, mask_model, args) ) {
+				print_error_and_line_num("Error in optimization of linear transformation\n",__FILE__, __LINE__);
 			}
 		}
 		else {
@@ -212,6 +248,16 @@ VIO_General_transform* minctracc( VIO_Volume source, VIO_Volume target, VIO_Volu
 	}
 	
 	
+	if (strlen(args->filenames.perf_report) != 0 &&
+	    write_perf_report(args->filenames.perf_report, args->filenames.data, args->filenames.model,
+	                      args->threads) != VIO_OK) {
+		print_error_and_line_num("Error saving perf report file %s.\n", __FILE__, __LINE__, args->filenames.perf_report);
+	}
+
+	delete_mask_spans(mask_data);
+	delete_mask_spans(mask_model);
+	delete_feature_mask_spans(&(args->features));
+
 	if (origTransform) FREE(origTransform);
 	return( args->trans_info.transformation );
 	
@@ -227,6 +273,8 @@ void initializeArgs(Arg_Data *args) {
 	args->filenames.output_trans = "";
 	args->filenames.measure_file = "";
 	args->filenames.matlab_file = "";
+	args->filenames.perf_report = "";
+	args->filenames.moments_cache = "";
 	
 	// Program flags
 	args->flags.verbose = 0; args->flags.debug = FALSE;
@@ -290,6 +338,20 @@ void initializeArgs(Arg_Data *args) {
 	args->speckle = 5.0;
 	args->groups = 256;
 	args->blur_pdf = 3;	
+	args->threads = 1;
+	args->source_cache_size = 512.0;
+	args->pyramid.n_levels = 0;
+	args->pyramid.level = NULL;
+	args->progress_stride = 1;
+	args->multistart = 1;
+	args->sample_fraction = 1.0;
+	args->sample_seed = 0;
+	args->sample_gradient = FALSE;
+	args->linear_schedule.n_levels = 0;
+	args->linear_schedule.level = NULL;
+	args->volume_type = NC_DOUBLE;
+	args->bricked_volumes = FALSE;
+	args->crop_volumes = FALSE;
 }
 
 /* Command line argument "-nonlinear" may be followed by an optional
@@ -330,9 +392,221 @@ int get_nonlinear_objective(char *dst, char *key, char* nextArg)
     return 1;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_nonlinear_schedule
+@INPUT      : dst - Pointer to client data from argument table
+              key - argument key
+              nextArg - argument following key
+@OUTPUT     : (nothing) 
+@RETURNS    : TRUE so that ParseArgv will discard nextArg
+@DESCRIPTION: Routine called by ParseArgv to read the levels of a coarse
+              to fine nonlinear fit.  Each level is given as
+              fwhm,step,lattice_diameter,iterations (all in mm but the
+              last), and levels are separated by ':', e.g.
+              -nonlinear_schedule 16,8,24,15:8,4,12,10:4,2,6,5
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+/* ARGSUSED */
+int get_nonlinear_schedule(char *dst, char *key, char *nextArg)
+{
+   Nonlinear_Pyramid *pyramid;
+   Pyramid_Level *level;
+   char *spec;
+   int n, length;
+
+   /* Check for following argument */
+   if (nextArg == NULL) {
+      (void)fprintf(stderr, 
+                     "\"%s\" option requires an additional argument\n",
+                     key);
+      return FALSE;
+   }
+
+   pyramid = (Nonlinear_Pyramid *) dst;
+
+   if (pyramid->level != NULL)
+     FREE(pyramid->level);
+
+   n = 1;
+   for (spec = nextArg; *spec != '\0'; spec++)
+     if (*spec == ':') n++;
+
+   ALLOC(pyramid->level, n);
+   pyramid->n_levels = 0;
+
+   spec = nextArg;
+   while (pyramid->n_levels < n) {
+     level = &pyramid->level[pyramid->n_levels];
+
+     if (sscanf(spec, "%lf,%lf,%lf,%d%n", &level->fwhm, &level->step,
+                &level->lattice_width, &level->iterations, &length) != 4 ||
+         (spec[length] != ':' && spec[length] != '\0') ||
+         level->fwhm < 0.0 || level->step <= 0.0 ||
+         level->lattice_width <= 0.0 || level->iterations < 1) {
+       (void)fprintf(stderr, 
+                     "Level %d of \"%s\" must be fwhm,step,lattice_diameter,iterations.\n",
+                     pyramid->n_levels+1, key);
+       exit(EXIT_FAILURE);
+     }
+
+     pyramid->n_levels++;
+     spec += length + 1;
+   }
+
+   return TRUE;
+}
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_linear_schedule
+@INPUT      : dst - Pointer to client data from argument table
+              key - argument key
+              nextArg - argument following key
+@OUTPUT     : (nothing) 
+@RETURNS    : TRUE so that ParseArgv will discard nextArg
+@DESCRIPTION: Routine called by ParseArgv to read the levels of a coarse
+              to fine linear fit.  Each level is given as
+              fwhm,step,simplex,tolerance[,objective][,fraction] (fwhm
+              and step in mm), the objective being one of xcorr, zscore,
+              ssc, vr, mi or nmi and the fraction that of -sample_fraction
+              (default: those of the run).  Levels are separated by ':',
+              e.g.
+              -linear_schedule 16,8,20,0.01,0.25:8,4,8,0.005:4,4,3,0.002,mi
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+/* ARGSUSED */
+int get_linear_schedule(char *dst, char *key, char *nextArg)
+{
+   static struct {
+     char *name;
+     int   type;
+   } objectives[] = {
+     {"xcorr",  XCORR},
+     {"zscore", ZSCORE},
+     {"ssc",    SSC},
+     {"vr",     VR},
+     {"mi",     MUTUAL_INFORMATION},
+     {"nmi",    NORMALIZED_MUTUAL_INFORMATION}
+   };
+   Linear_Schedule *schedule;
+   Linear_Level *level;
+   char *spec, *end;
+   double fraction;
+   int n, i, length, type;
+
+   /* Check for following argument */
+   if (nextArg == NULL) {
+      (void)fprintf(stderr, 
+                     "\"%s\" option requires an additional argument\n",
+                     key);
+      return FALSE;
+   }
+
+   schedule = (Linear_Schedule *) dst;
+
+   if (schedule->level != NULL)
+     FREE(schedule->level);
+
+   n = 1;
+   for (spec = nextArg; *spec != '\0'; spec++)
+     if (*spec == ':') n++;
+
+   ALLOC(schedule->level, n);
+   schedule->n_levels = 0;
+
+   spec = nextArg;
+   while (schedule->n_levels < n) {
+     level = &schedule->level[schedule->n_levels];
+     level->obj_function_type = -1;
+     level->sample_fraction   = -1.0;
+
+     if (sscanf(spec, "%lf,%lf,%lf,%lf%n", &level->fwhm, &level->step,
+                &level->simplex, &level->tolerance, &length) != 4 ||
+         (spec[length] != ':' && spec[length] != ',' && spec[length] != '\0') ||
+         level->fwhm < 0.0 || level->step <= 0.0 ||
+         level->simplex <= 0.0 || level->tolerance <= 0.0) {
+       (void)fprintf(stderr, 
+                     "Level %d of \"%s\" must be fwhm,step,simplex,tolerance[,objective][,fraction].\n",
+                     schedule->n_levels+1, key);
+       exit(EXIT_FAILURE);
+     }
+
+                                /* the optional objective and sample
+                                   fraction, in either order */
+     while (spec[length] == ',') {
+       spec += length + 1;
+       length = strcspn(spec, ",:");
+
+       fraction = strtod(spec, &end);
+       if (end == spec + length && length > 0) {
+         if (fraction <= 0.0 || fraction > 1.0) {
+           (void)fprintf(stderr, 
+                         "The sample fraction of level %d of \"%s\" must be greater than 0 and at most 1.\n",
+                         schedule->n_levels+1, key);
+           exit(EXIT_FAILURE);
+         }
+         level->sample_fraction = fraction;
+         continue;
+       }
+
+       type = -1;
+       for(i=0; i<(int)(sizeof(objectives)/sizeof(objectives[0])); i++)
+         if ((int)strlen(objectives[i].name) == length &&
+             strncmp(spec, objectives[i].name, length) == 0)
+           type = objectives[i].type;
+
+       if (type < 0) {
+         (void)fprintf(stderr, 
+                       "Unknown objective function \"%.*s\" in level %d of \"%s\".\n",
+                       length, spec, schedule->n_levels+1, key);
+         exit(EXIT_FAILURE);
+       }
+       level->obj_function_type = type;
+     }
+
+     schedule->n_levels++;
+     spec += length + 1;
+   }
+
+   return TRUE;
+}
+
+
+/* the spans and bitmaps of the masks of all features (see
+   Volume/mask_spans.c), made once they are loaded */
+
+static void make_feature_mask_spans(Feature_volumes *features)
+{
+  int i;
+
+  for(i=0; i<features->number_of_features; i++) {
+    (void)make_mask_spans(features->data_mask[i]);
+    (void)make_mask_spans(features->model_mask[i]);
+  }
+}
+
+static void delete_feature_mask_spans(Feature_volumes *features)
+{
+  int i;
+
+  for(i=0; i<features->number_of_features; i++) {
+    delete_mask_spans(features->data_mask[i]);
+    delete_mask_spans(features->model_mask[i]);
+  }
+}
 
 int free_features(Feature_volumes *features)
 {
+  delete_feature_mask_spans(features);
+
 
 
   if (*(features->data)       != (VIO_Volume)NULL) {delete_volume(*(features->data));      } FREE(features->data); 
@@ -450,7 +724,7 @@ int minctraccOldFashioned ( int argc, char* argv[] )
     
     sizes[3],i,num_features;
   VIO_Real
-    min_value, max_value, step[3];
+    min_value, max_value, step[3], margin_mm, min_fraction;
   char 
     *comments = history_string( argc, argv );
   FILE
@@ -458,12 +732,18 @@ int minctraccOldFashioned ( int argc, char* argv[] )
   VIO_Real
     obj_func_val;
   float quat4;
+  int
+    perf_phase, margin;
   
   prog_name     = argv[0];        
+
+  start_perf_report();
   
   /* Call ParseArgv to interpret all command line args (returns TRUE if error) */
 
+  perf_phase = begin_perf_phase("arguments");
   parse_flag = ParseArgv(&argc, argv, argTable, 0);
+  end_perf_phase(perf_phase);
 
   measure_matlab_flag = 
     (strlen(main_args->filenames.matlab_file)  != 0) ||
@@ -480,6 +760,9 @@ int minctraccOldFashioned ( int argc, char* argv[] )
   case N_NEIGHBOUR:
     main_args->interpolant = nearest_neighbour_interpolant;
     break;
+  case BSPLINE:
+    main_args->interpolant = bspline_interpolant;
+    break;
   default:
     (void) fprintf(stderr, "Error determining interpolation type\n");
     exit(EXIT_FAILURE);
@@ -569,6 +852,54 @@ int minctraccOldFashioned ( int argc, char* argv[] )
     (void)fprintf (stderr,"Use -clobber to overwrite.\n");
     exit(EXIT_FAILURE);
   }
+
+  if (!clobber_flag && 
+      (strlen(main_args->filenames.perf_report)!=0) && 
+      file_exists(main_args->filenames.perf_report)) {
+    (void)fprintf (stderr,"Perf report file %s exists.\n",main_args->filenames.perf_report);
+    (void)fprintf (stderr,"Use -clobber to overwrite.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (main_args->pyramid.n_levels > 0 &&
+      main_args->trans_info.transform_type != TRANS_NONLIN) {
+    (void)fprintf (stderr,"-nonlinear_schedule can only be used with -nonlinear.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (main_args->linear_schedule.n_levels > 0 &&
+      (main_args->trans_info.transform_type == TRANS_NONLIN ||
+       main_args->trans_info.transform_type == TRANS_PAT)) {
+    (void)fprintf (stderr,"-linear_schedule can only be used with a linear transformation type.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (main_args->progress_stride < 1) {
+    (void)fprintf (stderr,"-progress_stride must be at least 1.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (main_args->sample_fraction <= 0.0 || main_args->sample_fraction > 1.0) {
+    (void)fprintf (stderr,"-sample_fraction must be greater than 0 and at most 1.\n");
+    exit(EXIT_FAILURE);
+  }
+                                /* the levels of -linear_schedule may
+                                   sample less of the lattice */
+  min_fraction = main_args->sample_fraction;
+  for(i=0; i<main_args->linear_schedule.n_levels; i++)
+    if (main_args->linear_schedule.level[i].sample_fraction > 0.0)
+      min_fraction = MIN(min_fraction, main_args->linear_schedule.level[i].sample_fraction);
+
+  if (main_args->sample_gradient && min_fraction >= 1.0) {
+    (void)fprintf (stderr,"-sample_gradient needs a -sample_fraction below 1.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (min_fraction < 1.0) {
+    if (main_args->sample_seed == 0)
+      main_args->sample_seed = (int)(time(NULL) & 0x7fffffff);
+    if (main_args->flags.verbose > 0)
+      print ("Sampling %s%g of the lattice nodes%s (-sample_seed %d)\n",
+             (min_fraction < main_args->sample_fraction) ? "down to " : "",
+             min_fraction, 
+             main_args->sample_gradient ? ", weighted by the source gradient," : "",
+             main_args->sample_seed);
+  }
   if (strlen(main_args->filenames.matlab_file)  != 0 &&
       strlen(main_args->filenames.measure_file) != 0) {
     (void)fprintf(stderr, "\nWARNING: -matlab and -measure are mutually exclusive.  Only\n");
@@ -743,8 +1074,10 @@ int minctraccOldFashioned ( int argc, char* argv[] )
 
   ALLOC(data,1);
 
+  perf_phase = begin_perf_phase("volume_load");
+
   status = input_volume( main_args->filenames.data, 3, default_dim_names, 
-                         NC_DOUBLE, FALSE, 0.0, 0.0,
+                         main_args->volume_type, TRUE, 0.0, 0.0,
                          TRUE, &data, (minc_input_options *)NULL );
 
   if (status != VIO_OK)
@@ -753,12 +1086,43 @@ int minctraccOldFashioned ( int argc, char* argv[] )
   data_dxyz = data;
  
   status = input_volume( main_args->filenames.model, 3, default_dim_names, 
-                         NC_DOUBLE, FALSE, 0.0, 0.0,
+                         main_args->volume_type, TRUE, 0.0, 0.0,
                          TRUE, &model, (minc_input_options *)NULL );
   if (status != VIO_OK)
     print_error_and_line_num("Cannot input volume '%s'",
                              __FILE__, __LINE__,main_args->filenames.model);
   model_dxyz = model;
+
+  end_perf_phase(perf_phase);
+
+  if (main_args->crop_volumes) {
+
+                                /* keep the neighbours of the interpolant
+                                   and, for -nonlinear, the sub-lattices
+                                   around the nodes */
+    margin    = (main_args->interpolant_type == TRICUBIC ||
+                 main_args->interpolant_type == BSPLINE) ? 2 : 1;
+    margin_mm = 0.0;
+    if (main_args->trans_info.transform_type == TRANS_NONLIN)
+      for(i=0; i<3; i++)
+        margin_mm = MAX(margin_mm, 0.5 * fabs(main_args->lattice_width[i]));
+
+    perf_phase = begin_perf_phase("crop_volumes");
+    if (crop_volume_and_mask(&data, &mask_data, main_args->threshold[0], margin, margin_mm)) {
+      get_volume_sizes(data, sizes);
+      DEBUG_PRINT3 ( "Source volume cropped to %3d  by %3d  by %d \n",
+                     sizes[VIO_X], sizes[VIO_Y], sizes[VIO_Z]);
+    }
+    if (crop_volume_and_mask(&model, &mask_model, main_args->threshold[1], margin, margin_mm)) {
+      get_volume_sizes(model, sizes);
+      DEBUG_PRINT3 ( "Target volume cropped to %3d  by %3d  by %d \n",
+                     sizes[VIO_X], sizes[VIO_Y], sizes[VIO_Z]);
+    }
+    end_perf_phase(perf_phase);
+
+    data_dxyz  = data;
+    model_dxyz = model;
+  }
  
 
   get_volume_separations(data, step);
@@ -840,13 +1204,19 @@ int minctraccOldFashioned ( int argc, char* argv[] )
   }
   main_args->features.weight[0]          = 1.0;
 
+  perf_phase = begin_perf_phase("mask_spans");
+  make_feature_mask_spans(&(main_args->features));
+  end_perf_phase(perf_phase);
+
   /* ===========================  translate initial transformation matrix into 
                                   transformation parameters */
 
+    perf_phase = begin_perf_phase("init_params");
     if (!init_params( data, model, mask_data, mask_model, main_args )) {
       print_error_and_line_num("%s",__FILE__, __LINE__,
                              "Could not initialize transformation parameters\n");
     }
+    end_perf_phase(perf_phase);
 
 
 
@@ -928,7 +1298,9 @@ int minctraccOldFashioned ( int argc, char* argv[] )
                                 /* initialize the sampling lattice and figure out
                                    which of the two volumes is smaller.           */
     
+    perf_phase = begin_perf_phase("lattice_setup");
     init_lattice( data, model, mask_data, mask_model, main_args );
+    end_perf_phase(perf_phase);
 
     if (main_args->smallest_vol == 1) {
       DEBUG_PRINT("Source volume is smallest\n");
@@ -948,15 +1320,42 @@ int minctraccOldFashioned ( int argc, char* argv[] )
 
     if (main_args->trans_info.transform_type == TRANS_NONLIN) {
 
-      build_default_deformation_field(main_args);
+      if (main_args->pyramid.n_levels > 0) {
+
+                                /* coarse to fine fit, each level
+                                   resets the lattice itself */
+
+        if ( !optimize_non_linear_pyramid( data, model, mask_data, mask_model, main_args ) ) {
+          print_error_and_line_num("Error in optimization of non-linear transformation\n",
+                                   __FILE__, __LINE__);
+          exit(EXIT_FAILURE);
+        }
+      }
+      else {
+
+        perf_phase = begin_perf_phase("lattice_setup");
+        build_default_deformation_field(main_args);
+        end_perf_phase(perf_phase);
+      
+
+        if ( !optimize_non_linear_transformation( main_args ) ) {
+          print_error_and_line_num("Error in optimization of non-linear transformation\n",
+                                   __FILE__, __LINE__);
+          exit(EXIT_FAILURE);
+        }
+      }
       
+    }
+    else if (main_args->linear_schedule.n_levels > 0) {
+
+                                /* coarse to fine fit, each level
+                                   resets the lattice itself */
 
-      if ( !optimize_non_linear_transformation( main_args ) ) {
-        print_error_and_line_num("Error in optimization of non-linear transformation\n",
+      if ( !optimize_linear_schedule( data, model, mask_data, mask_model, main_args ) ) {
+        print_error_and_line_num("Error in optimization of linear transformation\n",
                                  __FILE__, __LINE__);
         exit(EXIT_FAILURE);
       }
-      
     }
     else {
       
@@ -1009,15 +1408,26 @@ int minctraccOldFashioned ( int argc, char* argv[] )
   /* ===========================   write out transformation =============== */
 
 
+  perf_phase = begin_perf_phase("output");
   status = output_transform_file(main_args->filenames.output_trans,
                                  comments,
                                  main_args->trans_info.transformation);
+  end_perf_phase(perf_phase);
      
   if (status!=VIO_OK) {
     print_error_and_line_num("Error saving transformation file.`\n",
                 __FILE__, __LINE__);
     exit(EXIT_FAILURE);
   }
+
+  if (strlen(main_args->filenames.perf_report) != 0 &&
+      write_perf_report(main_args->filenames.perf_report,
+                        main_args->filenames.data, main_args->filenames.model,
+                        main_args->threads) != VIO_OK) {
+    print_error_and_line_num("Error saving perf report file %s.\n",
+                             __FILE__, __LINE__, main_args->filenames.perf_report);
+    exit(EXIT_FAILURE);
+  }
   if( comments ) {
     FREE( comments );
     comments = NULL;
@@ -1314,10 +1724,11 @@ int get_feature_volumes(char *dst, char *key, int argc, char **argv)
       } 
 
     }
-    else {			/* if feature is not a label, then force load as DOUBLEs */
+    else {			/* if feature is not a label, then load it as the
+				   source and target (DOUBLEs by default) */
 
       status = input_volume(data_name, 3, default_dim_names, 
-			    NC_DOUBLE, FALSE, 0.0, 0.0,
+			    main_args->volume_type, TRUE, 0.0, 0.0,
 			    TRUE, &data_vol, 
 			    (minc_input_options *)NULL );
       if (status != VIO_OK) {
@@ -1325,7 +1736,7 @@ int get_feature_volumes(char *dst, char *key, int argc, char **argv)
 	return(-1);
       } 
       status = input_volume(model_name, 3, default_dim_names, 
-			    NC_DOUBLE, FALSE, 0.0, 0.0,
+			    main_args->volume_type, TRUE, 0.0, 0.0,
 			    TRUE, &model_vol, 
 			    (minc_input_options *)NULL );
       if (status != VIO_OK) {
@@ -139,6 +139,7 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include "cov_to_praxes.h"
 #include "make_rots.h"
 #include "quaternion.h"
+#include "volume_moments.h"
 
 extern Arg_Data *main_args;
 
@@ -178,112 +179,20 @@ void set_up_lattice(VIO_Volume data,       /* in: volume  */
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Wed Aug  2 12:05:39 MET DST 1995 LC
-@MODIFIED   : 
+@MODIFIED   : Oct 18, 2026 - computed by get_volume_moments()
               
 ---------------------------------------------------------------------------- */
 VIO_BOOL vol_cog(VIO_Volume d1, VIO_Volume m1, float *centroid, double *step)
 {
+  Volume_Moments
+    moments;
 
+  get_volume_moments(1, &d1, &m1, step, main_args->threads, &moments);
 
-  VectorR
-    vector_step;
-
-  PointR 
-    starting_position,
-    slice,
-    row,
-    col,
-    voxel;
-
-  VIO_Real
-    tx,ty,tz;
-
-  int
-    i,
-    r,c,s;
-
-  float
-    sx,sy,sz,si; 
-
-  VIO_Real
-    true_value;
-
-  int
-    count[ VIO_MAX_DIMENSIONS];
-  double 
-    start[VIO_MAX_DIMENSIONS],
-    wstart[ VIO_MAX_DIMENSIONS],
-    local_step[ VIO_MAX_DIMENSIONS];
-  VectorR
-    scaled_directions[VIO_MAX_DIMENSIONS],
-    directions[ VIO_MAX_DIMENSIONS];  
-
-                                /* build default sampling lattice info
-                                   on the data set (d1)               */
-  set_up_lattice(d1, step,start, wstart, count, local_step, directions);
-
-  
-   for(i=0; i<3; i++) {
-     Point_x(scaled_directions[i]) = Point_x(directions[i]) * local_step[i];
-     Point_y(scaled_directions[i]) = Point_y(directions[i]) * local_step[i];
-     Point_z(scaled_directions[i]) = Point_z(directions[i]) * local_step[i];
-   }
-
-  fill_Point( starting_position, wstart[0], wstart[1], wstart[2]);
-  
-                                /* calculate centroids */
-
-  sx = 0.0;
-  sy = 0.0;
-  sz = 0.0;
-  si = 0.0;
-
- 
-
-  for(s=0; s<count[SLICE_IND]; s++) {
-
-    SCALE_VECTOR( vector_step, scaled_directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-
-    for(r=0; r<count[ROW_IND]; r++) {
-
-      SCALE_VECTOR( vector_step, scaled_directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<count[COL_IND]; c++) {
-
-        convert_3D_world_to_voxel(d1, Point_x(col), Point_y(col), Point_z(col), &tx, &ty, &tz);
-
-
-        fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
-        
-
-        if (point_not_masked(m1, Point_x(col), Point_y(col), Point_z(col))) {        
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &true_value )) {
-            
-
-            sx +=  Point_x(col) * true_value;
-            sy +=  Point_y(col) * true_value;
-            sz +=  Point_z(col) * true_value;
-            
-            si += true_value;
-          }
-          /* else requested voxel is just outside volume., so ignore it */
-
-        }
-        
-        ADD_POINT_VECTOR( col, col, scaled_directions[COL_IND] );
-        
-      }
-    }
-  }
-
-  if (si!=0.0) {
-    centroid[1] = sx/ si;
-    centroid[2] = sy/ si;
-    centroid[3] = sz/ si;
+  if (moments.mass != 0.0) {
+    centroid[1] = moments.centroid[0];
+    centroid[2] = moments.centroid[1];
+    centroid[3] = moments.centroid[2];
     
     return(TRUE);
     
@@ -314,112 +223,18 @@ VIO_BOOL vol_cog(VIO_Volume d1, VIO_Volume m1, float *centroid, double *step)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Wed Aug  2 12:05:39 MET DST 1995 LC
-@MODIFIED   : 
+@MODIFIED   : Oct 18, 2026 - computed by get_volume_moments()
               
 ---------------------------------------------------------------------------- */
 VIO_BOOL vol_cov(VIO_Volume d1, VIO_Volume m1, float *centroid, float **covar, double *step)
 {
+  Volume_Moments
+    moments;
 
+  get_volume_moments(1, &d1, &m1, step, main_args->threads, &moments);
 
-  VectorR
-    vector_step;
-
-  PointR 
-    starting_position,
-    slice,
-    row,
-    col,
-    voxel;
-
-  VIO_Real
-    tx,ty,tz;
-
-  int
-    i,r,c,s;
-
-  float
-    sxx,syy,szz,
-    sxy,syz,sxz,
-    si; 
-
-  VIO_Real
-    true_value;
-
-  int
-    count[VIO_MAX_DIMENSIONS];
-  double 
-    start[VIO_MAX_DIMENSIONS],
-    wstart[VIO_MAX_DIMENSIONS],
-    local_step[VIO_MAX_DIMENSIONS];
-  VectorR
-    scaled_directions[VIO_MAX_DIMENSIONS],
-    directions[VIO_MAX_DIMENSIONS];  
-
-                                /* build default sampling lattice info
-                                   on the data set (d1)               */
-
-  set_up_lattice(d1, step,
-                 start, wstart, count, local_step, directions);
-
-   for(i=0; i<3; i++) {
-     Point_x(scaled_directions[i]) = Point_x(directions[i]) * local_step[i];
-     Point_y(scaled_directions[i]) = Point_y(directions[i]) * local_step[i];
-     Point_z(scaled_directions[i]) = Point_z(directions[i]) * local_step[i];
-   }
-
-  
-  fill_Point( starting_position, wstart[0], wstart[1], wstart[2]);
-  
-  si = 0.0;
-  sxx = syy = szz = 0.0;
-  sxy = syz = sxz = 0.0;
-    
-                                /* now calculate variances and co-variances */
-
-  for(s=0; s<count[SLICE_IND]; s++) {
-    
-    SCALE_VECTOR( vector_step, scaled_directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-    
-    for(r=0; r<count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, scaled_directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<count[COL_IND]; c++) {
-        
-        
-        convert_3D_world_to_voxel(d1, Point_x(col), Point_y(col), Point_z(col), &tx, &ty, &tz);
-        
-        fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
-        
-        if (point_not_masked(m1, Point_x(col), Point_y(col), Point_z(col))) {        
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &true_value )) {
-            
-            sxx += (Point_x( col )-centroid[1]) * (Point_x( col )-centroid[1]) * true_value;
-            syy += (Point_y( col )-centroid[2]) * (Point_y( col )-centroid[2]) * true_value;
-            szz += (Point_z( col )-centroid[3]) * (Point_z( col )-centroid[3]) * true_value;
-            sxy += (Point_x( col )-centroid[1]) * (Point_y( col )-centroid[2]) * true_value;
-            syz += (Point_y( col )-centroid[2]) * (Point_z( col )-centroid[3]) * true_value;
-            sxz += (Point_x( col )-centroid[1]) * (Point_z( col )-centroid[3]) * true_value;
-            si += true_value;
-          }
-          /* else requested voxel is just outside volume., so ignore it */
-          
-        } 
-        
-        ADD_POINT_VECTOR( col, col, scaled_directions[COL_IND] );
-        
-      }
-    }
-  }
-
-  if (si != 0.0) {
-    covar[1][1] = sxx/si; covar[1][2] = sxy/si; covar[1][3] = sxz/si;
-    covar[2][1] = sxy/si; covar[2][2] = syy/si; covar[2][3] = syz/si;
-    covar[3][1] = sxz/si; covar[3][2] = syz/si; covar[3][3] = szz/si;
+  if (moments.mass != 0.0) {
+    get_covariance_about(&moments, centroid, covar);
     
     return(TRUE);
     
@@ -453,9 +268,12 @@ VIO_BOOL vol_cov(VIO_Volume d1, VIO_Volume m1, float *centroid, float **covar, d
 @CREATED    : Feb 5, 1992 lc
 @MODIFIED   : Thu May 27 16:50:50 EST 1993 lc
                  rewrite for minc files and david's library
+              Oct 18, 2026 - cog and cov in one pass of get_volume_moments()
 ---------------------------------------------------------------------------- */
 VIO_BOOL vol_to_cov(VIO_Volume d1, VIO_Volume m1, float *centroid, float **covar, double *step)
 {
+  Volume_Moments
+    moments;
   int
     i,count[VIO_MAX_DIMENSIONS];
   double 
@@ -483,10 +301,15 @@ VIO_BOOL vol_to_cov(VIO_Volume d1, VIO_Volume m1, float *centroid, float **covar
   }
 
 
-  if ( vol_cog(d1, m1, centroid, step) )
-    
-    return ( vol_cov( d1, m1, centroid, covar, step) );
+  get_volume_moments(1, &d1, &m1, step, main_args->threads, &moments);
+
+  if (moments.mass != 0.0) {
+    for(i=0; i<3; i++)
+      centroid[i+1] = moments.centroid[i];
+    get_covariance_about(&moments, centroid, covar);
 
+    return(TRUE);
+  }
   else
     
     return (FALSE);
@@ -494,6 +317,80 @@ VIO_BOOL vol_to_cov(VIO_Volume d1, VIO_Volume m1, float *centroid, float **covar
 }
 
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_init_cog_and_cov
+@INPUT      : d1,d2,m1,m2,step,verbose,forced_center - as init_transformation()
+              with_d2 - also get the cog and cov of d2
+@OUTPUT     : c1, cov1 - cog of d1 (unless forced_center) and cov about c1
+              c2, cov2 - the same for d2, if with_d2
+@RETURNS    : TRUE if ok, FALSE if error.
+@DESCRIPTION: the moments of both volumes come from a single pass
+              (get_cached_volume_moments()), read from the -moments_cache
+              directory when they were saved there by an earlier run.
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static VIO_BOOL get_init_cog_and_cov(VIO_Volume d1, VIO_Volume d2,
+                                     VIO_Volume m1, VIO_Volume m2,
+                                     double *step,
+                                     int verbose,
+                                     int forced_center,
+                                     VIO_BOOL with_d2,
+                                     float *c1, float **cov1,
+                                     float *c2, float **cov2)
+{
+  VIO_Volume
+    data[2], mask[2];
+  char
+    *data_name[2], *mask_name[2];
+  Volume_Moments
+    moments[2];
+  int
+    i;
+
+  data[0] = d1;  mask[0] = m1;
+  data[1] = d2;  mask[1] = m2;
+  data_name[0] = main_args->filenames.data;   mask_name[0] = main_args->filenames.mask_data;
+  data_name[1] = main_args->filenames.model;  mask_name[1] = main_args->filenames.mask_model;
+
+  get_cached_volume_moments(with_d2 ? 2 : 1, data, mask, data_name, mask_name,
+                            step, main_args->threads, 
+                            main_args->filenames.moments_cache, moments);
+
+  /* =========  COG and COV for volume 1   =======  */
+                                /* if center already set, then don't recalculate */
+  if ( !forced_center) {
+    if (moments[0].mass != 0.0)
+      for(i=0; i<3; i++) c1[i+1] = moments[0].centroid[i];
+    if (verbose>0 && moments[0].mass != 0.0) print ("COG of v1: %f %f %f\n",c1[1],c1[2],c1[3]);
+  }
+  else {
+    if (verbose>0) print ("COG of v1 forced: %f %f %f\n",c1[1],c1[2],c1[3]);
+  }
+  if (moments[0].mass == 0.0) {
+    print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 1.\n" );
+    return(FALSE);
+  }
+  get_covariance_about(&moments[0], c1, cov1);
+
+  /* =========  COG and COV for volume 2 only if needed:   =======  */
+
+  if (with_d2) {
+    if (moments[1].mass == 0.0) {
+      print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 2.\n" );
+      return(FALSE);
+    }
+    for(i=0; i<3; i++) c2[i+1] = moments[1].centroid[i];
+    get_covariance_about(&moments[1], c2, cov2);
+    if (verbose>0) print ("COG of v2: %f %f %f\n",c2[1],c2[2],c2[3]);
+  }
+  else {
+    if (verbose>0) print ("Only center required, now returning from init_transformation\n");
+  }
+
+  return(TRUE);
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : init_transformation - get trans parameters using principal axis
                  transformation technique.  the transformation points in 
@@ -561,7 +458,6 @@ static  VIO_BOOL init_transformation(
     norm;
   
   int
-    stat,
     ndim,i,j;
 
   nr_identf(trans,1,4,1,4);        /* start with identity                       */
@@ -578,35 +474,13 @@ static  VIO_BOOL init_transformation(
   ALLOC(angles     ,4);
   
 
-  stat = TRUE;
+  /* =========  calculate COG and COV for volume 1, and for volume 2 only
+                if needed, in one pass  =======  */
 
-  /* =========  calculate COG and COV for volume 1   =======  */
-                                /* if center already set, then don't recalculate */
-  if ( !forced_center) {
-    stat = vol_cog(d1, m1, c1, step);
-    if (verbose>0 && stat) print ("COG of v1: %f %f %f\n",c1[1],c1[2],c1[3]);
-  }
-  else {
-    if (verbose>0) print ("COG of v1 forced: %f %f %f\n",c1[1],c1[2],c1[3]);
-  }
-  if (!stat || !vol_cov(d1, m1, c1, cov1, step ) ) {
-    print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 1.\n" );
+  if (!get_init_cog_and_cov(d1, d2, m1, m2, step, verbose, forced_center,
+                            flags->estimate_trans || flags->estimate_rots || flags->estimate_scale,
+                            c1, cov1, c2, cov2))
     return(FALSE);
-  }
-
-
-  /* =========  calculate COG and COV for volume 2 only if needed:   =======  */
-
-  if (flags->estimate_trans || flags->estimate_rots || flags->estimate_scale) {
-    if (! vol_to_cov(d2, m2, c2, cov2, step ) ) {
-      print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 2.\n" );
-      return(FALSE);
-    }
-    if (verbose>0) print ("COG of v2: %f %f %f\n",c2[1],c2[2],c2[3]);
-  }
-  else {
-    if (verbose>0) print ("Only center required, now returning from init_transformation\n");
-  }
 
   if (flags->estimate_trans) {
     tx = c2[1] - c1[1];    /* translations to map vol1 into vol2                  */
@@ -871,7 +745,6 @@ static  VIO_BOOL init_transformation_quater(
     norm;
   
   int
-    stat,
     ndim,i,j;
 
   
@@ -890,36 +763,13 @@ static  VIO_BOOL init_transformation_quater(
   for(i=0; i<3; i++) qt[i]=0.0;
   qt[3]=1.0;
 
-  stat = TRUE;
-
-  /* =========  calculate COG and COV for volume 1   =======  */
-
-                                /* if center already set, then don't recalculate */
-  if ( !forced_center) {
-    stat = vol_cog(d1, m1, c1, step);
-    if (verbose>0 && stat) print ("COG of v1: %f %f %f\n",c1[1],c1[2],c1[3]);
-  }
-  else {
-    if (verbose>0) print ("COG of v1 forced: %f %f %f\n",c1[1],c1[2],c1[3]);
-  }
+  /* =========  calculate COG and COV for volume 1, and for volume 2 only
+                if needed, in one pass  =======  */
 
-  if (!stat || !vol_cov(d1, m1, c1, cov1, step ) ) {
-    print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 1\n." );
+  if (!get_init_cog_and_cov(d1, d2, m1, m2, step, verbose, forced_center,
+                            flags->estimate_trans || flags->estimate_quats || flags->estimate_scale,
+                            c1, cov1, c2, cov2))
     return(FALSE);
-  }
-
-  /* =========  calculate COG and COV for volume 2 only if needed:   =======  */
-
-  if (flags->estimate_trans || flags->estimate_quats || flags->estimate_scale) {
-    if (! vol_to_cov(d2, m2, c2, cov2, step ) ) {
-      print_error_and_line_num("%s", __FILE__, __LINE__,"Cannot calculate the COG or COV of volume 2\n." );
-      return(FALSE);
-    }
-    if (verbose>0) print ("COG of v2: %f %f %f\n",c2[1],c2[2],c2[3]);
-  }
-  else {
-    if (verbose>0) print ("Only center required, now returning from init_transformation\n");
-  }
 
   if (flags->estimate_trans) {
     tx = c2[1] - c1[1];    /* translations to map vol1 into vol2                  */
@@ -146,6 +146,37 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 void build_rotmatrix(float **m, double *quat);
 void extract_quaternions(float **m, double *quat);
 
+                                /* a 4x4 matrix of matrix_basics.c (rows
+                                   and columns 1 to 4) on the stack: the
+                                   matrices below are built once per
+                                   evaluation of the objective function,
+                                   and should not cost an allocation */
+typedef struct {
+  float   elem[5][5];
+  float  *row[5];
+} Stack_matrix;
+
+static float **stack_matrix(Stack_matrix *m)
+{
+  int i;
+
+  for(i=0; i<5; i++)
+    m->row[i] = m->elem[i];
+
+  return(m->row);
+}
+
+/* the inverse of the shear matrix of make_shears(), which is unit lower
+   triangular, without the general (and allocating) invertmatrix() */
+
+static void invert_shears(float **SH, float **inverse)
+{
+  nr_identf(inverse,1,4,1,4);
+  inverse[2][1] = -SH[2][1];
+  inverse[3][2] = -SH[3][2];
+  inverse[3][1] = SH[2][1]*SH[3][2] - SH[3][1];
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : make_rots
 @INPUT      : rot_x, rot_y, rot_z - three rotation angles, in radians.
@@ -161,16 +192,13 @@ void extract_quaternions(float **m, double *quat);
 
 void   make_rots(float **xmat, float rot_x, float rot_y, float rot_z)
 {
+   Stack_matrix
+      storage[4];
    float
-      **TRX,
-      **TRY,
-      **TRZ,
-      **T1;
-   
-   VIO_ALLOC2D(TRX  ,5,5);
-   VIO_ALLOC2D(TRY  ,5,5);
-   VIO_ALLOC2D(TRZ  ,5,5);
-   VIO_ALLOC2D(T1   ,5,5);
+      **TRX = stack_matrix(&storage[0]),
+      **TRY = stack_matrix(&storage[1]),
+      **TRZ = stack_matrix(&storage[2]),
+      **T1  = stack_matrix(&storage[3]);
 
    nr_rotxf(TRX, rot_x);             /* create the rotate X matrix */
    nr_rotyf(TRY, rot_y);             /* create the rotate Y matrix */
@@ -179,12 +207,6 @@ void   make_rots(float **xmat, float rot_x, float rot_y, float rot_z)
    nr_multf(TRY,1,4,1,4,  TRX,1,4,1,4,  T1); /* apply rx and ry */
    nr_multf(TRZ,1,4,1,4,  T1,1,4,1,4,   xmat); /* apply rz */
 
-
-   VIO_FREE2D(TRX);
-   VIO_FREE2D(TRY);
-   VIO_FREE2D(TRZ);
-   VIO_FREE2D(T1 );
-
 }
 
 
@@ -243,28 +265,21 @@ void build_transformation_matrix(VIO_Transform *trans,
                                         double *rotations)
 {
   
+  Stack_matrix
+    storage[9];
   float
-    **T,
-    **SH,
-    **S,
-    **R,
-    **C,
-    **T1,
-    **T2,
-    **T3,
-    **T4;
+    **T  = stack_matrix(&storage[0]),
+    **SH = stack_matrix(&storage[1]),
+    **S  = stack_matrix(&storage[2]),
+    **R  = stack_matrix(&storage[3]),
+    **C  = stack_matrix(&storage[4]),
+    **T1 = stack_matrix(&storage[5]),
+    **T2 = stack_matrix(&storage[6]),
+    **T3 = stack_matrix(&storage[7]),
+    **T4 = stack_matrix(&storage[8]);
   int
     i,j;
   
-  VIO_ALLOC2D(T  ,5,5);
-  VIO_ALLOC2D(SH ,5,5);
-  VIO_ALLOC2D(S  ,5,5);
-  VIO_ALLOC2D(R  ,5,5);
-  VIO_ALLOC2D(C  ,5,5);
-  VIO_ALLOC2D(T1 ,5,5);
-  VIO_ALLOC2D(T2 ,5,5);
-  VIO_ALLOC2D(T3 ,5,5);
-  VIO_ALLOC2D(T4 ,5,5);
   
                                              /* mat = (T)(C)(SH)(S)(R)(-C) */
 
@@ -301,15 +316,6 @@ void build_transformation_matrix(VIO_Transform *trans,
     for(j=0; j<4; j++)
       Transform_elem(*trans, i, j ) = T4[i+1][j+1];
 
-  VIO_FREE2D(T    );
-  VIO_FREE2D(SH   );
-  VIO_FREE2D(S    );
-  VIO_FREE2D(R    );
-  VIO_FREE2D(C );
-  VIO_FREE2D(T1   );
-  VIO_FREE2D(T2   );
-  VIO_FREE2D(T3   );
-  VIO_FREE2D(T4   );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -336,16 +342,18 @@ void build_transformation_matrix_quater(VIO_Transform *trans,
                                                double *quaternions)
 {
   
+  Stack_matrix
+    storage[9];
   float
-    **T,
-    **SH,
-    **S,
-    **R,
-    **C,
-    **T1,
-    **T2,
-    **T3,
-    **T4;
+    **T  = stack_matrix(&storage[0]),
+    **SH = stack_matrix(&storage[1]),
+    **S  = stack_matrix(&storage[2]),
+    **R  = stack_matrix(&storage[3]),
+    **C  = stack_matrix(&storage[4]),
+    **T1 = stack_matrix(&storage[5]),
+    **T2 = stack_matrix(&storage[6]),
+    **T3 = stack_matrix(&storage[7]),
+    **T4 = stack_matrix(&storage[8]);
 
   double normal;
 
@@ -353,15 +361,6 @@ void build_transformation_matrix_quater(VIO_Transform *trans,
   int
     i,j;
   
-  VIO_ALLOC2D(T  ,5,5);
-  VIO_ALLOC2D(SH ,5,5);
-  VIO_ALLOC2D(S  ,5,5);
-  VIO_ALLOC2D(R  ,5,5);
-  VIO_ALLOC2D(C  ,5,5);
-  VIO_ALLOC2D(T1 ,5,5);
-  VIO_ALLOC2D(T2 ,5,5);
-  VIO_ALLOC2D(T3 ,5,5);
-  VIO_ALLOC2D(T4 ,5,5);
   
  
   
@@ -416,15 +415,6 @@ void build_transformation_matrix_quater(VIO_Transform *trans,
     for(j=0; j<4; j++)
       Transform_elem(*trans, i, j ) = T4[i+1][j+1];
 
-  VIO_FREE2D(T    );
-  VIO_FREE2D(SH   );
-  VIO_FREE2D(S    );
-  VIO_FREE2D(R    );
-  VIO_FREE2D(C );
-  VIO_FREE2D(T1   );
-  VIO_FREE2D(T2   );
-  VIO_FREE2D(T3   );
-  VIO_FREE2D(T4   );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -452,28 +442,21 @@ void build_inverse_transformation_matrix(VIO_Transform *trans,
                                                 double *shears,
                                                 double *rotations)
 {
+  Stack_matrix
+    storage[9];
   float
-    **T,
-    **SH,
-    **S,
-    **R,
-    **C,
-    **T1,
-    **T2,
-    **T3,
-    **T4;
+    **T  = stack_matrix(&storage[0]),
+    **SH = stack_matrix(&storage[1]),
+    **S  = stack_matrix(&storage[2]),
+    **R  = stack_matrix(&storage[3]),
+    **C  = stack_matrix(&storage[4]),
+    **T1 = stack_matrix(&storage[5]),
+    **T2 = stack_matrix(&storage[6]),
+    **T3 = stack_matrix(&storage[7]),
+    **T4 = stack_matrix(&storage[8]);
   int
     i,j;
   
-  VIO_ALLOC2D(T   ,5,5);
-  VIO_ALLOC2D(SH  ,5,5);
-  VIO_ALLOC2D(S   ,5,5);
-  VIO_ALLOC2D(R   ,5,5);
-  VIO_ALLOC2D(C   ,5,5);
-  VIO_ALLOC2D(T1  ,5,5);
-  VIO_ALLOC2D(T2  ,5,5);
-  VIO_ALLOC2D(T3  ,5,5);
-  VIO_ALLOC2D(T4  ,5,5);
   
                                 /* invmat = (C)(inv(r))(inv(S))(inv(SH))(-C)(-T)
                                    mat = (T)(C)(SH)(S)(R)(-C) */
@@ -494,7 +477,7 @@ void build_inverse_transformation_matrix(VIO_Transform *trans,
   
 
   make_shears(T1,shears);        /* make shear rotation matrix */
-  invertmatrix(4, T1, SH);        /* get inverse of the matrix */
+  invert_shears(T1, SH);          /* get inverse of the matrix */
 
                                 /* make scaling matrix */
   nr_identf(S,1,4,1,4);                   
@@ -519,15 +502,6 @@ void build_inverse_transformation_matrix(VIO_Transform *trans,
     for(j=0; j<4; j++)
       Transform_elem(*trans, i, j ) = T4[i+1][j+1];
 
-  VIO_FREE2D(T    );
-  VIO_FREE2D(SH   );
-  VIO_FREE2D(S    );
-  VIO_FREE2D(R    );
-  VIO_FREE2D(C );
-  VIO_FREE2D(T1   );
-  VIO_FREE2D(T2   );
-  VIO_FREE2D(T3   );
-  VIO_FREE2D(T4   );
 }
 
 
@@ -557,29 +531,22 @@ void build_inverse_transformation_matrix_quater(VIO_Transform *trans,
                                                        double *shears,
                                                        double *quaternions)
 {
+  Stack_matrix
+    storage[9];
   float
-    **T,
-    **SH,
-    **S,
-    **R,
-    **C,
-    **T1,
-    **T2,
-    **T3,
-    **T4;
+    **T  = stack_matrix(&storage[0]),
+    **SH = stack_matrix(&storage[1]),
+    **S  = stack_matrix(&storage[2]),
+    **R  = stack_matrix(&storage[3]),
+    **C  = stack_matrix(&storage[4]),
+    **T1 = stack_matrix(&storage[5]),
+    **T2 = stack_matrix(&storage[6]),
+    **T3 = stack_matrix(&storage[7]),
+    **T4 = stack_matrix(&storage[8]);
 
   int
     i,j;
   
-  VIO_ALLOC2D(T   ,5,5);
-  VIO_ALLOC2D(SH  ,5,5);
-  VIO_ALLOC2D(S   ,5,5);
-  VIO_ALLOC2D(R   ,5,5);
-  VIO_ALLOC2D(C   ,5,5);
-  VIO_ALLOC2D(T1  ,5,5);
-  VIO_ALLOC2D(T2  ,5,5);
-  VIO_ALLOC2D(T3  ,5,5);
-  VIO_ALLOC2D(T4  ,5,5);
   
                                 /* invmat = (C)(inv(r))(inv(S))(inv(SH))(-C)(-T)
                                    mat = (T)(C)(SH)(S)(R)(-C) */
@@ -596,7 +563,7 @@ void build_inverse_transformation_matrix_quater(VIO_Transform *trans,
   
 
   make_shears(T1,shears);        /* make shear rotation matrix */
-  invertmatrix(4, T1, SH);        /* get inverse of the matrix */
+  invert_shears(T1, SH);          /* get inverse of the matrix */
 
                                 /* make scaling matrix */
   nr_identf(S,1,4,1,4);                   
@@ -621,15 +588,6 @@ void build_inverse_transformation_matrix_quater(VIO_Transform *trans,
     for(j=0; j<4; j++)
       Transform_elem(*trans, i, j ) = T4[i+1][j+1];
 
-  VIO_FREE2D(T    );
-  VIO_FREE2D(SH   );
-  VIO_FREE2D(S    );
-  VIO_FREE2D(R    );
-  VIO_FREE2D(C );
-  VIO_FREE2D(T1   );
-  VIO_FREE2D(T2   );
-  VIO_FREE2D(T3   );
-  VIO_FREE2D(T4   );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
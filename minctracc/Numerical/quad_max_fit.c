@@ -72,9 +72,13 @@
 
 ---------------------------------------------------------------------------- */
 
+#include <config.h>
 #include <volume_io.h>                
 #include <math.h>
 #include <quad_max_fit.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define SMALL_EPS 0.000000001
 
@@ -87,6 +91,17 @@ extern int stat_quad_plus;
 extern int stat_quad_minus;
 extern int stat_quad_semi;
 
+                                /* the quad fit is called concurrently
+                                   when estimating nodes with -threads,
+                                   so the stat counters are protected  */
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t stat_quad_lock = PTHREAD_MUTEX_INITIALIZER;
+#define TALLY_QUAD_STAT( stat ) \
+  { pthread_mutex_lock(&stat_quad_lock); (stat)++; pthread_mutex_unlock(&stat_quad_lock); }
+#else
+#define TALLY_QUAD_STAT( stat ) { (stat)++; }
+#endif
+
     /* local prototypes */
 
 static VIO_BOOL negative_2D_definite(deriv_2D_struct *c);
@@ -304,7 +319,7 @@ VIO_BOOL return_3D_disp_from_min_quad_fit(VIO_Real r[3][3][3],
   *dispu = *dispv = *dispw = 0.0;
   estimate_3D_derivatives_new(r,&d);
   hack_to_min_val = FALSE;
-  stat_quad_total++;
+  TALLY_QUAD_STAT(stat_quad_total);
 
   /*    /          \    the values that form the matrix A come from the  */
   /*    | uu uv uw |    second order derivatives in 'd'.  If this matrix */
@@ -322,7 +337,7 @@ VIO_BOOL return_3D_disp_from_min_quad_fit(VIO_Real r[3][3][3],
            d.uw * (d.uv*d.vw - d.vv*d.uw) ;               
                                                        
     if ( fabs( detA ) <= MINIMUM_DET_ALLOWED ) {
-      hack_to_min_val = TRUE; stat_quad_zero++;
+      hack_to_min_val = TRUE; TALLY_QUAD_STAT(stat_quad_zero);
     }
     else {
                                 /* a = inv(A) */
@@ -345,20 +360,20 @@ VIO_BOOL return_3D_disp_from_min_quad_fit(VIO_Real r[3][3][3],
       *dispw = -a[2][0]*d.u - a[2][1]*d.v - a[2][2]*d.w;
 
       if ( fabs( *dispu ) < 2.0 && fabs( *dispv ) < 2.0 && fabs( *dispw ) < 2.0 ) {        
-        stat_quad_plus++; return (TRUE);
+        TALLY_QUAD_STAT(stat_quad_plus); return (TRUE);
       }
       else {
-        hack_to_min_val = TRUE; stat_quad_two++;    
+        hack_to_min_val = TRUE; TALLY_QUAD_STAT(stat_quad_two);    
       }
     }
   }
   else {
     if (positive_3D_semidefinite(&d)) {
-      stat_quad_semi++;
+      TALLY_QUAD_STAT(stat_quad_semi);
       /* get_disp_from_positive_semidefinite(&d, dispu, dispv, dispw); */
     }
     else{
-      stat_quad_minus++;;
+      TALLY_QUAD_STAT(stat_quad_minus);
       hack_to_min_val = TRUE;    
     }
   }
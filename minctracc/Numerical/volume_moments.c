@@ -0,0 +1,523 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : volume_moments.c
+@DESCRIPTION: the mass, centre of gravity and covariance of the source and
+              target volumes, for the principal axes transformation of
+              init_params.c.
+
+              Both volumes are sampled in one parallel pass: the slices
+              of the lattice of each volume (set_up_lattice() at the
+              requested step) are shared among threads, and each slice
+              keeps running moments updated sample by sample (weighted
+              Welford updates, so that the covariance does not come from
+              the difference of two large sums).  The slices are then
+              merged in order, so that the result does not depend on the
+              number of threads.
+
+              With -moments_cache <dir>, the moments of a volume read from
+              a file are saved in <dir>, in a small text file keyed by the
+              size and checksum of the volume file and of its mask file,
+              the lattice step, the interpolant and the size of the
+              volume in memory (smaller with -crop_volumes).  A template
+              used as the target of many runs then has its moments
+              computed once.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <stdio.h>
+#include <string.h>
+#include "constants.h"
+#include "minctracc_arg_data.h"
+#include "local_macros.h"
+#include "thread_support.h"
+#include "mask_spans.h"
+#include "volume_moments.h"
+
+extern Arg_Data *main_args;
+
+int point_not_masked(VIO_Volume volume,
+                     VIO_Real wx, VIO_Real wy, VIO_Real wz);
+
+void set_up_lattice(VIO_Volume data,       /* in: volume  */
+                    double *user_step, /* in: user requested spacing for lattice */
+                    double *start,     /* out:world starting position of lattice  in volume dircos coords*/
+                    double *wstart,     /* out:world starting position of lattice */
+                    int    *count,     /* out:number of steps in each direction */
+                    double *step,      /* out:step size in each direction */
+                    VectorR directions[]);/* out: vector directions for each index*/
+
+                                /* the sampling lattice of one volume */
+typedef struct {
+  VIO_Volume  data, mask;
+  int         count[VIO_MAX_DIMENSIONS];
+  PointR      starting_position;
+  VectorR     directions[VIO_MAX_DIMENSIONS]; /* scaled by the step */
+  int         first_item;       /* of its slices in the items of the pass */
+} Moments_Lattice;
+
+                                /* running moments: mass, mean and the
+                                   sums of the products of deviations  */
+typedef struct {
+  VIO_Real  w;
+  VIO_Real  mean[3];
+  VIO_Real  c[3][3];
+} Running_Moments;
+
+typedef struct {
+  int               n_volumes;
+  Moments_Lattice   lattice[2];
+  Running_Moments  *items;      /* one per slice of each lattice */
+} Moments_Work;
+
+static void clear_running_moments(Running_Moments *m)
+{
+  int i, j;
+
+  m->w = 0.0;
+  for(i=0; i<3; i++) {
+    m->mean[i] = 0.0;
+    for(j=0; j<3; j++)
+      m->c[i][j] = 0.0;
+  }
+}
+
+/* add the point x of weight w (West's weighted form of Welford's
+   update); a point that would bring the mass to exactly zero (only
+   possible with negative intensities) is skipped */
+
+static void add_to_running_moments(Running_Moments *m, VIO_Real x[], VIO_Real w)
+{
+  VIO_Real w_new, delta[3];
+  int      i, j;
+
+  w_new = m->w + w;
+  if (w == 0.0 || w_new == 0.0)
+    return;
+
+  for(i=0; i<3; i++) {
+    delta[i]    = x[i] - m->mean[i];
+    m->mean[i] += delta[i] * w / w_new;
+  }
+  for(i=0; i<3; i++)
+    for(j=0; j<3; j++)
+      m->c[i][j] += w * delta[i] * (x[j] - m->mean[j]);
+
+  m->w = w_new;
+}
+
+/* merge b into a (Chan et al.) */
+
+static void merge_running_moments(Running_Moments *a, Running_Moments *b)
+{
+  VIO_Real w, delta[3];
+  int      i, j;
+
+  if (b->w == 0.0)
+    return;
+  if (a->w == 0.0) {
+    *a = *b;
+    return;
+  }
+  w = a->w + b->w;
+  if (w == 0.0)
+    return;
+
+  for(i=0; i<3; i++)
+    delta[i] = b->mean[i] - a->mean[i];
+  for(i=0; i<3; i++)
+    for(j=0; j<3; j++)
+      a->c[i][j] += b->c[i][j] + delta[i] * delta[j] * a->w * b->w / w;
+  for(i=0; i<3; i++)
+    a->mean[i] += delta[i] * b->w / w;
+
+  a->w = w;
+}
+
+/* the items are the slices of the first lattice, then those of the
+   second */
+
+static void moments_of_slices(void *data, int thread, int first, int last)
+{
+  Moments_Work
+    *work = (Moments_Work *)data;
+  Moments_Lattice
+    *lattice;
+  Running_Moments
+    *m;
+  VectorR
+    vector_step;
+  PointR
+    slice, row, col, voxel;
+  Mask_Row
+    mask_row;
+  VIO_Real
+    tx, ty, tz, x[3],
+    true_value;
+  int
+    item, v, r, c, s;
+
+  for(item=first; item<last; item++) {
+
+    v = (work->n_volumes > 1 && item >= work->lattice[1].first_item) ? 1 : 0;
+    lattice = &work->lattice[v];
+    s = item - lattice->first_item;
+    m = &work->items[item];
+
+    clear_running_moments(m);
+
+    SCALE_VECTOR( vector_step, lattice->directions[SLICE_IND], s);
+    ADD_POINT_VECTOR( slice, lattice->starting_position, vector_step );
+
+    for(r=0; r<lattice->count[ROW_IND]; r++) {
+
+      SCALE_VECTOR( vector_step, lattice->directions[ROW_IND], r);
+      ADD_POINT_VECTOR( row, slice, vector_step );
+
+      SCALE_POINT( col, row, 1.0); /* init first col position */
+      get_mask_row(lattice->mask, TRUE, &row, &lattice->directions[COL_IND],
+                   lattice->count[COL_IND], &mask_row);
+
+      for(c=0; c<lattice->count[COL_IND]; c++) {
+
+        if (node_in_mask_row(&mask_row, c) &&
+            point_not_masked(lattice->mask, Point_x(col), Point_y(col), Point_z(col))) {
+
+          convert_3D_world_to_voxel(lattice->data, Point_x(col), Point_y(col), Point_z(col),
+                                    &tx, &ty, &tz);
+          fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
+
+          if (INTERPOLATE_TRUE_VALUE( lattice->data, &voxel, &true_value )) {
+            x[0] = Point_x(col);
+            x[1] = Point_y(col);
+            x[2] = Point_z(col);
+            add_to_running_moments(m, x, true_value);
+          }
+          /* else requested voxel is just outside volume., so ignore it */
+        }
+
+        ADD_POINT_VECTOR( col, col, lattice->directions[COL_IND] );
+      }
+    }
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_volume_moments
+@INPUT      : n_volumes - 1 or 2
+              data      - the volumes
+              mask      - their masks (NULL entries for none)
+              step      - the x,y,z spacing of the lattices
+              n_threads - for the pass
+@OUTPUT     : moments   - of each volume; a mass of 0 when no sample of
+                          the lattice was found in the volume and mask
+@RETURNS    :
+@DESCRIPTION: one pass over the lattices of all the volumes, see above.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void get_volume_moments(int n_volumes,
+                        VIO_Volume data[],
+                        VIO_Volume mask[],
+                        double *step,
+                        int n_threads,
+                        Volume_Moments moments[])
+{
+  Moments_Work
+    work;
+  Moments_Lattice
+    *lattice;
+  Running_Moments
+    total;
+  double
+    start[VIO_MAX_DIMENSIONS],
+    wstart[VIO_MAX_DIMENSIONS],
+    local_step[VIO_MAX_DIMENSIONS];
+  VectorR
+    directions[VIO_MAX_DIMENSIONS];
+  int
+    v, i, j, n_items;
+
+  work.n_volumes = n_volumes;
+  n_items = 0;
+
+  for(v=0; v<n_volumes; v++) {
+    lattice = &work.lattice[v];
+    lattice->data = data[v];
+    lattice->mask = mask[v];
+
+                                /* build default sampling lattice info
+                                   on the data set                    */
+    set_up_lattice(data[v], step, start, wstart, lattice->count, local_step, directions);
+
+    for(i=0; i<3; i++) {
+      Point_x(lattice->directions[i]) = Point_x(directions[i]) * local_step[i];
+      Point_y(lattice->directions[i]) = Point_y(directions[i]) * local_step[i];
+      Point_z(lattice->directions[i]) = Point_z(directions[i]) * local_step[i];
+    }
+    fill_Point( lattice->starting_position, wstart[0], wstart[1], wstart[2]);
+
+    lattice->first_item = n_items;
+    n_items += MAX(lattice->count[SLICE_IND], 0);
+  }
+
+  ALLOC(work.items, MAX(n_items, 1));
+
+  run_in_parallel(n_threads, n_items, 1, moments_of_slices, (void *)&work);
+
+  for(v=0; v<n_volumes; v++) {
+    clear_running_moments(&total);
+    for(i=0; i<MAX(work.lattice[v].count[SLICE_IND], 0); i++)
+      merge_running_moments(&total, &work.items[work.lattice[v].first_item + i]);
+
+    moments[v].mass = total.w;
+    for(i=0; i<3; i++) {
+      moments[v].centroid[i] = total.mean[i];
+      for(j=0; j<3; j++)
+        moments[v].covariance[i][j] = (total.w != 0.0) ? total.c[i][j] / total.w : 0.0;
+    }
+  }
+
+  FREE(work.items);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_covariance_about
+@INPUT      : moments
+              center - a point (in zero offset form, 1 to 3)
+@OUTPUT     : covar  - the mass normalized second moments about center
+                       (in zero offset form, 1 to 3 by 1 to 3), as
+                       vol_cov() computes them
+@RETURNS    :
+@DESCRIPTION: covariance about the centroid, plus the outer product of
+              the offset between the centroid and center.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void get_covariance_about(Volume_Moments *moments,
+                          float *center,
+                          float **covar)
+{
+  VIO_Real offset[3];
+  int      i, j;
+
+  for(i=0; i<3; i++)
+    offset[i] = moments->centroid[i] - center[i+1];
+
+  for(i=0; i<3; i++)
+    for(j=0; j<3; j++)
+      covar[i+1][j+1] = moments->covariance[i][j] + offset[i] * offset[j];
+}
+
+                                /* what the moments of a volume depend on */
+typedef struct {
+  long           data_size, mask_size;
+  unsigned long  data_checksum, mask_checksum;
+  double         step[3];
+  int            interpolant;
+  int            sizes[3];      /* of the volume, as cropped */
+} Moments_Key;
+
+/* the size and FNV-1a checksum (32 bits) of the bytes of the file name;
+   FALSE if it cannot be read */
+
+static VIO_BOOL checksum_file(char *name, long *size, unsigned long *checksum)
+{
+  FILE          *file;
+  unsigned char  buffer[65536];
+  size_t         n, i;
+  unsigned long  h;
+
+  if ((file = fopen(name, "rb")) == NULL)
+    return(FALSE);
+
+  h = 2166136261UL;
+  *size = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    for(i=0; i<n; i++) {
+      h ^= buffer[i];
+      h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    *size += (long)n;
+  }
+  fclose(file);
+
+  *checksum = h;
+  return(TRUE);
+}
+
+static VIO_BOOL get_moments_key(VIO_Volume data, char *data_name,
+                                VIO_Volume mask, char *mask_name,
+                                double *step, Moments_Key *key)
+{
+  int i;
+
+  if (data_name == NULL || strlen(data_name) == 0 ||
+      !checksum_file(data_name, &key->data_size, &key->data_checksum))
+    return(FALSE);
+
+  key->mask_size     = 0;
+  key->mask_checksum = 0;
+  if (mask != NULL &&
+      (mask_name == NULL || strlen(mask_name) == 0 ||
+       !checksum_file(mask_name, &key->mask_size, &key->mask_checksum)))
+    return(FALSE);
+
+  for(i=0; i<3; i++)
+    key->step[i] = step[i];
+  key->interpolant = (int)main_args->interpolant_type;
+  get_volume_sizes(data, key->sizes);
+
+  return(TRUE);
+}
+
+static void get_moments_file_name(char *cache_dir, Moments_Key *key, char *file_name)
+{
+  (void)sprintf(file_name, "%s/moments_%ld_%08lx_%ld_%08lx.txt", cache_dir,
+                key->data_size, key->data_checksum,
+                key->mask_size, key->mask_checksum);
+}
+
+/* TRUE if file_name holds the moments of key */
+
+static VIO_BOOL read_cached_moments(char *file_name, Moments_Key *key,
+                                    Volume_Moments *moments)
+{
+  FILE          *file;
+  Moments_Key    stored;
+  int            i, n;
+
+  if ((file = fopen(file_name, "r")) == NULL)
+    return(FALSE);
+
+  n = fscanf(file, " minctracc_volume_moments data %ld %lx mask %ld %lx step %lg %lg %lg interpolant %d sizes %d %d %d",
+             &stored.data_size, &stored.data_checksum,
+             &stored.mask_size, &stored.mask_checksum,
+             &stored.step[0], &stored.step[1], &stored.step[2],
+             &stored.interpolant,
+             &stored.sizes[0], &stored.sizes[1], &stored.sizes[2]);
+  if (n == 11)
+    n += fscanf(file, " mass %lg centroid %lg %lg %lg", &moments->mass,
+                &moments->centroid[0], &moments->centroid[1], &moments->centroid[2]);
+  if (n == 15) {
+    (void)fscanf(file, " covariance");
+    for(i=0; i<9; i++)
+      n += fscanf(file, " %lg", &moments->covariance[i/3][i%3]);
+  }
+  fclose(file);
+
+  return( n == 24 &&
+          stored.data_size == key->data_size &&
+          stored.data_checksum == key->data_checksum &&
+          stored.mask_size == key->mask_size &&
+          stored.mask_checksum == key->mask_checksum &&
+          stored.step[0] == key->step[0] &&
+          stored.step[1] == key->step[1] &&
+          stored.step[2] == key->step[2] &&
+          stored.interpolant == key->interpolant &&
+          stored.sizes[0] == key->sizes[0] &&
+          stored.sizes[1] == key->sizes[1] &&
+          stored.sizes[2] == key->sizes[2] );
+}
+
+static void write_cached_moments(char *file_name, Moments_Key *key,
+                                 Volume_Moments *moments)
+{
+  FILE *file;
+  int   i;
+
+  if ((file = fopen(file_name, "w")) == NULL) {
+    print ("Cannot write the moments cache file %s\n", file_name);
+    return;
+  }
+
+  (void)fprintf(file, "minctracc_volume_moments\n");
+  (void)fprintf(file, "data %ld %08lx\n", key->data_size, key->data_checksum);
+  (void)fprintf(file, "mask %ld %08lx\n", key->mask_size, key->mask_checksum);
+  (void)fprintf(file, "step %.17g %.17g %.17g\n", key->step[0], key->step[1], key->step[2]);
+  (void)fprintf(file, "interpolant %d\n", key->interpolant);
+  (void)fprintf(file, "sizes %d %d %d\n", key->sizes[0], key->sizes[1], key->sizes[2]);
+  (void)fprintf(file, "mass %.17g\n", moments->mass);
+  (void)fprintf(file, "centroid %.17g %.17g %.17g\n",
+                moments->centroid[0], moments->centroid[1], moments->centroid[2]);
+  (void)fprintf(file, "covariance");
+  for(i=0; i<9; i++)
+    (void)fprintf(file, " %.17g", moments->covariance[i/3][i%3]);
+  (void)fprintf(file, "\n");
+
+  fclose(file);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_cached_volume_moments
+@INPUT      : n_volumes, data, mask, step, n_threads - as get_volume_moments()
+              data_name - the file each volume was read from ("" if none)
+              mask_name - the file each mask was read from
+              cache_dir - directory of the cache ("" for no cache)
+@OUTPUT     : moments
+@RETURNS    :
+@DESCRIPTION: the moments of the volumes found in the cache are read from
+              it; the others are computed in one pass, and saved in the
+              cache if their files are known.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void get_cached_volume_moments(int n_volumes,
+                               VIO_Volume data[],
+                               VIO_Volume mask[],
+                               char *data_name[],
+                               char *mask_name[],
+                               double *step,
+                               int n_threads,
+                               char *cache_dir,
+                               Volume_Moments moments[])
+{
+  Moments_Key
+    key[2];
+  VIO_BOOL
+    keyed[2];
+  char
+    file_name[2][1024];
+  VIO_Volume
+    todo_data[2], todo_mask[2];
+  Volume_Moments
+    todo_moments[2];
+  int
+    v, todo[2], n_todo;
+
+  n_todo = 0;
+  for(v=0; v<n_volumes; v++) {
+    keyed[v] = (cache_dir != NULL && strlen(cache_dir) > 0 &&
+                strlen(cache_dir) < 900 &&
+                get_moments_key(data[v], data_name[v], mask[v], mask_name[v], step, &key[v]));
+
+    if (keyed[v]) {
+      get_moments_file_name(cache_dir, &key[v], file_name[v]);
+      if (read_cached_moments(file_name[v], &key[v], &moments[v])) {
+        if (main_args->flags.debug)
+          print ("Moments of %s read from %s\n", data_name[v], file_name[v]);
+        continue;
+      }
+    }
+
+    todo[n_todo]      = v;
+    todo_data[n_todo] = data[v];
+    todo_mask[n_todo] = mask[v];
+    n_todo++;
+  }
+
+  if (n_todo == 0)
+    return;
+
+  get_volume_moments(n_todo, todo_data, todo_mask, step, n_threads, todo_moments);
+
+  for(v=0; v<n_todo; v++) {
+    moments[todo[v]] = todo_moments[v];
+    if (keyed[todo[v]] && todo_moments[v].mass != 0.0) {
+      write_cached_moments(file_name[todo[v]], &key[todo[v]], &todo_moments[v]);
+      if (main_args->flags.debug)
+        print ("Moments of %s saved in %s\n", data_name[todo[v]], file_name[todo[v]]);
+    }
+  }
+}
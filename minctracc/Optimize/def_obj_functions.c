@@ -57,49 +57,25 @@
 #include "constants.h"
 #include <minctracc_arg_data.h>           /* definition of the global data struct      */
 #include <Proglib.h>
+#include "nonlin_context.h"
+#include "sub_lattice.h"
 
 
 /* GLOBALS used within these functions: */
 
 extern int 
   number_dimensions;            /* from do_nonlinear.c */
-extern Arg_Data 
-  *Gglobals;                    /* from do_nonlinear.c */
-extern float
-  *Gsqrt_features,
-  **Ga1_features,
-  *TX, *TY, *TZ;                /* from do_nonlinear.c */
-extern VIO_BOOL 
-  **masked_samples_in_source;  /* from do_nonlinear.c */
-extern int 
-  Glen;                         /* from do_nonlinear.c */
-extern VIO_Real                     /* from do_nonlinear.c */
-  Gtarget_vox_x, Gtarget_vox_y, Gtarget_vox_z,
-  Gproj_d1,  Gproj_d1x,  Gproj_d1y,  Gproj_d1z, 
-  Gproj_d2,  Gproj_d2x,  Gproj_d2y,  Gproj_d2z;
 extern double
   similarity_cost_ratio;
-extern VIO_Real     
-  Gcost_radius;                 /* from do_nonlinear.c */
 int 
   nearest_neighbour_interpolant(VIO_Volume volume, 
                                 PointR *coord, double *result);
-int target_sample_count=0;
 
 void from_param_to_grid_weights(
    VIO_Real p[],
    VIO_Real grid[]);
 
 
-float go_get_samples_with_offset(VIO_Volume data, VIO_Volume model_mask,
-                                        float *x, float *y, float *z,
-                                        VIO_Real  dx, VIO_Real  dy, VIO_Real dz,
-                                        int obj_func,
-                                        int len, int *sample_count,
-                                        float sqrt_s1, float *a1, VIO_BOOL *m1,
-                                        VIO_BOOL use_nearest_neighbour);
-
-
 /* This is the COST FUNCTION TO BE MINIMIZED.
    so that very large displacements are impossible */
 
@@ -136,12 +112,14 @@ static VIO_Real cost_fn(float x, float y, float z, VIO_Real max_length)
          D[3] stores the zdisp
 */
 
-static VIO_Real similarity_fn(float *d)
+static VIO_Real similarity_fn(Nonlin_Context *context, float *d)
 {
   int i;
   VIO_Real
     norm,
     s, func_sim;
+  Arg_Data
+    *globals;
    
   /* note: here the displacement order for go_get_samples_with_offset
      is 3,2,1 (=Z,Y,X) since the source and target volumes are stored in
@@ -152,30 +130,31 @@ static VIO_Real similarity_fn(float *d)
      and d[2] in 2D (d[3] stays const=0). */
   
   s = norm = 0.0;
+  globals = context->globals;
     
-  for(i=0; i<Gglobals->features.number_of_features; i++)  {
+  for(i=0; i<globals->features.number_of_features; i++)  {
 
                                 /* ignore OPTICAL FLOW objective functions, since it is
                                    computed directly and _not_ optimized */
 
-    if (Gglobals->features.obj_func[i] != NONLIN_OPTICALFLOW) {
+    if (globals->features.obj_func[i] != NONLIN_OPTICALFLOW) {
       func_sim = 
-        (VIO_Real)go_get_samples_with_offset(Gglobals->features.model[i],
-                Gglobals->features.model_mask[i],
-                                         TX,TY,TZ,
+        (VIO_Real)go_get_samples_with_offset(globals->features.model[i],
+                globals->features.model_mask[i],
+                                         context->TX,context->TY,context->TZ,
                                          d[3], d[2], d[1],
-                                         Gglobals->features.obj_func[i],
-                                         Glen, &target_sample_count,
-                                         Gsqrt_features[i], Ga1_features[i],
-                masked_samples_in_source[i],
-                                         Gglobals->interpolant==nearest_neighbour_interpolant);
+                                         globals->features.obj_func[i],
+                                         context->len, &context->target_sample_count,
+                                         context->sqrt_features[i], context->a1_features[i],
+                context->masked_samples_in_source[i],
+                                         globals->interpolant==nearest_neighbour_interpolant);
       
 
-      norm += fabs(Gglobals->features.weight[i]);
-      s += Gglobals->features.weight[i] * func_sim;
+      norm += fabs(globals->features.weight[i]);
+      s += globals->features.weight[i] * func_sim;
       
       /*
-        if ((Gglobals->features.obj_func[i]==NONLIN_CHAMFER) && (func_sim > 1.5))
+        if ((globals->features.obj_func[i]==NONLIN_CHAMFER) && (func_sim > 1.5))
         do nothing, do not add the chamfer distance info 
       */
       
@@ -196,7 +175,7 @@ static VIO_Real similarity_fn(float *d)
    this is the objective function that needs to be minimized 
    to give a local deformation
 */
-VIO_Real local_objective_function(float *d)
+VIO_Real local_objective_function(Nonlin_Context *context, float *d)
      
 {
   VIO_Real
@@ -204,8 +183,8 @@ VIO_Real local_objective_function(float *d)
     cost, 
     r;
   
-  similarity = (VIO_Real)similarity_fn( d );
-  cost       = (VIO_Real)cost_fn( d[1], d[2], d[3], Gcost_radius );
+  similarity = (VIO_Real)similarity_fn( context, d );
+  cost       = (VIO_Real)cost_fn( d[1], d[2], d[3], context->cost_radius );
   
   r = 1.0 - 
       similarity * similarity_cost_ratio + 
@@ -215,10 +194,83 @@ VIO_Real local_objective_function(float *d)
 }
 
 
+/* 
+   the same objective function, evaluated for n_offsets displacements
+   at once: r[k] = local_objective_function(context, d[k]).  The
+   similarity of all displacements is computed in a single pass over
+   the sub-lattice (see go_get_samples_with_offsets()), which is what
+   makes the quadratic fit affordable.
+*/
+void local_objective_function_at_offsets(Nonlin_Context *context,
+                                         int n_offsets,
+                                         float d[][4],
+                                         VIO_Real r[])
+{
+  int i,k;
+  VIO_Real
+    norm,
+    similarity[MAX_SUB_LATTICE_OFFSETS],
+    dx[MAX_SUB_LATTICE_OFFSETS],
+    dy[MAX_SUB_LATTICE_OFFSETS],
+    dz[MAX_SUB_LATTICE_OFFSETS],
+    cost;
+  float
+    func_sim[MAX_SUB_LATTICE_OFFSETS];
+  Arg_Data
+    *globals;
+
+  globals = context->globals;
+  norm = 0.0;
+
+  for(k=0; k<n_offsets; k++) {
+    similarity[k] = 0.0;
+    dx[k] = d[k][3];            /* Z,Y,X order, as in similarity_fn() */
+    dy[k] = d[k][2];
+    dz[k] = d[k][1];
+  }
+
+  for(i=0; i<globals->features.number_of_features; i++)  {
+
+    if (globals->features.obj_func[i] != NONLIN_OPTICALFLOW) {
+
+      go_get_samples_with_offsets(globals->features.model[i],
+                                  globals->features.model_mask[i],
+                                  context->TX,context->TY,context->TZ,
+                                  n_offsets, dx, dy, dz,
+                                  globals->features.obj_func[i],
+                                  context->len,
+                                  context->sqrt_features[i], context->a1_features[i],
+                                  context->masked_samples_in_source[i],
+                                  globals->interpolant==nearest_neighbour_interpolant,
+                                  func_sim);
+
+      norm += fabs(globals->features.weight[i]);
+      for(k=0; k<n_offsets; k++)
+        similarity[k] += globals->features.weight[i] * (VIO_Real)func_sim[k];
+    }
+  }
+
+  if (norm <= 0.0) 
+    print_error_and_line_num("The feature weights are null.", 
+                             __FILE__, __LINE__);
+
+  for(k=0; k<n_offsets; k++) {
+    similarity[k] = similarity[k] / norm;
+    cost = (VIO_Real)cost_fn( d[k][1], d[k][2], d[k][3], context->cost_radius );
+
+    r[k] = 1.0 - 
+      similarity[k] * similarity_cost_ratio + 
+      cost          * (1.0-similarity_cost_ratio);
+  }
+}
+
+
 /*  
-    amoeba_NL_obj_function() is minimized in the amoeba() optimization function
+    amoeba_NL_obj_function() is minimized in the amoeba() optimization function,
+    the Nonlin_Context of the calling thread comes in as the amoeba's
+    function_data.
 */
-VIO_Real amoeba_NL_obj_function(void * dummy, float d[])
+VIO_Real amoeba_NL_obj_function(void * context, float d[])
 {
   int i;
   float p[4];
@@ -238,7 +290,7 @@ VIO_Real amoeba_NL_obj_function(void * dummy, float d[])
     p[i+1] = (float)grid_weights[i];
 
 
-  obj_func_val =  local_objective_function(p);
+  obj_func_val =  local_objective_function((Nonlin_Context *)context, p);
 
 
   return ( obj_func_val );
@@ -234,6 +234,12 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include "local_macros.h"
 #include "constants.h"
 #include "interpolation.h"
+#include "mask_spans.h"
+#include "sampling_kernels.h"
+#include "deformation_field.h"
+#include "thread_support.h"
+#include "warp_buffers.h"
+#include "perf_report.h"
 
 extern Arg_Data *main_args;
 
@@ -253,6 +259,9 @@ int trilinear_interpolant(VIO_Volume volume,
 int nearest_neighbour_interpolant(VIO_Volume volume, 
                                          PointR *coord, double *result);
 
+int point_not_masked(VIO_Volume volume, 
+                     VIO_Real wx, VIO_Real wy, VIO_Real wz);
+
 VIO_Real get_volume_maximum_real_value(VIO_Volume volume);
 
 VIO_Real get_coeff_from_neighbours(VIO_General_transform *trans,
@@ -508,6 +517,8 @@ void add_additional_warp_to_current(VIO_General_transform *additional,
     i;
   VIO_Real 
     additional_value, current_value;
+  Warp_Buffer
+    additional_buffer, current_buffer;
 
 
   if (get_volume_n_dimensions(additional->displacement_volume) != 
@@ -534,6 +545,14 @@ void add_additional_warp_to_current(VIO_General_transform *additional,
     }
   }
 
+                                /* same sizes and order: add the two
+                                   buffers value by value */
+  if (get_warp_buffer(additional->displacement_volume, &additional_buffer) &&
+      get_warp_buffer(current->displacement_volume, &current_buffer)) {
+    add_warp_buffers(&additional_buffer, &current_buffer, weight, main_args->threads);
+    return;
+  }
+
   for(i=0; i<VIO_MAX_DIMENSIONS; i++) index[i]=0;
 
   for(index[xyzv_additional[VIO_X]]=0; index[xyzv_additional[VIO_X]]<count[xyzv_additional[VIO_X]]; index[xyzv_additional[VIO_X]]++)
@@ -600,6 +619,8 @@ void smooth_the_warp(VIO_General_transform *smoothed,
     mx, my, mz,smoothing;
   VIO_progress_struct
     progress;
+  Warp_Buffer
+    smoothed_buffer, current_buffer;
   
   
   if (get_volume_n_dimensions(smoothed->displacement_volume) != 
@@ -646,6 +667,13 @@ void smooth_the_warp(VIO_General_transform *smoothed,
   start[VIO_Z+1] = 0;
   end[VIO_Z+1] = 3;
   
+  if (smoothed->displacement_volume != current->displacement_volume &&
+      get_warp_buffer(smoothed->displacement_volume, &smoothed_buffer) &&
+      get_warp_buffer(current->displacement_volume, &current_buffer)) {
+    smooth_warp_buffer(&smoothed_buffer, &current_buffer, start, end,
+                       smoothing_weight, main_args->threads);
+    return;
+  }
   
   initialize_progress_report( &progress, FALSE, 
 			      (end[VIO_X]-start[VIO_X])*
@@ -779,6 +807,8 @@ void extrapolate_to_unestimated_nodes(VIO_General_transform *current,
     mx, my, mz;
   VIO_progress_struct
     progress;
+  Warp_Buffer
+    current_buffer, additional_buffer;
 
   extrapolated = many = total = 0;
 
@@ -834,6 +864,16 @@ void extrapolate_to_unestimated_nodes(VIO_General_transform *current,
   get_voxel_spatial_loop_limits(additional->displacement_volume, start, end);
   start[VIO_Z+1] = 0;
   end[VIO_Z+1]   = 3;
+
+  if (current->displacement_volume != additional->displacement_volume &&
+      get_warp_buffer(current->displacement_volume, &current_buffer) &&
+      get_warp_buffer(additional->displacement_volume, &additional_buffer)) {
+    extrapolate_warp_buffer(&current_buffer, &additional_buffer, estimated_flag_vol,
+                            start, end, main_args->threads,
+                            &total, &many, &extrapolated);
+    print ("There were %d out of %d extrapolated (%d left) (%d extrapolated)\n",many,total,total-many, extrapolated);
+    return;
+  }
  
   initialize_progress_report( &progress, FALSE, 
                              (end[VIO_X]-start[VIO_X])*
@@ -1105,124 +1145,352 @@ void build_two_perpendicular_vectors(VIO_Real orig[],
                 __FILE__, __LINE__);
 }
 
-float xcorr_objective_with_def(VIO_Volume d1,
-                                      VIO_Volume d2,
-                                      VIO_Volume m1,
-                                      VIO_Volume m2, 
-                                      Arg_Data *globals)
+                                /* per-thread storage for one row of the
+                                   lattice of xcorr_objective_with_def() */
+typedef struct {
+  double   *vx, *vy, *vz;       /* voxel coordinates of the points      */
+  double   *value1, *value2;    /* their values in d1 and d2            */
+  VIO_BOOL *used;               /* not masked, and inside so far        */
+  double   *px, *py, *pz;       /* for interpolate_points()             */
+  double   *samples;
+  int      *list;
+} Row_Buffers;
+
+static void alloc_row_buffers(Row_Buffers *buffers, int n)
 {
+  ALLOC(buffers->vx, n);
+  ALLOC(buffers->vy, n);
+  ALLOC(buffers->vz, n);
+  ALLOC(buffers->value1, n);
+  ALLOC(buffers->value2, n);
+  ALLOC(buffers->used, n);
+  ALLOC(buffers->px, n);
+  ALLOC(buffers->py, n);
+  ALLOC(buffers->pz, n);
+  ALLOC(buffers->samples, n);
+  ALLOC(buffers->list, n);
+}
 
-  VectorR
-    slice_dir,
-    row_dir,
-    col_dir,
-    vector_step;
-
-  PointR
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2,
-    voxel;
+static void free_row_buffers(Row_Buffers *buffers)
+{
+  FREE(buffers->vx);
+  FREE(buffers->vy);
+  FREE(buffers->vz);
+  FREE(buffers->value1);
+  FREE(buffers->value2);
+  FREE(buffers->used);
+  FREE(buffers->px);
+  FREE(buffers->py);
+  FREE(buffers->pz);
+  FREE(buffers->samples);
+  FREE(buffers->list);
+}
 
-  double
-    tx,ty,tz;
-  int
-    r,c,s;
+                                /* everything needed by the threads to
+                                   compute the correlation of
+                                   xcorr_objective_with_def(), one slice of
+                                   the lattice at a time               */
+typedef struct {
+  VIO_Volume   d1, d2, m1, m2;
+  Arg_Data    *globals;
+  int          stride;          /* sample every stride'th lattice point */
+  int          n_cols;          /* points per row                      */
+  VectorR      col_step;        /* from one point of a row to the next */
+
+  VIO_BOOL     split;           /* TRUE: apply linear_map, then warp   */
+  Affine_Map   linear_map;
+  VIO_General_transform *warp;
+
+  VIO_Real    *sums;            /* s1,s2,s3 of each slice              */
+  int         *counts;          /* count1,count2 and the # of points
+                                   interpolated in d1, of each slice   */
+  Row_Buffers *buffers;         /* one per thread                      */
+} Xcorr_Work;
+
+/* map a lattice point (world coordinates of d1) into the world
+   coordinates of d2 */
+
+static void transform_lattice_point(Xcorr_Work *work,
+                                    VIO_Real x, VIO_Real y, VIO_Real z,
+                                    VIO_Real *tx, VIO_Real *ty, VIO_Real *tz)
+{
+  if (work->split) {
+    apply_affine_map(work->linear_map, x, y, z, &x, &y, &z);
+    general_transform_point(work->warp, x, y, z, tx, ty, tz);
+  }
+  else
+    general_transform_point(work->globals->trans_info.transformation,
+                            x, y, z, tx, ty, tz);
+}
 
-  VIO_Real
-    sign_x,sign_y,sign_z,
-    value1, value2;
-  
-  VIO_Real
-    s1,s2,s3;                   /* to store the sums for f1,f2,f3 */
-  float 
-    result;                                /* the result */
-  int 
-    count1,count2;
+/* interpolate volume at the n voxel positions (x[c],y[c],z[c]) for
+   which used[c] is TRUE; used[c] is cleared where the interpolant
+   fails.  When the trilinear interpolant is selected, the points where
+   it needs no special handling of the edges are interpolated together
+   with trilinear_samples_at_points(), the others one at a time. */
 
+static void interpolate_points(VIO_Volume volume, int n,
+                               double x[], double y[], double z[],
+                               VIO_BOOL used[], double values[],
+                               Row_Buffers *buffers)
+{
+  PointR      voxel;
+  Voxel_Array voxels;
+  int         c, m;
+  double      *px, *py, *pz;
+
+  if (main_args->interpolant != trilinear_interpolant ||
+      !get_voxel_array(volume, &voxels)) {
+    for(c=0; c<n; c++)
+      if (used[c]) {
+        fill_Point( voxel, x[c], y[c], z[c] );
+        used[c] = INTERPOLATE_TRUE_VALUE( volume, &voxel, &values[c] );
+      }
+    return;
+  }
 
+  px = buffers->px;
+  py = buffers->py;
+  pz = buffers->pz;
+
+  m = 0;
+  for(c=0; c<n; c++) {
+    if (!used[c]) continue;
+
+    if (x[c] >= 0 && x[c] < voxels.sizes[0]-1 &&
+        y[c] >= 0 && y[c] < voxels.sizes[1]-1 &&
+        z[c] >= 0 && z[c] < voxels.sizes[2]-1) {
+      px[m] = x[c];
+      py[m] = y[c];
+      pz[m] = z[c];
+      buffers->list[m] = c;
+      m++;
+    }
+    else {
+      fill_Point( voxel, x[c], y[c], z[c] );
+      used[c] = INTERPOLATE_TRUE_VALUE( volume, &voxel, &values[c] );
+    }
+  }
 
+  trilinear_samples_at_points(&voxels, m, px, py, pz, buffers->samples);
 
+  for(c=0; c<m; c++)
+    values[ buffers->list[c] ] = buffers->samples[c];
+}
 
-  fill_Point( starting_position, globals->start[VIO_X], globals->start[VIO_Y], globals->start[VIO_Z]);
+/* add the contribution of the row of lattice points starting at row
+   to sums[] and counts[] */
 
+static void sample_lattice_row(Xcorr_Work *work, int thread, PointR *row,
+                               VIO_Real sums[], int counts[])
+{
+  Row_Buffers *buffers;
+  PointR      col;
+  Mask_Row    mask_row;
+  VIO_Real    tx, ty, tz;
+  double      *vx, *vy, *vz, *value1, *value2;
+  VIO_BOOL    *used;
+  int         c, n;
+
+  n       = work->n_cols;
+  buffers = &work->buffers[thread];
+
+  vx     = buffers->vx;
+  vy     = buffers->vy;
+  vz     = buffers->vz;
+  value1 = buffers->value1;
+  value2 = buffers->value2;
+  used   = buffers->used;
+
+                                /* the points of the row in d1 */
+  get_mask_row(work->m1, TRUE, row, &work->col_step, n, &mask_row);
+
+  col = *row;
+  for(c=0; c<n; c++) {
+    used[c] = node_in_mask_row(&mask_row, c) &&
+              point_not_masked(work->m1, Point_x(col), Point_y(col), Point_z(col));
+    if (used[c])
+      counts[2]++;
+    convert_3D_world_to_voxel(work->d1, Point_x(col), Point_y(col), Point_z(col),
+                              &vx[c], &vy[c], &vz[c]);
+    ADD_POINT_VECTOR( col, col, work->col_step );
+  }
 
-  s1 = s2 = s3 = 0.0;
-  count1 = count2 = 0;
+  interpolate_points(work->d1, n, vx, vy, vz, used, value1, buffers);
+
+                                /* and their homologs in d2 */
+  col = *row;
+  for(c=0; c<n; c++) {
+    if (used[c]) {
+      counts[0]++;
+
+      transform_lattice_point(work, Point_x(col), Point_y(col), Point_z(col),
+                              &tx, &ty, &tz);
+      used[c] = point_not_masked(work->m2, tx, ty, tz);
+      convert_3D_world_to_voxel(work->d2, tx, ty, tz, &vx[c], &vy[c], &vz[c]);
+    }
+    ADD_POINT_VECTOR( col, col, work->col_step );
+  }
+
+  interpolate_points(work->d2, n, vx, vy, vz, used, value2, buffers);
+
+  for(c=0; c<n; c++)
+    if (used[c] &&
+        value1[c] > work->globals->threshold[0] &&
+        value2[c] > work->globals->threshold[1] ) {
+      counts[1]++;
+
+      sums[0] += value1[c]*value2[c];
+      sums[1] += value1[c]*value1[c];
+      sums[2] += value2[c]*value2[c];
+    }
+}
+
+/* Parallel_Function: the slices first..last-1 of the (strided) lattice */
+
+static void sample_lattice_slices(void *data, int thread, int first, int last)
+{
+  Xcorr_Work *work;
+  Arg_Data   *globals;
+  VectorR     vector_step;
+  PointR      starting_position, slice, row;
+  VIO_Real    sign_y, sign_z;
+  int         i, s, r;
+
+  work    = (Xcorr_Work *)data;
+  globals = work->globals;
+
+  fill_Point( starting_position, globals->start[VIO_X], globals->start[VIO_Y], globals->start[VIO_Z]);
 
-  if (globals->step[VIO_X] > 0 ) sign_x = 1.0; else sign_x = -1.0;
   if (globals->step[VIO_Y] > 0 ) sign_y = 1.0; else sign_y = -1.0;
   if (globals->step[VIO_Z] > 0 ) sign_z = 1.0; else sign_z = -1.0;
 
-  for(s=0; s<=globals->count[VIO_Z]; s++) {
+  for(i=first; i<last; i++) {
+
+    work->sums[3*i] = work->sums[3*i+1] = work->sums[3*i+2] = 0.0;
+    work->counts[3*i] = work->counts[3*i+1] = work->counts[3*i+2] = 0;
 
+    s = i * work->stride;
     SCALE_VECTOR( vector_step, globals->directions[VIO_Z], s*sign_z);
     ADD_POINT_VECTOR( slice, starting_position, vector_step );
 
+    for(r=0; r<=globals->count[VIO_Y]; r+=work->stride) {
 
-    for(r=0; r<=globals->count[VIO_Y]; r++) {
-      
       SCALE_VECTOR( vector_step, globals->directions[VIO_Y], r*sign_y);
       ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<=globals->count[VIO_X]; c++) {
-        
-
-        convert_3D_world_to_voxel(d1, Point_x(col), Point_y(col), Point_z(col), &tx, &ty, &tz);
 
-  
-        
-        fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
-        
-        if (point_not_masked(m1, Point_x(col), Point_y(col), Point_z(col))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
+      sample_lattice_row(work, thread, &row, &work->sums[3*i], &work->counts[3*i]);
+    }
+  }
+}
 
-            count1++;
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : xcorr_objective_with_def
+@INPUT      : d1,d2:
+                source and target volumes
+              m1,m2:
+                their masks (or NULL)
+              globals:
+                the sampling lattice, thresholds and current transformation
+@OUTPUT     :
+@RETURNS    : 1 - normalized cross-correlation of d1 and d2 over the
+              lattice, after transformation of the points into d2.
+@DESCRIPTION: used to report progress of the nonlinear fit.  The slices of
+              the lattice are shared by globals->threads threads; the sums
+              of each slice are kept apart and added up in slice order, so
+              that the result does not depend on the number of threads.
+              With -progress_stride n, only every n'th point along each
+              axis of the lattice is used.
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+float xcorr_objective_with_def(VIO_Volume d1,
+                                      VIO_Volume d2,
+                                      VIO_Volume m1,
+                                      VIO_Volume m2, 
+                                      Arg_Data *globals)
+{
+  Xcorr_Work
+    work;
+  Affine_Map
+    inverse_map;
+  VIO_General_transform
+    *transformation;
+  VIO_Real
+    sign_x,
+    s1,s2,s3;                   /* to store the sums for f1,f2,f3 */
+  float 
+    result;                                /* the result */
+  int 
+    count1,count2,
+    n_slices, n_threads, i,
+    perf_phase;
+  long
+    n_samples;                  /* points interpolated in d1 */
+
+  perf_phase = begin_perf_phase("progress_correlation");
+
+  work.d1      = d1;
+  work.d2      = d2;
+  work.m1      = m1;
+  work.m2      = m2;
+  work.globals = globals;
+  work.stride  = MAX(globals->progress_stride, 1);
+  work.n_cols  = globals->count[VIO_X] / work.stride + 1;
 
-            DO_TRANSFORM(pos2, globals->trans_info.transformation, col);
-            
-            convert_3D_world_to_voxel(d2, Point_x(pos2), Point_y(pos2), Point_z(pos2), &tx, &ty, &tz);
-            
-            fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
-        
-            if (point_not_masked(m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
+  if (globals->step[VIO_X] > 0 ) sign_x = 1.0; else sign_x = -1.0;
+  SCALE_VECTOR( work.col_step, globals->directions[VIO_X], sign_x * work.stride);
+
+                                /* the fit is done on a grid transform
+                                   following a linear one: apply the
+                                   linear part from its matrix.  The
+                                   grid part stays with volume_io, so
+                                   that the correlation is that of the
+                                   transformation that is written out */
+  transformation = globals->trans_info.transformation;
+  work.split = (get_transform_type(transformation) == CONCATENATED_TRANSFORM &&
+                get_n_concated_transforms(transformation) == 2 &&
+                !transformation->inverse_flag &&
+                get_linear_transform_maps(get_nth_general_transform(transformation, 0),
+                                          work.linear_map, inverse_map));
+  if (work.split)
+    work.warp = get_nth_general_transform(transformation, 1);
+
+  n_slices  = globals->count[VIO_Z] / work.stride + 1;
+  n_threads = get_number_of_threads_to_use(globals->threads, n_slices);
+
+  ALLOC(work.sums,   3*n_slices);
+  ALLOC(work.counts, 3*n_slices);
+  ALLOC(work.buffers, n_threads);
+  for(i=0; i<n_threads; i++)
+    alloc_row_buffers(&work.buffers[i], work.n_cols);
+
+  run_in_parallel(n_threads, n_slices, 1, sample_lattice_slices, (void *)&work);
 
+  s1 = s2 = s3 = 0.0;
+  count1 = count2 = n_samples = 0;
+  for(i=0; i<n_slices; i++) {
+    s1 += work.sums[3*i];
+    s2 += work.sums[3*i+1];
+    s3 += work.sums[3*i+2];
+    count1 += work.counts[3*i];
+    count2 += work.counts[3*i+1];
+    n_samples += work.counts[3*i+2];
+  }
 
-                if (value1 > globals->threshold[0] && value2 > globals->threshold[1] ) {
-                  
-                  count2++;
+  for(i=0; i<n_threads; i++)
+    free_row_buffers(&work.buffers[i]);
+  FREE(work.buffers);
+  FREE(work.sums);
+  FREE(work.counts);
 
-                  s1 += value1*value2;
-                  s2 += value1*value1;
-                  s3 += value2*value2;
-                  
-                } 
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        if (sign_x > 0) {
-          ADD_POINT_VECTOR( col, col, globals->directions[VIO_X] );
-        }
-        else {
-          SUB_POINT_VECTOR( col, col, globals->directions[VIO_X] );
-        }
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
-  
   result = 1.0 - s1 / (sqrt((double)s2)*sqrt((double)s3));
   
   if (globals->flags.debug) (void)print ("%7d %7d -> %10.8f\n",count1,count2,result);
+
+  add_to_perf_counter(PERF_OBJECTIVE_EVALUATIONS, 1);
+  add_to_perf_counter(PERF_INTERPOLATED_SAMPLES, n_samples);
+  end_perf_phase(perf_phase);
   
   return (result);
   
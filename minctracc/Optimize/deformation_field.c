@@ -0,0 +1,205 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : deformation_field.c
+@DESCRIPTION: a float copy of a GRID_TRANSFORM displacement volume, for
+              fast look-ups while the nodes are estimated.
+
+              The displacement volume of a GRID_TRANSFORM is a 4D volume
+              whose dimension order depends on the file it came from, and
+              every read through GET_VALUE_4D() or convert_world_to_voxel()
+              goes through the generic volume_io code.  Here the three
+              components are kept in three separate float arrays, in X, Y,
+              Z node order, along with the world to node map of the
+              volume, so that a look-up costs one affine map and three
+              loads (see nearest_deformation() in deformation_field.h).
+
+              When the volume already holds floats in that order (vector
+              dimension first, X last, as for the super-sampled warp made
+              by create_super_sampled_data_volumes()), the three arrays
+              are its own voxels and nothing is copied.  Otherwise the
+              volume stays the reference: it is what the optimization
+              updates and smooths, and what is saved, and the copy is
+              refreshed with update_deformation_field() each time the
+              volume changes.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "deformation_field.h"
+
+void get_volume_XYZV_indices(VIO_Volume data, int xyzv[]);
+
+/* copy the 3 rows of an affine VIO_Transform; FALSE if it is not affine */
+
+static VIO_BOOL get_affine_map(VIO_Transform *transform, Affine_Map map)
+{
+  int i, j;
+
+  if (Transform_elem(*transform,3,0) != 0.0 ||
+      Transform_elem(*transform,3,1) != 0.0 ||
+      Transform_elem(*transform,3,2) != 0.0 ||
+      Transform_elem(*transform,3,3) != 1.0)
+    return(FALSE);
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    for(j=0; j<4; j++)
+      map[i][j] = Transform_elem(*transform,i,j);
+
+  return(TRUE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_linear_transform_maps
+@INPUT      : transform
+@OUTPUT     : forward - the map applied by general_transform_point()
+              inverse - the map applied by general_inverse_transform_point()
+@RETURNS    : TRUE if transform is a single affine LINEAR transform, FALSE
+              otherwise (and the maps are not set)
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_linear_transform_maps(VIO_General_transform *transform,
+                                   Affine_Map forward,
+                                   Affine_Map inverse)
+{
+  if (transform == NULL || get_transform_type(transform) != LINEAR)
+    return(FALSE);
+
+  return(get_affine_map(get_linear_transform_ptr(transform),         forward) &&
+         get_affine_map(get_inverse_linear_transform_ptr(transform), inverse));
+}
+
+/* the float voxels of displacement_volume, if they are stored in a
+   single block with the vector dimension first and X last */
+
+static float *get_float_voxels(VIO_Volume displacement_volume,
+                               int sizes[], int xyzv[])
+{
+  float ****voxels;
+
+  if (get_volume_n_dimensions(displacement_volume) != 4 ||
+      get_volume_data_type(displacement_volume) != VIO_FLOAT ||
+      volume_is_cached(displacement_volume) ||
+      VOXEL_DATA(displacement_volume) == NULL ||
+      xyzv[VIO_Z+1] != 0 || xyzv[VIO_Z] != 1 || xyzv[VIO_Y] != 2 || xyzv[VIO_X] != 3 ||
+      sizes[0] != VIO_N_DIMENSIONS)
+    return(NULL);
+
+  voxels = (float ****)VOXEL_DATA(displacement_volume);
+
+  if (&voxels[sizes[0]-1][sizes[1]-1][sizes[2]-1][sizes[3]-1] - &voxels[0][0][0][0] !=
+      (long)sizes[0] * sizes[1] * sizes[2] * sizes[3] - 1)
+    return(NULL);
+
+  return(&voxels[0][0][0][0]);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : make_deformation_field
+@INPUT      : displacement_volume - the 4D volume of a GRID_TRANSFORM
+@OUTPUT     : field
+@RETURNS    :
+@DESCRIPTION: set up field for the nodes of displacement_volume: on the
+              voxels of the volume when they can be used as they are (see
+              get_float_voxels()), otherwise on a copy of its current
+              displacements.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void make_deformation_field(Deformation_Field *field, VIO_Volume displacement_volume)
+{
+  VIO_General_transform *voxel_to_world;
+  int   xyzv[VIO_MAX_DIMENSIONS], sizes[VIO_MAX_DIMENSIONS];
+  long  n_nodes;
+  float *voxels;
+  int   i;
+
+  get_volume_sizes(displacement_volume, sizes);
+  get_volume_XYZV_indices(displacement_volume, xyzv);
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    field->count[i] = sizes[ xyzv[i] ];
+
+                                /* convert_world_to_voxel() applies the
+                                   inverse of this transform, and returns
+                                   the X, Y, Z voxel coordinates in the
+                                   same order */
+  voxel_to_world = get_voxel_to_world_transform(displacement_volume);
+
+  if (get_transform_type(voxel_to_world) != LINEAR ||
+      !get_affine_map(get_inverse_linear_transform_ptr(voxel_to_world),
+                      field->world_to_grid))
+    print_error_and_line_num("Deformation field with a non-affine voxel to world transform",
+                             __FILE__, __LINE__);
+
+  n_nodes = (long)field->count[VIO_X] * field->count[VIO_Y] * field->count[VIO_Z];
+
+  voxels = get_float_voxels(displacement_volume, sizes, xyzv);
+  field->is_copy = (voxels == NULL);
+
+  if (field->is_copy) {
+    ALLOC(field->dx, n_nodes);
+    ALLOC(field->dy, n_nodes);
+    ALLOC(field->dz, n_nodes);
+    update_deformation_field(field, displacement_volume);
+  }
+  else {
+    field->dx = voxels;
+    field->dy = voxels + n_nodes;
+    field->dz = voxels + 2*n_nodes;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : update_deformation_field
+@INPUT      : displacement_volume - the volume given to make_deformation_field()
+@OUTPUT     : field
+@RETURNS    :
+@DESCRIPTION: copy the current displacements of the volume into field;
+              nothing to do when field is on the voxels of the volume.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void update_deformation_field(Deformation_Field *field, VIO_Volume displacement_volume)
+{
+  int      xyzv[VIO_MAX_DIMENSIONS], index[VIO_MAX_DIMENSIONS];
+  VIO_Real value;
+  float   *component[VIO_N_DIMENSIONS];
+  long     n;
+
+  if (!field->is_copy)
+    return;
+
+  get_volume_XYZV_indices(displacement_volume, xyzv);
+
+  component[VIO_X] = field->dx;
+  component[VIO_Y] = field->dy;
+  component[VIO_Z] = field->dz;
+
+  for(n=0; n<VIO_MAX_DIMENSIONS; n++) index[n] = 0;
+
+  n = 0;
+  for(index[xyzv[VIO_Z]]=0; index[xyzv[VIO_Z]]<field->count[VIO_Z]; index[xyzv[VIO_Z]]++)
+    for(index[xyzv[VIO_Y]]=0; index[xyzv[VIO_Y]]<field->count[VIO_Y]; index[xyzv[VIO_Y]]++)
+      for(index[xyzv[VIO_X]]=0; index[xyzv[VIO_X]]<field->count[VIO_X]; index[xyzv[VIO_X]]++) {
+
+        for(index[xyzv[VIO_Z+1]]=0; index[xyzv[VIO_Z+1]]<VIO_N_DIMENSIONS; index[xyzv[VIO_Z+1]]++) {
+          GET_VALUE_4D(value, displacement_volume,
+                       index[0], index[1], index[2], index[3]);
+          component[ index[xyzv[VIO_Z+1]] ][n] = (float)value;
+        }
+        n++;
+      }
+}
+
+void delete_deformation_field(Deformation_Field *field)
+{
+  if (field->is_copy) {
+    FREE(field->dx);
+    FREE(field->dy);
+    FREE(field->dz);
+  }
+}
@@ -382,6 +382,10 @@ time_t time(time_t *tloc);
 #include <sub_lattice.h>        /* prototypes for sub_lattice manipulation   */
 #include <extras.h>             /* prototypes for extra convienience routines*/
 #include <quad_max_fit.h>       /* prototypes for quadratic fitting routines */
+#include <nonlin_context.h>     /* per-thread state for node estimation      */
+#include <thread_support.h>     /* to estimate nodes in parallel             */
+#include <deformation_field.h>   /* float copy of the super-sampled warp      */
+#include <perf_report.h>        /* phase timing and counters for -perf_report */
 
 
 
@@ -409,43 +413,57 @@ static stats_struct
    stat_eigval1,
    stat_eigval2;
 
-                                /* these Globals are used to communicate to
-                                   the correlation functions over top the
-                                   SIMPLEX optimization routine */
-
-float  *Gsqrt_features=NULL;                /* normalization const for correlation       */
-float  **Ga1_features=NULL;                /* samples in source sub-lattice             */
-VIO_BOOL **masked_samples_in_source=NULL;   /* masked samples in source sub-lattice */
-float  *TX=NULL; 
-float  *TY=NULL; 
-float  *TZ=NULL;                /* sample sub-lattice positions in target    */
-
-static float *SX=NULL; 
-static float *SY=NULL; 
-static float *SZ=NULL;                /* sample sub-lattice positions in source    */
-
-int 
-  Glen = 0;                                /* # of samples in sub-lattice               */
-
-
-         /* these Globals are used to communicate the projection */
-         /* values over top the SIMPLEX optimization  routine    */ 
-
-VIO_Real  Gtarget_vox_x = 0.0;
-VIO_Real  Gtarget_vox_y = 0.0;
-VIO_Real  Gtarget_vox_z = 0.0;
-VIO_Real  Gproj_d1      = 0.0;
-VIO_Real  Gproj_d1x     = 0.0;
-VIO_Real  Gproj_d1y     = 0.0;
-VIO_Real  Gproj_d1z     = 0.0;
-VIO_Real  Gproj_d2      = 0.0;
-VIO_Real  Gproj_d2x     = 0.0;
-VIO_Real  Gproj_d2y     = 0.0;
-VIO_Real  Gproj_d2z     = 0.0;
-
-        /* Globals used for local simplex Optimization  */
-static VIO_Real     Gsimplex_size=0.0;        /* the radius of the local simplex           */
-VIO_Real     Gcost_radius=0.0;        /* constant used in the cost function        */
+                                /* the sub-lattice data and the simplex
+                                   radius used by the correlation
+                                   functions over top the SIMPLEX
+                                   optimization routine are kept in a
+                                   Nonlin_Context, one per thread
+                                   (see nonlin_context.h)               */
+
+                                /* the outcome of the estimation for a
+                                   single node.  All nodes of an x-slice
+                                   are estimated (possibly in parallel)
+                                   before their results are stored and
+                                   the stats tallied, in the same node
+                                   order as a serial run.               */
+#define NODE_SKIPPED    0       /* masked, below threshold or at the edge */
+#define NODE_NO_DEF     1       /* tried, but no deformation was found    */
+#define NODE_ESTIMATED  2       /* deformation found                      */
+
+typedef struct {
+  int       status;             /* one of NODE_{SKIPPED,NO_DEF,ESTIMATED} */
+  VIO_Real  result;             /* magnitude of additional warp vector    */
+  int       nfunks;             /* number of obj function evaluations     */
+  long      samples;            /* lattice points visited by them         */
+  VIO_Real  def_vector[3];      /* value to store in additional_vol       */
+  VIO_Real  another_vector[3];  /* value to store in another_vol          */
+  VIO_BOOL  eig_found;          /* non-isotropic smoothing stats, if any  */
+  VIO_Real  eig_vals[3];
+  VIO_Real  conf[3];
+} Node_Estimate;
+
+                                /* everything needed by the threads to
+                                   estimate the nodes of one x-slice   */
+typedef struct {
+  Arg_Data              *globals;
+  VIO_General_transform *current_warp;
+  VIO_Volume             current_vol;
+  int                   *xyzv, *start, *end;
+  int                    x_index;       /* index[xyzv[VIO_X]] of the slice */
+  VIO_Real               spacing;
+  VIO_Real               threshold1, threshold2;
+  int                    iteration;
+  int                    ndim;
+  VIO_BOOL               sub_lattice_needed;
+  Nonlin_Context        *contexts;      /* one per thread                  */
+  Node_Estimate         *estimates;     /* one per node of the slice       */
+} Slice_Estimation;
+
+                                /* number of nodes handed to a thread at
+                                   once; small, since the cost of a node
+                                   varies wildly (masked nodes are almost
+                                   free)                                */
+#define NODES_PER_CHUNK 4
 
         /* Globals used to split the input transformation into a
            linear part and a super-sampled non-linear part */
@@ -454,13 +472,21 @@ VIO_General_transform *Gsuper_sampled_warp = NULL;
 VIO_General_transform *Glinear_transform = NULL;
 VIO_Volume  Gsuper_sampled_vol;
 
+        /* the float displacements of Gsuper_sampled_vol, and the
+           matrices of Glinear_transform when it is a single affine
+           transform */
+
+Deformation_Field Gsuper_sampled_field;
+VIO_BOOL    Glinear_is_affine = FALSE;
+Affine_Map  Glinear_map, Glinear_inverse_map;
+
 
         /* VIO_Volume order definition for super sampled data */
 static char *my_XYZ_dim_names[] = { MIxspace, MIyspace, MIzspace };
 
 
         /* program Global data used to store all info regarding data
-           and transformations  */
+           and transformations (only read while nodes are estimated) */
 Arg_Data *Gglobals;
 
 
@@ -533,13 +559,10 @@ static VIO_Real
 
  void  terminate_amoeba( amoeba_struct  *amoeba );
 
- VIO_Real amoeba_NL_obj_function(void * dummy, float d[]);
-
 #define AMOEBA_ITERATION_LIMIT  400 /* max number of iterations for amoeba */
 
- VIO_Real local_objective_function(float *x);
-
-static VIO_Real get_deformation_vector_for_node(VIO_Real spacing, VIO_Real threshold1, 
+static VIO_Real get_deformation_vector_for_node(Nonlin_Context *context,
+                                             VIO_Real spacing, VIO_Real threshold1, 
                                              VIO_Real source_coord[],
                                              VIO_Real mean_target[],
                                              VIO_Real def_vector[],
@@ -549,7 +572,9 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing, VIO_Real thres
                                              int ndim,
                                              VIO_BOOL sub_lattice_needed);
 
-static double return_locally_smoothed_def(int  isotropic_smoothing,
+static double return_locally_smoothed_def(Nonlin_Context *context,
+                                         Node_Estimate *estimate,
+                                         int  isotropic_smoothing,
                                          int  ndim,
                                          VIO_Real smoothing_wght,
                                          VIO_Real iteration_wght,
@@ -563,6 +588,7 @@ static double return_locally_smoothed_def(int  isotropic_smoothing,
 
 
 static VIO_BOOL get_best_start_from_neighbours(
+                                               Arg_Data *globals,
                                                VIO_Real threshold1, 
                                                VIO_Real source[],
                                                VIO_Real mean_target[],
@@ -600,7 +626,8 @@ int nearest_neighbour_interpolant(VIO_Volume volume,
 static VIO_BOOL is_a_sub_lattice_needed (char obj_func[],
                                          int  number_of_features);
 
-static VIO_BOOL build_lattices(VIO_Real spacing, 
+static VIO_BOOL build_lattices(Nonlin_Context *context,
+                               VIO_Real spacing, 
                                VIO_Real threshold, 
                                VIO_Real source_coord[],
                                VIO_Real mean_target[],
@@ -627,7 +654,8 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
                                      VIO_Volume model,
                                      int ndim);
 
-static VIO_Real get_chamfer_vector(VIO_Real threshold1, 
+static VIO_Real get_chamfer_vector(Arg_Data *globals,
+                                VIO_Real threshold1, 
                                 VIO_Real source_coord[],
                                 VIO_Real mean_target[],
                                 VIO_Real def_vector[],
@@ -656,6 +684,16 @@ void map_def_from_grid_space(VIO_Real g0,
                                     VIO_Real *dy,
                                     VIO_Real *dz);
 
+static void init_nonlin_context(Nonlin_Context *context,
+                                Arg_Data *globals,
+                                VIO_Real simplex_size,
+                                VIO_Real cost_radius);
+
+static void delete_nonlin_context(Nonlin_Context *context);
+
+static void estimate_nodes_in_slice(void *slice_estimation,
+                                    int thread, int first, int last);
+
 
 
 /**************************************************************************/
@@ -680,7 +718,8 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
       iteration_start_time,        /* variables to time each iteration                   */
       temp_start_time,
       timer1,timer2,
-      nfunk_total;
+      nfunk_total,
+      nfunk_tried, samples;     /* over all the nodes tried, for -perf_report */
 
    int 
      num_of_dims_to_optimize,
@@ -692,11 +731,15 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
       end[VIO_MAX_DIMENSIONS],        /* ending limit of index[]                      */
       debug_sizes[VIO_MAX_DIMENSIONS],
       iters,                        /* iteration counter */
-      i,j,k,ff,ff_count,
+      i,j,k,
       nodes_done, nodes_tried,        /* variables to calc stats on deformation estim  */
       nodes_seen, over,
-      nfunks, nfunk1, nodes1,
-      sub_lattice_needed;
+      nfunk1, nodes1,
+      setup_phase, iteration_phase, perf_phase,
+      sub_lattice_needed,
+      n_threads,                /* number of threads estimating nodes           */
+      n_nodes, nz, n,                /* nodes in an x-slice, and in a z-row          */
+      lattice_len;                /* # of samples in a source sub-lattice         */
 
    VIO_Real 
 
@@ -714,31 +757,28 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                 /* variables to calc stats on deformation estim  */
       mag, mean_disp_mag, std, 
 
-      another_vector[3],        
       current_def_vector[3],        /* the current deformation vector for a  node    */
-      result_def_vector[3],        /* the smoothed deformation vector for a node    */
-      def_vector[3],                /* the additional deformation estimated for node,
-                                   for these three vectors in real world coords
-                                   index [0] stores the x disp, and [2] the z disp */
-      voxel_displacement[VIO_N_DIMENSIONS],    /* the additional displacement, in voxel coords 
-                                   with [0] storing the displacement of the
-                                   fastest varying index, and [2] the slowest in
-                                   the data voluming = xdim and zdim respectively*/
       wx,wy,wz,                        /* temporary storage for a world coordinate      */
-      source_node[3],                /* world coordinate of source node               */
       target_node[3],                /* world coordinate of corresponding target node */
-      mean_target[3],                /* mean deformed pos, determined by neighbors    */
-      mean_vector[3],                /* mean deformed vector, determined by neighbors */
       threshold1,                /* intensity thresh for source vol               */
       threshold2,                /* intensity thresh for target vol               */
-      result,                        /* magnitude of additional warp vector           */
-      eig1;
+      simplex_size,                /* radius of the local simplex (data voxels)     */
+      cost_radius;                /* constant used in the cost function            */
 
    VIO_progress_struct                /* to print out program progress report */
       progress;
 
    VIO_STR filenamestring;
-   VIO_BOOL condition;
+
+   Slice_Estimation                /* the work shared by the threads          */
+      slice;
+   Nonlin_Context
+      *contexts;                /* per-thread sub-lattices and samples     */
+   Source_Lattice_Cache
+      source_cache;             /* source sub-lattices kept between iterations */
+   Node_Estimate
+      *estimates,                /* results for all nodes of an x-slice     */
+      *estimate;
 
   /*******************************************************************************/
 
@@ -748,6 +788,8 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
 
    Gglobals= globals;
    current_def_vector[0]=current_def_vector[1]=current_def_vector[2]=0.0;
+
+   setup_phase = begin_perf_phase("nonlinear_setup");
    
    /* pour eviter d'avoir une option -2Dnonlin ou 3d le fcalcul se fait directement */
    num_of_dims_to_optimize = 0;
@@ -761,12 +803,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                                    external variable */
 
 
-   /* allocate space required for some globals */
-
    if (Gglobals->features.number_of_features > 0) {
-      VIO_ALLOC2D (Ga1_features, Gglobals->features.number_of_features, MAX_G_LEN+1);
-      VIO_ALLOC2D (masked_samples_in_source, Gglobals->features.number_of_features, MAX_G_LEN+1);
-      ALLOC( Gsqrt_features, Gglobals->features.number_of_features);
 
       sub_lattice_needed = is_a_sub_lattice_needed (Gglobals->features.obj_func,
                                                     Gglobals->features.number_of_features);
@@ -797,13 +834,6 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                               __FILE__, __LINE__);
    }
 
-   ALLOC(SX,MAX_G_LEN+1);        /* and coordinates in source volume  */
-   ALLOC(SY,MAX_G_LEN+1);
-   ALLOC(SZ,MAX_G_LEN+1);
-   ALLOC(TX,MAX_G_LEN+1);        /* and coordinates in target volume  */
-   ALLOC(TY,MAX_G_LEN+1);
-   ALLOC(TZ,MAX_G_LEN+1);
-
    /* split the total transformation into the first linear part and the
       last non-linear def.  */  
    split_up_the_transformation(globals->trans_info.transformation,
@@ -817,6 +847,8 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
    }
                                 /* set up linear part of transformation   */
    Glinear_transform = all_until_last; 
+   Glinear_is_affine = get_linear_transform_maps(Glinear_transform,
+                                                 Glinear_map, Glinear_inverse_map);
 
                                 /* print some debugging info    */
    if (globals->flags.debug) {        
@@ -887,17 +919,17 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
    get_volume_separations(Gglobals->features.model[0], steps_data);
    
    if (steps_data[0]!=0.0) {
-                                /* Gsimplex_size is in voxel units
+                                /* simplex_size is in voxel units
                                    in the data volume.             */
 
      for(i=0; i<VIO_N_DIMENSIONS; i++) {step_magnitude[i] = fabs(steps_data[i]); }
 
-      Gsimplex_size= fabs(steps[xyzv[VIO_X]]) / MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2]);  
+      simplex_size= fabs(steps[xyzv[VIO_X]]) / MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2]);  
 
-      if (fabs(Gsimplex_size) < fabs(steps_data[0]) && globals->flags.verbose>0) {
+      if (fabs(simplex_size) < fabs(steps_data[0]) && globals->flags.verbose>0) {
          print ("*** WARNING ***\n");
          print ("Simplex size will be smaller than data voxel size (%f < %f)\n",
-                Gsimplex_size,steps_data[0]);
+                simplex_size,steps_data[0]);
       }
    }
    else
@@ -961,6 +993,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                       Gsuper_sampled_warp,
                                       globals->trans_info.use_super);
     Gsuper_sampled_vol = Gsuper_sampled_warp->displacement_volume;
+    make_deformation_field(&Gsuper_sampled_field, Gsuper_sampled_vol);
 
 
 
@@ -1001,7 +1034,58 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                 /* set up other parameters needed
                                    for non linear fitting */
 
-  Gcost_radius = 8*Gsimplex_size*Gsimplex_size*Gsimplex_size;
+  cost_radius = 8*simplex_size*simplex_size*simplex_size;
+
+                                /* each thread estimating nodes owns
+                                   its own sub-lattices and samples  */
+
+  n_nodes   = (end[VIO_Y]-start[VIO_Y])*(end[VIO_Z]-start[VIO_Z]);
+  nz        = end[VIO_Z]-start[VIO_Z];
+  n_threads = get_number_of_threads_to_use(globals->threads, n_nodes);
+
+  ALLOC(contexts, n_threads);
+  for(i=0; i<n_threads; i++)
+    init_nonlin_context(&contexts[i], globals, simplex_size, cost_radius);
+  ALLOC(estimates, MAX(n_nodes,1));
+
+                                /* the source side of the sub-lattices does
+                                   not change from one iteration to the
+                                   next, so keep it for as many nodes as
+                                   the memory cap allows.  All source
+                                   sub-lattices have the same number of
+                                   samples, wherever they are built.  */
+  lattice_len = 0;
+  if (sub_lattice_needed)
+    build_source_lattice(0.0, 0.0, 0.0,
+                         contexts[0].SX, contexts[0].SY, contexts[0].SZ,
+                         globals->lattice_width[VIO_X],globals->lattice_width[VIO_Y],globals->lattice_width[VIO_Z],
+                         Diameter_of_local_lattice,  
+                         Diameter_of_local_lattice,  
+                         Diameter_of_local_lattice,
+                         number_dimensions, &lattice_len);
+
+  init_source_lattice_cache(&source_cache,
+                            (end[VIO_X]-start[VIO_X])*n_nodes,
+                            lattice_len,
+                            globals->features.number_of_features,
+                            globals->source_cache_size);
+  for(i=0; i<n_threads; i++)
+    contexts[i].source_cache = &source_cache;
+
+  if (globals->flags.debug && sub_lattice_needed)
+    print("Source lattice cache : %d of %d nodes (%d samples each)\n",
+          source_cache.n_slots, (end[VIO_X]-start[VIO_X])*n_nodes, lattice_len);
+
+  slice.globals            = globals;
+  slice.current_warp       = current_warp;
+  slice.current_vol        = current_vol;
+  slice.xyzv               = xyzv;
+  slice.start              = start;
+  slice.end                = end;
+  slice.sub_lattice_needed = sub_lattice_needed;
+  slice.ndim               = number_dimensions;
+  slice.contexts           = contexts;
+  slice.estimates          = estimates;
 
 
  /*   set_feature_value_threshold(Gglobals->features.data[0],  */
@@ -1050,13 +1134,13 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
       if ( Gglobals->trans_info.use_simplex) {
         print ("  This fit will use local simplex optimization and\n");
         print ("  Simplex radius = %7.2f (voxels) or %7.2f(mm)\n",
-               Gsimplex_size, 
-               Gsimplex_size * MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2]));      }
+               simplex_size, 
+               simplex_size * MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2]));      }
       else {
         print ("  This fit will use local quadratic fitting and\n");
         print ("  Search/quad fit radius= %7.2f (data voxels) or %7.2f(mm)\n",
-               Gsimplex_size /2.0, 
-               Gsimplex_size * MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2])/2.0);
+               simplex_size /2.0, 
+               simplex_size * MAX3(step_magnitude[0],step_magnitude[1],step_magnitude[2])/2.0);
       }
     }
     else {
@@ -1142,18 +1226,26 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
 
    mean_disp_mag = 0.0;
 
+   end_perf_phase(setup_phase);
+
    for(iters=0; iters<iteration_limit; iters++) 
      {
        
        iteration_start_time = time(NULL);
+       iteration_phase = begin_perf_phase("nonlinear_iteration");
        
        if (globals->trans_info.use_super>0) 
          {
            
            temp_start_time = time(NULL);
+           perf_phase = begin_perf_phase("super_sampling");
            
            interpolate_super_sampled_data_by2(current_warp,
                                           Gsuper_sampled_warp);
+                                /* a no-op unless the field had to be a
+                                   copy of the volume                   */
+           update_deformation_field(&Gsuper_sampled_field, Gsuper_sampled_vol);
+           end_perf_phase(perf_phase);
            if (globals->flags.debug){
              report_time(temp_start_time, "TIME:Interpolating super-sampled data");
              }
@@ -1181,6 +1273,8 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
        nodes_seen      = 0; 
        over            = 0;        
        nfunk_total     = 0;
+       nfunk_tried     = 0;
+       samples         = 0;
        std             = 0.0;
 
        init_stats(&stat_def_mag,  "def_mag");
@@ -1199,186 +1293,112 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                    "Estimating deformations" );
           
        temp_start_time = time(NULL);
+       perf_phase = begin_perf_phase("estimation");
        
        for(i=0; i<VIO_MAX_DIMENSIONS; i++) index[i]=0;
        
-       /* step index[] through all the nodes in the deformation field. */
+       /* step index[] through all the nodes in the deformation field,
+          one x-slice at a time.  The nodes of a slice are estimated
+          first (in parallel when -threads > 1), then their results are
+          stored, in order, in the additional warp. */
        
+       slice.spacing    = steps[xyzv[VIO_X]];
+       slice.threshold1 = threshold1;
+       slice.threshold2 = threshold2;
+       slice.iteration  = iters;
 
        for(index[xyzv[VIO_X]]=start[VIO_X]; index[xyzv[VIO_X]]<end[VIO_X]; index[xyzv[VIO_X]]++) 
          {
            
            timer1 = time(NULL);               /* for stats on this slice */
            nfunk1 = 0; nodes1 = 0;
+
+           slice.x_index = index[xyzv[VIO_X]];
+           run_in_parallel(n_threads, n_nodes, NODES_PER_CHUNK,
+                           estimate_nodes_in_slice, (void *)&slice);
            
-           for(index[xyzv[VIO_Y]]=start[VIO_Y]; index[xyzv[VIO_Y]]<end[VIO_Y]; index[xyzv[VIO_Y]]++) 
+           for(n=0; n<n_nodes; n++) 
              {
-             
-               for(index[xyzv[VIO_Z]]=start[VIO_Z]; index[xyzv[VIO_Z]]<end[VIO_Z]; index[xyzv[VIO_Z]]++) 
-                 {
+               index[xyzv[VIO_Y]] = start[VIO_Y] + n / nz;
+               index[xyzv[VIO_Z]] = start[VIO_Z] + n % nz;
+               estimate = &estimates[n];
                
-                   nodes_seen++;          
-                                        /* get the lattice coordinate 
-                                           of the current index node  */
-                   for(i=0; i<VIO_MAX_DIMENSIONS; i++) voxel[i]=index[i];
-
-                   convert_voxel_to_world(current_vol, 
-                                          voxel,
-                                          &(target_node[VIO_X]), &(target_node[VIO_Y]), &(target_node[VIO_Z]));
-
-                   for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++) 
-                     current_def_vector[ index[ xyzv[VIO_Z+1] ] ] = 
-                     get_volume_real_value(current_vol,
-                                           index[0],index[1],index[2],index[3],index[4]);
+               nodes_seen++;          
+               nfunk_tried += estimate->nfunks;
+               samples     += estimate->samples;
 
-                                        /* add the warp to get the target 
-                                           lattice position in world coords */
-
-                   wx = target_node[VIO_X] + current_def_vector[VIO_X]; 
-                   wy = target_node[VIO_Y] + current_def_vector[VIO_Y]; 
-                   wz = target_node[VIO_Z] + current_def_vector[VIO_Z];
-         
-                   ff_count = 0;
-
-                   for(ff=0; ff<Gglobals->features.number_of_features; ff++){
-                     if (point_not_masked(Gglobals->features.model_mask[ff], wx, wy, wz) )
-                       ff_count++;
-                   }
-
-                   condition = ff_count &&
-                     get_value_of_point_in_volume(wx,wy,wz,Gglobals->features.model[0]) > threshold2;
-
-                   if (condition) {
-
-                                         /* now get the mean warped position of 
-                                            the target's neighbours */
-                     
-                     index[ xyzv[VIO_Z+1] ] = 0;
-                     if (get_average_warp_of_neighbours(current_warp,
-                                                        index, mean_target)) {
-                       
-                                        /* what is the offset to the mean_target? */
-                     
-                       // this is a tad dumb is it not?
-                       for(i=VIO_X; i<=VIO_Z; i++)
-                         mean_vector[i] = mean_target[i] - target_node[i];
-                       
-                                        /* get the targets homolog in the
-                                           world coord system of the source
-                                           data volume                      */
-
-                       general_inverse_transform_point(Glinear_transform,
-                                                       target_node[VIO_X], target_node[VIO_Y], target_node[VIO_Z],
-                                                       &(source_node[VIO_X]),&(source_node[VIO_Y]),&(source_node[VIO_Z])); 
-
-                                               /* find the best deformation for
-                                           this node                        */
-                       
+               if (estimate->status == NODE_NO_DEF) 
+                 {
+                   nodes_tried++;
+                 }
+               else if (estimate->status == NODE_ESTIMATED) 
+                 {
+                                          /* store the deformation vector */
 
-                       result = get_deformation_vector_for_node(steps[xyzv[VIO_X]], 
-                                                                threshold1,
-                                                                source_node,
-                                                                mean_target,
-                                                                def_vector,
-                                                                voxel_displacement,
-                                                                iters, iteration_limit, 
-                                                                &nfunks,
-                                                                num_of_dims_to_optimize,
-                                                                sub_lattice_needed);
-                     
-                     
-                       if (result < 0.0) 
+                   if (Gglobals->trans_info.use_local_smoothing) 
+                     {
+                       if (estimate->eig_found) 
                          {
-                           nodes_tried++;
-                           result = 0.0;
-                         } 
-                       else 
+                           tally_stats(&stat_eigval0, estimate->eig_vals[0]);
+                           tally_stats(&stat_eigval1, estimate->eig_vals[1]);
+                           tally_stats(&stat_eigval2, estimate->eig_vals[2]);
+                           tally_stats(&stat_conf0, estimate->conf[0]);
+                           tally_stats(&stat_conf1, estimate->conf[1]);
+                           tally_stats(&stat_conf2, estimate->conf[2]);
+                         }
+
+                       for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++)  
                          {
-                                          /* store the deformation vector */
-
-                           eig1 = 0.0;
-                           if (Gglobals->trans_info.use_local_smoothing) 
-                             {
-                               eig1 = return_locally_smoothed_def(
-                                                                  Gglobals->trans_info.use_local_isotropic,
-                                                                  number_dimensions,
-                                                                  smoothing_weight,
-                                                                  iteration_weight,
-                                                                  result_def_vector,
-                                                                  current_def_vector,
-                                                                  mean_vector,
-                                                                  def_vector,
-                                                                  another_vector,
-                                                                  voxel_displacement);
-
-                                            /* Remember that I can't modify current_vol just
-                                             yet, so I have to set additional_vol to a value,
-                                             that when added to current_vol (below) I will
-                                             have the correct result!  */
-
-                               for(i=VIO_X; i<=VIO_Z; i++)
-                                 result_def_vector[ i ] -= current_def_vector[ i ];
-                               
-
-                               for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++)  
-                                 {
-                                   set_volume_real_value(additional_vol,
-                                                         index[0],index[1],index[2],
-                                                         index[3],index[4],
-                                                         result_def_vector[index[ xyzv[VIO_Z+1]]]);
-                                   set_volume_real_value(another_vol,
-                                                         index[0],index[1],index[2],
-                                                         index[3],index[4],
-                                                         another_vector[ index[ xyzv[VIO_Z+1] ] ]);
-                                 }
-
-                             }
-                           else 
-                             {                /* then prepare for global smoothing, (this will
-                                           actually be done after all nodes 
-                                           have been estimated  */
+                           set_volume_real_value(additional_vol,
+                                                 index[0],index[1],index[2],
+                                                 index[3],index[4],
+                                                 estimate->def_vector[index[ xyzv[VIO_Z+1]]]);
+                           set_volume_real_value(another_vol,
+                                                 index[0],index[1],index[2],
+                                                 index[3],index[4],
+                                                 estimate->another_vector[ index[ xyzv[VIO_Z+1] ] ]);
+                         }
+                     }
+                   else 
+                     {                /* then prepare for global smoothing, (this will
+                                         actually be done after all nodes 
+                                         have been estimated  */
                                
-                               for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++) 
-                                 set_volume_real_value(additional_vol,
-                                                       index[0],index[1],index[2],
-                                                       index[3],index[4],
-                                                       def_vector[ index[ xyzv[VIO_Z+1] ] ]);
+                       for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++) 
+                         set_volume_real_value(additional_vol,
+                                               index[0],index[1],index[2],
+                                               index[3],index[4],
+                                               estimate->def_vector[ index[ xyzv[VIO_Z+1] ] ]);
 
-                             }
+                     }
                                          /* store the def magnitude */
 
-                           set_volume_real_value(additional_mag,
-                                                 index[xyzv[VIO_X]],index[xyzv[VIO_Y]],index[xyzv[VIO_Z]],0,0,
-                                                 result);
+                   set_volume_real_value(additional_mag,
+                                         index[xyzv[VIO_X]],index[xyzv[VIO_Y]],index[xyzv[VIO_Z]],0,0,
+                                         estimate->result);
                                          /* set the 'node estimated' flag */
-                           set_volume_real_value(estimated_flag_vol,
-                                                 index[xyzv[VIO_X]],index[xyzv[VIO_Y]],index[xyzv[VIO_Z]],0,0,
-                                                 1.0);
+                   set_volume_real_value(estimated_flag_vol,
+                                         index[xyzv[VIO_X]],index[xyzv[VIO_Y]],index[xyzv[VIO_Z]],0,0,
+                                         1.0);
                            
                                          /* tally up some statistics for this iteration */
-                           if (fabs(result) > 0.95*steps[xyzv[VIO_X]]) over++;
+                   if (fabs(estimate->result) > 0.95*steps[xyzv[VIO_X]]) over++;
                            
-                           nfunk_total += nfunks;
-                           nfunk1      += nfunks; 
-                           nodes1++;        
-                           nodes_done++;
+                   nfunk_total += estimate->nfunks;
+                   nfunk1      += estimate->nfunks; 
+                   nodes1++;        
+                   nodes_done++;
                            
-                           tally_stats(&stat_def_mag,   result);
-                           tally_stats(&stat_num_funks, nfunks);
+                   tally_stats(&stat_def_mag,   estimate->result);
+                   tally_stats(&stat_num_funks, estimate->nfunks);
                            
-                         } /* of else (result<0) */
+                 } /* of else if (NODE_ESTIMATED) */
 
-                     } /* if get_average_warp_of_neighbours */
-            
-                   } /* point not masked and val in volume2 > threshold 2 */
-          
-            
-                 }  /* forless on Z index */
-          
-               update_progress_report( &progress, 
-                                       (end[VIO_Y]-start[VIO_Y])*(index[ xyzv[VIO_X]]-start[VIO_X])+
-                                       (index[ xyzv[VIO_Y]]-start[VIO_Y])+1 );
-             } /* forless on Y index */
+               if (n % nz == nz-1)
+                 update_progress_report( &progress, 
+                                         (end[VIO_Y]-start[VIO_Y])*(index[ xyzv[VIO_X]]-start[VIO_X])+
+                                         (index[ xyzv[VIO_Y]]-start[VIO_Y])+1 );
+             } /* for each node of the slice */
            timer2 = time(NULL);
 
            if (globals->flags.debug && globals->flags.verbose>1) 
@@ -1391,6 +1411,14 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
       
          } /* forless on X index */
 
+       add_to_perf_counter(PERF_NODES_SEEN,            nodes_seen);
+       add_to_perf_counter(PERF_NODES_TRIED,           nodes_tried);
+       add_to_perf_counter(PERF_NODES_DONE,            nodes_done);
+       add_to_perf_counter(PERF_AMOEBA_EVALUATIONS,    nfunk_total);
+       add_to_perf_counter(PERF_OBJECTIVE_EVALUATIONS, nfunk_tried);
+       add_to_perf_counter(PERF_INTERPOLATED_SAMPLES,  samples);
+       end_perf_phase(perf_phase);
+
        if (globals->flags.debug) 
          {
            
@@ -1468,10 +1496,12 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
 
 
            temp_start_time = time(NULL);
+           perf_phase = begin_perf_phase("extrapolation");
            
            extrapolate_to_unestimated_nodes(current_warp,
                                             additional_warp,
                                             estimated_flag_vol);
+           end_perf_phase(perf_phase);
            if (globals->flags.debug) 
              report_time(temp_start_time, "TIME:Extrapolating the current warp");
            
@@ -1479,10 +1509,12 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
            /* current = current + additional */
            
            temp_start_time = time(NULL);
+           perf_phase = begin_perf_phase("add_warp");
            
            add_additional_warp_to_current(current_warp,
                                           additional_warp,
                                           1.0);
+           end_perf_phase(perf_phase);
            if (globals->flags.debug) 
              report_time(temp_start_time, "TIME:Adding additional to current");
 
@@ -1495,9 +1527,11 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
               and then apply global  smoothing */
            
            temp_start_time = time(NULL);
+           perf_phase = begin_perf_phase("add_warp");
            add_additional_warp_to_current(additional_warp,
                                           current_warp,
                                            iteration_weight);
+           end_perf_phase(perf_phase);
            if (globals->flags.debug) 
              report_time(temp_start_time, "TIME:Adding additional to current");
        
@@ -1508,6 +1542,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
                                    current = smooth(additional) */
 
            temp_start_time = time(NULL);
+           perf_phase = begin_perf_phase("smoothing");
            
            smooth_the_warp(another_warp, /* try smoothing twice to get better def fields? or we could smooth once, and then use Pierrick's nlmeans*/
                            additional_warp,
@@ -1516,6 +1551,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
            smooth_the_warp(current_warp,   
                            another_warp,
                             additional_mag, -1.0);
+           end_perf_phase(perf_phase);
            
            if (globals->flags.debug) 
               report_time(temp_start_time, "TIME:Smoothing the current warp");
@@ -1577,6 +1613,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
            
          }
 
+       end_perf_phase(iteration_phase);
 
        terminate_progress_report( &progress );
 
@@ -1605,6 +1642,7 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
 
    if (globals->trans_info.use_super>0) 
      {
+       delete_deformation_field(&Gsuper_sampled_field);
        delete_general_transform(Gsuper_sampled_warp);
        FREE(Gsuper_sampled_warp);
      }
@@ -1616,12 +1654,11 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
    FREE(another_warp); 
 
   
-   if (Gglobals->features.number_of_features>0) 
-     {
-       VIO_FREE2D(Ga1_features);
-       VIO_FREE2D(masked_samples_in_source);
-       FREE(Gsqrt_features);
-     }
+   for(i=0; i<n_threads; i++)
+     delete_nonlin_context(&contexts[i]);
+   FREE(contexts);
+   FREE(estimates);
+   delete_source_lattice_cache(&source_cache);
  
    delete_general_transform(all_until_last);
    FREE(all_until_last);
@@ -1629,13 +1666,6 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
    delete_volume(additional_mag);
    delete_volume(estimated_flag_vol);
 
-   FREE(TX );
-   FREE(TY );
-   FREE(TZ );
-   FREE(SX );
-   FREE(SY );
-   FREE(SZ );
-    
 
 
    return (VIO_OK);
@@ -1644,6 +1674,237 @@ VIO_Status do_non_linear_optimization(Arg_Data *globals)
 
 
 
+/* allocate the sub-lattice and sample storage used by one thread
+   to estimate the deformation at a node */
+
+static void init_nonlin_context(Nonlin_Context *context,
+                                Arg_Data *globals,
+                                VIO_Real simplex_size,
+                                VIO_Real cost_radius)
+{
+  int n_features;
+
+  n_features = globals->features.number_of_features;
+
+  context->globals             = globals;
+  context->simplex_size        = simplex_size;
+  context->cost_radius         = cost_radius;
+  context->len                 = 0;
+  context->target_sample_count = 0;
+  context->source_cache        = NULL;
+  context->node                = -1;
+
+  VIO_ALLOC2D (context->a1_features, n_features, MAX_G_LEN+1);
+  VIO_ALLOC2D (context->masked_samples_in_source, n_features, MAX_G_LEN+1);
+  ALLOC( context->sqrt_features, n_features);
+
+  ALLOC(context->SX,MAX_G_LEN+1);        /* and coordinates in source volume  */
+  ALLOC(context->SY,MAX_G_LEN+1);
+  ALLOC(context->SZ,MAX_G_LEN+1);
+  ALLOC(context->TX,MAX_G_LEN+1);        /* and coordinates in target volume  */
+  ALLOC(context->TY,MAX_G_LEN+1);
+  ALLOC(context->TZ,MAX_G_LEN+1);
+}
+
+static void delete_nonlin_context(Nonlin_Context *context)
+{
+  VIO_FREE2D(context->a1_features);
+  VIO_FREE2D(context->masked_samples_in_source);
+  FREE(context->sqrt_features);
+
+  FREE(context->TX );
+  FREE(context->TY );
+  FREE(context->TZ );
+  FREE(context->SX );
+  FREE(context->SY );
+  FREE(context->SZ );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : estimate_nodes_in_slice
+@INPUT      : slice_estimation - a Slice_Estimation
+              thread           - index of the calling thread, selects the
+                                 Nonlin_Context to use
+              first,last       - range of nodes (first..last-1) of the slice
+                                 to estimate, numbered z fastest
+@OUTPUT     : slice_estimation->estimates[first..last-1]
+@RETURNS    : 
+@DESCRIPTION: estimate the additional deformation needed at each node in
+              the range.  Neither the deformation volumes nor the stats are
+              modified here, since the nodes of a slice may be processed
+              concurrently; do_non_linear_optimization() stores the results
+              once the whole slice is done.
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void estimate_nodes_in_slice(void *slice_estimation,
+                                    int thread, int first, int last)
+{
+  Slice_Estimation *slice;
+  Nonlin_Context   *context;
+  Node_Estimate    *estimate;
+  Arg_Data         *globals;
+  int
+    *xyzv, *start, *end,
+    index[VIO_MAX_DIMENSIONS],
+    i, n, ff, ff_count;
+  VIO_Real 
+    voxel[VIO_MAX_DIMENSIONS],
+    current_def_vector[3],        /* the current deformation vector for a  node    */
+    result_def_vector[3],        /* the smoothed deformation vector for a node    */
+    def_vector[3],                /* the additional deformation estimated for node */
+    voxel_displacement[VIO_N_DIMENSIONS], /* the additional displacement, in voxel coords */
+    wx,wy,wz,                        /* temporary storage for a world coordinate      */
+    source_node[3],                /* world coordinate of source node               */
+    target_node[3],                /* world coordinate of corresponding target node */
+    mean_target[3],                /* mean deformed pos, determined by neighbors    */
+    mean_vector[3],                /* mean deformed vector, determined by neighbors */
+    result;                        /* magnitude of additional warp vector           */
+  VIO_BOOL condition;
+
+  slice   = (Slice_Estimation *)slice_estimation;
+  context = &slice->contexts[thread];
+  globals = slice->globals;
+  xyzv    = slice->xyzv;
+  start   = slice->start;
+  end     = slice->end;
+
+  for(i=0; i<VIO_MAX_DIMENSIONS; i++) index[i]=0;
+  index[xyzv[VIO_X]] = slice->x_index;
+
+  for(n=first; n<last; n++) {
+
+    estimate = &slice->estimates[n];
+    estimate->status    = NODE_SKIPPED;
+    estimate->result    = 0.0;
+    estimate->nfunks    = 0;
+    estimate->samples   = 0;
+    estimate->eig_found = FALSE;
+    for(i=VIO_X; i<=VIO_Z; i++) {
+      estimate->def_vector[i]     = 0.0;
+      estimate->another_vector[i] = 0.0;
+    }
+
+    index[xyzv[VIO_Y]] = start[VIO_Y] + n / (end[VIO_Z]-start[VIO_Z]);
+    index[xyzv[VIO_Z]] = start[VIO_Z] + n % (end[VIO_Z]-start[VIO_Z]);
+
+                                        /* number the node in the whole
+                                           field, for the source cache */
+    context->node = (slice->x_index - start[VIO_X]) *
+                    (end[VIO_Y]-start[VIO_Y]) * (end[VIO_Z]-start[VIO_Z]) + n;
+
+                                        /* get the lattice coordinate 
+                                           of the current index node  */
+    for(i=0; i<VIO_MAX_DIMENSIONS; i++) voxel[i]=index[i];
+
+    convert_voxel_to_world(slice->current_vol, 
+                           voxel,
+                           &(target_node[VIO_X]), &(target_node[VIO_Y]), &(target_node[VIO_Z]));
+
+    for(index[xyzv[VIO_Z+1]]=start[VIO_Z+1]; index[xyzv[VIO_Z+1]]<end[VIO_Z+1]; index[xyzv[VIO_Z+1]]++) 
+      current_def_vector[ index[ xyzv[VIO_Z+1] ] ] = 
+        get_volume_real_value(slice->current_vol,
+                              index[0],index[1],index[2],index[3],index[4]);
+
+                                        /* add the warp to get the target 
+                                           lattice position in world coords */
+
+    wx = target_node[VIO_X] + current_def_vector[VIO_X]; 
+    wy = target_node[VIO_Y] + current_def_vector[VIO_Y]; 
+    wz = target_node[VIO_Z] + current_def_vector[VIO_Z];
+         
+    ff_count = 0;
+
+    for(ff=0; ff<globals->features.number_of_features; ff++){
+      if (point_not_masked(globals->features.model_mask[ff], wx, wy, wz) )
+        ff_count++;
+    }
+
+    condition = ff_count &&
+      get_value_of_point_in_volume(wx,wy,wz,globals->features.model[0]) > slice->threshold2;
+
+    if (!condition) continue;
+
+                                         /* now get the mean warped position of 
+                                            the target's neighbours */
+                     
+    index[ xyzv[VIO_Z+1] ] = 0;
+    if (!get_average_warp_of_neighbours(slice->current_warp,
+                                        index, mean_target)) continue;
+                       
+                                        /* what is the offset to the mean_target? */
+    for(i=VIO_X; i<=VIO_Z; i++)
+      mean_vector[i] = mean_target[i] - target_node[i];
+                       
+                                        /* get the targets homolog in the
+                                           world coord system of the source
+                                           data volume                      */
+
+    if (Glinear_is_affine)
+      apply_affine_map(Glinear_inverse_map,
+                       target_node[VIO_X], target_node[VIO_Y], target_node[VIO_Z],
+                       &(source_node[VIO_X]),&(source_node[VIO_Y]),&(source_node[VIO_Z]));
+    else
+      general_inverse_transform_point(Glinear_transform,
+                                      target_node[VIO_X], target_node[VIO_Y], target_node[VIO_Z],
+                                      &(source_node[VIO_X]),&(source_node[VIO_Y]),&(source_node[VIO_Z])); 
+
+                                        /* find the best deformation for
+                                           this node                        */
+
+    result = get_deformation_vector_for_node(context,
+                                             slice->spacing, 
+                                             slice->threshold1,
+                                             source_node,
+                                             mean_target,
+                                             def_vector,
+                                             voxel_displacement,
+                                             slice->iteration, iteration_limit, 
+                                             &estimate->nfunks,
+                                             slice->ndim,
+                                             slice->sub_lattice_needed);
+
+    estimate->samples = (long)estimate->nfunks * context->len *
+                        globals->features.number_of_features;
+                     
+    if (result < 0.0) {
+      estimate->status = NODE_NO_DEF;
+      continue;
+    }
+
+    estimate->status = NODE_ESTIMATED;
+    estimate->result = result;
+
+    if (globals->trans_info.use_local_smoothing) {
+      (void)return_locally_smoothed_def(context,
+                                        estimate,
+                                        globals->trans_info.use_local_isotropic,
+                                        slice->ndim,
+                                        smoothing_weight,
+                                        iteration_weight,
+                                        result_def_vector,
+                                        current_def_vector,
+                                        mean_vector,
+                                        def_vector,
+                                        estimate->another_vector,
+                                        voxel_displacement);
+
+                                        /* Remember that I can't modify current_vol just
+                                           yet, so I have to set additional_vol to a value,
+                                           that when added to current_vol (below) I will
+                                           have the correct result!  */
+
+      for(i=VIO_X; i<=VIO_Z; i++)
+        estimate->def_vector[ i ] = result_def_vector[ i ] - current_def_vector[ i ];
+    }
+    else {
+      for(i=VIO_X; i<=VIO_Z; i++)
+        estimate->def_vector[ i ] = def_vector[ i ];
+    }
+  }
+}
+
+
 /*   look though the list of object functions requested,
      and set is_a_sub_lattice_needed=TRUE if any obj function
      is used other than Optical Flow
@@ -1757,7 +2018,9 @@ static double confidence_function(double x) {
 
 }
 
-static double return_locally_smoothed_def(int isotropic_smoothing,
+static double return_locally_smoothed_def(Nonlin_Context *context,
+                                           Node_Estimate *estimate,
+                                           int  isotropic_smoothing,
                                            int  ndim,
                                            VIO_Real smoothing_wght,
                                            VIO_Real iteration_wght,
@@ -1779,12 +2042,14 @@ static double return_locally_smoothed_def(int isotropic_smoothing,
     diff[3],                        /* to represent def - mean_def          */
     len[3],                        /* length of projection onto eig_vecs   */
     Smin,                        /* best local correlation value         */
-    eps;                        /* epsilon value                        */
+    eps,                        /* epsilon value                        */
+    obj_values[27];             /* obj function at the offsets          */
   int
-    flag,i,j,k;
+    flag,i,j,k,
+    n_offsets;
 
   float 
-    pos_vector[4];
+    offsets[27][4];             /* 3x3x3 displacements of the lattice   */
 
   eps = 0.0001; /* SMALL_EPSILON_VALUE*/
   eig_vals[0] = 0.0;
@@ -1841,10 +2106,10 @@ static double return_locally_smoothed_def(int isotropic_smoothing,
       voxel_displacement[i] *= iteration_wght;
     }
                       /* update target lattice position */
-    for(i=1; i<Glen; i++) {
-      TX[i] += voxel_displacement[2]; /* slowest varying index for data */
-      TY[i] += voxel_displacement[1];
-      TZ[i] += voxel_displacement[0]; /* fastest index */
+    for(i=1; i<context->len; i++) {
+      context->TX[i] += voxel_displacement[2]; /* slowest varying index for data */
+      context->TY[i] += voxel_displacement[1];
+      context->TZ[i] += voxel_displacement[0]; /* fastest index */
     }
 
     flag = FALSE;
@@ -1859,15 +2124,24 @@ static double return_locally_smoothed_def(int isotropic_smoothing,
       /* build up the 3x3x3 matrix of local correlation values,
          and get the principal directions */
 
-      Smin = DBL_MAX;
+      n_offsets = 0;
       for(i=-1; i<=1; i++)
         for(j=-1; j<=1; j++)
           for(k=-1; k<=1; k++) {
-            pos_vector[1] = (float) (i * Gsimplex_size)/2.0;
-            pos_vector[2] = (float) (j * Gsimplex_size)/2.0;
-            pos_vector[3] = (float) (k * Gsimplex_size)/2.0;
+            offsets[n_offsets][1] = (float) (i * context->simplex_size)/2.0;
+            offsets[n_offsets][2] = (float) (j * context->simplex_size)/2.0;
+            offsets[n_offsets][3] = (float) (k * context->simplex_size)/2.0;
+            n_offsets++;
+          }
 
-            local_corr3D[i+1][j+1][k+1] = local_objective_function(pos_vector); 
+      local_objective_function_at_offsets(context, n_offsets, offsets, obj_values);
+
+      Smin = DBL_MAX;
+      n_offsets = 0;
+      for(i=-1; i<=1; i++)
+        for(j=-1; j<=1; j++)
+          for(k=-1; k<=1; k++) {
+            local_corr3D[i+1][j+1][k+1] = obj_values[n_offsets++];
 
             if ( local_corr3D[i+1][j+1][k+1] < Smin)
               Smin = local_corr3D[i+1][j+1][k+1];
@@ -1886,12 +2160,13 @@ static double return_locally_smoothed_def(int isotropic_smoothing,
       for(i=0; i<3; i++)
         conf[i] = confidence_function( eig_vals[i] );
 
-      tally_stats(&stat_eigval0, eig_vals[0]);
-      tally_stats(&stat_eigval1, eig_vals[1]);
-      tally_stats(&stat_eigval2, eig_vals[2]);
-      tally_stats(&stat_conf0, conf[0]);
-      tally_stats(&stat_conf1, conf[1]);
-      tally_stats(&stat_conf2, conf[2]);
+                                /* the stats are tallied by the caller,
+                                   in node order */
+      estimate->eig_found = TRUE;
+      for(i=0; i<3; i++) {
+        estimate->eig_vals[i] = eig_vals[i];
+        estimate->conf[i]     = conf[i];
+      }
                 
                                 /* project the diff onto each of the 
                                    eigen vecs [i] */
@@ -1955,6 +2230,7 @@ static double return_locally_smoothed_def(int isotropic_smoothing,
 */
 
 static VIO_BOOL get_best_start_from_neighbours(
+                           Arg_Data *globals,
                            VIO_Real threshold1, 
                            VIO_Real source[],
                            VIO_Real mean_target[],
@@ -1968,7 +2244,7 @@ static VIO_BOOL get_best_start_from_neighbours(
 
 
   mag_normal1 = get_value_of_point_in_volume(source[VIO_X],source[VIO_Y],source[VIO_Z], 
-                                             Gglobals->features.data[0]);
+                                             globals->features.data[0]);
 
   if (mag_normal1 < threshold1)
     return(FALSE);        
@@ -1978,7 +2254,7 @@ static VIO_BOOL get_best_start_from_neighbours(
 
 /* possible problem: does the following work for a 2D grid transformation? 
  */
-    general_transform_point(Gglobals->trans_info.transformation, 
+    general_transform_point(globals->trans_info.transformation, 
                             source[VIO_X],source[VIO_Y],source[VIO_Z], 
                             &(target[VIO_X]),&(target[VIO_Y]),&(target[VIO_Z]));
 
@@ -2034,6 +2310,7 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
     min,max,thresh,             /* volume real min, max and estimate on smallest
                                    derivative */
     xp, yp, zp,                        /* temp storage for coordinate position */
+    proj_d1, proj_d2,           /* intensities in source and target     */
     mag,
     dx[VIO_MAX_DIMENSIONS],                /* derivative in X (world-coord)        */
     dy[VIO_MAX_DIMENSIONS],                /*     "         Y                      */
@@ -2052,7 +2329,7 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
                              0, TRUE, 0.0, val,
                              dx,dy,dz,
                              NULL,NULL,NULL,NULL,NULL,NULL);
-    Gproj_d2 = val[0];
+    proj_d2 = val[0];
     
     xp = source_coord[0];        /* get intensity only                   */
     yp = source_coord[1];        /* in source volume                     */
@@ -2063,7 +2340,7 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
                              NULL,NULL,NULL,
                              NULL,NULL,NULL,
                              NULL,NULL,NULL);
-    Gproj_d1 = val[0];
+    proj_d1 = val[0];
     
                                 /* compute deformations directly!       */
 
@@ -2076,17 +2353,17 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
       
 
     if (fabs(dx[0]) > thresh)   /* fastest (X) */
-      def_vector[0] = ((Gproj_d1 - Gproj_d2) /  dx[0]);
+      def_vector[0] = ((proj_d1 - proj_d2) /  dx[0]);
     else
       def_vector[0] = 0.0;
     
     if (fabs(dy[0]) > thresh)
-      def_vector[1] = ((Gproj_d1 - Gproj_d2) /  dy[0]);
+      def_vector[1] = ((proj_d1 - proj_d2) /  dy[0]);
     else
       def_vector[1] = 0.0;
     
     if (fabs(dz[0]) > thresh && ndim==3)  /* slowest  (Z) */
-      def_vector[2] = ((Gproj_d1 - Gproj_d2) /  dz[0]);
+      def_vector[2] = ((proj_d1 - proj_d2) /  dz[0]);
     else
       def_vector[2] = 0.0;
     
@@ -2121,7 +2398,8 @@ static VIO_Real get_optical_flow_vector(VIO_Real threshold1,
 
 #define MAX_CAPTURE 3.8                
 
-static VIO_Real get_chamfer_vector(VIO_Real capture_limit, 
+static VIO_Real get_chamfer_vector(Arg_Data *globals,
+                                VIO_Real capture_limit, 
                                 VIO_Real source_coord[],
                                 VIO_Real mean_target[],
                                 VIO_Real def_vector[],
@@ -2216,7 +2494,7 @@ print ("%5.3f: %7.2f %7.2f %7.2f -> %7.2f %7.2f %7.2f [%7.2f %7.2f %7.2f ]",
         /* sx,sy,sz is now on the closest surface in the data volume,
            we now need the equivalent target coord */
 
-        general_transform_point(Gglobals->trans_info.transformation, 
+        general_transform_point(globals->trans_info.transformation, 
                               sx,sy,sz,  &tx,&ty,&tz);
 
 
@@ -2284,7 +2562,8 @@ print ("%5.3f: %7.2f %7.2f %7.2f -> %7.2f %7.2f %7.2f [%7.2f %7.2f %7.2f ]",
   return(result);
 }
 
-static VIO_BOOL build_lattices(VIO_Real spacing, 
+static VIO_BOOL build_lattices(Nonlin_Context *context,
+                               VIO_Real spacing, 
                                VIO_Real threshold, 
                                VIO_Real source_coord[],
                                VIO_Real mean_target[],
@@ -2293,8 +2572,11 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
                                int ndim)
 {
 
+  Arg_Data
+    *globals;
   VIO_BOOL
-    result;
+    result,
+    cached;
   VIO_Real
     pos[3],
     xp,yp,zp;
@@ -2314,9 +2596,10 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
   */
   
 
+  globals = context->globals;
   result = TRUE;
 
-  if (!get_best_start_from_neighbours(threshold,
+  if (!get_best_start_from_neighbours(globals, threshold,
                                       source_coord, mean_target, target_coord,
                                       def_vector)) {
     
@@ -2338,21 +2621,29 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
           build the list of world coordinates representing nodes in the
           sub-lattice within the source volume                       
 
-       The spherical sub-lattice will have Glen points in the source
+       The spherical sub-lattice will have context->len points in the source
        volume, note: sub-lattice diameter= 1.5*fwhm 
        (here specified as 3*spacing = 2*(fwhm/2) to specify radius 
        in build_source_lattice) 
 
-       note that SX, SY, SZ, TX,TY,TZ, and Glen are all globals
+       note that SX, SY, SZ, TX,TY,TZ, and len are all stored in
+       the context, for use by the objective functions
+
+       The source side does not depend on the current warp: if this
+       node was built in a previous iteration, the lattice and the
+       source samples are simply taken back from the cache.
     */
 
-    build_source_lattice(xp, yp, zp, 
-                         SX, SY, SZ,
-                         Gglobals->lattice_width[VIO_X],Gglobals->lattice_width[VIO_Y],Gglobals->lattice_width[VIO_Z],
-                         Diameter_of_local_lattice,  
-                         Diameter_of_local_lattice,  
-                         Diameter_of_local_lattice,
-                         ndim, &Glen);
+    cached = get_cached_source_lattice(context);
+
+    if (!cached)
+      build_source_lattice(xp, yp, zp, 
+                           context->SX, context->SY, context->SZ,
+                           globals->lattice_width[VIO_X],globals->lattice_width[VIO_Y],globals->lattice_width[VIO_Z],
+                           Diameter_of_local_lattice,  
+                           Diameter_of_local_lattice,  
+                           Diameter_of_local_lattice,
+                           ndim, &context->len);
 
     /* -------------------------------------------------------------- */
     /* BUILD THE TARGET VOLUME LOCAL NEIGHBOURHOOD INFO */
@@ -2361,11 +2652,11 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
        current transformation, in order to build a deformed lattice
        (in the WORLD COORDS of the target volume) */
 
-    if (Gglobals->trans_info.use_super>0) 
+    if (globals->trans_info.use_super>0) 
       build_target_lattice_using_super_sampled_def(
-                  SX,SY,SZ, TX,TY,TZ, Glen, ndim);
+                  context->SX,context->SY,context->SZ, context->TX,context->TY,context->TZ, context->len, ndim);
     else 
-      build_target_lattice(SX,SY,SZ, TX,TY,TZ, Glen, ndim);
+      build_target_lattice(context->SX,context->SY,context->SZ, context->TX,context->TY,context->TZ, context->len, ndim);
       
 
     /* -------------------------------------------------------------- */
@@ -2381,34 +2672,41 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
                 (since I load the features in ZYX order in main() and
                 in get_feature_volume()                               
 
-                so, TX[] will store the voxel zdim position, TY with
+                so, context->TX[] will store the voxel zdim position, TY with
                 ydim, and TZ the voxel xdim coordinate.  BIZARRE I know,
                 but it works... */
 
-    for(i=1; i<=Glen; i++) {
-      convert_3D_world_to_voxel(Gglobals->features.model[0], 
-                                (VIO_Real)TX[i],(VIO_Real)TY[i],(VIO_Real)TZ[i], 
+    for(i=1; i<=context->len; i++) {
+      convert_3D_world_to_voxel(globals->features.model[0], 
+                                (VIO_Real)context->TX[i],(VIO_Real)context->TY[i],(VIO_Real)context->TZ[i], 
                                 &pos[0], &pos[1], &pos[2]);
 
       /*      print ("%3d %8.3f %8.3f %8.3f -> %8.3f %8.3f %8.3f -> %8.3f %8.3f %8.3f \n",
-             i,SX[i],SY[i],SZ[i],
-             TX[i],TY[i],TZ[i],
+             i,context->SX[i],context->SY[i],context->SZ[i],
+             context->TX[i],context->TY[i],context->TZ[i],
              pos[0], pos[1], pos[2]); */
 
-      TX[i] = pos[0];
-      TY[i] = pos[1];
-      TZ[i] = pos[2];
+      context->TX[i] = pos[0];
+      context->TY[i] = pos[1];
+      context->TZ[i] = pos[2];
     }
 
+    /* -------------------------------------------------------------- */
+    /* everything below only concerns the source side, which is already
+       in the context when it came from the cache                     */
+
+    if (cached)
+      return(result);
+
     /* -------------------------------------------------------------- */
     /* re-build the source lattice (without local neighbour warp),
        that will be used in the optimization below                    */
 
-    if (Gglobals->trans_info.use_magnitude) {
-      for(i=1; i<=Glen; i++) {
-        SX[i] += source_coord[VIO_X] - xp;
-        SY[i] += source_coord[VIO_Y] - yp;
-        SZ[i] += source_coord[VIO_Z] - zp;
+    if (globals->trans_info.use_magnitude) {
+      for(i=1; i<=context->len; i++) {
+        context->SX[i] += source_coord[VIO_X] - xp;
+        context->SY[i] += source_coord[VIO_Y] - yp;
+        context->SZ[i] += source_coord[VIO_Z] - zp;
       }
     }
 
@@ -2422,15 +2720,15 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
        will use the sublattice in the optimization 
     */
 
-    for(i=0; i<Gglobals->features.number_of_features; i++) {
+    for(i=0; i<globals->features.number_of_features; i++) {
 
-      if (Gglobals->features.obj_func[i] != NONLIN_OPTICALFLOW && Gglobals->features.obj_func[i] != NONLIN_CHAMFER)
+      if (globals->features.obj_func[i] != NONLIN_OPTICALFLOW && globals->features.obj_func[i] != NONLIN_CHAMFER)
 
-        go_get_samples_in_source(Gglobals->features.data[i], 
-                                 Gglobals->features.data_mask[i],
-                                 SX,SY,SZ, Ga1_features[i], 
-                                 masked_samples_in_source[i], Glen, 
-                                 (Gglobals->interpolant==nearest_neighbour_interpolant ? -1 : 0)
+        go_get_samples_in_source(globals->features.data[i], 
+                                 globals->features.data_mask[i],
+                                 context->SX,context->SY,context->SZ, context->a1_features[i], 
+                                 context->masked_samples_in_source[i], context->len, 
+                                 (globals->interpolant==nearest_neighbour_interpolant ? -1 : 0)
                                  );
     }
 
@@ -2441,42 +2739,45 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
        eval'd once for the source volume. Note that this variable is not
        used when doing OPTICAL FLOW. */
 
-    for(i=0; i<Gglobals->features.number_of_features; i++) {
+    for(i=0; i<globals->features.number_of_features; i++) {
 
-      switch (Gglobals->features.obj_func[i]) {
+      switch (globals->features.obj_func[i]) {
       case NONLIN_XCORR:
-        Gsqrt_features[i] = 0.0;
-        for(j=1; j<=Glen; j++) {
-          if ( masked_samples_in_source[i][j] ==0)
-            Gsqrt_features[i] += Ga1_features[i][j]*Ga1_features[i][j];
+        context->sqrt_features[i] = 0.0;
+        for(j=1; j<=context->len; j++) {
+          if ( context->masked_samples_in_source[i][j] ==0)
+            context->sqrt_features[i] += context->a1_features[i][j]*context->a1_features[i][j];
         }
          
-        Gsqrt_features[i] = sqrt((double)Gsqrt_features[i]);
+        context->sqrt_features[i] = sqrt((double)context->sqrt_features[i]);
         break;
       case NONLIN_DIFF:
-        Gsqrt_features[i] = (VIO_Real)Glen;
+        context->sqrt_features[i] = (VIO_Real)context->len;
         break;
       case NONLIN_LABEL:
-        Gsqrt_features[i] = (VIO_Real)Glen;
+        context->sqrt_features[i] = (VIO_Real)context->len;
         break;
       case NONLIN_CHAMFER:
-        Gsqrt_features[i] = 0;
+        context->sqrt_features[i] = 0;
         break;
       case NONLIN_OPTICALFLOW:
-        Gsqrt_features[i] = 0;
+        context->sqrt_features[i] = 0;
         break;
       case NONLIN_CORRCOEFF:
-        Gsqrt_features[i] = (VIO_Real)Glen;
+        context->sqrt_features[i] = (VIO_Real)context->len;
         break;
       case NONLIN_SQDIFF:
-        Gsqrt_features[i] = (VIO_Real)Glen;
+        context->sqrt_features[i] = (VIO_Real)context->len;
         break;
 
       default:
         print_error_and_line_num("Objective function %d not supported in build_lattices",
-                                 __FILE__, __LINE__,Gglobals->features.obj_func[i]);
+                                 __FILE__, __LINE__,globals->features.obj_func[i]);
       }
     }
+
+                                /* and keep it for the next iterations */
+    cache_source_lattice(context);
     
   }
   return(result );
@@ -2520,7 +2821,8 @@ static VIO_BOOL build_lattices(VIO_Real spacing,
 */
 
 
-static VIO_Real get_deformation_vector_for_node(VIO_Real spacing, 
+static VIO_Real get_deformation_vector_for_node(Nonlin_Context *context,
+                                             VIO_Real spacing, 
                                              VIO_Real threshold1, 
                                              VIO_Real source_coord[],
                                              VIO_Real mean_target[],
@@ -2547,17 +2849,23 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
     pos[3],
     simplex_size,
     result,
-    target_coord[3];
+    target_coord[3],
+    obj_values[27];
   float 
-    pos_vector[4];
+    offsets[27][4];             /* 3x3x3 displacements of the lattice   */
   int 
     flag,
     nfunk,
+    n_offsets,
     i,j,k;
   amoeba_struct
     the_amoeba;
   VIO_Real
     *parameters;
+  Arg_Data
+    *globals;
+
+  globals = context->globals;
 
                                 /* initialize for no deformation */
   result = 0.0;                        
@@ -2567,7 +2875,7 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
                                 /* build sub-lattice if necessary */
   if (sub_lattice_needed) {
 
-    if ( ! build_lattices(spacing, threshold1, 
+    if ( ! build_lattices(context, spacing, threshold1, 
                           source_coord, mean_target, target_coord, def_vector,
                           ndim) ){
       result = -DBL_MAX;
@@ -2580,15 +2888,15 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
 
   optical_partial_weight = other_partial_weight = total_weight = 0.0;
 
-  for(i=0; i<Gglobals->features.number_of_features; i++) {
+  for(i=0; i<globals->features.number_of_features; i++) {
 
-    if ((Gglobals->features.obj_func[i] == NONLIN_OPTICALFLOW) || 
-        (Gglobals->features.obj_func[i] == NONLIN_CHAMFER) )
-      optical_partial_weight += Gglobals->features.weight[i];
+    if ((globals->features.obj_func[i] == NONLIN_OPTICALFLOW) || 
+        (globals->features.obj_func[i] == NONLIN_CHAMFER) )
+      optical_partial_weight += globals->features.weight[i];
     else
-      other_partial_weight += Gglobals->features.weight[i];
+      other_partial_weight += globals->features.weight[i];
 
-    total_weight += Gglobals->features.weight[i];
+    total_weight += globals->features.weight[i];
   }
 
   if (total_weight == 0.0) {
@@ -2606,28 +2914,37 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
     /*  FIND BEST DEFORMATION VECTOR
         now find the best local deformation that maximises the local
         neighbourhood correlation between the source values stored in
-        **Ga1_features at positions Sx, SY, SZ with the homologous 
+        in context->a1_features at positions SX, SY, SZ with the homologous 
         values at positions TX,TY,TZ in the target volume */
     
-    if ( !Gglobals->trans_info.use_simplex) {
+    if ( !globals->trans_info.use_simplex) {
       
       /* ----------------------------------------------------------- */
       /*  USE QUADRATIC FITTING to find best deformation vector      */
       
       if (ndim==3) { /* build up the 3x3x3 matrix of local correlation values */
         
+        n_offsets = 0;
         for(i=-1; i<=1; i++) {
-          
-          pos_vector[1] = (float) i * Gsimplex_size/2.0;
           for(j=-1; j<=1; j++) {
-            
-            pos_vector[2] = (float) j * Gsimplex_size/2.0;
             for(k=-1; k<=1; k++) {
-              pos_vector[3] = (float) k * Gsimplex_size/2.0;
-              local_corr3D[i+1][j+1][k+1] = local_objective_function(pos_vector); 
+              offsets[n_offsets][1] = (float) i * context->simplex_size/2.0;
+              offsets[n_offsets][2] = (float) j * context->simplex_size/2.0;
+              offsets[n_offsets][3] = (float) k * context->simplex_size/2.0;
+              n_offsets++;
             }
           }
         }
+                                /* all 27 values in one pass over the
+                                   sub-lattice */
+        local_objective_function_at_offsets(context, n_offsets, offsets, obj_values);
+
+        n_offsets = 0;
+        for(i=-1; i<=1; i++)
+          for(j=-1; j<=1; j++)
+            for(k=-1; k<=1; k++)
+              local_corr3D[i+1][j+1][k+1] = obj_values[n_offsets++];
+
         *num_functions += 27;
         flag = return_3D_disp_from_min_quad_fit(local_corr3D, &du, &dv, &dw);
         
@@ -2635,15 +2952,22 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
       else {
         /* build up the 3x3 matrix of local correlation values */
         
-        pos_vector[3] = 0.0;        /* since 2D */
-        
+        n_offsets = 0;
         for(i=-1; i<=1; i++) {
-          pos_vector[1] = (float) i * Gsimplex_size/2.0;
           for(j=-1; j<=1; j++) {
-            pos_vector[2] = (float) j * Gsimplex_size/2.0;
-            local_corr2D[i+1][j+1] = 1.0 - local_objective_function(pos_vector); 
+            offsets[n_offsets][1] = (float) i * context->simplex_size/2.0;
+            offsets[n_offsets][2] = (float) j * context->simplex_size/2.0;
+            offsets[n_offsets][3] = 0.0;        /* since 2D */
+            n_offsets++;
           }
         }
+        local_objective_function_at_offsets(context, n_offsets, offsets, obj_values);
+
+        n_offsets = 0;
+        for(i=-1; i<=1; i++)
+          for(j=-1; j<=1; j++)
+            local_corr2D[i+1][j+1] = 1.0 - obj_values[n_offsets++];
+
         *num_functions += 9;
         
         flag = return_2D_disp_from_quad_fit(local_corr2D,  &du, &dv);
@@ -2654,9 +2978,9 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
 
       
       if ( flag ) {
-        voxel_displacement[0] = dw * Gsimplex_size/2.0;        /* fastest (X) data index */
-        voxel_displacement[1] = dv * Gsimplex_size/2.0;        /* Y */
-        voxel_displacement[2] = du * Gsimplex_size/2.0;        /* slowest, Z */
+        voxel_displacement[0] = dw * context->simplex_size/2.0;        /* fastest (X) data index */
+        voxel_displacement[1] = dv * context->simplex_size/2.0;        /* Y */
+        voxel_displacement[2] = du * context->simplex_size/2.0;        /* slowest, Z */
       }
       else {
         result = -DBL_MAX;
@@ -2685,13 +3009,13 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
                                    note that the simplex is in voxel
                                    coordinates of the data volume...
                                 */
-      simplex_size = Gsimplex_size * 
+      simplex_size = context->simplex_size * 
         (0.5 + 
          0.5*((VIO_Real)(total_iters-iteration)/(VIO_Real)total_iters));
       
       initialize_amoeba(&the_amoeba, ndim, parameters, 
                         simplex_size, amoeba_NL_obj_function, 
-                        NULL, (VIO_Real)ftol);
+                        (void *)context, (VIO_Real)ftol);
       
       
       nfunk = 4;                /* since 4 eval's needed to init the amoeba */
@@ -2766,7 +3090,7 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
     }
     else {
       
-      convert_3D_world_to_voxel(Gglobals->features.model[0], 
+      convert_3D_world_to_voxel(globals->features.model[0], 
                                 target_coord[VIO_X],target_coord[VIO_Y],target_coord[VIO_Z], 
                                 &voxel[0], &voxel[1], &voxel[2]);
       
@@ -2775,7 +3099,7 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
          in z,y,x order and the voxel displacement is in x,y,z
          order. */
 
-      convert_3D_voxel_to_world(Gglobals->features.model[0], 
+      convert_3D_voxel_to_world(globals->features.model[0], 
                                 (VIO_Real)(voxel[0]+voxel_displacement[2]),   /* voxel[z]+voxel_displacement[z] */
                                 (VIO_Real)(voxel[1]+voxel_displacement[1]),   /* voxel[y]+voxel_displacement[y] */
                                 (VIO_Real)(voxel[2]+voxel_displacement[0]),   /* voxel[x]+voxel_displacement[x] */
@@ -2816,36 +3140,36 @@ static VIO_Real get_deformation_vector_for_node(VIO_Real spacing,
 
     temp_total_weight = 0;
 
-    for(i=0; i<Gglobals->features.number_of_features; i++) {
+    for(i=0; i<globals->features.number_of_features; i++) {
       
-      if (Gglobals->features.obj_func[i] == NONLIN_OPTICALFLOW ||  
-          Gglobals->features.obj_func[i] == NONLIN_CHAMFER)  {
+      if (globals->features.obj_func[i] == NONLIN_OPTICALFLOW ||  
+          globals->features.obj_func[i] == NONLIN_CHAMFER)  {
         
-        if (Gglobals->features.obj_func[i] == NONLIN_OPTICALFLOW) {
+        if (globals->features.obj_func[i] == NONLIN_OPTICALFLOW) {
           result =  get_optical_flow_vector(threshold1, 
                                             source_coord, mean_target,
                                             real_def, vox_def,
-                                            Gglobals->features.data[i],
-                                            Gglobals->features.model[i],
+                                            globals->features.data[i],
+                                            globals->features.model[i],
                                             ndim);
 
 	}
         else                   /* must be CHAMFER */
-          result =  get_chamfer_vector(spacing,   
+          result =  get_chamfer_vector(globals, spacing,   
                                        source_coord, mean_target,
                                        real_def, vox_def,
-                                       Gglobals->features.data[i],
-                                       Gglobals->features.model[i],
+                                       globals->features.data[i],
+                                       globals->features.model[i],
                                        ndim);
         if (result > 0.0) {
           *num_functions += 1;
                                 /* add in the weighted deformations */
 
-          temp_total_weight += Gglobals->features.weight[i];
+          temp_total_weight += globals->features.weight[i];
           
           for(j=0; j<3; j++) {
-            optical_def_vector[j]         += real_def[j] * Gglobals->features.weight[i];
-            optical_voxel_displacement[j] += vox_def[j]  * Gglobals->features.weight[i];
+            optical_def_vector[j]         += real_def[j] * globals->features.weight[i];
+            optical_voxel_displacement[j] += vox_def[j]  * globals->features.weight[i];
           }
         } 
 
@@ -0,0 +1,561 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : lattice_samples.c
+@DESCRIPTION: the source side of the lattice of a linear fit, compiled
+              once into a list of points.
+
+              Every evaluation of a linear objective function walks the
+              same lattice through the source volume: it checks the
+              source mask at each node, reads the source value there and
+              tests it against the source threshold, and only then maps
+              the node into the target.  None of this depends on the
+              parameters being optimized, so optimize_linear_transformation()
+              builds the list of the nodes that survive (their voxel
+              coordinates in the source, and the source values) before the
+              optimizer starts, and the objective functions only transform
+              these points and sample the target.
+
+              The points are kept in lattice order, slice by slice, so
+              that the objective functions can still share the slices
+              among threads and add them up in order: the result is the
+              same as walking the lattice.
+
+              With -sample_fraction f < 1, only a random subset of the
+              points of each slice (f of them, rounded up) is kept.  The
+              subset is drawn once per list from -sample_seed, so that
+              every evaluation of the fit sees the same points and the
+              run can be repeated.  With -sample_gradient, the points of
+              a slice are drawn with a probability that grows with the
+              gradient magnitude of the source there: the quota of the
+              slice goes mostly to edges rather than to flat background
+              and tissue interiors.
+
+              What is kept at each point follows what the objective
+              function reads from the source:
+                 xcorr       - d1 at the voxel nearest the node (nearest
+                               neighbour), nodes under the threshold are
+                               dropped;
+                 zscore, vr  - d1 at the voxel nearest the node (with the
+                               -trilinear etc. interpolant), the node
+                               itself is mapped into the target;
+                 mi, nmi     - the partial volume bins and weights of d1
+                               at the node (corners that fall in the same
+                               bin are merged), nodes under the threshold
+                               are dropped.
+              ssc counts the sign changes along the scan of the lattice,
+              and still walks it.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <stdlib.h>             /* erand48(), qsort() */
+#include <Proglib.h>
+#include "constants.h"
+#include "minctracc_arg_data.h"
+#include "local_macros.h"
+#include "interpolation.h"
+#include "mask_spans.h"
+#include "vox_space.h"
+#include "objectives.h"
+#include "thread_support.h"
+#include "lattice_samples.h"
+
+extern Arg_Data *main_args;
+
+VIO_BOOL partial_volume_interpolation(VIO_Volume data,
+                                      VIO_Real coord[],
+                                      VIO_Real intensity_vals[],
+                                      VIO_Real fractional_vals[],
+                                      VIO_Real *result);
+int      merge_partial_volume_bins(VIO_Real intensity_vals[],
+                                   VIO_Real fractional_vals[],
+                                   int index[],
+                                   VIO_Real fractions[]);
+
+typedef enum {
+  NEAREST_SAMPLES,              /* xcorr       */
+  TRUE_VALUE_SAMPLES,           /* zscore, vr  */
+  PARTIAL_VOLUME_SAMPLES        /* mi, nmi     */
+} Sample_Kind;
+
+typedef struct {
+  Lattice_Samples    *samples;
+  VIO_Volume          d1, m1;
+  Arg_Data           *globals;
+  Linear_voxel_space  vox_space;
+  PointR              starting_position;
+  Sample_Kind         kind;
+  VIO_BOOL            fill;     /* FALSE: only count the points per slice */
+} Build_Work;
+
+VIO_BOOL lattice_samples_supported(Objective_Function obj_function)
+{
+  return( obj_function == xcorr_objective ||
+          obj_function == zscore_objective ||
+          obj_function == vr_objective ||
+          obj_function == mutual_information_objective ||
+          obj_function == normalized_mutual_information_objective );
+}
+
+static void store_point(Build_Work *work, int n, PointR *point, VIO_Real value1)
+{
+  Lattice_Samples *samples = work->samples;
+
+  samples->coords[3*n]   = Point_x(*point);
+  samples->coords[3*n+1] = Point_y(*point);
+  samples->coords[3*n+2] = Point_z(*point);
+  samples->value1[n]     = value1;
+}
+
+/* count (or, when work->fill, store) the points of slices first..last-1 */
+
+static void walk_source_slices(void *data, int thread, int first, int last)
+{
+  Build_Work
+    *work = (Build_Work *)data;
+  Lattice_Samples
+    *samples = work->samples;
+  Linear_voxel_space
+    *vox_space = &work->vox_space;
+  Arg_Data
+    *globals = work->globals;
+  VectorR
+    vector_step;
+  PointR
+    slice,
+    row,
+    col,
+    voxel;
+  Mask_Row
+    mask_row;
+  VIO_Real
+    coord[3],
+    intensity_vals1[8],
+    fractional_vals1[8],
+    value1;
+  int
+    r,c,s,n,
+    inside;
+  long
+    count1;
+
+  for(s=first; s<last; s++) {
+
+    n      = work->fill ? samples->first[s] : 0;
+    count1 = 0;
+
+    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
+    ADD_POINT_VECTOR( slice, work->starting_position, vector_step );
+
+    for(r=0; r<globals->count[ROW_IND]; r++) {
+
+      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
+      ADD_POINT_VECTOR( row, slice, vector_step );
+
+      SCALE_POINT( col, row, 1.0); /* init first col position */
+
+                                /* skip the nodes of the row that are
+                                   outside of the mask */
+      get_mask_row(work->m1, FALSE, &row, &vox_space->directions[COL_IND],
+                   globals->count[COL_IND], &mask_row);
+
+      for(c=0; c<globals->count[COL_IND]; c++) {
+
+        if (!node_in_mask_row(&mask_row, c)) {
+          ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
+          continue;
+        }
+
+        if (work->kind == PARTIAL_VOLUME_SAMPLES) {
+
+          if (voxel_point_not_masked(work->m1, Point_x(col), Point_y(col), Point_z(col))) {
+
+            coord[VIO_X] = Point_x(col);
+            coord[VIO_Y] = Point_y(col);
+            coord[VIO_Z] = Point_z(col);
+
+            if (partial_volume_interpolation(work->d1, coord,
+                                             intensity_vals1, fractional_vals1,
+                                             &value1) &&
+                value1 > globals->threshold[0]) {
+
+              count1++;
+              if (work->fill) {
+                store_point(work, n, &col, value1);
+                samples->n_bins1[n] = (unsigned char)
+                  merge_partial_volume_bins(intensity_vals1, fractional_vals1,
+                                            &samples->index1[8*n],
+                                            &samples->fractions1[8*n]);
+              }
+              n++;
+            }
+          }
+        }
+        else {
+                                /* use the voxel center closest to this lattice
+                                   node.
+                                */
+          fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) );
+
+          if (voxel_point_not_masked(work->m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
+
+            if (work->kind == NEAREST_SAMPLES)
+              inside = nearest_neighbour_interpolant( work->d1, &voxel, &value1 );
+            else
+              inside = INTERPOLATE_TRUE_VALUE( work->d1, &voxel, &value1 );
+
+            if (inside) {
+
+              count1++;
+
+              if (work->kind == TRUE_VALUE_SAMPLES) {
+                if (work->fill) store_point(work, n, &col, value1);
+                n++;
+              }
+              else if (value1 > globals->threshold[0]) {
+                if (work->fill) store_point(work, n, &voxel, value1);
+                n++;
+              }
+            }
+          }
+        }
+
+        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
+
+      } /* for c */
+    } /* for r */
+
+    if (!work->fill) {
+      samples->first[s+1] = n;  /* # of points, until the sum below */
+      samples->count1[s]  = count1;
+    }
+  } /* for s */
+}
+
+/* move point from of samples to point to (to <= from) */
+
+static void move_lattice_sample(Lattice_Samples *samples, int to, int from)
+{
+  int j;
+
+  samples->coords[3*to]   = samples->coords[3*from];
+  samples->coords[3*to+1] = samples->coords[3*from+1];
+  samples->coords[3*to+2] = samples->coords[3*from+2];
+  samples->value1[to]     = samples->value1[from];
+  if (samples->index1 != NULL) {
+    for(j=0; j<8; j++) {
+      samples->index1[8*to+j]     = samples->index1[8*from+j];
+      samples->fractions1[8*to+j] = samples->fractions1[8*from+j];
+    }
+    samples->n_bins1[to] = samples->n_bins1[from];
+  }
+}
+
+/* the gradient magnitude (per mm) of d1 at the voxel nearest to the
+   voxel coordinate coord, by central differences; 0 on the border */
+
+static VIO_Real source_gradient_magnitude(VIO_Volume d1,
+                                          int sizes[],
+                                          VIO_Real separations[],
+                                          VIO_Real coord[])
+{
+  int      v[3], c;
+  VIO_Real plus, minus, derivative, sum;
+
+  for(c=0; c<3; c++)
+    v[c] = VIO_ROUND(coord[c]);
+
+  sum = 0.0;
+  for(c=0; c<3; c++) {
+    if (v[c] < 1 || v[c] >= sizes[c]-1)
+      return(0.0);
+
+    v[c]++;
+    plus  = get_volume_real_value(d1, v[0], v[1], v[2], 0, 0);
+    v[c] -= 2;
+    minus = get_volume_real_value(d1, v[0], v[1], v[2], 0, 0);
+    v[c]++;
+
+    derivative = (plus - minus) / (2.0 * fabs(separations[c]));
+    sum += derivative * derivative;
+  }
+
+  return(sqrt(sum));
+}
+
+                                /* a point of a slice, and its key for the
+                                   weighted draw of -sample_gradient    */
+typedef struct {
+  VIO_Real key;
+  int      index;
+} Weighted_Sample;
+
+static int compare_sample_keys(const void *a, const void *b)
+{
+  VIO_Real ka = ((const Weighted_Sample *)a)->key;
+  VIO_Real kb = ((const Weighted_Sample *)b)->key;
+
+  return( ka > kb ? -1 : (ka < kb ? 1 : 0) );
+}
+
+static int compare_sample_indices(const void *a, const void *b)
+{
+  return( ((const Weighted_Sample *)a)->index - ((const Weighted_Sample *)b)->index );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : subsample_lattice_samples
+@INPUT      : samples  - the list of all the points of the lattice
+              fraction - of the points of each slice to keep
+              seed     - of the draw
+              gradient - weight the draw by the gradient magnitude of the
+                         source volume
+@OUTPUT     : samples  - only the points drawn, in lattice order
+@RETURNS    : 
+@DESCRIPTION: each slice keeps fraction of its points, rounded up.
+              Without gradient, they are chosen by selection sampling,
+              each point with the same probability.  With gradient, point
+              i gets the weight w = |grad d1| + 10% of the mean over the
+              list (so that flat regions are not left out altogether),
+              and the points with the largest keys log(u)/w, u uniform,
+              are kept: a draw without replacement with probabilities
+              proportional to w (Efraimidis and Spirakis).
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void subsample_lattice_samples(Lattice_Samples *samples,
+                                      VIO_Real fraction,
+                                      int seed,
+                                      VIO_BOOL gradient)
+{
+  unsigned short
+    xsubi[3];
+  int
+    s, i, n_out, start, end, n, n_points, keep, kept,
+    sizes[VIO_MAX_DIMENSIONS];
+  VIO_Real
+    separations[VIO_MAX_DIMENSIONS],
+    *weights, floor_weight, u;
+  Weighted_Sample
+    *draw;
+
+  xsubi[0] = 0x330E;            /* as srand48(seed) */
+  xsubi[1] = (unsigned short)(seed & 0xffff);
+  xsubi[2] = (unsigned short)((seed >> 16) & 0xffff);
+
+  n_points = samples->first[samples->n_slices] - samples->first[0];
+  weights  = NULL;
+  draw     = NULL;
+
+  if (gradient && n_points > 0) {
+    get_volume_sizes(samples->d1, sizes);
+    get_volume_separations(samples->d1, separations);
+
+    ALLOC(weights, n_points);
+    ALLOC(draw, n_points);
+
+    floor_weight = 0.0;
+    for(i=0; i<n_points; i++) {
+      weights[i] = source_gradient_magnitude(samples->d1, sizes, separations,
+                                             &samples->coords[3*(samples->first[0]+i)]);
+      floor_weight += weights[i];
+    }
+    floor_weight = 0.1 * floor_weight / n_points;
+    if (floor_weight <= 0.0)
+      floor_weight = 1.0;
+    for(i=0; i<n_points; i++)
+      weights[i] += floor_weight;
+  }
+
+  n_out = 0;
+  end   = samples->first[0];
+
+  for(s=0; s<samples->n_slices; s++) {
+    start = end;
+    end   = samples->first[s+1];
+    n     = end - start;
+    keep  = (int)ceil(fraction * n);
+
+    samples->first[s] = n_out;
+
+    if (weights != NULL) {
+      for(i=0; i<n; i++) {
+        do {
+          u = erand48(xsubi);
+        } while (u <= 0.0);
+        draw[i].key   = log(u) / weights[start - samples->first[0] + i];
+        draw[i].index = start + i;
+      }
+      qsort(draw, n, sizeof(Weighted_Sample), compare_sample_keys);
+      qsort(draw, keep, sizeof(Weighted_Sample), compare_sample_indices);
+
+      for(i=0; i<keep; i++)
+        move_lattice_sample(samples, n_out++, draw[i].index);
+    }
+    else {
+      for(i=start, kept=0; i<end && kept<keep; i++) {
+                                /* pick the point with probability
+                                   (still to keep)/(still to see)     */
+        if ((VIO_Real)(end - i) * erand48(xsubi) >= (VIO_Real)(keep - kept))
+          continue;
+
+        move_lattice_sample(samples, n_out++, i);
+        kept++;
+      }
+    }
+  }
+
+  samples->first[samples->n_slices] = n_out;
+
+  if (weights != NULL) {
+    FREE(weights);
+    FREE(draw);
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : build_lattice_samples
+@INPUT      : d1, d2, m1 - source, target and source mask, in the order
+                           they are handed to the objective function
+              globals    - the lattice, threshold and objective function
+@OUTPUT     :
+@RETURNS    : the list of the points of the lattice, or NULL if the
+              objective function of globals walks the lattice itself
+@DESCRIPTION: the lattice is walked twice, both times over all threads:
+              once to count the points of each slice, once to store them.
+              The points are then subsampled if globals->sample_fraction
+              is below 1 (weighted by the source gradient if
+              globals->sample_gradient).
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+Lattice_Samples *build_lattice_samples(VIO_Volume d1,
+                                       VIO_Volume d2,
+                                       VIO_Volume m1,
+                                       Arg_Data *globals)
+{
+  Lattice_Samples *samples;
+  Build_Work       work;
+  int              s, n_points;
+
+  if (!lattice_samples_supported(globals->obj_function))
+    return(NULL);
+
+  ALLOC(samples, 1);
+
+  samples->d1           = d1;
+  samples->m1           = m1;
+  samples->obj_function = globals->obj_function;
+  for(s=0; s<3; s++) {
+    samples->start[s]      = globals->start[s];
+    samples->count[s]      = globals->count[s];
+    samples->step[s]       = globals->step[s];
+    samples->directions[s] = globals->directions[s];
+  }
+  samples->fraction     = globals->sample_fraction;
+  samples->seed         = globals->sample_seed;
+  samples->gradient     = globals->sample_gradient;
+  samples->n_slices     = MAX(globals->count[SLICE_IND], 0);
+
+  ALLOC(samples->first,  samples->n_slices+1);
+  ALLOC(samples->count1, samples->n_slices+1);
+
+  work.samples = samples;
+  work.d1      = d1;
+  work.m1      = m1;
+  work.globals = globals;
+
+  if (globals->obj_function == xcorr_objective)
+    work.kind = NEAREST_SAMPLES;
+  else if (globals->obj_function == zscore_objective ||
+           globals->obj_function == vr_objective)
+    work.kind = TRUE_VALUE_SAMPLES;
+  else
+    work.kind = PARTIAL_VOLUME_SAMPLES;
+
+  get_into_linear_voxel_space(globals, &work.vox_space, d1, d2);
+  fill_Point( work.starting_position,
+              work.vox_space.start[VIO_X], work.vox_space.start[VIO_Y], work.vox_space.start[VIO_Z]);
+
+  work.fill = FALSE;
+  samples->first[0] = 0;
+  run_in_parallel(globals->threads, samples->n_slices, 1, walk_source_slices, (void *)&work);
+
+  for(s=0; s<samples->n_slices; s++)
+    samples->first[s+1] += samples->first[s];
+  n_points = MAX(samples->first[samples->n_slices], 1);
+
+  ALLOC(samples->coords, 3*n_points);
+  ALLOC(samples->value1, n_points);
+  if (work.kind == PARTIAL_VOLUME_SAMPLES) {
+    ALLOC(samples->index1,     8*n_points);
+    ALLOC(samples->fractions1, 8*n_points);
+    ALLOC(samples->n_bins1,    n_points);
+  }
+  else {
+    samples->index1     = NULL;
+    samples->fractions1 = NULL;
+    samples->n_bins1    = NULL;
+  }
+
+  work.fill = TRUE;
+  run_in_parallel(globals->threads, samples->n_slices, 1, walk_source_slices, (void *)&work);
+
+  if (samples->fraction < 1.0)
+    subsample_lattice_samples(samples, samples->fraction, samples->seed,
+                              samples->gradient);
+
+  return(samples);
+}
+
+/* TRUE if samples can stand for the lattice walk of the objective
+   function of globals, on d1 and m1 */
+
+VIO_BOOL lattice_samples_match(Lattice_Samples *samples,
+                               VIO_Volume d1,
+                               VIO_Volume m1,
+                               Arg_Data *globals)
+{
+  int s, c;
+
+  if (samples == NULL)
+    return(FALSE);
+
+                                /* the lattice is also fixed by the
+                                   step and the directions of its axes */
+  for(s=0; s<3; s++) {
+    if (samples->step[s] != globals->step[s])
+      return(FALSE);
+    for(c=0; c<VIO_N_DIMENSIONS; c++)
+      if (samples->directions[s].coords[c] != globals->directions[s].coords[c])
+        return(FALSE);
+  }
+
+  return( samples->d1 == d1 && samples->m1 == m1 &&
+          samples->obj_function == globals->obj_function &&
+          samples->start[VIO_X] == globals->start[VIO_X] &&
+          samples->start[VIO_Y] == globals->start[VIO_Y] &&
+          samples->start[VIO_Z] == globals->start[VIO_Z] &&
+          samples->count[VIO_X] == globals->count[VIO_X] &&
+          samples->count[VIO_Y] == globals->count[VIO_Y] &&
+          samples->count[VIO_Z] == globals->count[VIO_Z] &&
+          samples->fraction == globals->sample_fraction &&
+          samples->seed == globals->sample_seed &&
+          samples->gradient == globals->sample_gradient );
+}
+
+void delete_lattice_samples(Lattice_Samples *samples)
+{
+  if (samples == NULL)
+    return;
+
+  FREE(samples->first);
+  FREE(samples->count1);
+  FREE(samples->coords);
+  FREE(samples->value1);
+  if (samples->index1 != NULL)     FREE(samples->index1);
+  if (samples->fractions1 != NULL) FREE(samples->fractions1);
+  if (samples->n_bins1 != NULL)    FREE(samples->n_bins1);
+  FREE(samples);
+}
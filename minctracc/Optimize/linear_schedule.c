@@ -0,0 +1,229 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : linear_schedule.c
+@DESCRIPTION: coarse-to-fine estimation of a linear transformation within
+              a single minctracc run.
+
+              Each level of the schedule given with -linear_schedule
+              blurs (and, for the coarse levels, subsamples) the source
+              and target volumes in memory, sets the lattice step, the
+              simplex radius, the stopping tolerance and, optionally, the
+              objective function of the level, and runs the usual linear
+              optimization.  The parameters found at one level are the
+              starting point of the next one.
+
+              This replaces a chain of mincblur and minctracc runs (as in
+              the fits of mritotal) that each read the blurred volumes
+              and the transformation of the previous fit from disk.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "minctracc.h"
+#include "pyramid_volumes.h"
+#include "mask_spans.h"
+#include "perf_report.h"
+
+extern double   ftol;
+extern double   simplex_size;
+extern VIO_Real initial_corr, final_corr;
+
+static Objective_Function get_level_objective(int obj_function_type)
+{
+  switch (obj_function_type) {
+  case XCORR:                         return(xcorr_objective);
+  case ZSCORE:                        return(zscore_objective);
+  case SSC:                           return(ssc_objective);
+  case VR:                            return(vr_objective);
+  case MUTUAL_INFORMATION:            return(mutual_information_objective);
+  case NORMALIZED_MUTUAL_INFORMATION: return(normalized_mutual_information_objective);
+  default:                            return(NULL);
+  }
+}
+
+/* return the level version of volume, or volume itself when the level
+   neither blurs nor subsamples it.  -zscore, -ssc, -mi and -nmi rewrite
+   the volumes they are given, so these always get a copy, to leave the
+   full resolution volumes intact for the next levels.  A new level mask
+   gets its spans (see mask_spans.c), which delete_level_volume() frees. */
+
+static VIO_Volume get_level_volume(VIO_Volume volume, VIO_Real fwhm,
+                                   VIO_BOOL is_mask, VIO_BOOL rewritten)
+{
+  VIO_Volume level_mask;
+  int        factor[VIO_N_DIMENSIONS];
+
+  if (volume == NULL)
+    return(NULL);
+
+  get_pyramid_subsampling(volume, fwhm, factor);
+
+  if (factor[0]==1 && factor[1]==1 && factor[2]==1 &&
+      (is_mask || (fwhm <= 0.0 && !rewritten)))
+    return(volume);
+
+  if (!is_mask)
+    return( make_pyramid_volume(volume, fwhm, factor) );
+
+  level_mask = make_pyramid_volume(volume, 0.0, factor);
+  (void)make_mask_spans(level_mask);
+
+  return(level_mask);
+}
+
+static void delete_level_volume(VIO_Volume level_volume, VIO_Volume volume)
+{
+  if (level_volume != NULL && level_volume != volume) {
+    delete_mask_spans(level_volume);
+    delete_volume(level_volume);
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : optimize_linear_schedule
+@INPUT      : d1,d2:
+                source and target volumes, at full resolution
+              m1,m2:
+                their masks (or NULL)
+              globals:
+                globals->linear_schedule holds the levels, from coarse to
+                fine.  globals->trans_info holds the starting parameters
+                (from init_params()).
+@OUTPUT     : globals->trans_info: the parameters and transformation of
+                the last level.
+@RETURNS    : TRUE if ok, FALSE if error.
+@DESCRIPTION: -multistart is only used on the first level.  initial_corr
+              is the objective function before the first level, final_corr
+              the one after the last level.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL optimize_linear_schedule(VIO_Volume d1,
+                                  VIO_Volume d2,
+                                  VIO_Volume m1,
+                                  VIO_Volume m2,
+                                  Arg_Data *globals)
+{
+  Linear_Level
+    *level;
+  VIO_Volume
+    level_d1, level_d2, level_m1, level_m2;
+  Objective_Function
+    obj_function;
+  VIO_Real
+    threshold[2],
+    first_corr;
+  double
+    run_ftol, run_simplex_size, run_sample_fraction,
+    run_step[VIO_N_DIMENSIONS];
+  VIO_BOOL
+    stat, rewritten;
+  int
+    l, i,
+    run_multistart,
+    level_phase, perf_phase;
+
+  stat = TRUE;
+
+  obj_function        = globals->obj_function;
+  run_ftol            = ftol;
+  run_simplex_size    = simplex_size;
+  run_multistart      = globals->multistart;
+  run_sample_fraction = globals->sample_fraction;
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    run_step[i] = globals->step[i];
+  first_corr          = 0.0;
+
+  for(l=0; l<globals->linear_schedule.n_levels && stat; l++) {
+
+    level = &globals->linear_schedule.level[l];
+
+    level_phase = begin_perf_phase("linear_level");
+
+    globals->obj_function = (level->obj_function_type < 0) ? obj_function :
+                            get_level_objective(level->obj_function_type);
+    simplex_size = level->simplex;
+    ftol         = level->tolerance;
+    globals->sample_fraction = (level->sample_fraction < 0.0) ?
+                               run_sample_fraction : level->sample_fraction;
+    if (l > 0)
+      globals->multistart = 1;
+
+    if (globals->flags.verbose>0)
+      print ("Level %d of %d: fwhm %g, step %g, simplex %g, tolerance %g, sample fraction %g\n",
+             l+1, globals->linear_schedule.n_levels, level->fwhm, level->step,
+             level->simplex, level->tolerance, globals->sample_fraction);
+
+    rewritten = (globals->obj_function == zscore_objective ||
+                 globals->obj_function == ssc_objective ||
+                 globals->obj_function == mutual_information_objective ||
+                 globals->obj_function == normalized_mutual_information_objective);
+
+    perf_phase = begin_perf_phase("level_volumes");
+    level_d1 = get_level_volume(d1, level->fwhm, FALSE, rewritten);
+    level_d2 = get_level_volume(d2, level->fwhm, FALSE, rewritten);
+    level_m1 = get_level_volume(m1, level->fwhm, TRUE, FALSE);
+    level_m2 = get_level_volume(m2, level->fwhm, TRUE, FALSE);
+    end_perf_phase(perf_phase);
+
+    globals->features.data[0]       = level_d1;
+    globals->features.model[0]      = level_d2;
+    globals->features.data_mask[0]  = level_m1;
+    globals->features.model_mask[0] = level_m2;
+
+    for(i=0; i<VIO_N_DIMENSIONS; i++)
+      globals->step[i] = (run_step[i] < 0.0) ? -level->step : level->step;
+
+                                /* -zscore and -ssc rescale the thresholds
+                                   along with the volumes */
+    threshold[0] = globals->threshold[0];
+    threshold[1] = globals->threshold[1];
+
+    perf_phase = begin_perf_phase("lattice_setup");
+    init_lattice(level_d1, level_d2, level_m1, level_m2, globals);
+    end_perf_phase(perf_phase);
+
+    if (globals->trans_info.rotation_type == TRANS_QUAT)
+      stat = optimize_linear_transformation_quater(level_d1, level_d2,
+                                                   level_m1, level_m2, globals);
+    else
+      stat = optimize_linear_transformation(level_d1, level_d2,
+                                            level_m1, level_m2, globals);
+
+    if (l == 0)
+      first_corr = initial_corr;
+
+    if (globals->flags.verbose>0)
+      print ("Level %d objective function: %0.8f -> %0.8f\n",
+             l+1, initial_corr, final_corr);
+
+    globals->threshold[0] = threshold[0];
+    globals->threshold[1] = threshold[1];
+
+    delete_level_volume(level_d1, d1);
+    delete_level_volume(level_d2, d2);
+    delete_level_volume(level_m1, m1);
+    delete_level_volume(level_m2, m2);
+
+    end_perf_phase(level_phase);
+  }
+
+  initial_corr = first_corr;
+
+  globals->obj_function    = obj_function;
+  ftol                     = run_ftol;
+  simplex_size             = run_simplex_size;
+  globals->multistart      = run_multistart;
+  globals->sample_fraction = run_sample_fraction;
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    globals->step[i] = run_step[i];
+
+  globals->features.data[0]       = d1;
+  globals->features.model[0]      = d2;
+  globals->features.data_mask[0]  = m1;
+  globals->features.model_mask[0] = m2;
+
+  return(stat);
+}
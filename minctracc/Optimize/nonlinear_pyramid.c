@@ -0,0 +1,183 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nonlinear_pyramid.c
+@DESCRIPTION: coarse-to-fine estimation of a nonlinear deformation field
+              within a single minctracc run.
+
+              Each level of the schedule given with -nonlinear_schedule
+              blurs (and, for the coarse levels, subsamples) the source
+              and target volumes in memory, sets the node spacing,
+              sub-lattice diameter and number of iterations of the level,
+              and runs the usual nonlinear optimization.  The deformation
+              field estimated at one level is resampled onto the lattice
+              of the next by build_default_deformation_field(), exactly as
+              when a previous fit is given with -transformation.
+
+              This replaces a chain of mincblur and minctracc runs that
+              write each blurred volume and intermediate transformation to
+              disk only to read them back at the next level.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "minctracc.h"
+#include "pyramid_volumes.h"
+#include "mask_spans.h"
+#include "perf_report.h"
+
+extern int iteration_limit;      /* total number of iterations       */
+
+/* return the level version of volume, or volume itself when the level
+   neither blurs nor subsamples it.  A new level mask gets its spans
+   (see mask_spans.c), which delete_level_volume() frees. */
+
+static VIO_Volume get_level_volume(VIO_Volume volume, VIO_Real fwhm,
+                                   VIO_BOOL is_mask)
+{
+  VIO_Volume level_mask;
+  int        factor[VIO_N_DIMENSIONS];
+
+  if (volume == NULL)
+    return(NULL);
+
+  get_pyramid_subsampling(volume, fwhm, factor);
+
+  if (factor[0]==1 && factor[1]==1 && factor[2]==1 && (is_mask || fwhm <= 0.0))
+    return(volume);
+
+  if (!is_mask)
+    return( make_pyramid_volume(volume, fwhm, factor) );
+
+  level_mask = make_pyramid_volume(volume, 0.0, factor);
+  (void)make_mask_spans(level_mask);
+
+  return(level_mask);
+}
+
+static void delete_level_volume(VIO_Volume level_volume, VIO_Volume volume)
+{
+  if (level_volume != NULL && level_volume != volume) {
+    delete_mask_spans(level_volume);
+    delete_volume(level_volume);
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : optimize_non_linear_pyramid
+@INPUT      : d1,d2:
+                source and target volumes, at full resolution
+              m1,m2:
+                their masks (or NULL)
+              globals:
+                globals->pyramid holds the levels, from coarse to fine.
+                The deformation field is appended to
+                globals->trans_info.transformation on the first level.
+@OUTPUT     : globals->trans_info.transformation
+@RETURNS    : TRUE if ok, FALSE if error.
+@DESCRIPTION: only the main source/target pair (feature 0) is blurred and
+              subsampled; volumes given with -feature_vol are used as they
+              are at every level.  globals->step, globals->lattice_width
+              and iteration_limit are set by each level and restored
+              at the end.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL optimize_non_linear_pyramid(VIO_Volume d1,
+                                     VIO_Volume d2,
+                                     VIO_Volume m1,
+                                     VIO_Volume m2,
+                                     Arg_Data *globals)
+{
+  Pyramid_Level
+    *level;
+  VIO_Volume
+    level_d1, level_d2, level_m1, level_m2;
+  VIO_Real
+    threshold[2],
+    run_step[VIO_N_DIMENSIONS],
+    run_lattice_width[VIO_N_DIMENSIONS];
+  VIO_BOOL
+    stat;
+  int
+    l, i,
+    run_iteration_limit,
+    level_phase, perf_phase;
+
+  stat = TRUE;
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++) {
+    run_step[i]          = globals->step[i];
+    run_lattice_width[i] = globals->lattice_width[i];
+  }
+  run_iteration_limit = iteration_limit;
+
+  for(l=0; l<globals->pyramid.n_levels && stat; l++) {
+
+    level = &globals->pyramid.level[l];
+
+    level_phase = begin_perf_phase("nonlinear_level");
+
+    if (globals->flags.verbose>0)
+      print ("Level %d of %d: fwhm %g, step %g, lattice diameter %g, %d iterations\n",
+             l+1, globals->pyramid.n_levels, level->fwhm, level->step,
+             level->lattice_width, level->iterations);
+
+    perf_phase = begin_perf_phase("level_volumes");
+    level_d1 = get_level_volume(d1, level->fwhm, FALSE);
+    level_d2 = get_level_volume(d2, level->fwhm, FALSE);
+    level_m1 = get_level_volume(m1, level->fwhm, TRUE);
+    level_m2 = get_level_volume(m2, level->fwhm, TRUE);
+    end_perf_phase(perf_phase);
+
+    globals->features.data[0]       = level_d1;
+    globals->features.model[0]      = level_d2;
+    globals->features.data_mask[0]  = level_m1;
+    globals->features.model_mask[0] = level_m2;
+
+                                /* an axis without a lattice (2D fits)
+                                   keeps a zero diameter */
+    for(i=0; i<VIO_N_DIMENSIONS; i++) {
+      globals->step[i]          = (run_step[i] < 0.0) ? -level->step : level->step;
+      globals->lattice_width[i] = (run_lattice_width[i] == 0.0) ? 0.0 : level->lattice_width;
+    }
+    iteration_limit = level->iterations;
+
+                                /* -zscore and -ssc rescale the thresholds
+                                   along with the volumes */
+    threshold[0] = globals->threshold[0];
+    threshold[1] = globals->threshold[1];
+
+    perf_phase = begin_perf_phase("lattice_setup");
+    init_lattice(level_d1, level_d2, level_m1, level_m2, globals);
+
+    build_default_deformation_field(globals);
+    end_perf_phase(perf_phase);
+
+    stat = optimize_non_linear_transformation(globals);
+
+    globals->threshold[0] = threshold[0];
+    globals->threshold[1] = threshold[1];
+
+    delete_level_volume(level_d1, d1);
+    delete_level_volume(level_d2, d2);
+    delete_level_volume(level_m1, m1);
+    delete_level_volume(level_m2, m2);
+
+    end_perf_phase(level_phase);
+  }
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++) {
+    globals->step[i]          = run_step[i];
+    globals->lattice_width[i] = run_lattice_width[i];
+  }
+  iteration_limit = run_iteration_limit;
+
+  globals->features.data[0]       = d1;
+  globals->features.model[0]      = d2;
+  globals->features.data_mask[0]  = m1;
+  globals->features.model_mask[0] = m2;
+
+  return(stat);
+}
@@ -91,15 +91,15 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include "minctracc_arg_data.h"
 #include "vox_space.h"
 #include "objectives.h"
+#include "thread_support.h"
+#include "lattice_samples.h"
 #include <math.h>
 
 extern Arg_Data *main_args;
 
-                        /* these are defined/alloc'd in optimize.c  */
+                        /* this is defined/alloc'd in optimize.c  */
 
-extern VIO_Real            **prob_hash_table; 
-extern VIO_Real            *prob_fn1;         
-extern VIO_Real            *prob_fn2;         
+extern Lattice_Samples     *lattice_samples;
 
 int point_not_masked(VIO_Volume volume, VIO_Real wx, VIO_Real wy, VIO_Real wz);
 int voxel_point_not_masked(VIO_Volume volume, 
@@ -124,21 +124,22 @@ int voxel_point_not_masked(VIO_Volume volume,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Tue Mar 12 09:37:44 MET 1996
-@MODIFIED   : 
+@MODIFIED   : Oct 18, 2026 - the work is done by partial_volume_at(),
+              which the objective function calls with the sizes of the
+              volume looked up once per evaluation.
 ---------------------------------------------------------------------------- */
-VIO_BOOL partial_volume_interpolation(VIO_Volume data,
-                                            VIO_Real coord[],
-                                            VIO_Real intensity_vals[],
-                                            VIO_Real fractional_vals[],
-                                            VIO_Real *result)
+static VIO_BOOL partial_volume_at(VIO_Volume data,
+                                  int sizes[],
+                                  VIO_Real coord[],
+                                  VIO_Real intensity_vals[],
+                                  VIO_Real fractional_vals[],
+                                  VIO_Real *result)
 {
   long ind0, ind1, ind2, max[3];
-  int sizes[3];
-  static double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
+  double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
   
   /* Check that the coordinate is inside the volume */
   
-  get_volume_sizes(data, sizes);
   max[0]=sizes[0];
   max[1]=sizes[1];
   max[2]=sizes[2];
@@ -208,6 +209,49 @@ VIO_BOOL partial_volume_interpolation(VIO_Volume data,
   return TRUE;
   
 }
+
+VIO_BOOL partial_volume_interpolation(VIO_Volume data,
+                                            VIO_Real coord[],
+                                            VIO_Real intensity_vals[],
+                                            VIO_Real fractional_vals[],
+                                            VIO_Real *result)
+{
+  int sizes[3];
+
+  get_volume_sizes(data, sizes);
+
+  return( partial_volume_at(data, sizes, coord, intensity_vals, fractional_vals, result) );
+}
+
+/* the distinct histogram bins of the 8 corners of a partial volume
+   interpolation, in index[], with the sum of the fractions of the
+   corners that fall in each, in fractions[].  Returns the number of
+   bins (1 to 8): in smooth regions most corners share a bin, and the
+   joint histogram gets n1*n2 updates per node instead of 64. */
+
+int merge_partial_volume_bins(VIO_Real intensity_vals[],
+                              VIO_Real fractional_vals[],
+                              int index[],
+                              VIO_Real fractions[])
+{
+  int i, j, n, bin;
+
+  n = 0;
+  for(i=0; i<8; i++) {
+    bin = VIO_ROUND( intensity_vals[i] );
+    for(j=0; j<n && index[j] != bin; j++)
+      /* empty */ ;
+    if (j == n) {
+      index[n]     = bin;
+      fractions[n] = fractional_vals[i];
+      n++;
+    }
+    else
+      fractions[j] += fractional_vals[i];
+  }
+
+  return(n);
+}
         
 
 static void blur_pdf( VIO_Real *pdf, int blur_size, int pdf_length) {
@@ -286,7 +330,36 @@ static void blur_jpdf (VIO_Real **hist, int blur_size, int pdf_length) {
     VIO_Real **temp_hist, *temp_col;
     int i,j;
     
-    if (blur_size > 1) 
+    if (blur_size == 3)         /* the default: the same as below, with
+                                   the columns blurred a row at a time */
+    {
+        VIO_ALLOC2D(temp_hist, pdf_length, pdf_length);
+
+        for(i=0; i<pdf_length; i++)   /* blur the rows */
+        {
+            temp_hist[i][0]            = hist[i][0];
+            temp_hist[i][pdf_length-1] = hist[i][pdf_length-1];
+            if (i == 0 || i == pdf_length-1)
+                for(j=1; j<pdf_length-1; j++)
+                    temp_hist[i][j] = hist[i][j];
+            else
+                for(j=1; j<pdf_length-1; j++)
+                    temp_hist[i][j] = (hist[i][j-1] + hist[i][j] + hist[i][j+1])/3.0;
+        }
+
+        for(i=0; i<pdf_length; i++)   /* blur the cols (not the first and last) */
+        {
+            if (i == 0 || i == pdf_length-1)
+                for(j=1; j<pdf_length-1; j++)
+                    hist[i][j] = temp_hist[i][j];
+            else
+                for(j=1; j<pdf_length-1; j++)
+                    hist[i][j] = (temp_hist[i-1][j] + temp_hist[i][j] + temp_hist[i+1][j])/3.0;
+        }
+
+        VIO_FREE2D(temp_hist);
+    }
+    else if (blur_size > 1) 
     {
                     
         VIO_ALLOC2D(temp_hist, pdf_length, pdf_length);
@@ -318,6 +391,128 @@ static void blur_jpdf (VIO_Real **hist, int blur_size, int pdf_length) {
 }
 
 
+                                /* the histograms of one block of slices
+                                   of the lattice of
+                                   mutual_information_objective()     */
+typedef struct {
+  VIO_Real   *prob_fn1;
+  VIO_Real   *prob_fn2;
+  VIO_Real  **prob_hash_table;
+  long        count1, count2;
+} MI_Histograms;
+
+                                /* everything the threads need to fill
+                                   the histograms, one block of
+                                   contiguous slices each.  The blocks are
+                                   added up in order, so that the result
+                                   is the same from one run to the next.
+                                   The source side of the lattice comes
+                                   from the list of lattice_samples.c */
+typedef struct {
+  VIO_Volume          d1, d2, m1, m2;
+  Arg_Data           *globals;
+  VIO_Transform      *trans;
+  Lattice_Samples    *samples;
+  int                 sizes2[3];  /* of d2                              */
+  int                 slices_per_block;
+  MI_Histograms      *blocks;
+} MI_Work;
+
+static void fill_histogram_blocks(void *data, int thread, int first, int last)
+{
+  MI_Work
+    *work = (MI_Work *)data;
+  Lattice_Samples
+    *samples = work->samples;
+  Arg_Data
+    *globals = work->globals;
+  MI_Histograms
+    *h;
+  VIO_Real
+    voxel_coord[3],
+    *coord,
+    *fractional_vals1,
+    *joint_row,
+    f1;
+  int
+    b,i,j,n,
+    *index1,
+    index2[8],
+    n_bins1, n_bins2,
+    s,
+    last_slice;
+  VIO_Real
+    intensity_vals2[8],                /* voxel values to index into histogram */
+    fractional_vals2[8],        /* fractional values to add to histo */
+    fractions2[8],              /* ...merged by bin                  */
+    value2;
+
+  for(b=first; b<last; b++) {
+
+    h = &work->blocks[b];
+
+    last_slice = MIN((b+1)*work->slices_per_block, samples->n_slices);
+
+    /* ---------- step through the slices of the block ------------- */
+    for(s=b*work->slices_per_block; s<last_slice; s++) {
+
+      h->count1 += samples->count1[s];
+
+                                /* the nodes of this slice that are in
+                                   volume 1 and over its threshold      */
+      for(n=samples->first[s]; n<samples->first[s+1]; n++) {
+
+        coord            = &samples->coords[3*n];
+        index1           = &samples->index1[8*n];
+        fractional_vals1 = &samples->fractions1[8*n];
+        n_bins1          = samples->n_bins1[n];
+
+                                /* transform the node coordinate into
+                                   volume 2                             */
+
+        my_homogenous_transform_point(work->trans,
+                                      coord[0], coord[1], coord[2], 1.0,
+                                      &voxel_coord[VIO_X], &voxel_coord[VIO_Y], &voxel_coord[VIO_Z]);
+              
+        /* get the node value in volume 2,
+           if it falls within the volume    */
+              
+        if (voxel_point_not_masked(work->m2, voxel_coord[VIO_X], voxel_coord[VIO_Y], voxel_coord[VIO_Z] )) {
+                 
+          if (partial_volume_at(work->d2, work->sizes2,
+                                voxel_coord, 
+                                intensity_vals2,
+                                fractional_vals2,
+                                &value2 )) {
+                  
+            if (value2 > globals->threshold[1]) { /* is the voxel in the thresholded region? */
+
+              h->count2++;
+
+              n_bins2 = merge_partial_volume_bins(intensity_vals2, fractional_vals2,
+                                                  index2, fractions2);
+                       
+              for(i=0; i<n_bins1; i++)
+                h->prob_fn1[ index1[i] ] += fractional_vals1[i];
+              for(j=0; j<n_bins2; j++)
+                h->prob_fn2[ index2[j] ] += fractions2[j];
+
+              for(i=0; i<n_bins1; i++) {
+                joint_row = h->prob_hash_table[ index1[i] ];
+                f1        = fractional_vals1[i];
+                for(j=0; j<n_bins2; j++)
+                  joint_row[ index2[j] ] += f1*fractions2[j];
+              }
+                       
+            } /* if value2>thres */
+          } /* if voxel in d2 */
+        } /* if point in mask volume two */
+      } /* for n */
+    } /* for s */
+
+  } /* for b */
+}
+
 /* this function will calculate the mutual information similarity
    value based on the paper by Collignon, IPMI95, p 266 
 
@@ -341,31 +536,23 @@ float mutual_information_objective(VIO_Volume d1,
                                           Arg_Data *globals)
 {
 
-  VectorR                        /* these variables are used to step through */
-    vector_step;                /* the 3D lattice                           */
-  PointR
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2;
-  VIO_Real
-    voxel_coord[3];
+  MI_Work
+    work;
+  MI_Histograms
+    *h;
+  Linear_voxel_space
+    vox_space;
+  VIO_BOOL
+    own_samples;
+  VIO_Real                      /* the histograms of the whole lattice */
+    *prob_fn1,
+    *prob_fn2,
+    **prob_hash_table;
   int
-    i,j,
+    i,j,k,b,
     count1,count2,                /* number of nodes in first vol, second vol */
-    index1[8],
-    index2[8],
-    r,c,s;
-  
-  VIO_Real
-    min_range1, max_range1, range1,
-    min_range2, max_range2, range2,
-    intensity_vals1[8],                /* voxel values to index into histogram */
-    intensity_vals2[8],
-    fractional_vals1[8],        /* fractional values to add to histo */
-    fractional_vals2[8],
-    value1, value2;
+    n_slices, n_blocks,
+    *bins2, n_bins2;              /* the bins of prob_fn2 that are > 0 */
   double
     Hy, Hx, Ixy;		/* entropies */
   double
@@ -373,137 +560,94 @@ float mutual_information_objective(VIO_Volume d1,
   float 
     mutual_info_result;                        
 
-  Voxel_space_struct *vox_space;
-  VIO_Transform          *trans;
-
 
                                 /* init any objective function specific
                                    stuff here                           */
   count1 = count2 = 0;
   mutual_info_result = 0.0;
 
-  for(i=0; i<globals->groups; i++) {
-    prob_fn1[i] = 0.0;
-    prob_fn2[i] = 0.0;
-  }
-
-  for(i=0; i<globals->groups; i++) 
-    for(j=0; j<globals->groups; j++) 
-      prob_hash_table[i][j] = 0.0;
-
-  /*
-    this was here, but appears to be useless!  dlc 04/2009
-
-    get_volume_minimum_maximum_real_value(d1, &min_range1, &max_range1);
-    get_volume_minimum_maximum_real_value(d2, &min_range2, &max_range2);
-    
-    range1 = max_range1 - min_range1;
-    range2 = max_range2 - min_range2;
-
-  */
-
-
                                 /* prepare data for the voxel-to-voxel
                                    space transformation (instead of the
                                    general but inefficient world-world
                                    computations. */
 
-  vox_space = new_voxel_space_struct();
-  get_into_voxel_space(globals, vox_space, d1, d2);
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
-
-                                /* get ready to step though the 3D lattice
-                                   */
+  work.d1      = d1;
+  work.d2      = d2;
+  work.m1      = m1;
+  work.m2      = m2;
+  work.globals = globals;
+
+  get_into_linear_voxel_space(globals, &vox_space, d1, d2);
+  work.trans = &vox_space.voxel_to_voxel;
+  get_volume_sizes(d2, work.sizes2);
+
+                                /* the source side of the lattice */
+  own_samples = !lattice_samples_match(lattice_samples, d1, m1, globals);
+  if (own_samples)
+    work.samples = build_lattice_samples(d1, d2, m1, globals);
+  else
+    work.samples = lattice_samples;
+
+                                /* one block of slices per thread, each
+                                   with its own histograms: nothing is
+                                   shared with another evaluation that
+                                   may run at the same time (-multistart) */
+  n_slices = work.samples->n_slices;
+  n_blocks = get_number_of_threads_to_use(globals->threads, n_slices);
+  work.slices_per_block = (n_slices + n_blocks - 1) / n_blocks;
+  if (work.slices_per_block < 1) work.slices_per_block = 1;
+
+  ALLOC(work.blocks, n_blocks);
+
+  for(b=0; b<n_blocks; b++) {
+    h = &work.blocks[b];
+    ALLOC(h->prob_fn1, globals->groups);
+    ALLOC(h->prob_fn2, globals->groups);
+    VIO_ALLOC2D(h->prob_hash_table, globals->groups, globals->groups);
+    h->count1 = h->count2 = 0;
 
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
-
-  /* ---------- step through all slices of lattice ------------- */
-  for(s=0; s<globals->count[SLICE_IND]; s++) {
-
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
+    for(i=0; i<globals->groups; i++) {
+      h->prob_fn1[i] = 0.0;
+      h->prob_fn2[i] = 0.0;
+    }
 
-    /* ---------- step through all rows of lattice ------------- */
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
+    for(i=0; i<globals->groups; i++) 
+      for(j=0; j<globals->groups; j++) 
+        h->prob_hash_table[i][j] = 0.0;
+  }
 
-      /* ---------- step through all cols of lattice ------------- */
-      for(c=0; c<globals->count[COL_IND]; c++) {
-        
-                                   /* get the node value in volume 1,
-                                      if it falls within the volume    */
+  run_in_parallel(n_blocks, n_blocks, 1, fill_histogram_blocks, (void *)&work);
 
-        if (voxel_point_not_masked(m1, Point_x(col), Point_y(col), Point_z(col))) {
-          
-           voxel_coord[VIO_X] = Point_x(col);
-           voxel_coord[VIO_Y] = Point_y(col);
-           voxel_coord[VIO_Z] = Point_z(col);
-           
+                                /* add the blocks up, in order, into
+                                   the first one */
+  prob_fn1        = work.blocks[0].prob_fn1;
+  prob_fn2        = work.blocks[0].prob_fn2;
+  prob_hash_table = work.blocks[0].prob_hash_table;
 
-          if (partial_volume_interpolation(d1, 
-                                           voxel_coord, 
-                                           intensity_vals1,
-                                           fractional_vals1,
-                                           &value1 )) {
+  for(b=0; b<n_blocks; b++) {
+    h = &work.blocks[b];
 
-            if (value1 > globals->threshold[0]) { /* is the voxel in the thresholded region? */
+    count1 += (int)h->count1;
+    count2 += (int)h->count2;
 
-              count1++;
-                                /* transform the node coordinate into
-                                   volume 2                             */
+    if (b > 0) {
+      for(i=0; i<globals->groups; i++) {
+        prob_fn1[i] += h->prob_fn1[i];
+        prob_fn2[i] += h->prob_fn2[i];
+      }
+      for(i=0; i<globals->groups; i++) 
+        for(j=0; j<globals->groups; j++) 
+          prob_hash_table[i][j] += h->prob_hash_table[i][j];
 
-              my_homogenous_transform_point(trans,
-                                            Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                            &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-              
-              /* get the node value in volume 2,
-                 if it falls within the volume    */
-              
-              if (voxel_point_not_masked(m2,Point_x(pos2), Point_y(pos2), Point_z(pos2) )) {
-                 
-                 voxel_coord[VIO_X] = Point_x(pos2);
-                 voxel_coord[VIO_Y] = Point_y(pos2);
-                 voxel_coord[VIO_Z] = Point_z(pos2);
-                 
-                 if (partial_volume_interpolation(d2, 
-                                                  voxel_coord, 
-                                                  intensity_vals2,
-                                                  fractional_vals2,
-                                                  &value2 )) {
-                  
-                    if (value2 > globals->threshold[1]) { /* is the voxel in the thresholded region? */
+      FREE(h->prob_fn1);
+      FREE(h->prob_fn2);
+      VIO_FREE2D(h->prob_hash_table);
+    }
+  }
 
-                       count2++;
-                       
-                       for(i=0; i<8; i++) {
-                          index1[i] = VIO_ROUND( intensity_vals1[i] );
-                          index2[i] = VIO_ROUND( intensity_vals2[i] );
-                          prob_fn1[ index1[i] ] += fractional_vals1[i];
-                          prob_fn2[ index2[i] ] += fractional_vals2[i];
-                       }
-                       for(i=0; i<8; i++) 
-                          for(j=0; j<8; j++) {
-                             prob_hash_table[ index1[i] ][ index2[j] ] += 
-                                fractional_vals1[i]*fractional_vals2[j];
-                          }
-                       
-                       
-                    } /* if value2>thres */
-                 } /* if voxel in d2 */
-              } /* if point in mask volume two */
-           } /* if value1>thres */
-         } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
+  FREE(work.blocks);
+  if (own_samples)
+    delete_lattice_samples(work.samples);
 
 
 
@@ -533,10 +677,18 @@ float mutual_information_objective(VIO_Volume d1,
       prob_fn1[i] /= count2;
       prob_fn2[i] /= count2;
     }
+
+                                /* the sums below only look at bins
+                                   where both marginals are > 0 */
+    ALLOC(bins2, globals->groups);
+    n_bins2 = 0;
+    for(j=0; j<globals->groups; j++)
+      if (prob_fn2[j] > 0.0) bins2[n_bins2++] = j;
     
     for(i=0; i<globals->groups; i++) 
-      for(j=0; j<globals->groups; j++) 
-        prob_hash_table[i][j] /= count2;
+      if (prob_fn1[i] > 0.0)
+        for(k=0; k<n_bins2; k++) 
+          prob_hash_table[i][bins2[k]] /= count2;
     
 
 
@@ -580,7 +732,9 @@ float mutual_information_objective(VIO_Volume d1,
       }
       
       for(i=0; i<globals->groups; i++) {        /* compute mutual information */
-	for(j=0; j<globals->groups; j++) {
+	if (prob_fn1[i] <= 0.0) continue;
+	for(k=0; k<n_bins2; k++) {
+	  j = bins2[k];
 	  product = prob_fn1[i]*prob_fn2[j] ;
 	  if (prob_hash_table[i][j]>0.0 && product>0.0) 
 	    Ixy += (double)prob_hash_table[i][j] *  log( (double)( prob_hash_table[i][j]/product));
@@ -597,7 +751,8 @@ float mutual_information_objective(VIO_Volume d1,
 
     } else {			/* this is the standard MI computation pre Oct 2008 (the -mi option for linear reg) */
       for(i=0; i<globals->groups; i++) 
-	for(j=0; j<globals->groups; j++) {
+	for(k=0; k<n_bins2; k++) {
+	  j = bins2[k];
 	  
 	  if ( prob_fn1[i] > 0.0 &&  prob_fn2[j] > 0.0 && prob_hash_table[i][j]>0.0)
 	    /* this is the same as Ixy, just above */
@@ -607,6 +762,8 @@ float mutual_information_objective(VIO_Volume d1,
     }
 
     mutual_info_result *= -1.0;
+
+    FREE(bins2);
   }
 
   if (globals->flags.debug) {
@@ -615,6 +772,10 @@ float mutual_information_objective(VIO_Volume d1,
 
 
   /* don't forget to free up any variables you declared above */
+
+  FREE(prob_fn1);
+  FREE(prob_fn2);
+  VIO_FREE2D(prob_hash_table);
     
   return (mutual_info_result);
   
@@ -114,6 +114,8 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include "minctracc_arg_data.h"
 #include "interpolation.h"
 #include "segment_table.h"
+#include "thread_support.h"
+#include "lattice_samples.h"
 #include "local_macros.h"
 #include <Proglib.h>
 #include "vox_space.h"
@@ -123,6 +125,10 @@ extern Arg_Data *main_args;
 
 extern Segment_Table *segment_table;
 
+                                /* built for the current fit by
+                                   optimize_linear_transformation()    */
+extern Lattice_Samples *lattice_samples;
+
 int point_not_masked(VIO_Volume volume, 
                             VIO_Real wx, VIO_Real wy, VIO_Real wz);
 
@@ -147,6 +153,527 @@ void dump_iteration_information(int count1,int count2,float result,VIO_Transform
   }*/
 }
 
+                                /* everything the threads need to walk the
+                                   lattice of one of the objective
+                                   functions below.  The lattice is cut
+                                   into items (slices, or columns); each
+                                   item keeps its own sums and counts,
+                                   added up afterwards in item order, so
+                                   that the result does not depend on the
+                                   number of threads.  Except for ssc,
+                                   the source side of the lattice comes
+                                   from the list of lattice_samples.c:
+                                   the one of the fit if it matches,
+                                   one built here otherwise.           */
+typedef struct {
+  VIO_Volume          d1, d2, m1, m2;
+  Arg_Data           *globals;
+  Linear_voxel_space  vox_space;
+  VIO_Transform      *trans;       /* voxel of d1 -> voxel of d2     */
+  PointR              starting_position;
+  Lattice_Samples    *samples;
+  VIO_BOOL            own_samples; /* built for this evaluation      */
+  VIO_BOOL            with_gradient; /* also add up the terms of the
+                                        gradient (xcorr, zscore)      */
+  int                 n_sums;      /* per item                       */
+  int                 n_counts;
+  VIO_Real           *sums;
+  long               *counts;
+} Lattice_Work;
+
+static void begin_lattice_work(Lattice_Work *work,
+                               VIO_Volume d1,
+                               VIO_Volume d2,
+                               VIO_Volume m1,
+                               VIO_Volume m2, 
+                               Arg_Data *globals,
+                               VIO_BOOL use_samples,
+                               int n_items, int n_sums, int n_counts)
+{
+  int i;
+
+  work->d1      = d1;
+  work->d2      = d2;
+  work->m1      = m1;
+  work->m2      = m2;
+  work->globals = globals;
+
+                                /* prepare data for the voxel-to-voxel
+                                   space transformation (instead of the
+                                   general but inefficient world-world
+                                   computations. */
+  get_into_linear_voxel_space(globals, &work->vox_space, d1, d2);
+  work->trans = &work->vox_space.voxel_to_voxel;
+
+  fill_Point( work->starting_position, 
+              work->vox_space.start[VIO_X], work->vox_space.start[VIO_Y], work->vox_space.start[VIO_Z]);
+
+  work->samples       = NULL;
+  work->own_samples   = FALSE;
+  work->with_gradient = FALSE;
+  if (use_samples) {
+    if (lattice_samples_match(lattice_samples, d1, m1, globals))
+      work->samples = lattice_samples;
+    else {
+      work->samples     = build_lattice_samples(d1, d2, m1, globals);
+      work->own_samples = TRUE;
+    }
+  }
+
+  work->n_sums   = n_sums;
+  work->n_counts = n_counts;
+  work->sums     = NULL;
+  work->counts   = NULL;
+
+  if (n_sums > 0) {
+    ALLOC(work->sums, n_items*n_sums);
+    for(i=0; i<n_items*n_sums; i++) work->sums[i] = 0.0;
+  }
+  if (n_counts > 0) {
+    ALLOC(work->counts, n_items*n_counts);
+    for(i=0; i<n_items*n_counts; i++) work->counts[i] = 0;
+  }
+}
+
+/* add up the sums and counts of the n_items items, in order */
+
+static void reduce_lattice_work(Lattice_Work *work, int n_items,
+                                VIO_Real sums[], long counts[])
+{
+  int i, j;
+
+  for(j=0; j<work->n_sums; j++)   sums[j]   = 0.0;
+  for(j=0; j<work->n_counts; j++) counts[j] = 0;
+
+  for(i=0; i<n_items; i++) {
+    for(j=0; j<work->n_sums; j++)
+      sums[j] += work->sums[i*work->n_sums + j];
+    for(j=0; j<work->n_counts; j++)
+      counts[j] += work->counts[i*work->n_counts + j];
+  }
+}
+
+static void end_lattice_work(Lattice_Work *work)
+{
+  if (work->sums   != NULL) FREE(work->sums);
+  if (work->counts != NULL) FREE(work->counts);
+
+  if (work->own_samples)
+    delete_lattice_samples(work->samples);
+}
+
+                                /* the derivative of an objective
+                                   function with respect to the voxel to
+                                   voxel transformation T (d1 -> d2) comes
+                                   from sums of the form
+                                      sum( w * grad(d2) * [x y z 1] )
+                                   over the points of the lattice, one
+                                   3x4 matrix for each weight w          */
+#define GRADIENT_TERMS 12
+
+static void add_gradient_terms(VIO_Real terms[],
+                               VIO_Real weight,
+                               VIO_Real gradient2[],
+                               VIO_Real coord[])
+{
+  int r;
+  VIO_Real w;
+
+  for(r=0; r<3; r++) {
+    w = weight * gradient2[r];
+    terms[4*r]   += w * coord[0];
+    terms[4*r+1] += w * coord[1];
+    terms[4*r+2] += w * coord[2];
+    terms[4*r+3] += w;
+  }
+}
+
+/* value and gradient (in voxel units) of d2 at voxel: the gradient is the
+   one of the trilinear interpolant, whatever the interpolant of the value */
+
+static int interpolate_with_gradient(VIO_Volume d2, PointR *voxel,
+                                     VIO_Real *value2, VIO_Real gradient2[])
+{
+  VIO_Real value;
+
+  if (main_args->interpolant == trilinear_interpolant)
+    return( trilinear_interpolant_with_gradient(d2, voxel, value2, gradient2) );
+
+  if (!INTERPOLATE_TRUE_VALUE( d2, voxel, value2 ))
+    return( FALSE );
+
+  (void)trilinear_interpolant_with_gradient(d2, voxel, &value, gradient2);
+  return( TRUE );
+}
+
+/* s1,s2,s3 and count1,count2 of xcorr_objective(), for the slices
+   first..last-1 of the lattice, followed by the gradient terms of s1
+   and s3/2 when work->with_gradient */
+
+static void xcorr_slices(void *data, int thread, int first, int last)
+{
+  Lattice_Work
+    *work = (Lattice_Work *)data;
+  Lattice_Samples
+    *samples = work->samples;
+  Arg_Data
+    *globals = work->globals;
+  PointR
+    voxel;
+  int
+    i,s,
+    inside;
+  VIO_Real
+    value1, value2,
+    gradient2[3],
+    *coord,
+    *sums;
+  long
+    *counts;
+
+  for(s=first; s<last; s++) { 
+
+    sums   = &work->sums[work->n_sums*s];
+    counts = &work->counts[2*s];
+
+    counts[0] = samples->count1[s];
+
+                                /* the voxels of d1 nearest the nodes of
+                                   this slice, with value1 above the
+                                   threshold */
+    for(i=samples->first[s]; i<samples->first[s+1]; i++) {
+
+      coord  = &samples->coords[3*i];
+      value1 = samples->value1[i];
+
+      my_homogenous_transform_point(work->trans,
+                                    coord[0], coord[1], coord[2], 1.0,
+                                    &Point_x(voxel), &Point_y(voxel), &Point_z(voxel));
+
+      if (voxel_point_not_masked(work->m2, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
+
+        if (work->with_gradient)
+          inside = interpolate_with_gradient( work->d2, &voxel, &value2, gradient2 );
+        else
+          inside = INTERPOLATE_TRUE_VALUE( work->d2, &voxel, &value2 );
+              
+        if (inside) {
+
+          if (value2 > globals->threshold[1] ) {
+                  
+            counts[1]++;
+
+            sums[0] += value1*value2;
+            sums[1] += value1*value1;
+            sums[2] += value2*value2;
+
+            if (work->with_gradient) {
+              add_gradient_terms(&sums[3],                value1, gradient2, coord);
+              add_gradient_terms(&sums[3+GRADIENT_TERMS], value2, gradient2, coord);
+            }
+                  
+          } 
+                
+        } /* if voxel in d2 */
+      } /* if point in mask volume two */
+    } /* for i */
+  } /* for s */
+}
+
+                                /* counts kept for each item of
+                                   ssc_objective(): count1, count2 and,
+                                   for each state the item may start in
+                                   (greater, not greater), the number of
+                                   zero crossings and the state at the end */
+#define SSC_COUNTS 6
+
+static void ssc_sample(Lattice_Work *work, PointR *col, long counts[])
+{
+  PointR
+    pos2,
+    voxel;
+  VIO_Real
+    value1, value2;
+  int
+    t, greater;
+
+                                /* use the voxel center closest to this lattice
+                                   node. 
+                                */
+  fill_Point( voxel, VIO_ROUND(Point_x(*col)), VIO_ROUND(Point_y(*col)), VIO_ROUND(Point_z(*col)) ); 
+        
+  if (voxel_point_not_masked(work->m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
+          
+    if (INTERPOLATE_TRUE_VALUE( work->d1, &voxel, &value1 )) {
+
+      counts[0]++;
+
+      my_homogenous_transform_point(work->trans,
+                                    Point_x(*col), Point_y(*col), Point_z(*col), 1.0,
+                                    &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
+
+      fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
+        
+      if (voxel_point_not_masked(work->m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
+              
+        if (INTERPOLATE_TRUE_VALUE( work->d2, &voxel, &value2 )) {
+
+          counts[1]++;
+
+          for(t=0; t<2; t++) {
+            greater = (int)counts[3+2*t];
+            if (!((greater && value1>value2) || (!greater && value1<value2))) {
+              counts[3+2*t] = !greater;
+              counts[2+2*t]++;
+            } 
+          }
+                
+        } /* if voxel in d2 */
+      } /* if point in mask volume two */
+    } /* if voxel in d1 */
+  } /* if point in mask volume one */
+}
+
+/* the items of ssc_objective() are the slices of the scan along rows,
+   then the slices of the scan along cols, then the cols of the scan
+   along slices */
+
+static void ssc_items(void *data, int thread, int first, int last)
+{
+  Lattice_Work
+    *work = (Lattice_Work *)data;
+  Linear_voxel_space
+    *vox_space = &work->vox_space;
+  Arg_Data
+    *globals = work->globals;
+  VectorR
+    vector_step;
+  PointR
+    slice,
+    row,
+    col;
+  int
+    i,r,c,s,
+    n_slices;
+  long
+    *counts;
+
+  n_slices = globals->count[SLICE_IND];
+
+  for(i=first; i<last; i++) {
+
+    counts    = &work->counts[SSC_COUNTS*i];
+    counts[3] = TRUE;
+    counts[5] = FALSE;
+
+    if (i < n_slices) {
+
+      /* ------------------------  count along rows (fastest=col) first ------------------- */
+
+      s = i;
+      SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
+      ADD_POINT_VECTOR( slice, work->starting_position, vector_step );
+
+      for(r=0; r<globals->count[ROW_IND]; r++) {
+      
+        SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
+        ADD_POINT_VECTOR( row, slice, vector_step );
+      
+        SCALE_POINT( col, row, 1.0); /* init first col position */
+        for(c=0; c<globals->count[COL_IND]; c++) {
+          ssc_sample(work, &col, counts);
+          ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
+        } /* for c */
+      } /* for r */
+    }
+    else if (i < 2*n_slices) {
+
+      /* ------------------------  count along cols second  --(fastest=row)--------------- */
+
+      s = i - n_slices;
+      SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
+      ADD_POINT_VECTOR( slice, work->starting_position, vector_step );
+
+      for(c=0; c<globals->count[COL_IND]; c++) {
+      
+        SCALE_VECTOR( vector_step, vox_space->directions[COL_IND], c);
+        ADD_POINT_VECTOR( col, slice, vector_step );
+      
+        SCALE_POINT( row, col, 1.0); /* init first row position */
+        for(r=0; r<globals->count[ROW_IND]; r++) {
+          ssc_sample(work, &col, counts);
+          ADD_POINT_VECTOR( row, row, vox_space->directions[ROW_IND] );
+        } /* for r */
+      } /* for c */
+    }
+    else {
+
+      /* ------------------------  count along slices last ------------------------ */
+
+      c = i - 2*n_slices;
+      SCALE_VECTOR( vector_step, vox_space->directions[COL_IND], c);
+      ADD_POINT_VECTOR( col, work->starting_position, vector_step );
+
+      for(r=0; r<globals->count[ROW_IND]; r++) {
+      
+        SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
+        ADD_POINT_VECTOR( row, col, vector_step );
+      
+        SCALE_POINT( slice, row, 1.0); /* init first slice position */
+        for(s=0; s<globals->count[SLICE_IND]; s++) {
+          ssc_sample(work, &col, counts);
+          ADD_POINT_VECTOR( slice, slice, vox_space->directions[SLICE_IND] );
+        } /* for s */
+      } /* for r */
+    }
+  }
+}
+
+/* z2_sum and count1,count2,count3 of zscore_objective(), for the slices
+   first..last-1 of the lattice, followed by the gradient terms of
+   z2_sum/-2 when work->with_gradient */
+
+static void zscore_slices(void *data, int thread, int first, int last)
+{
+  Lattice_Work
+    *work = (Lattice_Work *)data;
+  Lattice_Samples
+    *samples = work->samples;
+  Arg_Data
+    *globals = work->globals;
+  PointR 
+    voxel;
+  int
+    i,s,
+    inside;
+  VIO_Real
+    value1, value2,
+    gradient2[3],
+    *coord,
+    *sums;
+  long
+    *counts;
+
+  for(s=first; s<last; s++) {
+
+    sums   = &work->sums[work->n_sums*s];
+    counts = &work->counts[3*s];
+
+    counts[0] = samples->count1[s];
+
+    for(i=samples->first[s]; i<samples->first[s+1]; i++) {
+
+      coord  = &samples->coords[3*i];
+      value1 = samples->value1[i];
+
+      my_homogenous_transform_point(work->trans,
+                                    coord[0], coord[1], coord[2], 1.0,
+                                    &Point_x(voxel), &Point_y(voxel), &Point_z(voxel));
+        
+      if (voxel_point_not_masked(work->m2, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
+
+        if (work->with_gradient)
+          inside = interpolate_with_gradient( work->d2, &voxel, &value2, gradient2 );
+        else
+          inside = INTERPOLATE_TRUE_VALUE( work->d2, &voxel, &value2 );
+              
+        if (inside) {
+
+          counts[1]++;
+
+          if (fabs(value1) > globals->threshold[0] && fabs(value2) > globals->threshold[1] ) {
+            counts[2]++;
+            sums[0] +=  (value1-value2)*(value1-value2);
+
+            if (work->with_gradient)
+              add_gradient_terms(&sums[1], value1-value2, gradient2, coord);
+          } 
+                
+        } /* if voxel in d2 */
+      } /* if point in mask volume two */
+    } /* for i */
+  } /* for s */
+}
+
+/* for the slices first..last-1 of the lattice of vr_objective(): the
+   sums of the ratios (sums[index]) and of their squares
+   (sums[groups+1+index]) of each group, count1, count2 and the count3
+   of each group (counts[2+index]) */
+
+static void vr_slices(void *data, int thread, int first, int last)
+{
+  Lattice_Work
+    *work = (Lattice_Work *)data;
+  Lattice_Samples
+    *samples = work->samples;
+  Arg_Data
+    *globals = work->globals;
+  PointR
+    voxel;
+  int
+    i,s,
+    index, groups;
+  VIO_Real
+    value1, value2,
+    voxel_value1,
+    rat,
+    *coord,
+    *rat_sum, *rat2_sum;
+  long
+    *counts;
+
+  groups = segment_table->groups;
+
+  for(s=first; s<last; s++) {
+
+    rat_sum  = &work->sums[work->n_sums*s];
+    rat2_sum = &rat_sum[groups+1];
+    counts   = &work->counts[work->n_counts*s];
+
+    counts[0] = samples->count1[s];
+
+    for(i=samples->first[s]; i<samples->first[s+1]; i++) {
+
+      coord  = &samples->coords[3*i];
+      value1 = samples->value1[i];
+
+      my_homogenous_transform_point(work->trans,
+                                    coord[0], coord[1], coord[2], 1.0,
+                                    &Point_x(voxel), &Point_y(voxel), &Point_z(voxel));
+        
+      if (voxel_point_not_masked(work->m2, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
+              
+        if (INTERPOLATE_TRUE_VALUE( work->d2, &voxel, &value2 )) {
+
+          counts[1]++;
+          /* voxel_value2 = CONVERT_VALUE_TO_VOXEL(d1,value2 ); */
+
+          if (value1 > globals->threshold[0] && value2 > globals->threshold[1]
+              && value2 != 0.0)  {
+
+            voxel_value1 = CONVERT_VALUE_TO_VOXEL(work->d1,value1 );
+            index = (*segment_table->segment)( voxel_value1, segment_table);
+
+            if (index>0) {
+              counts[2+index]++;
+              rat = value1 / value2;
+              rat_sum[index] += rat;
+              rat2_sum[index] +=  rat*rat;
+            }
+            else {
+              print_error_and_line_num("Cannot segment voxel value %d into one of %d groups.", 
+                                       __FILE__, __LINE__, voxel_value1,groups );
+              exit(EXIT_FAILURE);
+
+            }
+          } 
+                
+        } /* if voxel in d2 */
+      } /* if point in mask volume two */
+    } /* for i */
+  } /* for s */
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : xcorr_objective
 @INPUT      : volumetric data, for use in correlation.  
@@ -208,361 +735,174 @@ void dump_iteration_information(int count1,int count2,float result,VIO_Transform
                     w/-trilin
                  this is an overall speed up of 73/38 = 92%
                  the new version takes only     38/73 = 52%  of the time of the previous!
+              Oct 18, 2026
+                 the slices of the lattice are shared among -threads
+                 threads (see Lattice_Work above), here and in the
+                 ssc, zscore and vr objectives.
+              Oct 18, 2026
+                 xcorr_value() also returns the gradient with respect to
+                 the voxel to voxel transformation, for the BFGS
+                 optimizer (see objective_with_gradient() below).
 ---------------------------------------------------------------------------- */
+static float xcorr_value(VIO_Volume d1,
+                         VIO_Volume d2,
+                         VIO_Volume m1,
+                         VIO_Volume m2, 
+                         Arg_Data *globals,
+                         VIO_Real gradient[3][4])
+{
+  Lattice_Work
+    work;
+  VIO_Real
+    sums[3+2*GRADIENT_TERMS],   /* to store the sums for f1,f2,f3 */
+    norm;
+  long
+    counts[2];                  /* count1, count2 */
+  float 
+    result;                                /* the result */
+  int
+    n_slices, r, c;
+
+  n_slices = globals->count[SLICE_IND];
+
+  begin_lattice_work(&work, d1, d2, m1, m2, globals, TRUE, n_slices, 
+                     (gradient != NULL) ? 3+2*GRADIENT_TERMS : 3, 2);
+  work.with_gradient = (gradient != NULL);
+
+                                /* loop through all nodes of the lattice
+                                   that pass the source tests */
+  run_in_parallel(globals->threads, n_slices, 1, xcorr_slices, (void *)&work);
+
+  reduce_lattice_work(&work, n_slices, sums, counts);
+  
+  result = 1.0 - sums[0] / (sqrt((double)sums[1])*sqrt((double)sums[2]));
+
+                                /* d(result) = -d(f1)/norm + f1*d(f3)/(2*norm*f3) */
+  if (gradient != NULL) {
+    norm = sqrt((double)sums[1])*sqrt((double)sums[2]);
+    for(r=0; r<3; r++)
+      for(c=0; c<4; c++)
+        gradient[r][c] = -sums[3+4*r+c] / norm + 
+          sums[0] * sums[3+GRADIENT_TERMS+4*r+c] / (norm*sums[2]);
+  }
+  
+  if (globals->flags.debug) dump_iteration_information((int)counts[0],(int)counts[1],result,work.trans);/*(void)print ("%7d %7d -> %10.8f\n",count1,count2,result);*/
+
+  end_lattice_work(&work);
+
+  return (result);
+  
+}
+
 float xcorr_objective(VIO_Volume d1,
                       VIO_Volume d2,
                       VIO_Volume m1,
                       VIO_Volume m2, 
                       Arg_Data *globals)
 {
+  return( xcorr_value(d1, d2, m1, m2, globals, NULL) );
+}
 
-  VectorR
-    vector_step;
-
-  PointR
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2,
-    voxel;
-
-  int
-    r,c,s;
 
-  VIO_Real
-    value1, value2;
-  
-  VIO_Real
-    s1,s2,s3;                   /* to store the sums for f1,f2,f3 */
+float ssc_objective(VIO_Volume d1,
+                    VIO_Volume d2,
+                    VIO_Volume m1,
+                    VIO_Volume m2, 
+                    Arg_Data *globals)
+{
+  Lattice_Work
+    work;
   float 
     result;                                /* the result */
-  int 
-    count1,count2;
-
+  long
+    count1, count2,
+    *counts;
+  int
+    i, t,
+    n_items,
+    greater;
+  unsigned  long
+    zero_crossings;
 
-  Voxel_space_struct *vox_space;
-  VIO_Transform          *trans;
+  n_items = 2*globals->count[SLICE_IND] + globals->count[COL_IND];
 
+  begin_lattice_work(&work, d1, d2, m1, m2, globals, FALSE, n_items, 0, SSC_COUNTS);
 
-                                /* prepare counters for this objective
-                                   function */
-  s1 = s2 = s3 = 0.0;
-  count1 = count2 = 0;
-                                /* prepare data for the voxel-to-voxel
-                                   space transformation (instead of the
-                                   general but inefficient world-world
-                                   computations. */
+  run_in_parallel(globals->threads, n_items, 1, ssc_items, (void *)&work);
 
+                                /* follow the state from one item to
+                                   the next, in the order of the scan */
+  greater = TRUE;
+  zero_crossings = count1 = count2 = 0;
 
-  vox_space = new_voxel_space_struct();
+  for(i=0; i<n_items; i++) {
+    counts = &work.counts[SSC_COUNTS*i];
+    t = greater ? 0 : 1;
 
-  get_into_voxel_space(globals, vox_space, d1, d2);
+    count1 += counts[0];
+    count2 += counts[1];
+    zero_crossings += counts[2+2*t];
+    greater = (int)counts[3+2*t];
+  }
 
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
+  end_lattice_work(&work);
 
+  result = -1.0 * (float)zero_crossings;
 
-                                /* loop through all nodes of the lattice */
-                                                                                                                              
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
+  if (globals->flags.debug) (void)print ("%7d %7d -> %10.8f\n",(int)count1,(int)count2,result);
 
-  /* ---------- step through all slices of lattice ------------- */
-  for(s=0; s<globals->count[SLICE_IND]; s++) { 
+  return (result);
+  
+}
 
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
+static float zscore_value(VIO_Volume d1,
+                          VIO_Volume d2,
+                          VIO_Volume m1,
+                          VIO_Volume m2, 
+                          Arg_Data *globals,
+                          VIO_Real gradient[3][4])
+{
+  Lattice_Work
+    work;
+  VIO_Real
+    sums[1+GRADIENT_TERMS],     /* z2_sum and its gradient terms */
+    z2_sum, denom;
+  long
+    counts[3];                  /* count1, count2, count3 */
+  float 
+    result;                                /* the result */
+  int
+    n_slices, r, c;
 
-    /* ---------- step through all rows of lattice ------------- */
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
+  n_slices = globals->count[SLICE_IND];
 
-      /* ---------- step through all cols of lattice ------------- */
-      for(c=0; c<globals->count[COL_IND]; c++) {
-                
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
+  begin_lattice_work(&work, d1, d2, m1, m2, globals, TRUE, n_slices, 
+                     (gradient != NULL) ? 1+GRADIENT_TERMS : 1, 3);
+  work.with_gradient = (gradient != NULL);
 
+  run_in_parallel(globals->threads, n_slices, 1, zscore_slices, (void *)&work);
 
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (nearest_neighbour_interpolant( d1, &voxel, &value1 )) {
+  reduce_lattice_work(&work, n_slices, sums, counts);
 
-            count1++;
+  end_lattice_work(&work);
 
-            my_homogenous_transform_point(trans,
-                                          Point_x(voxel), Point_y(voxel), Point_z(voxel), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-
-         
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-        
-            if (voxel_point_not_masked(m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
+  z2_sum = sums[0];
 
+  if (counts[2] > 0)
+    result = sqrt((double)z2_sum) / counts[2];
+  else
+    result = sqrt((double)z2_sum);
 
-                if (value1 > globals->threshold[0] && value2 > globals->threshold[1] ) {
-                  
-                  count2++;
+                                /* d(z2_sum) = -2 * sum((d1-d2)*d(d2)) */
+  if (gradient != NULL) {
+    denom = sqrt((double)z2_sum) * ((counts[2] > 0) ? counts[2] : 1);
+    for(r=0; r<3; r++)
+      for(c=0; c<4; c++)
+        gradient[r][c] = (denom > 0.0) ? -sums[1+4*r+c] / denom : 0.0;
+  }
 
-                  s1 += value1*value2;
-                  s2 += value1*value1;
-                  s3 += value2*value2;
-                  
-                } 
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
-  
-  result = 1.0 - s1 / (sqrt((double)s2)*sqrt((double)s3));
+  if (globals->flags.debug) (void)print ("%7d %7d %7d -> %10.8f\n",(int)counts[0],(int)counts[1],(int)counts[2],result);
   
-  if (globals->flags.debug) dump_iteration_information(count1,count2,result,trans);/*(void)print ("%7d %7d -> %10.8f\n",count1,count2,result);*/
-
-  delete_voxel_space_struct(vox_space);
-
-  return (result);
-  
-}
-
-
-float ssc_objective(VIO_Volume d1,
-                    VIO_Volume d2,
-                    VIO_Volume m1,
-                    VIO_Volume m2, 
-                    Arg_Data *globals)
-{
-  VectorR
-    vector_step;
-
-  PointR
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2,
-    voxel;
-
-  int
-    r,c,s;
-
-  VIO_Real
-    value1, value2;
-  
-  float 
-    result;                                /* the result */
-  int 
-    count1, count2,
-    greater;
-  unsigned  long
-    zero_crossings;
-  Voxel_space_struct *vox_space;
-  VIO_Transform          *trans;
-
-                                /* prepare counters for this objective
-                                   function */
-  greater = TRUE;
-  zero_crossings = count1 = count2 = 0;
-
-                                /* prepare data for the voxel-to-voxel
-                                   space transformation (instead of the
-                                   general but inefficient world-world
-                                   computations. */
-
-  vox_space = new_voxel_space_struct();
-  get_into_voxel_space(globals, vox_space, d1, d2);
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
-
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
-
-  /* ------------------------  count along rows (fastest=col) first ------------------- */
-
-
-  for(s=0; s<globals->count[SLICE_IND]; s++) {
-
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<globals->count[COL_IND]; c++) {
-        
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
-        
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
-
-            count1++;
-
-            my_homogenous_transform_point(trans,
-                                          Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-
-            
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-        
-            if (voxel_point_not_masked(m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
-
-                count2++;
-
-                if (!((greater && value1>value2) || (!greater && value1<value2))) {
-                  greater = !greater;
-                  zero_crossings++;
-                } 
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
-
-  /* ------------------------  count along cols second  --(fastest=row)--------------- */
-
-  for(s=0; s<globals->count[SLICE_IND]; s++) {
-
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-
-    for(c=0; c<globals->count[COL_IND]; c++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[COL_IND], c);
-      ADD_POINT_VECTOR( col, slice, vector_step );
-      
-      SCALE_POINT( row, col, 1.0); /* init first row position */
-
-      for(r=0; r<globals->count[ROW_IND]; r++) {
-
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
-        
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
-
-            count1++;
-
-            my_homogenous_transform_point(trans,
-                                          Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-            
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-        
-            if (voxel_point_not_masked(m2,Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
-
-                count2++;
-
-                if (!((greater && value1>value2) || (!greater && value1<value2))) {
-                  greater = !greater;
-                  zero_crossings++;
-                } 
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( row, row, vox_space->directions[ROW_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
-
-
-
-
-  /* ------------------------  count along slices last ------------------------ */
-
-
-  for(c=0; c<globals->count[COL_IND]; c++) {
-    
-    SCALE_VECTOR( vector_step, vox_space->directions[COL_IND], c);
-    ADD_POINT_VECTOR( col, starting_position, vector_step );
-
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, col, vector_step );
-      
-      SCALE_POINT( slice, row, 1.0); /* init first col position */
-
-      for(s=0; s<globals->count[SLICE_IND]; s++) {
-        
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
-        
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
-
-            count1++;
-
-            my_homogenous_transform_point(trans,
-                                          Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-            
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-
-            if (voxel_point_not_masked(m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
-
-                count2++;
-
-                if (!((greater && value1>value2) || (!greater && value1<value2))) {
-                  greater = !greater;
-                  zero_crossings++;
-                } 
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( slice, slice, vox_space->directions[SLICE_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
-
-
-  result = -1.0 * (float)zero_crossings;
-
-  if (globals->flags.debug) (void)print ("%7d %7d -> %10.8f\n",count1,count2,result);
-
   return (result);
   
 }
@@ -573,110 +913,42 @@ float zscore_objective(VIO_Volume d1,
                            VIO_Volume m2, 
                            Arg_Data *globals)
 {
-  VectorR
-    vector_step;
-
-  PointR 
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2,
-    voxel;
-
-  int
-    r,c,s;
-
-  VIO_Real
-    value1, value2;
-  
-  VIO_Real
-    z2_sum;
-  float 
-    result;                                /* the result */
-  int 
-    count1,count2,count3;
-  Voxel_space_struct *vox_space;
-  VIO_Transform          *trans;
-
-
-                                /* prepare data for the voxel-to-voxel
-                                   space transformation (instead of the
-                                   general but inefficient world-world
-                                   computations. */
-
-  vox_space = new_voxel_space_struct();
-  get_into_voxel_space(globals, vox_space, d1, d2);
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
-
-
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
-
-  z2_sum = 0.0;
-  count1 = count2 = count3 = 0;
-
-  for(s=0; s<globals->count[SLICE_IND]; s++) {
-
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<globals->count[COL_IND]; c++) {
-        
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
-        
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
-
-            count1++;
-
-            my_homogenous_transform_point(trans,
-                                          Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-            
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-        
-            if (voxel_point_not_masked(m2, Point_x(pos2), Point_y(pos2), Point_z(pos2))) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
-
-                count2++;
+  return( zscore_value(d1, d2, m1, m2, globals, NULL) );
+}
 
-                if (fabs(value1) > globals->threshold[0] && fabs(value2) > globals->threshold[1] ) {
-                  count3++;
-                  z2_sum +=  (value1-value2)*(value1-value2);
-                } 
-        
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : objective_with_gradient
+@INPUT      : d1,d2,m1,m2,globals - as for the objective function of globals
+@OUTPUT     : gradient - the derivative of the objective function with
+                 respect to the elements of the first three rows of the
+                 voxel to voxel transformation of get_into_voxel_space()
+                 (voxel of d1 -> voxel of d2)
+@RETURNS    : the value of the objective function of globals
+@DESCRIPTION: the derivative is added up in the same lattice pass as the
+              value, from the gradient of the trilinear interpolant of d2
+              at each point.  Points that enter or leave the masks or
+              thresholds are not accounted for.  Only for the objective
+              functions for which objective_gradient_supported().
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+VIO_BOOL objective_gradient_supported(Objective_Function obj_function)
+{
+  return( obj_function == xcorr_objective ||
+          obj_function == zscore_objective );
+}
 
-  if (count3 > 0)
-    result = sqrt((double)z2_sum) / count3;
+float objective_with_gradient(VIO_Volume d1,
+                              VIO_Volume d2,
+                              VIO_Volume m1,
+                              VIO_Volume m2, 
+                              Arg_Data *globals,
+                              VIO_Real gradient[3][4])
+{
+  if (globals->obj_function == xcorr_objective)
+    return( xcorr_value(d1, d2, m1, m2, globals, gradient) );
   else
-    result = sqrt((double)z2_sum);
-
-  if (globals->flags.debug) (void)print ("%7d %7d %7d -> %10.8f\n",count1,count2,count3,result);
-  
-  return (result);
-  
+    return( zscore_value(d1, d2, m1, m2, globals, gradient) );
 }
 
 
@@ -687,157 +959,60 @@ float vr_objective(VIO_Volume d1,
                           VIO_Volume m2, 
                           Arg_Data *globals)
 {
-  VectorR
-    vector_step;
-
-  PointR
-    starting_position,
-    slice,
-    row,
-    col,
-    pos2,
-    voxel;
-
-  int
-    r,c,s;
-
+  Lattice_Work
+    work;
   VIO_Real
-    value1, value2,
-    voxel_value1;
-  
+    *sums,
+    *rat_sum,
+    *rat2_sum;
   float
-    rat,
     total_variance,
-    *limits,
-    *rat_sum,
-    *rat2_sum,
     *var;
   unsigned long
-    total_count,
+    total_count;
+  long
+    *counts,
     *count3;
 
   float 
     result;                                /* the result */
   int 
-    index,i,count1,count2;
-  Voxel_space_struct *vox_space;
-  VIO_Transform          *trans;
+    index,groups,n_slices;
 
 
+  groups   = segment_table->groups;
+  n_slices = globals->count[SLICE_IND];
 
                                 /* build segmentation info!  */
 
-  ALLOC(rat_sum  ,1+segment_table->groups);
-  ALLOC(rat2_sum ,1+segment_table->groups);
-  ALLOC(var      ,1+segment_table->groups);
-  ALLOC(limits   ,1+segment_table->groups);
+  ALLOC(sums  , 2*(groups+1));
+  ALLOC(counts, groups+3);
+  ALLOC(var   , 1+groups);
 
-  ALLOC(count3, (segment_table->groups+1));
-
-                                /* prepare data for the voxel-to-voxel
-                                   space transformation (instead of the
-                                   general but inefficient world-world
-                                   computations. */
-
-  vox_space = new_voxel_space_struct();
-  get_into_voxel_space(globals, vox_space, d1, d2);
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
-
-
-
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
-
-                                /* init running sums and counters. */
-  for(i=1; i<=segment_table->groups; i++) {
-    rat_sum[i] = 0.0;
-    rat2_sum[i] = 0.0;
-    count3[i]   = 0;
-    var[i] = 0.0;
-  }
-  count1 = count2 = 0;
+  rat_sum  = sums;
+  rat2_sum = &sums[groups+1];
+  count3   = &counts[2];
 
                                 /* loop through each node of lattice */
-  for(s=0; s<globals->count[SLICE_IND]; s++) {
+  begin_lattice_work(&work, d1, d2, m1, m2, globals, TRUE, n_slices, 2*(groups+1), groups+3);
 
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
-    ADD_POINT_VECTOR( slice, starting_position, vector_step );
-
-    for(r=0; r<globals->count[ROW_IND]; r++) {
-      
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
-      ADD_POINT_VECTOR( row, slice, vector_step );
-      
-      SCALE_POINT( col, row, 1.0); /* init first col position */
-      for(c=0; c<globals->count[COL_IND]; c++) {
-        
-                                /* use the voxel center closest to this lattice
-                                   node. 
-                                */
-        fill_Point( voxel, VIO_ROUND(Point_x(col)), VIO_ROUND(Point_y(col)), VIO_ROUND(Point_z(col)) ); 
-        
-        if (voxel_point_not_masked(m1, Point_x(voxel), Point_y(voxel), Point_z(voxel))) {
-          
-          if (INTERPOLATE_TRUE_VALUE( d1, &voxel, &value1 )) {
-
-            count1++;
-            voxel_value1 = CONVERT_VALUE_TO_VOXEL(d1,value1 );
+  run_in_parallel(globals->threads, n_slices, 1, vr_slices, (void *)&work);
 
+  reduce_lattice_work(&work, n_slices, sums, counts);
 
-            my_homogenous_transform_point(trans,
-                                          Point_x(col), Point_y(col), Point_z(col), 1.0,
-                                          &Point_x(pos2), &Point_y(pos2), &Point_z(pos2));
-            
-            fill_Point( voxel, Point_x(pos2), Point_y(pos2), Point_z(pos2) ); /* build the voxel POINT */
-        
-            if (voxel_point_not_masked(m2,Point_x(pos2), Point_y(pos2), Point_z(pos2) )) {
-              
-              if (INTERPOLATE_TRUE_VALUE( d2, &voxel, &value2 )) {
-
-                count2++;
-                /* voxel_value2 = CONVERT_VALUE_TO_VOXEL(d1,value2 ); */
-
-                if (value1 > globals->threshold[0] && value2 > globals->threshold[1]
-                    && value2 != 0.0)  {
-
-                  index = (*segment_table->segment)( voxel_value1, segment_table);
-
-                  if (index>0) {
-                    count3[index]++;
-                    rat = value1 / value2;
-                    rat_sum[index] += rat;
-                    rat2_sum[index] +=  rat*rat;
-                  }
-                  else {
-                    print_error_and_line_num("Cannot segment voxel value %d into one of %d groups.", 
-                                __FILE__, __LINE__, voxel_value1,segment_table->groups );
-                    exit(EXIT_FAILURE);
-
-                  }
-                } 
-                
-                
-              } /* if voxel in d2 */
-            } /* if point in mask volume two */
-          } /* if voxel in d1 */
-        } /* if point in mask volume one */
-        
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
-        
-      } /* for c */
-    } /* for r */
-  } /* for s */
+  end_lattice_work(&work);
 
 
   total_variance = 0.0;
   total_count = 0;
 
-  for(index=1; index<=segment_table->groups; index++) {
+  for(index=1; index<=groups; index++) {
     if (count3[index] > 1) 
       total_count += count3[index];
   }
 
   if (total_count > 1) {
-    for(index=1; index<=segment_table->groups; index++) {
+    for(index=1; index<=groups; index++) {
       if (count3[index] > 1) {
         var[index]  = ((double)count3[index]*rat2_sum[index] - rat_sum[index]*rat_sum[index]) / 
           ((double)count3[index]*((double)count3[index]-1.0));
@@ -853,13 +1028,11 @@ float vr_objective(VIO_Volume d1,
 
   result = total_variance;
 
-  if (globals->flags.debug) print ("%7d %7d %7d -> %10.8f\n",count1,count2,count3[1],result);
+  if (globals->flags.debug) print ("%7d %7d %7d -> %10.8f\n",(int)counts[0],(int)counts[1],(int)count3[1],result);
 
-  FREE(rat_sum);
-  FREE(rat2_sum);
+  FREE(sums);
+  FREE(counts);
   FREE(var);
-  FREE(limits);
-  FREE(count3);
 
 
 
@@ -892,7 +1065,7 @@ float stub_objective(VIO_Volume d1,
     result;                                /* the result */
   int 
     count1,count2;                /* number of nodes in first vol, second vol */
-  Voxel_space_struct *vox_space;
+  Linear_voxel_space vox_space;
   VIO_Transform          *trans;
 
 
@@ -907,23 +1080,22 @@ float stub_objective(VIO_Volume d1,
                                    general but inefficient world-world
                                    computations. */
 
-  vox_space = new_voxel_space_struct();
-  get_into_voxel_space(globals, vox_space, d1, d2);
-  trans = get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
+  get_into_linear_voxel_space(globals, &vox_space, d1, d2);
+  trans = &vox_space.voxel_to_voxel;
 
                         /* build world lattice info */
 
-  fill_Point( starting_position, vox_space->start[VIO_X], vox_space->start[VIO_Y], vox_space->start[VIO_Z]);
+  fill_Point( starting_position, vox_space.start[VIO_X], vox_space.start[VIO_Y], vox_space.start[VIO_Z]);
 
                                 /* loop through each node of lattice */
   for(s=0; s<globals->count[SLICE_IND]; s++) {
 
-    SCALE_VECTOR( vector_step, vox_space->directions[SLICE_IND], s);
+    SCALE_VECTOR( vector_step, vox_space.directions[SLICE_IND], s);
     ADD_POINT_VECTOR( slice, starting_position, vector_step );
 
     for(r=0; r<globals->count[ROW_IND]; r++) {
       
-      SCALE_VECTOR( vector_step, vox_space->directions[ROW_IND], r);
+      SCALE_VECTOR( vector_step, vox_space.directions[ROW_IND], r);
       ADD_POINT_VECTOR( row, slice, vector_step );
       
       SCALE_POINT( col, row, 1.0); /* init first col position */
@@ -984,7 +1156,7 @@ float stub_objective(VIO_Volume d1,
           } /* if voxel in d1 */
         } /* if point in mask volume one */
         
-        ADD_POINT_VECTOR( col, col, vox_space->directions[COL_IND] );
+        ADD_POINT_VECTOR( col, col, vox_space.directions[COL_IND] );
         
       } /* for c */
     } /* for r */
@@ -173,13 +173,20 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include <volume_io.h>
 #include <Proglib.h>
 #include <amoeba.h>
+#include <powell.h>
 
 #include "constants.h"
 #include "minctracc_arg_data.h"
 #include "objectives.h"
+#include "interpolation.h"
+#include "sampling_kernels.h"
 #include "make_rots.h"
 #include "segment_table.h"
 #include "quaternion.h"
+#include "perf_report.h"
+#include "lattice_samples.h"
+#include "vox_space.h"
+#include "thread_support.h"
 
 #include "local_macros.h"
 
@@ -190,18 +197,13 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 
 extern Arg_Data *main_args;
 
-VIO_Volume   Gdata1, Gdata2, Gmask1, Gmask2;
-int      Ginverse_mapping_flag, Gndim;
-
 extern   double   ftol ;        
 extern   double   simplex_size ;
 extern   VIO_Real     initial_corr, final_corr;
 
          Segment_Table  *segment_table;        /* for variance of ratios */
 
-         VIO_Real            **prob_hash_table;   /* for mutual information */
-         VIO_Real            *prob_fn1;      /*     for vol 1 */
-         VIO_Real            *prob_fn2;      /*     for vol 2 */
+         Lattice_Samples     *lattice_samples = NULL; /* of the current fit */
 
 
 /* external calls: */
@@ -371,9 +373,129 @@ inline static VIO_BOOL in_limits(double x,double lower,double upper)
     return lower <= x && x <= upper;
 }
 
+/* the parameters of the transformation for the optimization vector
+   params, with delta added to its k-th element (numbered from 0, none
+   if k < 0) */
+
+static void set_fit_parameters(Fit_Data *fit, float *params, int k, double delta,
+                               double *trans, double *rots, double *scale,
+                               double *shear, double *cent)
+{
+  Arg_Data *args = fit->globals;
+  int i, j;
+  double *parameter;
+
+  for(i=0; i<3; i++) {                /* set default values from the fit */
+    shear[i] = args->trans_info.shears[i];
+    scale[i] = args->trans_info.scales[i];
+    trans[i] = args->trans_info.translations[i];
+    rots[i]  = args->trans_info.rotations[i];
+    cent[i]  = args->trans_info.center[i];
+  }
+
+                                /* modify the parameters to be optimized */
+  vector_to_parameters(trans, rots, scale, shear, params, args->trans_info.weights);
+
+  if (k >= 0) {                 /* find the parameter of the k-th element */
+    for(j=0; j<12; j++)
+      if (args->trans_info.weights[j] != 0.0 && k-- == 0)
+        break;
+    if (j < 3)      parameter = &trans[j];
+    else if (j < 6) parameter = &rots[j-3];
+    else if (j < 9) parameter = &scale[j-6];
+    else            parameter = &shear[j-9];
+    *parameter += delta * args->trans_info.weights[j];
+  }
+  
+  if (args->trans_info.transform_type==TRANS_LSQ7) { /* adjust scaley and scalez only */
+                                                         /* if 7 parameter fit.  */
+    scale[1] = scale[0];
+    scale[2] = scale[0];
+  }
+}
+
+                                /* the lower and upper limits of the
+                                   rotations (radians), scales and
+                                   shears of a fit, for
+                                   fit_parameters_in_limits() and
+                                   distance_out_of_limits()            */
+static const double rotation_limits[2] = { -3.1415927/2.0, 3.1415927/2.0 };
+static const double scale_limits[2]    = { 0.0, 3.0 };
+static const double shear_limits[2]    = { -2.0, 2.0 };
+
+static VIO_BOOL fit_parameters_in_limits(double *rots, double *scale, double *shear)
+{
+  int i;
+
+  for(i=0; i<3; i++)
+    if (!in_limits(rots[i],  rotation_limits[0], rotation_limits[1]) ||
+        !in_limits(scale[i], scale_limits[0],    scale_limits[1]) ||
+        !in_limits(shear[i], shear_limits[0],    shear_limits[1]))
+      return(FALSE);
+
+  return(TRUE);
+}
+
+/* how far rots, scale and shear are outside of the limits of
+   fit_parameters_in_limits(): the sum of the distances to the limits
+   they are past, 0 inside */
+
+static double distance_out_of_limits(double *rots, double *scale, double *shear)
+{
+  double distance;
+  int    i;
+
+  distance = 0.0;
+  for(i=0; i<3; i++) {
+    distance += MAX(rotation_limits[0] - rots[i], 0.0)  + MAX(rots[i] - rotation_limits[1], 0.0);
+    distance += MAX(scale_limits[0]    - scale[i], 0.0) + MAX(scale[i] - scale_limits[1], 0.0);
+    distance += MAX(shear_limits[0]    - shear[i], 0.0) + MAX(shear[i] - shear_limits[1], 0.0);
+  }
+
+  return(distance);
+}
+
+/* the number of lattice points interpolated by one evaluation of the
+   objective function: those of the list of lattice_samples.c (already
+   masked, thresholded and subsampled) when the objective function reads
+   it, the whole lattice otherwise */
+
+static long samples_per_evaluation(Fit_Data *fit)
+{
+  Arg_Data *args = fit->globals;
+
+  if (lattice_samples_match(lattice_samples, fit->data1, fit->mask1, args))
+    return( (long)lattice_samples->first[lattice_samples->n_slices] );
+
+  return( (long)args->count[0] * args->count[1] * args->count[2] );
+}
+
+/* store the transformation of these parameters in the linear transform
+   being optimized */
+
+static void build_fit_matrix(Fit_Data *fit, double *cent, double *trans, 
+                             double *scale, double *shear, double *rots)
+{
+  VIO_Transform *mat;
+
+  if (get_transform_type(fit->globals->trans_info.transformation) == CONCATENATED_TRANSFORM) {
+    mat = get_linear_transform_ptr(
+           get_nth_general_transform(fit->globals->trans_info.transformation,0));
+  }
+  else
+    mat = get_linear_transform_ptr(fit->globals->trans_info.transformation);
+  
+  if (fit->inverse_mapping)
+    build_inverse_transformation_matrix(mat, cent, trans, scale, shear, rots);
+  else
+    build_transformation_matrix(mat, cent, trans, scale, shear, rots);
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : fit_function
-@INPUT      : params - a variable length array of floats
+@INPUT      : fit    - the volumes, parameters and transformation being
+                       fitted (see init_fit_data())
+              params - a variable length array of floats
 @OUTPUT     :               
 @RETURNS    : a float value of the user requested objective function,
               measuring the similarity between two data sets.
@@ -382,14 +504,15 @@ inline static VIO_BOOL in_limits(double x,double lower,double upper)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : 
-@MODIFIED   : 
+@MODIFIED   : Oct 18, 2026 - everything comes from fit, and only the
+              transformation of fit->globals is changed, so that fits
+              with their own copy of the Arg_Data can run at the same
+              time (-multistart).
 ---------------------------------------------------------------------------- */
 
-float fit_function(Arg_Data *args,float *params) 
+float fit_function(Fit_Data *fit, float *params) 
 {
-
-  VIO_Transform *mat;
-  int i;
+  Arg_Data *args = fit->globals;
   float r;
 
 
@@ -400,67 +523,35 @@ float fit_function(Arg_Data *args,float *params)
   double shear[6];
 
 
-  for(i=0; i<3; i++) {                /* set default values from GLOBAL MAIN_ARGS */
-    shear[i] = main_args->trans_info.shears[i];
-    scale[i] = main_args->trans_info.scales[i];
-    trans[i] = main_args->trans_info.translations[i];
-    rots[i]  = main_args->trans_info.rotations[i];
-    cent[i]  = main_args->trans_info.center[i];
-  }
-
-                                /* modify the parameters to be optimized */
-  vector_to_parameters(trans, rots, scale, shear, params, main_args->trans_info.weights);
-  
-  if (main_args->trans_info.transform_type==TRANS_LSQ7) { /* adjust scaley and scalez only */
-                                                         /* if 7 parameter fit.  */
-    scale[1] = scale[0];
-    scale[2] = scale[0];
-  }
-
+  set_fit_parameters(fit, params, -1, 0.0, trans, rots, scale, shear, cent);
 
-  if (!in_limits(rots[0], (double)-3.1415927/2.0, (double)3.1415927/2.0) ||
-      !in_limits(rots[1], (double)-3.1415927/2.0, (double)3.1415927/2.0) ||
-      !in_limits(rots[2], (double)-3.1415927/2.0, (double)3.1415927/2.0) ||
-      !in_limits(scale[0],(double)0.0, (double)3.0) ||
-      !in_limits(scale[1],(double)0.0, (double)3.0) ||
-      !in_limits(scale[2],(double)0.0, (double)3.0) ||
-      !in_limits(shear[0],(double)-2.0, (double)2.0) ||
-      !in_limits(shear[1],(double)-2.0, (double)2.0) ||
-      !in_limits(shear[2],(double)-2.0, (double)2.0))
+  if (!fit_parameters_in_limits(rots, scale, shear))
 
     {
 
  (void)printf("out : %7.4f=%c %7.4f=%c %7.4f=%c   %7.4f=%c %7.4f=%c %7.4f=%c   %7.4f=%c %7.4f=%c %7.4f=%c \n",
-       rots[0], in_limits(rots[0], (double)-3.1415927/2.0, (double)3.1415927/2.0) ? 'T': 'F' , 
-       rots[1], in_limits(rots[1], (double)-3.1415927/2.0, (double)3.1415927/2.0) ? 'T': 'F' , 
-       rots[2], in_limits(rots[2], (double)-3.1415927/2.0, (double)3.1415927/2.0) ? 'T': 'F' , 
-       scale[0],in_limits(scale[0], (double)0.0, (double)3.0)? 'T': 'F' , 
-       scale[1],in_limits(scale[1], (double)0.0, (double)3.0)? 'T': 'F' , 
-       scale[2],in_limits(scale[2], (double)0.0, (double)3.0)? 'T': 'F' , 
-       shear[0],in_limits(shear[0], (double)-2.0, (double)2.0)? 'T': 'F' , 
-       shear[1],in_limits(shear[1], (double)-2.0, (double)2.0)? 'T': 'F' , 
-       shear[2],in_limits(shear[2], (double)-2.0, (double)2.0)? 'T': 'F' );
+       rots[0], in_limits(rots[0], rotation_limits[0], rotation_limits[1]) ? 'T': 'F' , 
+       rots[1], in_limits(rots[1], rotation_limits[0], rotation_limits[1]) ? 'T': 'F' , 
+       rots[2], in_limits(rots[2], rotation_limits[0], rotation_limits[1]) ? 'T': 'F' , 
+       scale[0],in_limits(scale[0], scale_limits[0], scale_limits[1])? 'T': 'F' , 
+       scale[1],in_limits(scale[1], scale_limits[0], scale_limits[1])? 'T': 'F' , 
+       scale[2],in_limits(scale[2], scale_limits[0], scale_limits[1])? 'T': 'F' , 
+       shear[0],in_limits(shear[0], shear_limits[0], shear_limits[1])? 'T': 'F' , 
+       shear[1],in_limits(shear[1], shear_limits[0], shear_limits[1])? 'T': 'F' , 
+       shear[2],in_limits(shear[2], shear_limits[0], shear_limits[1])? 'T': 'F' );
 
     r = 1e10;
   }
   else {
-                                /* get the linear transformation ptr */
 
-    if (get_transform_type(main_args->trans_info.transformation) == CONCATENATED_TRANSFORM) {
-      mat = get_linear_transform_ptr(
-             get_nth_general_transform(main_args->trans_info.transformation,0));
-    }
-    else
-      mat = get_linear_transform_ptr(main_args->trans_info.transformation);
-    
-    if (Ginverse_mapping_flag)
-      build_inverse_transformation_matrix(mat, cent, trans, scale, shear, rots);
-    else
-      build_transformation_matrix(mat, cent, trans, scale, shear, rots);
+    build_fit_matrix(fit, cent, trans, scale, shear, rots);
     
     /* call the needed objective function */
     
-    r = (main_args->obj_function)(Gdata1,Gdata2,Gmask1,Gmask2,args);
+    r = (args->obj_function)(fit->data1,fit->data2,fit->mask1,fit->mask2,args);
+
+    add_to_perf_counter(PERF_OBJECTIVE_EVALUATIONS, 1);
+    add_to_perf_counter(PERF_INTERPOLATED_SAMPLES, samples_per_evaluation(fit));
   }
 
   return(r);
@@ -469,34 +560,153 @@ float fit_function(Arg_Data *args,float *params)
 
 VIO_Real amoeba_obj_function(void *function_data, float d[])
 {
+  Fit_Data *fit = (Fit_Data *)function_data;
   int i;
   float p[13];
 
-  for(i=0; i<Gndim; i++)
+  for(i=0; i<fit->ndim; i++)
     p[i+1] = d[i];
   
-  return ( (VIO_Real)fit_function((Arg_Data *)function_data,p) );
+  return ( (VIO_Real)fit_function(fit,p) );
 }
 
 #ifdef HAVE_LIBLBFGS
 
+/* the first three rows of the voxel to voxel transformation that the
+   objective functions apply to the lattice, for the current linear
+   transform */
+
+static void get_fit_voxel_transform(Fit_Data *fit, VIO_Real vox_trans[3][4])
+{
+  Linear_voxel_space vox_space;
+  int r, c;
+
+  get_into_linear_voxel_space(fit->globals, &vox_space, fit->data1, fit->data2);
+
+  for(r=0; r<3; r++)
+    for(c=0; c<4; c++)
+      vox_trans[r][c] = Transform_elem(vox_space.voxel_to_voxel, r, c);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : fit_function_with_gradient
+@INPUT      : fit, params - as for fit_function()
+@OUTPUT     : gradient - the derivatives of fit_function() with respect to
+                 the fit->ndim elements of params (gradient[0] for params[1])
+@RETURNS    : the value of fit_function()
+@DESCRIPTION: for the objective functions that objective_gradient_supported():
+              the objective function adds up its derivative with respect to
+              the voxel to voxel transformation in the same lattice pass as
+              its value, and the chain rule takes it to the parameters.
+              The derivative of the voxel to voxel transformation with
+              respect to each parameter is a central difference of
+              build_fit_matrix() and get_into_voxel_space(), i.e. of 4x4
+              matrices only: the lattice is walked once per gradient
+              instead of fit->ndim+1 times.
+
+              Outside of the parameter limits, fit_function() is a flat
+              1e10, which gives the line search no direction.  There the
+              value is 1e10 * (1 + d), d being distance_out_of_limits(),
+              and the gradient is that of this value, so that it points
+              away from the limits and the line search steps back in.
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static float fit_function_with_gradient(Fit_Data *fit, float *params, VIO_Real gradient[])
+{
+  Arg_Data *args = fit->globals;
+  double trans[3];
+  double cent[3];
+  double rots[3];
+  double scale[3];
+  double shear[6];
+  VIO_Real 
+    d_objective[3][4],          /* d(objective)/d(voxel transformation) */
+    d_vox_trans[12][3][4],      /* d(voxel transformation)/d(params[k+1]) */
+    plus[3][4], minus[3][4],
+    distance, distance_plus, distance_minus;
+  int k, r, c;
+  float result;
+
+  for(k=0; k<fit->ndim; k++)
+    gradient[k] = 0.0;
+
+  set_fit_parameters(fit, params, -1, 0.0, trans, rots, scale, shear, cent);
+
+  if (!fit_parameters_in_limits(rots, scale, shear)) {
+
+    result   = fit_function(fit, params);
+    distance = distance_out_of_limits(rots, scale, shear);
+
+    for(k=0; k<fit->ndim; k++) {
+      set_fit_parameters(fit, params, k, BFGSEPSILON, trans, rots, scale, shear, cent);
+      distance_plus  = distance_out_of_limits(rots, scale, shear);
+      set_fit_parameters(fit, params, k, -BFGSEPSILON, trans, rots, scale, shear, cent);
+      distance_minus = distance_out_of_limits(rots, scale, shear);
+
+      gradient[k] = result * (distance_plus - distance_minus) / (2.0*BFGSEPSILON);
+    }
+
+    return( result * (1.0 + distance) );
+  }
+
+  for(k=0; k<fit->ndim; k++) {
+
+    set_fit_parameters(fit, params, k, BFGSEPSILON, trans, rots, scale, shear, cent);
+    build_fit_matrix(fit, cent, trans, scale, shear, rots);
+    get_fit_voxel_transform(fit, plus);
+
+    set_fit_parameters(fit, params, k, -BFGSEPSILON, trans, rots, scale, shear, cent);
+    build_fit_matrix(fit, cent, trans, scale, shear, rots);
+    get_fit_voxel_transform(fit, minus);
+
+    for(r=0; r<3; r++)
+      for(c=0; c<4; c++)
+        d_vox_trans[k][r][c] = (plus[r][c] - minus[r][c]) / (2.0*BFGSEPSILON);
+  }
+
+  set_fit_parameters(fit, params, -1, 0.0, trans, rots, scale, shear, cent);
+  build_fit_matrix(fit, cent, trans, scale, shear, rots);
+
+  result = objective_with_gradient(fit->data1,fit->data2,fit->mask1,fit->mask2,args,d_objective);
+
+  add_to_perf_counter(PERF_OBJECTIVE_EVALUATIONS, 1);
+  add_to_perf_counter(PERF_INTERPOLATED_SAMPLES, samples_per_evaluation(fit));
+
+  for(k=0; k<fit->ndim; k++)
+    for(r=0; r<3; r++)
+      for(c=0; c<4; c++)
+        gradient[k] += d_objective[r][c] * d_vox_trans[k][r][c];
+
+  return(result);
+}
+
 // Objective function for BFGS optimizer
 lbfgsfloatval_t bfgs_obj_function(void *function_data, const lbfgsfloatval_t *x, lbfgsfloatval_t *g, const int n, const lbfgsfloatval_t step) {
+	Fit_Data *fit = (Fit_Data *)function_data;
 	int i;
 	float p[13];
 	lbfgsfloatval_t fx,fx2;
+	VIO_Real gradient[12];
 	
 //	fprintf(stderr,"ROBB: in BFGS objective function!\n");
-//	fprintf(stderr,"ROBB: Gndim: %d\n",Gndim);
+//	fprintf(stderr,"ROBB: fit->ndim: %d\n",fit->ndim);
 	
-	for(i=0; i<Gndim; i++)
+	for(i=0; i<fit->ndim; i++)
 		p[i+1] = x[i];
+
+	if (objective_gradient_supported(fit->globals->obj_function)) {
+		fx = (lbfgsfloatval_t) fit_function_with_gradient(fit,p,gradient);
+		for (i=0; i<fit->ndim; i++)
+			g[i] = (lbfgsfloatval_t) gradient[i];
+		return fx;
+	}
   
-	fx = (lbfgsfloatval_t) fit_function((Arg_Data *)function_data,p);
+	fx = (lbfgsfloatval_t) fit_function(fit,p);
 	
-	for (i=0; i<Gndim; i++) {
+	for (i=0; i<fit->ndim; i++) {
 		p[i+1] += BFGSEPSILON;
-		fx2 = (lbfgsfloatval_t) fit_function((Arg_Data *)function_data,p);
+		fx2 = (lbfgsfloatval_t) fit_function(fit,p);
 		p[i+1] -= BFGSEPSILON;
 		g[i] = (lbfgsfloatval_t) (fx2-fx) / BFGSEPSILON;
 //		fprintf(stderr,"ROBB In objective function.  Param %d. Fx is %f.  Fx2 is %f.  Grad is %f\n",i,fx,fx2,g[i]);
@@ -530,8 +740,9 @@ int bfgs_progress(void *instance, const lbfgsfloatval_t *x, const lbfgsfloatval_
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
 
-float fit_function_quater(Arg_Data *args,float *params) 
+float fit_function_quater(Fit_Data *fit, float *params) 
 {
+  Arg_Data *args = fit->globals;
 
   VIO_Transform *mat;
   int i;
@@ -600,14 +811,17 @@ float fit_function_quater(Arg_Data *args,float *params)
     else
       mat = get_linear_transform_ptr(args->trans_info.transformation);
     
-    if (Ginverse_mapping_flag)
+    if (fit->inverse_mapping)
       build_inverse_transformation_matrix_quater(mat, cent, trans, scale, shear, quats);
     else
       build_transformation_matrix_quater(mat, cent, trans, scale, shear, quats);
     
     /* call the needed objective function */
     
-    r = (args->obj_function)(Gdata1,Gdata2,Gmask1,Gmask2,args);
+    r = (args->obj_function)(fit->data1,fit->data2,fit->mask1,fit->mask2,args);
+
+    add_to_perf_counter(PERF_OBJECTIVE_EVALUATIONS, 1);
+    add_to_perf_counter(PERF_INTERPOLATED_SAMPLES, samples_per_evaluation(fit));
   }
 
   return(r);
@@ -616,13 +830,14 @@ float fit_function_quater(Arg_Data *args,float *params)
 
 VIO_Real amoeba_obj_function_quater(void *function_data, float d[])
 {
+  Fit_Data *fit = (Fit_Data *)function_data;
   int i;
   float p[13];
 
-  for(i=0; i<Gndim; i++)
+  for(i=0; i<fit->ndim; i++)
     p[i+1] = d[i];
   
-  return ( (VIO_Real)fit_function_quater(function_data,p) );
+  return ( (VIO_Real)fit_function_quater(fit,p) );
 }
 
 
@@ -631,12 +846,10 @@ VIO_Real amoeba_obj_function_quater(void *function_data, float d[])
                 get the parameters necessary to map volume 1 to volume 2
                 using the simplex optimizaqtion algorithm and a user specified
                 objective function.
-@INPUT      : d1,d2:
-                two volumes of data (already in memory).
-              m1,m2:
-                two mask volumes for data (already in memory).
-              globals:
-                a global data structure containing info from the command line,
+@INPUT      : fit:
+                the two volumes of data and their masks, in the order of
+                the objective function, and in fit->globals a global data
+                structure containing info from the command line,
                 including the input parameters to be optimized, the input matrix,
                 and a plethora of flags!
 @OUTPUT     : 
@@ -648,12 +861,10 @@ VIO_Real amoeba_obj_function_quater(void *function_data, float d[])
 @CREATED    : Fri Jun 11 11:16:25 EST 1993 LC
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
-VIO_BOOL optimize_simplex(VIO_Volume d1,
-                                VIO_Volume d2,
-                                VIO_Volume m1,
-                                VIO_Volume m2, 
-                                Arg_Data *globals)
+VIO_BOOL optimize_simplex(Fit_Data *fit)
 {
+  Arg_Data
+    *globals = fit->globals;
   VIO_BOOL 
     stat;
   float 
@@ -687,10 +898,10 @@ VIO_BOOL optimize_simplex(VIO_Volume d1,
   for(i=0; i<12; i++)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
   if (stat && ndim>0) {
-    Gndim = ndim;
+    fit->ndim = ndim;
 
     ALLOC(p,ndim+1+1);                /* my parameters for the simplex 
                                    [1..ndim+1]*/
@@ -712,7 +923,7 @@ VIO_BOOL optimize_simplex(VIO_Volume d1,
 
     initialize_amoeba(&the_amoeba, ndim, parameters, 
                       simplex_size, amoeba_obj_function, 
-                      globals, (VIO_Real)local_ftol);
+                      fit, (VIO_Real)local_ftol);
 
     max_iters = 400;
     iteration_number = 0;
@@ -720,6 +931,8 @@ VIO_BOOL optimize_simplex(VIO_Volume d1,
     while ( iteration_number<max_iters && perform_amoeba(&the_amoeba, &iteration_number) ) 
       /* empty */ ;
 
+    add_to_perf_counter(PERF_AMOEBA_EVALUATIONS, iteration_number);
+
     
     if (globals->flags.debug) {
       
@@ -791,17 +1004,147 @@ VIO_BOOL optimize_simplex(VIO_Volume d1,
 
 
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : optimize_powell
+                get the parameters necessary to map volume 1 to volume 2
+                using Powell's direction set method and a user specified
+                objective function.
+@INPUT      : fit:
+                the two volumes of data and their masks, in the order of
+                the objective function, and in fit->globals a global data
+                structure containing info from the command line,
+                including the input parameters to be optimized, the input matrix,
+                and a plethora of flags!
+@OUTPUT     : 
+@RETURNS    : TRUE if ok, FALSE if error.
+@DESCRIPTION: the first directions are simplex_size long along each
+              parameter, and the search stops when a sweep over all
+              directions gains less than ftol, as for the simplex.
+@METHOD     : uses minimize_powell() of powell.c
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+VIO_BOOL optimize_powell(Fit_Data *fit)
+{
+  Arg_Data
+    *globals = fit->globals;
+  float 
+    *p;
+  int 
+    n_evaluations,
+    i, 
+    ndim;
+
+  VIO_Transform
+    *mat;
+
+  VIO_Real
+    *parameters,
+    value;
+
+  double trans[3];
+  double cent[3];
+  double rots[3];
+  double scale[3];
+  double shear[6];
+
+                                /* find number of dimensions for optimization */
+  ndim = 0;
+  for(i=0; i<12; i++)
+    if (globals->trans_info.weights[i] != 0.0) ndim++;
+
+  if (ndim == 0)
+    return( TRUE );
+
+  fit->ndim = ndim;
+
+  ALLOC(p,ndim+1+1);                /* parameters [1..ndim+1] */
+  ALLOC(parameters, ndim+1);        /* and [0..ndim] */
+    
+                                /* build the parameter vector from the 
+                                   initial transformation parameters   */
+  parameters_to_vector(globals->trans_info.translations,
+                       globals->trans_info.rotations,
+                       globals->trans_info.scales,
+                       globals->trans_info.shears,
+                       p,
+                       globals->trans_info.weights);
+
+  for(i=0; i<ndim; i++)
+    parameters[i] = (VIO_Real)p[i+1];
+
+  n_evaluations = minimize_powell(ndim, parameters, simplex_size,
+                                  amoeba_obj_function, fit,
+                                  ftol, 2000, &value);
+
+  add_to_perf_counter(PERF_POWELL_EVALUATIONS, n_evaluations);
+
+  if (globals->flags.debug)
+    (void)print("done with Powell after %d function evaluations (%f)\n",
+                n_evaluations, value);
+
+                                /* copy result into main data structure */
+  for(i=0; i<ndim; i++)                
+    p[i+1] = (float)parameters[i];
+    
+  vector_to_parameters(globals->trans_info.translations,
+                       globals->trans_info.rotations,
+                       globals->trans_info.scales,
+                       globals->trans_info.shears,
+                       p,
+                       globals->trans_info.weights);
+
+  if (globals->trans_info.transform_type==TRANS_LSQ7) { /* adjust scaley and scalez only */
+    /* if 7 parameter fit.  */
+    globals->trans_info.scales[1] = globals->trans_info.scales[0];
+    globals->trans_info.scales[2] = globals->trans_info.scales[0];
+  }
+    
+  for(i=0; i<3; i++) {
+    trans[i] = globals->trans_info.translations[i]; 
+    rots[i]  = globals->trans_info.rotations[i];
+    scale[i] = globals->trans_info.scales[i];
+    cent[i]  = globals->trans_info.center[i];
+    shear[i] = globals->trans_info.shears[i];
+  }
+
+  if (globals->flags.debug) {
+    print("after parameter optimization\n");
+    print("-center      %10.5f %10.5f %10.5f\n", cent[0], cent[1], cent[2]);
+    print("-translation %10.5f %10.5f %10.5f\n", trans[0], trans[1], trans[2]);
+    print("-rotation    %10.5f %10.5f %10.5f\n", 
+          rots[0]*180.0/3.1415927, rots[1]*180.0/3.1415927, rots[2]*180.0/3.1415927);
+    print("-scale       %10.5f %10.5f %10.5f\n", scale[0], scale[1], scale[2]);
+    print("-shear       %10.5f %10.5f %10.5f\n", shear[0], shear[1], shear[2]);
+  }
+  
+  if (get_transform_type(globals->trans_info.transformation) == CONCATENATED_TRANSFORM) {
+    mat = get_linear_transform_ptr(
+            get_nth_general_transform(globals->trans_info.transformation,0));
+  }
+  else
+    mat = get_linear_transform_ptr(globals->trans_info.transformation);
+    
+  build_transformation_matrix(mat, cent, trans, scale, shear, rots);
+
+  FREE(p);
+  FREE(parameters);
+
+  return( TRUE );
+}
+
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : optimize_simplex_quater
                 get the parameters necessary to map volume 1 to volume 2
                 using the simplex optimizaqtion algorithm and a user specified
                 objective function.
-@INPUT      : d1,d2:
-                two volumes of data (already in memory).
-              m1,m2:
-                two mask volumes for data (already in memory).
-              globals:
-                a global data structure containing info from the command line,
+@INPUT      : fit:
+                the two volumes of data and their masks, in the order of
+                the objective function, and in fit->globals a global data
+                structure containing info from the command line,
                 including the input parameters to be optimized, the input matrix,
                 and a plethora of flags!
                 same as optimize_simplex but with quaternions
@@ -814,12 +1157,10 @@ VIO_BOOL optimize_simplex(VIO_Volume d1,
 @CREATED    : Fri Jun 11 11:16:25 EST 1993 LC
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
-VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
-                                       VIO_Volume d2,
-                                       VIO_Volume m1,
-                                       VIO_Volume m2, 
-                                       Arg_Data *globals)
+VIO_BOOL optimize_simplex_quater(Fit_Data *fit)
 {
+  Arg_Data
+    *globals = fit->globals;
   VIO_BOOL 
     stat;
   float 
@@ -856,10 +1197,10 @@ VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
   for(i=0; i<12; i++)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
   if (stat && ndim>0) {
-    Gndim = ndim;
+    fit->ndim = ndim;
 
     ALLOC(p,ndim+1+1);                /* my parameters for the simplex 
                                         [1..ndim+1]*/
@@ -887,7 +1228,7 @@ VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
 
     initialize_amoeba(&the_amoeba, ndim, parameters, 
                       simplex_size, amoeba_obj_function_quater, 
-                      globals, (VIO_Real)local_ftol);
+                      fit, (VIO_Real)local_ftol);
 
     max_iters = 400;
     iteration_number = 0;
@@ -895,6 +1236,8 @@ VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
     while ( iteration_number<max_iters && perform_amoeba(&the_amoeba, &iteration_number) ) 
       /* empty */ ;
 
+    add_to_perf_counter(PERF_AMOEBA_EVALUATIONS, iteration_number);
+
     
     if (globals->flags.debug) {
       
@@ -978,12 +1321,10 @@ VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
                 get the parameters necessary to map volume 1 to volume 2
                 using the BFGS algorithm and a user specified
                 objective function.
-@INPUT      : d1,d2:
-                two volumes of data (already in memory).
-              m1,m2:
-                two mask volumes for data (already in memory).
-              globals:
-                a global data structure containing info from the command line,
+@INPUT      : fit:
+                the two volumes of data and their masks, in the order of
+                the objective function, and in fit->globals a global data
+                structure containing info from the command line,
                 including the input parameters to be optimized, the input matrix,
                 and a plethora of flags!
 @OUTPUT     : 
@@ -995,12 +1336,10 @@ VIO_BOOL optimize_simplex_quater(VIO_Volume d1,
 @CREATED    : February 19, 2013
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
-VIO_BOOL optimize_BFGS(VIO_Volume d1,
-                                VIO_Volume d2,
-                                VIO_Volume m1,
-                                VIO_Volume m2, 
-                                Arg_Data *globals)
+VIO_BOOL optimize_BFGS(Fit_Data *fit)
 {
+  Arg_Data
+    *globals = fit->globals;
 	VIO_BOOL stat;
 	float local_ftol, *p;
 	int max_iters, i,j, ndim;
@@ -1024,7 +1363,7 @@ VIO_BOOL optimize_BFGS(VIO_Volume d1,
 	for(i=0; i<12; i++)
 		if (globals->trans_info.weights[i] != 0.0) ndim++;
 		
-	Gndim = ndim;
+	fit->ndim = ndim;
 	
 	ALLOC(p,ndim+1+1);                // Louis parameters (1 based arrays)
 	
@@ -1045,9 +1384,9 @@ VIO_BOOL optimize_BFGS(VIO_Volume d1,
 	lbfgs_parameter_t param;
 	lbfgs_parameter_init(&param);
 	if (globals->flags.debug)
-		stat = lbfgs(ndim,parameters,NULL,bfgs_obj_function,bfgs_progress,globals,&param);
+		stat = lbfgs(ndim,parameters,NULL,bfgs_obj_function,bfgs_progress,fit,&param);
 	else
-		stat = lbfgs(ndim,parameters,NULL,bfgs_obj_function,NULL,globals,&param);
+		stat = lbfgs(ndim,parameters,NULL,bfgs_obj_function,NULL,fit,&param);
 	if (stat) {
 		fprintf(stderr,"BFGS Status: %d\n",stat);	
 		fprintf(stderr,"LBFGS_SUCCESS %d\n",LBFGS_SUCCESS);
@@ -1174,6 +1513,233 @@ VIO_BOOL replace_volume_data_with_ubyte(VIO_Volume data)
 }
 
 
+/* hand the volumes to the objective function with the smallest one
+   first (to save on CPU) */
+
+static void init_fit_data(Fit_Data *fit,
+                          VIO_Volume d1,
+                          VIO_Volume d2,
+                          VIO_Volume m1,
+                          VIO_Volume m2, 
+                          Arg_Data *globals)
+{
+  fit->globals = globals;
+  fit->ndim    = 0;
+
+  if (globals->smallest_vol == 1) {
+    fit->data1 = d1;      fit->data2 = d2;
+    fit->mask1 = m1;      fit->mask2 = m2;
+    fit->inverse_mapping = FALSE;
+  }
+  else {
+    fit->data1 = d2;      fit->data2 = d1;
+    fit->mask1 = m2;      fit->mask2 = m1;
+    fit->inverse_mapping = TRUE;
+  }
+}
+
+                                /* the starting points tried by
+                                   -multistart, as offsets from the
+                                   initial guess: translations (mm)
+                                   and rotations (degrees)           */
+#define N_MULTISTART_OFFSETS 18
+
+/* There are no axis flips (180 degree turns or mirrorings) among them.
+   The volumes are taken to share the orientation of their world
+   coordinates, so a flip is not a plausible start, and it could not be
+   fitted anyway: fit_parameters_in_limits() keeps the rotations within
+   +/-90 degrees and the scales positive, so a mirroring (negative
+   scale) is not representable and a turned start is rejected.  A
+   flipped head is also a strong local optimum of xcorr, because of
+   its near symmetry, which the fine fit would then refine. */
+
+static double multistart_offsets[N_MULTISTART_OFFSETS][6] = {
+  /*   tx     ty     tz      rx     ry     rz  */
+  {   0.0,   0.0,   0.0,   25.0,   0.0,   0.0 },
+  {   0.0,   0.0,   0.0,  -25.0,   0.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0,  25.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0, -25.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0,   0.0,  25.0 },
+  {   0.0,   0.0,   0.0,    0.0,   0.0, -25.0 },
+  {  10.0,   0.0,   0.0,    0.0,   0.0,   0.0 },
+  { -10.0,   0.0,   0.0,    0.0,   0.0,   0.0 },
+  {   0.0,  10.0,   0.0,    0.0,   0.0,   0.0 },
+  {   0.0, -10.0,   0.0,    0.0,   0.0,   0.0 },
+  {   0.0,   0.0,  10.0,    0.0,   0.0,   0.0 },
+  {   0.0,   0.0, -10.0,    0.0,   0.0,   0.0 },
+  {   0.0,   0.0,   0.0,   50.0,   0.0,   0.0 },
+  {   0.0,   0.0,   0.0,  -50.0,   0.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0,  50.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0, -50.0,   0.0 },
+  {   0.0,   0.0,   0.0,    0.0,   0.0,  50.0 },
+  {   0.0,   0.0,   0.0,    0.0,   0.0, -50.0 }
+};
+
+typedef struct {
+  Fit_Data  *fit;               /* the volumes of the fit            */
+  Arg_Data  *start;             /* one per starting point            */
+  VIO_BOOL  *in_limits;
+  float     *values;            /* of the objective function at the
+                                   end of each coarse fit            */
+} Multistart_Work;
+
+/* fit starting points first..last-1 on the coarse lattice */
+
+static void fit_multistart_points(void *data, int thread, int first, int last)
+{
+  Multistart_Work
+    *work = (Multistart_Work *)data;
+  Fit_Data
+    fit;
+  float
+    p[13];
+  int
+    k;
+
+  for(k=first; k<last; k++) {
+
+    work->values[k] = 1e10;
+    if (!work->in_limits[k])
+      continue;
+
+    fit         = *work->fit;
+    fit.globals = &work->start[k];
+
+    if (optimize_simplex(&fit)) {
+      parameters_to_vector(fit.globals->trans_info.translations,
+                           fit.globals->trans_info.rotations,
+                           fit.globals->trans_info.scales,
+                           fit.globals->trans_info.shears,
+                           p,
+                           fit.globals->trans_info.weights);
+      work->values[k] = fit_function(&fit, p);
+    }
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : multistart_linear_fit
+@INPUT      : fit - the volumes, and in fit->globals the initial guess
+                    and the number of starting points (-multistart)
+@OUTPUT     : the parameters of fit->globals->trans_info are replaced by
+              the best of the starting points
+@RETURNS    : 
+@DESCRIPTION: the initial guess, and up to globals->multistart-1 points
+              offset from it (see multistart_offsets, only the offsets
+              along parameters being optimized are used), are each fitted
+              with the simplex on a lattice twice as coarse as the one
+              given, over -threads threads.  The fit that ends with the
+              lowest value of the objective function (the first one, on
+              ties) is kept, and refined by the caller on the full lattice.
+@METHOD     : 
+@GLOBALS    : lattice_samples is switched to the coarse lattice while the
+              starting points are fitted
+@CALLS      : optimize_simplex
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void multistart_linear_fit(Fit_Data *fit)
+{
+  Arg_Data
+    *globals = fit->globals,
+    coarse;
+  Multistart_Work
+    work;
+  Lattice_Samples
+    *fine_samples;
+  double
+    rots[3], scale[3], shear[3];
+  int
+    i, k, n_starts, best, offset[N_MULTISTART_OFFSETS+1];
+
+                                /* the initial guess, and the offsets
+                                   that only move optimized parameters */
+  n_starts  = 1;
+  offset[0] = -1;
+  for(k=0; k<N_MULTISTART_OFFSETS && n_starts<globals->multistart; k++) {
+    for(i=0; i<6; i++)
+      if (multistart_offsets[k][i] != 0.0 && globals->trans_info.weights[i] == 0.0)
+        break;
+    if (i == 6)
+      offset[n_starts++] = k;
+  }
+
+  if (n_starts < 2)
+    return;
+                                /* the coarse lattice: every other
+                                   node, from the first one, so that
+                                   the last coarse node is never past
+                                   the last node of the lattice     */
+  coarse = *globals;
+  for(i=0; i<3; i++) {
+    coarse.step[i]  *= 2.0;
+    if (coarse.count[i] > 0)
+      coarse.count[i] = (coarse.count[i] - 1) / 2 + 1;
+    SCALE_VECTOR( coarse.directions[i], coarse.directions[i], 2.0);
+  }
+
+  fine_samples    = lattice_samples;
+  lattice_samples = build_lattice_samples(fit->data1, fit->data2, fit->mask1, &coarse);
+
+  coarse.threads     = 1;       /* the threads go to the starting points */
+  coarse.flags.debug = FALSE;
+
+  ALLOC(work.start,     n_starts);
+  ALLOC(work.in_limits, n_starts);
+  ALLOC(work.values,    n_starts);
+  work.fit = fit;
+
+  for(k=0; k<n_starts; k++) {
+    work.start[k] = coarse;
+    ALLOC(work.start[k].trans_info.transformation, 1);
+    copy_general_transform(globals->trans_info.transformation,
+                           work.start[k].trans_info.transformation);
+
+    if (offset[k] >= 0)
+      for(i=0; i<3; i++) {
+        work.start[k].trans_info.translations[i] += multistart_offsets[offset[k]][i];
+        work.start[k].trans_info.rotations[i]    += multistart_offsets[offset[k]][i+3] * 3.1415927/180.0;
+      }
+
+    for(i=0; i<3; i++) {
+      rots[i]  = work.start[k].trans_info.rotations[i];
+      scale[i] = work.start[k].trans_info.scales[i];
+      shear[i] = work.start[k].trans_info.shears[i];
+    }
+    work.in_limits[k] = fit_parameters_in_limits(rots, scale, shear);
+  }
+
+  run_in_parallel(globals->threads, n_starts, 1, fit_multistart_points, (void *)&work);
+
+  best = 0;
+  for(k=1; k<n_starts; k++)
+    if (work.values[k] < work.values[best])
+      best = k;
+
+  if (globals->flags.debug)
+    for(k=0; k<n_starts; k++)
+      print("multistart %2d: %s %f\n", k,
+            k == best ? "*" : " ", work.values[k]);
+
+  for(i=0; i<3; i++) {
+    globals->trans_info.translations[i] = work.start[best].trans_info.translations[i];
+    globals->trans_info.rotations[i]    = work.start[best].trans_info.rotations[i];
+    globals->trans_info.scales[i]       = work.start[best].trans_info.scales[i];
+    globals->trans_info.shears[i]       = work.start[best].trans_info.shears[i];
+  }
+
+  for(k=0; k<n_starts; k++) {
+    delete_general_transform(work.start[k].trans_info.transformation);
+    FREE(work.start[k].trans_info.transformation);
+  }
+  FREE(work.start);
+  FREE(work.in_limits);
+  FREE(work.values);
+
+  delete_lattice_samples(lattice_samples);
+  lattice_samples = fine_samples;
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : optimize_linear_transformation
                 get the parameters necessary to map volume 1 to volume 2
@@ -1210,12 +1776,14 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
 {
   VIO_BOOL 
     stat;
-  int i;
+  int i, perf_phase;
   VIO_Data_types
     data_type;
   float *p;
   VIO_Transform
     *mat;
+  Fit_Data
+    fit;
 
   double trans[3];
   double cent[3];
@@ -1309,10 +1877,6 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
         }
       }
 
-      ALLOC(   prob_fn1,   globals->groups);
-      ALLOC(   prob_fn2,   globals->groups);
-      VIO_ALLOC2D( prob_hash_table, globals->groups, globals->groups);
-
     } else
   if (globals->obj_function == xcorr_objective) {
                                 /*EMPTY*/
@@ -1374,20 +1938,45 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
     stat = FALSE;
   }
 
-           /* ---------------- swap the volumes, so that the smallest
-                               is first (to save on CPU)             ---------*/
+           /* ---------------- -bspline interpolates the cubic B-spline
+                               coefficients of the (rewritten)
+                               volumes, kept for the whole fit       ---------*/
 
-  if (globals->smallest_vol == 1) {
-    Gdata1 = d1;      Gdata2 = d2;
-    Gmask1 = m1;      Gmask2 = m2;
-    Ginverse_mapping_flag = FALSE;
+  if (globals->interpolant == bspline_interpolant) {
+    perf_phase = begin_perf_phase("bspline_prefilter");
+    prefilter_bspline_volume(d1);
+    prefilter_bspline_volume(d2);
+    end_perf_phase(perf_phase);
   }
-  else {
-    Gdata1 = d2;      Gdata2 = d1;
-    Gmask1 = m2;      Gmask2 = m1;
-    Ginverse_mapping_flag = TRUE;
+
+           /* ---------------- -bricked_volumes: the interpolants read
+                               the (rewritten) volumes brick by brick ---------*/
+
+  if (globals->bricked_volumes) {
+    perf_phase = begin_perf_phase("brick_volumes");
+    (void)make_bricked_volume(d1);
+    (void)make_bricked_volume(d2);
+    end_perf_phase(perf_phase);
   }
 
+           /* ---------------- swap the volumes, so that the smallest
+                               is first (to save on CPU)             ---------*/
+
+  init_fit_data(&fit, d1, d2, m1, m2, globals);
+
+           /* ---------------- list the lattice nodes that pass the
+                               source mask and threshold, once for
+                               the whole fit                         ---------*/
+
+  perf_phase = begin_perf_phase("lattice_samples");
+  lattice_samples = build_lattice_samples(fit.data1, fit.data2, fit.mask1, globals);
+  end_perf_phase(perf_phase);
+
+  if (globals->flags.debug && lattice_samples != NULL)
+    print ("%d of %d lattice nodes are sampled in the source\n",
+           lattice_samples->first[lattice_samples->n_slices],
+           globals->count[VIO_X] * globals->count[VIO_Y] * globals->count[VIO_Z]);
+
 
            /* ---------------- call the requested obj_function to 
                                establish the initial fitting value  ---------*/
@@ -1402,18 +1991,31 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
 
 
 
-  initial_corr = fit_function(globals,p);
+  initial_corr = fit_function(&fit,p);
+
+           /* ---------------- fit the starting points of -multistart
+                               on a coarse lattice, and keep the best ---*/
+
+  if (globals->multistart > 1) {
+    perf_phase = begin_perf_phase("multistart");
+    multistart_linear_fit(&fit);
+    end_perf_phase(perf_phase);
+  }
 
            /* ---------------- call requested optimization strategy ---------*/
 
 //fprintf(stderr,"ROBB: Optimizer: %d\n",globals->optimize_type);
+  perf_phase = begin_perf_phase("optimizer");
   switch (globals->optimize_type) {
   case OPT_SIMPLEX:
-    stat = optimize_simplex(d1, d2, m1, m2, globals);
+    stat = optimize_simplex(&fit);
+    break;
+  case OPT_POWELL:
+    stat = optimize_powell(&fit);
     break;
 #ifdef HAVE_LIBLBFGS
   case OPT_BFGS:
-    stat = optimize_BFGS(d1,d2,m1,m2,globals);
+    stat = optimize_BFGS(&fit);
     break;
 #else
   case OPT_BFGS:
@@ -1428,6 +2030,7 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
     (void)fprintf(stderr, "Error in line %d, file %s\n",__LINE__, __FILE__);
     stat = FALSE;
   }
+  end_perf_phase(perf_phase);
   
   parameters_to_vector(globals->trans_info.translations,
                        globals->trans_info.rotations,
@@ -1436,10 +2039,13 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
                        p,
                        globals->trans_info.weights);
 
-  final_corr = fit_function(globals,p);
+  final_corr = fit_function(&fit,p);
 
   FREE(p);
 
+  delete_lattice_samples(lattice_samples);
+  lattice_samples = NULL;
+
   /*--------- set up final transformation matrix ------------------*/
 
   if (get_transform_type(globals->trans_info.transformation) == CONCATENATED_TRANSFORM) {
@@ -1465,15 +2071,18 @@ VIO_BOOL optimize_linear_transformation(VIO_Volume d1,
   if (globals->obj_function == vr_objective)
     {
       stat = stat && free_segment_table(segment_table);
-    } else
-  if (globals->obj_function == mutual_information_objective || globals->obj_function == normalized_mutual_information_objective )
-                                /* Collignon's mutual information */
-    {
-      FREE(   prob_fn1 );
-      FREE(   prob_fn2 );
-      VIO_FREE2D( prob_hash_table);
     }
 
+  if (globals->interpolant == bspline_interpolant) {
+    delete_bspline_coefficients(d1);
+    delete_bspline_coefficients(d2);
+  }
+
+  if (globals->bricked_volumes) {
+    delete_bricked_volume(d1);
+    delete_bricked_volume(d2);
+  }
+
 
   return(stat);
 }
@@ -1516,12 +2125,14 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
 {
   VIO_BOOL 
     stat;
-  int i;
+  int i, perf_phase;
   VIO_Data_types
     data_type;
   float *p;
   VIO_Transform
     *mat;
+  Fit_Data
+    fit;
 
   double trans[3];
   double cent[3];
@@ -1615,10 +2226,6 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
         }
       }
 
-      ALLOC(   prob_fn1,   globals->groups);
-      ALLOC(   prob_fn2,   globals->groups);
-      VIO_ALLOC2D( prob_hash_table, globals->groups, globals->groups);
-
     } else
   if (globals->obj_function == xcorr_objective) {
                                 /*EMPTY*/
@@ -1681,20 +2288,45 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
     stat = FALSE;
   }
 
-           /* ---------------- swap the volumes, so that the smallest
-                               is first (to save on CPU)             ---------*/
+           /* ---------------- -bspline interpolates the cubic B-spline
+                               coefficients of the (rewritten)
+                               volumes, kept for the whole fit       ---------*/
 
-  if (globals->smallest_vol == 1) {
-    Gdata1 = d1;      Gdata2 = d2;
-    Gmask1 = m1;      Gmask2 = m2;
-    Ginverse_mapping_flag = FALSE;
+  if (globals->interpolant == bspline_interpolant) {
+    perf_phase = begin_perf_phase("bspline_prefilter");
+    prefilter_bspline_volume(d1);
+    prefilter_bspline_volume(d2);
+    end_perf_phase(perf_phase);
   }
-  else {
-    Gdata1 = d2;      Gdata2 = d1;
-    Gmask1 = m2;      Gmask2 = m1;
-    Ginverse_mapping_flag = TRUE;
+
+           /* ---------------- -bricked_volumes: the interpolants read
+                               the (rewritten) volumes brick by brick ---------*/
+
+  if (globals->bricked_volumes) {
+    perf_phase = begin_perf_phase("brick_volumes");
+    (void)make_bricked_volume(d1);
+    (void)make_bricked_volume(d2);
+    end_perf_phase(perf_phase);
   }
 
+           /* ---------------- swap the volumes, so that the smallest
+                               is first (to save on CPU)             ---------*/
+
+  init_fit_data(&fit, d1, d2, m1, m2, globals);
+
+           /* ---------------- list the lattice nodes that pass the
+                               source mask and threshold, once for
+                               the whole fit                         ---------*/
+
+  perf_phase = begin_perf_phase("lattice_samples");
+  lattice_samples = build_lattice_samples(fit.data1, fit.data2, fit.mask1, globals);
+  end_perf_phase(perf_phase);
+
+  if (globals->flags.debug && lattice_samples != NULL)
+    print ("%d of %d lattice nodes are sampled in the source\n",
+           lattice_samples->first[lattice_samples->n_slices],
+           globals->count[VIO_X] * globals->count[VIO_Y] * globals->count[VIO_Z]);
+
 
            /* ---------------- call the requested obj_function to 
                                establish the initial fitting value  ---------*/
@@ -1710,13 +2342,14 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
                               p,
                               globals->trans_info.weights);
 
-  initial_corr = fit_function_quater(globals,p);
+  initial_corr = fit_function_quater(&fit,p);
 
            /* ---------------- call requested optimization strategy ---------*/
 
+  perf_phase = begin_perf_phase("optimizer");
   switch (globals->optimize_type) {
   case OPT_SIMPLEX:
-    stat = optimize_simplex_quater(d1, d2, m1, m2, globals);
+    stat = optimize_simplex_quater(&fit);
     break;
   default:
     (void)fprintf(stderr, "Unknown type of optimization requested (%d)\n",
@@ -1724,6 +2357,7 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
     (void)fprintf(stderr, "Error in line %d, file %s\n",__LINE__, __FILE__);
     stat = FALSE;
   }
+  end_perf_phase(perf_phase);
   
   parameters_to_vector_quater(globals->trans_info.translations,
                               globals->trans_info.quaternions,
@@ -1732,10 +2366,13 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
                               p,
                               globals->trans_info.weights);
 
-  final_corr = fit_function_quater(globals,p);
+  final_corr = fit_function_quater(&fit,p);
 
   FREE(p);
 
+  delete_lattice_samples(lattice_samples);
+  lattice_samples = NULL;
+
   /*--------- set up final transformation matrix ------------------*/
 
   if (get_transform_type(globals->trans_info.transformation) == CONCATENATED_TRANSFORM) {
@@ -1762,15 +2399,18 @@ VIO_BOOL optimize_linear_transformation_quater(VIO_Volume d1,
   if (globals->obj_function == vr_objective)
     {
       stat = stat && free_segment_table(segment_table);
-    } else
-  if (globals->obj_function == mutual_information_objective || globals->obj_function == normalized_mutual_information_objective  )
-                                /* Collignon's mutual information */
-    {
-      FREE(   prob_fn1 );
-      FREE(   prob_fn2 );
-      VIO_FREE2D( prob_hash_table);
     }
 
+  if (globals->interpolant == bspline_interpolant) {
+    delete_bspline_coefficients(d1);
+    delete_bspline_coefficients(d2);
+  }
+
+  if (globals->bricked_volumes) {
+    delete_bricked_volume(d1);
+    delete_bricked_volume(d2);
+  }
+
 
   return(stat);
 }
@@ -1818,6 +2458,8 @@ float measure_fit(VIO_Volume d1,
     ndim;
   VIO_Data_types
     data_type;
+  Fit_Data
+    fit;
 
 
 
@@ -1882,10 +2524,6 @@ float measure_fit(VIO_Volume d1,
         }
       }
 
-      ALLOC(   prob_fn1,   globals->groups);
-      ALLOC(   prob_fn2,   globals->groups);
-      VIO_ALLOC2D( prob_hash_table, globals->groups, globals->groups);
-
     } 
           /* ---------------- prepare the weighting array for obj func evaluation  ---------*/
  
@@ -1946,26 +2584,13 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
   for(i=0; i<12; i++)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
   y = -1e10; 
 
   if (stat) {
-    Gndim = ndim;
-    if (globals->smallest_vol == 1) {
-      Gdata1 = d1;
-      Gdata2 = d2;
-      Gmask1 = m1;
-      Gmask2 = m2;
-      Ginverse_mapping_flag = FALSE;
-    }
-    else {
-      Gdata1 = d2;
-      Gdata2 = d1;
-      Gmask1 = m2;
-      Gmask2 = m1;
-      Ginverse_mapping_flag = TRUE;
-    }
+    init_fit_data(&fit, d1, d2, m1, m2, globals);
+    fit.ndim = ndim;
 
     VIO_ALLOC2D(p,ndim+1+1,ndim+1); /* simplex */
     
@@ -1976,7 +2601,7 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
                          p[1],
                          globals->trans_info.weights);
 
-    y = fit_function(globals,p[1]);        /* evaluate the objective  function */
+    y = fit_function(&fit,p[1]);        /* evaluate the objective  function */
 
     VIO_FREE2D(p); /* simplex */
 
@@ -2040,26 +2665,13 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
   for(i=0; i<13; i++)
     if (globals->trans_info.weights[i] != 0.0) ndim++;
 
-                                /* set GLOBALS to communicate with the
+                                /* set up the data of the
                                    function to be fitted!              */
   y = -1e10; 
 
   if (stat) {
-    Gndim = ndim;
-    if (globals->smallest_vol == 1) {
-      Gdata1 = d1;
-      Gdata2 = d2;
-      Gmask1 = m1;
-      Gmask2 = m2;
-      Ginverse_mapping_flag = FALSE;
-    }
-    else {
-      Gdata1 = d2;
-      Gdata2 = d1;
-      Gmask1 = m2;
-      Gmask2 = m1;
-      Ginverse_mapping_flag = TRUE;
-    }
+    init_fit_data(&fit, d1, d2, m1, m2, globals);
+    fit.ndim = ndim;
 
     VIO_ALLOC2D(p,ndim+1+1,ndim+1); /* simplex */
     
@@ -2070,7 +2682,7 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
                                 p[1],
                                 globals->trans_info.weights);
 
-    y = fit_function_quater(globals,p[1]);        /* evaluate the objective  function */
+    y = fit_function_quater(&fit,p[1]);        /* evaluate the objective  function */
 
     VIO_FREE2D(p); /* simplex */
   }
@@ -2083,14 +2695,7 @@ if(globals->trans_info.rotation_type == TRANS_ROT)
       (void)fprintf(stderr, "Can't free segment table.\n");
       (void)fprintf(stderr, "Error in line %d, file %s\n",__LINE__, __FILE__);
     }
-  } else
-  if (globals->obj_function == mutual_information_objective  || globals->obj_function == normalized_mutual_information_objective )
-                                /* Collignon's mutual information */
-    {
-      FREE(   prob_fn1 );
-      FREE(   prob_fn2 );
-      VIO_FREE2D( prob_hash_table);
-    }
+  }
 
 
   return(y);
@@ -2136,7 +2741,7 @@ VIO_BOOL optimize_non_linear_transformation(Arg_Data *globals)
 {
   VIO_BOOL 
     stat;
-  int i;
+  int i, perf_phase;
 
   stat = TRUE;
   
@@ -2219,10 +2824,28 @@ VIO_BOOL optimize_non_linear_transformation(Arg_Data *globals)
 
 
 
+           /* ---------------- -bricked_volumes: the interpolants read
+                               the (rewritten) volumes brick by brick ---------*/
+
+  if (globals->bricked_volumes) {
+    perf_phase = begin_perf_phase("brick_volumes");
+    for(i=0; i<globals->features.number_of_features; i++) {
+      (void)make_bricked_volume(globals->features.data[i]);
+      (void)make_bricked_volume(globals->features.model[i]);
+    }
+    end_perf_phase(perf_phase);
+  }
+
            /* ---------------- call requested optimization strategy ---------*/
 
 
   stat = ( do_non_linear_optimization(globals)==VIO_OK );
+
+  if (globals->bricked_volumes)
+    for(i=0; i<globals->features.number_of_features; i++) {
+      delete_bricked_volume(globals->features.data[i]);
+      delete_bricked_volume(globals->features.model[i]);
+    }
  
   
           /* ----------------finish up parameter/matrix manipulations ------*/
@@ -0,0 +1,313 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : perf_report.c
+@DESCRIPTION: wall and CPU time of the phases of a minctracc run, and a few
+              work counters, saved as JSON by -perf_report.
+
+              A phase is bracketed by begin_perf_phase() and
+              end_perf_phase(); phases may be nested (an iteration holds
+              its smoothing, say) and the same name may be used many times,
+              each occurrence getting its own index.  Each phase records
+              its wall time, the CPU time of the process over all its
+              threads, the peak resident set size when it ended and how
+              much each counter grew while it ran.
+
+              The phases and counters are always kept (this costs a few
+              system calls per phase); the file is only written when asked
+              for.  The phases are only opened and closed by the main
+              thread; the counters are locked, since -multistart fits
+              run their objective functions in worker threads.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <time.h>
+#include <string.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#include "perf_report.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+typedef struct {
+  char   *name;
+  int     index;                /* occurrence of name in the run    */
+  int     depth;                /* # of phases open when it began   */
+  VIO_BOOL open;
+  double  start_wall, start_cpu;
+  double  wall, cpu;
+  long    peak_rss;             /* kB, when the phase ended         */
+  long    counters[N_PERF_COUNTERS];
+} Perf_Phase;
+
+static char *counter_names[N_PERF_COUNTERS] = {
+  "objective_evaluations",
+  "interpolated_samples",
+  "nodes_seen",
+  "nodes_tried",
+  "nodes_done",
+  "amoeba_evaluations",
+  "powell_evaluations"
+};
+
+static Perf_Phase *phases       = NULL;
+static int         n_phases     = 0;
+static int         n_alloced    = 0;
+static int         depth        = 0;
+static long        counters[N_PERF_COUNTERS];
+static double      run_start_wall, run_start_cpu;
+static VIO_BOOL    started      = FALSE;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static double get_wall_seconds(void)
+{
+#ifdef HAVE_SYS_TIME_H
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return( (double)now.tv_sec + 1.0e-6 * (double)now.tv_usec );
+#else
+  return( (double)time(NULL) );
+#endif
+}
+
+static double get_cpu_seconds(void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return( (double)usage.ru_utime.tv_sec + 1.0e-6 * (double)usage.ru_utime.tv_usec +
+          (double)usage.ru_stime.tv_sec + 1.0e-6 * (double)usage.ru_stime.tv_usec );
+#else
+  return( (double)clock() / CLOCKS_PER_SEC );
+#endif
+}
+
+/* peak resident set size of the process in kB, 0 if unknown */
+
+static long get_peak_rss(void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return( (long)(usage.ru_maxrss / 1024) );  /* in bytes there */
+#else
+  return( (long)usage.ru_maxrss );
+#endif
+#else
+  return( 0 );
+#endif
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : start_perf_report
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: forget the phases and counters recorded so far, and start
+              the clock of the run.  Called at the very beginning of a
+              run; the first begin_perf_phase() starts the clock otherwise.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void start_perf_report(void)
+{
+  int i;
+
+  n_phases = 0;
+  depth    = 0;
+  for(i=0; i<N_PERF_COUNTERS; i++)
+    counters[i] = 0;
+
+  run_start_wall = get_wall_seconds();
+  run_start_cpu  = get_cpu_seconds();
+  started        = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : begin_perf_phase
+@INPUT      : name - a string constant, kept as is
+@OUTPUT     :
+@RETURNS    : the phase, to hand to end_perf_phase()
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int begin_perf_phase(char *name)
+{
+  Perf_Phase *phase;
+  int         i;
+
+  if (!started)
+    start_perf_report();
+
+  if (n_phases == n_alloced) {
+    n_alloced = (n_alloced == 0) ? 64 : 2*n_alloced;
+    if (phases == NULL)
+      ALLOC(phases, n_alloced);
+    else
+      REALLOC(phases, n_alloced);
+  }
+
+  phase = &phases[n_phases];
+
+  phase->name  = name;
+  phase->index = 0;
+  for(i=0; i<n_phases; i++)
+    if (strcmp(phases[i].name, name) == 0)
+      phase->index++;
+  phase->depth = depth++;
+  phase->open  = TRUE;
+
+  for(i=0; i<N_PERF_COUNTERS; i++)
+    phase->counters[i] = counters[i];
+
+  phase->wall       = phase->cpu = 0.0;
+  phase->peak_rss   = 0;
+  phase->start_cpu  = get_cpu_seconds();
+  phase->start_wall = get_wall_seconds();
+
+  return( n_phases++ );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : end_perf_phase
+@INPUT      : phase - returned by begin_perf_phase()
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void end_perf_phase(int phase)
+{
+  Perf_Phase *p;
+  int         i;
+
+  if (phase < 0 || phase >= n_phases || !phases[phase].open)
+    return;
+
+  p = &phases[phase];
+
+  p->wall     = get_wall_seconds() - p->start_wall;
+  p->cpu      = get_cpu_seconds()  - p->start_cpu;
+  p->peak_rss = get_peak_rss();
+  for(i=0; i<N_PERF_COUNTERS; i++)
+    p->counters[i] = counters[i] - p->counters[i];
+  p->open = FALSE;
+
+  depth--;
+}
+
+void add_to_perf_counter(Perf_Counter counter, long amount)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&counters_lock);
+#endif
+  counters[counter] += amount;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&counters_lock);
+#endif
+}
+
+/* write s as a JSON string */
+
+static void write_json_string(FILE *file, char *s)
+{
+  (void)fputc('"', file);
+  for(; s != NULL && *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\')
+      (void)fprintf(file, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      (void)fprintf(file, "\\u%04x", (unsigned char)*s);
+    else
+      (void)fputc(*s, file);
+  }
+  (void)fputc('"', file);
+}
+
+static void write_counters(FILE *file, long values[])
+{
+  int i;
+
+  (void)fprintf(file, "{");
+  for(i=0; i<N_PERF_COUNTERS; i++)
+    (void)fprintf(file, "%s\"%s\": %ld", (i==0) ? "" : ", ",
+                  counter_names[i], values[i]);
+  (void)fprintf(file, "}");
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : write_perf_report
+@INPUT      : filename
+              source, target - names of the volumes, for the record
+              n_threads      - value of -threads
+@OUTPUT     :
+@RETURNS    : VIO_OK, or VIO_ERROR if the file could not be written
+@DESCRIPTION: save the run totals and the phases, in the order they
+              began, as a JSON object.  Phases still open are left out.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_Status write_perf_report(char *filename,
+                             char *source, char *target, int n_threads)
+{
+  FILE       *file;
+  Perf_Phase *p;
+  VIO_Status  status;
+  VIO_BOOL    first;
+  int         i;
+
+  if (!started)
+    start_perf_report();
+
+  status = open_file(filename, WRITE_FILE, ASCII_FORMAT, &file);
+  if (status != VIO_OK)
+    return(status);
+
+  (void)fprintf(file, "{\n  \"source\": ");
+  write_json_string(file, source);
+  (void)fprintf(file, ",\n  \"target\": ");
+  write_json_string(file, target);
+  (void)fprintf(file, ",\n  \"threads\": %d,\n", n_threads);
+  (void)fprintf(file, "  \"wall_seconds\": %.6f,\n", get_wall_seconds() - run_start_wall);
+  (void)fprintf(file, "  \"cpu_seconds\": %.6f,\n",  get_cpu_seconds()  - run_start_cpu);
+  (void)fprintf(file, "  \"peak_rss_kb\": %ld,\n",   get_peak_rss());
+  (void)fprintf(file, "  \"counters\": ");
+  write_counters(file, counters);
+  (void)fprintf(file, ",\n  \"phases\": [");
+
+  first = TRUE;
+  for(i=0; i<n_phases; i++) {
+    p = &phases[i];
+    if (p->open)
+      continue;
+
+    (void)fprintf(file, "%s\n    {\"name\": ", first ? "" : ",");
+    write_json_string(file, p->name);
+    (void)fprintf(file, ", \"index\": %d, \"depth\": %d, \"start_seconds\": %.6f, "
+                  "\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"peak_rss_kb\": %ld,\n"
+                  "     \"counters\": ",
+                  p->index, p->depth, p->start_wall - run_start_wall,
+                  p->wall, p->cpu, p->peak_rss);
+    write_counters(file, p->counters);
+    (void)fprintf(file, "}");
+    first = FALSE;
+  }
+
+  (void)fprintf(file, "\n  ]\n}\n");
+
+  return( close_file(file) );
+}
@@ -0,0 +1,418 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : powell.c
+@DESCRIPTION: Powell's direction set method, a derivative free minimizer
+              for the linear fit (-use_powell), used in the same way as
+              the amoeba simplex of amoeba.c.
+
+              The function is minimized along each of a set of directions
+              in turn (at first the parameter axes, parameter_delta
+              long), with a bracketing step followed by Brent's line
+              search, and the direction of largest decrease is replaced
+              by the overall move of the sweep when that is worthwhile.
+              Each line search only needs a handful of evaluations, so
+              that a 9 or 12 parameter fit takes far fewer of them than
+              the simplex.
+
+              Nothing here knows about the limits of the parameters:
+              the function returns a large value outside of them (see
+              fit_function() in optimize.c), and the line searches stay
+              away from such points like from any other high value.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif //HAVE_CONFIG_H
+
+#include <volume_io.h>
+#include <powell.h>
+
+#define  GOLD             1.618034  /* growth of the bracketing steps      */
+#define  GROWTH_LIMIT     100.0     /* of a parabolic bracketing step      */
+#define  CGOLD            0.3819660 /* golden section of Brent's method    */
+#define  TINY             1.0e-20
+#define  LINE_TOLERANCE   1.0e-3    /* of a line search, relative...       */
+#define  LINE_ABS_TOLERANCE 1.0e-3  /* ...and in units of the direction    */
+#define  MAX_LINE_STEPS   100
+
+                                /* the function along origin+x*direction */
+typedef struct
+{
+    int               n_parameters;
+    powell_function   function;
+    void              *function_data;
+    VIO_Real          *origin;
+    VIO_Real          *direction;
+    float             *trial;
+    int               n_evaluations;
+    int               max_evaluations;
+} Powell_Line;
+
+static  VIO_Real  value_along_line(
+    Powell_Line  *line,
+    VIO_Real     x )
+{
+    int  i;
+
+    for( i = 0;  i < line->n_parameters;  ++i )
+        line->trial[i] = (float) (line->origin[i] + x * line->direction[i]);
+
+    line->n_evaluations++;
+
+    return( (*line->function) ( line->function_data, line->trial ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : bracket_minimum
+@INPUT      : line
+              ax, bx      - two points on the line
+              fa          - the value at ax
+@OUTPUT     : ax, bx, cx  - with bx between ax and cx
+              fb, fc      - the values at bx and cx (fa too)
+@RETURNS    :
+@DESCRIPTION: Walks downhill from ax and bx, by growing golden steps and
+              parabolic extrapolation, until the value goes up again: bx
+              is then below both ax and cx.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static  void  bracket_minimum(
+    Powell_Line  *line,
+    VIO_Real     *ax,
+    VIO_Real     *bx,
+    VIO_Real     *cx,
+    VIO_Real     *fa,
+    VIO_Real     *fb,
+    VIO_Real     *fc )
+{
+    VIO_Real  u, fu, r, q, denom, limit, t;
+
+    *fb = value_along_line( line, *bx );
+
+    if( *fb > *fa )             /* go downhill from a to b */
+    {
+        t = *ax;  *ax = *bx;  *bx = t;
+        t = *fa;  *fa = *fb;  *fb = t;
+    }
+
+    *cx = *bx + GOLD * (*bx - *ax);
+    *fc = value_along_line( line, *cx );
+
+    while( *fb > *fc && line->n_evaluations < line->max_evaluations )
+    {
+                                /* the minimum of the parabola by a,b,c */
+        r = (*bx - *ax) * (*fb - *fc);
+        q = (*bx - *cx) * (*fb - *fa);
+        denom = q - r;
+        if( fabs( denom ) < TINY )
+            denom = (denom < 0.0) ? -TINY : TINY;
+        u = *bx - ((*bx - *cx) * q - (*bx - *ax) * r) / (2.0 * denom);
+        limit = *bx + GROWTH_LIMIT * (*cx - *bx);
+
+        if( (*bx - u) * (u - *cx) > 0.0 )          /* between b and c */
+        {
+            fu = value_along_line( line, u );
+            if( fu < *fc )
+            {
+                *ax = *bx;  *fa = *fb;
+                *bx = u;    *fb = fu;
+                return;
+            }
+            else if( fu > *fb )
+            {
+                *cx = u;    *fc = fu;
+                return;
+            }
+            u = *cx + GOLD * (*cx - *bx);
+            fu = value_along_line( line, u );
+        }
+        else if( (*cx - u) * (u - limit) > 0.0 )   /* beyond c */
+        {
+            fu = value_along_line( line, u );
+            if( fu < *fc )
+            {
+                *bx = *cx;  *fb = *fc;
+                *cx = u;    *fc = fu;
+                u = *cx + GOLD * (*cx - *bx);
+                fu = value_along_line( line, u );
+            }
+        }
+        else if( (u - limit) * (limit - *cx) >= 0.0 )
+        {
+            u = limit;
+            fu = value_along_line( line, u );
+        }
+        else
+        {
+            u = *cx + GOLD * (*cx - *bx);
+            fu = value_along_line( line, u );
+        }
+
+        *ax = *bx;  *fa = *fb;
+        *bx = *cx;  *fb = *fc;
+        *cx = u;    *fc = fu;
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : brent_minimum
+@INPUT      : line
+              ax, bx, cx  - a bracket of the minimum (see bracket_minimum)
+              fb          - the value at bx
+@OUTPUT     : xmin        - where the minimum was found
+@RETURNS    : the value at xmin
+@DESCRIPTION: Brent's line search: parabolic interpolation when it behaves,
+              golden section otherwise.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static  VIO_Real  brent_minimum(
+    Powell_Line  *line,
+    VIO_Real     ax,
+    VIO_Real     bx,
+    VIO_Real     cx,
+    VIO_Real     fb,
+    VIO_Real     *xmin )
+{
+    int       step;
+    VIO_Real  a, b, d, e, p, q, r, u, v, w, x, xm;
+    VIO_Real  fu, fv, fw, fx, tol1, tol2, old_e;
+
+    a = (ax < cx) ? ax : cx;
+    b = (ax > cx) ? ax : cx;
+    x = w = v = bx;
+    fx = fw = fv = fb;
+    d = e = 0.0;
+
+    for( step = 0;  step < MAX_LINE_STEPS &&
+                    line->n_evaluations < line->max_evaluations;  ++step )
+    {
+        xm = 0.5 * (a + b);
+        tol1 = LINE_TOLERANCE * fabs( x ) + LINE_ABS_TOLERANCE;
+        tol2 = 2.0 * tol1;
+
+        if( fabs( x - xm ) <= tol2 - 0.5 * (b - a) )
+            break;
+
+        if( fabs( e ) > tol1 )  /* try a parabolic step */
+        {
+            r = (x - w) * (fx - fv);
+            q = (x - v) * (fx - fw);
+            p = (x - v) * q - (x - w) * r;
+            q = 2.0 * (q - r);
+            if( q > 0.0 )
+                p = -p;
+            q = fabs( q );
+            old_e = e;
+            e = d;
+
+            if( fabs( p ) >= fabs( 0.5 * q * old_e ) ||
+                p <= q * (a - x) || p >= q * (b - x) )
+            {
+                e = (x >= xm) ? a - x : b - x;
+                d = CGOLD * e;
+            }
+            else
+            {
+                d = p / q;
+                u = x + d;
+                if( u - a < tol2 || b - u < tol2 )
+                    d = (xm - x >= 0.0) ? tol1 : -tol1;
+            }
+        }
+        else
+        {
+            e = (x >= xm) ? a - x : b - x;
+            d = CGOLD * e;
+        }
+
+        if( fabs( d ) >= tol1 )
+            u = x + d;
+        else
+            u = x + ((d >= 0.0) ? tol1 : -tol1);
+
+        fu = value_along_line( line, u );
+
+        if( fu <= fx )
+        {
+            if( u >= x )  a = x;  else  b = x;
+            v = w;  fv = fw;
+            w = x;  fw = fx;
+            x = u;  fx = fu;
+        }
+        else
+        {
+            if( u < x )  a = u;  else  b = u;
+            if( fu <= fw || w == x )
+            {
+                v = w;  fv = fw;
+                w = u;  fw = fu;
+            }
+            else if( fu <= fv || v == x || v == w )
+            {
+                v = u;  fv = fu;
+            }
+        }
+    }
+
+    *xmin = x;
+
+    return( fx );
+}
+
+/* minimize along direction from line->origin, where the value is
+   value; the origin moves to the minimum and the direction is scaled
+   by the step taken.  Returns the value at the minimum. */
+
+static  VIO_Real  minimize_along_direction(
+    Powell_Line  *line,
+    VIO_Real     direction[],
+    VIO_Real     value )
+{
+    int       i;
+    VIO_Real  ax, bx, cx, fa, fb, fc, xmin, fmin;
+
+    line->direction = direction;
+
+    ax = 0.0;
+    bx = 1.0;
+    fa = value;
+    bracket_minimum( line, &ax, &bx, &cx, &fa, &fb, &fc );
+
+    fmin = brent_minimum( line, ax, bx, cx, fb, &xmin );
+
+    if( fmin > value )          /* never move uphill */
+        return( value );
+
+    for( i = 0;  i < line->n_parameters;  ++i )
+    {
+        direction[i] *= xmin;
+        line->origin[i] += direction[i];
+    }
+
+    return( fmin );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : minimize_powell
+@INPUT      : n_parameters
+              parameters       - the starting point
+              parameter_delta  - length of the first directions
+              function
+              function_data
+              tolerance        - stop when a sweep over all directions
+                                 improves the value by less than this
+                                 fraction
+              max_evaluations
+@OUTPUT     : parameters       - the minimum found
+              value            - the value of the function there
+@RETURNS    : the number of function evaluations
+@DESCRIPTION: Powell's method, with the heuristic of Numerical Recipes for
+              discarding the direction of largest decrease.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int  minimize_powell(
+    int              n_parameters,
+    VIO_Real         parameters[],
+    VIO_Real         parameter_delta,
+    powell_function  function,
+    void             *function_data,
+    VIO_Real         tolerance,
+    int              max_evaluations,
+    VIO_Real         *value )
+{
+    Powell_Line  line;
+    VIO_Real     **directions, *sweep_start, *sweep_move;
+    VIO_Real     fp, fret, fptt, largest_decrease, t;
+    int          i, j, largest;
+
+    line.n_parameters    = n_parameters;
+    line.function        = function;
+    line.function_data   = function_data;
+    line.origin          = parameters;
+    line.n_evaluations   = 0;
+    line.max_evaluations = max_evaluations;
+
+    ALLOC( line.trial, n_parameters );
+    ALLOC( sweep_start, n_parameters );
+    ALLOC( sweep_move, n_parameters );
+    VIO_ALLOC2D( directions, n_parameters, n_parameters );
+
+    for( i = 0;  i < n_parameters;  ++i )
+    {
+        for( j = 0;  j < n_parameters;  ++j )
+            directions[i][j] = 0.0;
+        directions[i][i] = parameter_delta;
+        sweep_start[i] = parameters[i];
+    }
+
+    line.direction = directions[0];
+    fret = value_along_line( &line, 0.0 );
+
+    while( line.n_evaluations < max_evaluations )
+    {
+        fp = fret;
+        largest = 0;
+        largest_decrease = 0.0;
+
+        for( i = 0;  i < n_parameters;  ++i )
+        {
+            fptt = fret;
+            fret = minimize_along_direction( &line, directions[i], fret );
+            if( fptt - fret > largest_decrease )
+            {
+                largest_decrease = fptt - fret;
+                largest = i;
+            }
+        }
+
+        if( 2.0 * (fp - fret) <= tolerance * (fabs( fp ) + fabs( fret )) + TINY )
+            break;
+                                /* the move of this sweep, and the value
+                                   as far again along it */
+        for( j = 0;  j < n_parameters;  ++j )
+        {
+            sweep_move[j] = parameters[j] - sweep_start[j];
+            sweep_start[j] = parameters[j];
+        }
+        line.direction = sweep_move;
+        fptt = value_along_line( &line, 1.0 );
+
+        if( fptt < fp )
+        {
+            t = 2.0 * (fp - 2.0 * fret + fptt) *
+                (fp - fret - largest_decrease) * (fp - fret - largest_decrease) -
+                largest_decrease * (fp - fptt) * (fp - fptt);
+
+            if( t < 0.0 )       /* replace the direction of largest decrease */
+            {
+                fret = minimize_along_direction( &line, sweep_move, fret );
+                for( j = 0;  j < n_parameters;  ++j )
+                {
+                    directions[largest][j] = directions[n_parameters-1][j];
+                    directions[n_parameters-1][j] = sweep_move[j];
+                }
+            }
+        }
+    }
+
+    *value = fret;
+
+    FREE( line.trial );
+    FREE( sweep_start );
+    FREE( sweep_move );
+    VIO_FREE2D( directions );
+
+    return( line.n_evaluations );
+}
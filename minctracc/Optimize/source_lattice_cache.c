@@ -0,0 +1,228 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : source_lattice_cache.c
+@DESCRIPTION: keep the source side of the sub-lattice of each node of the
+              deformation field from one iteration to the next.
+
+              The source sub-lattice of a node (its coordinates SX,SY,SZ,
+              the feature values and mask flags interpolated there, and
+              the normalization constants derived from them) depends only
+              on the position of the node and on the source volumes, none
+              of which change during do_non_linear_optimization().  Only
+              the target sub-lattice moves with the current warp.  So the
+              first time a node is estimated, its source side is stored in
+              a slot of the cache, and later iterations copy it back
+              instead of interpolating the source volumes again.
+
+              All slots have the same size, since every source sub-lattice
+              has the same number of samples.  The number of slots is
+              limited by the memory cap given to
+              init_source_lattice_cache(); once they are all taken, the
+              remaining nodes are simply rebuilt at each iteration, as
+              they would be without the cache.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "constants.h"
+#include "minctracc_arg_data.h"
+#include "nonlin_context.h"
+
+/* only the features that use the sub-lattice are interpolated in the
+   source volume (see build_lattices() in do_nonlinear.c), and only
+   those are kept here */
+
+static VIO_BOOL is_sampled_in_source(char obj_func)
+{
+  return(obj_func != NONLIN_OPTICALFLOW && obj_func != NONLIN_CHAMFER);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : init_source_lattice_cache
+@INPUT      : n_nodes       - number of nodes in the deformation field
+              len           - number of samples in a source sub-lattice
+              n_features    - number of feature volumes
+              max_megabytes - memory cap for the cache, <= 0 to disable it
+@OUTPUT     : cache
+@RETURNS    :
+@DESCRIPTION: room for min(n_nodes, cap/slot size) slots is reserved;
+              slots are handed out to the nodes as they are first built.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void init_source_lattice_cache(Source_Lattice_Cache *cache,
+                               int n_nodes,
+                               int len,
+                               int n_features,
+                               VIO_Real max_megabytes)
+{
+  VIO_Real slot_bytes, max_slots;
+  int      i;
+
+  cache->n_nodes     = n_nodes;
+  cache->len         = len;
+  cache->n_features  = n_features;
+  cache->slots_used  = 0;
+  cache->n_slots     = 0;
+  cache->slot        = NULL;
+  cache->values      = NULL;
+  cache->masked      = NULL;
+
+                                /* SX,SY,SZ, one row of samples per
+                                   feature, and one norm per feature */
+  cache->slot_floats = (3 + n_features) * len + n_features;
+
+  slot_bytes = cache->slot_floats * sizeof(float) +
+               n_features * len * sizeof(unsigned char);
+
+  max_slots = (max_megabytes * 1024.0 * 1024.0) / slot_bytes;
+  if (max_slots > n_nodes) max_slots = n_nodes;
+
+  if (len <= 0 || max_slots < 1.0)
+    return;
+
+  cache->n_slots = (int)max_slots;
+
+  ALLOC(cache->slot, n_nodes);
+  for(i=0; i<n_nodes; i++)
+    cache->slot[i] = -1;
+
+  ALLOC(cache->values, (size_t)cache->n_slots * cache->slot_floats);
+  ALLOC(cache->masked, (size_t)cache->n_slots * n_features * len);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&cache->lock, NULL);
+#endif
+}
+
+void delete_source_lattice_cache(Source_Lattice_Cache *cache)
+{
+  if (cache->n_slots == 0)
+    return;
+
+  FREE(cache->slot);
+  FREE(cache->values);
+  FREE(cache->masked);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&cache->lock);
+#endif
+
+  cache->n_slots = 0;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_cached_source_lattice
+@INPUT      : context - context->source_cache and context->node select the
+                        node to look up
+@OUTPUT     : context->len, SX,SY,SZ, a1_features, masked_samples_in_source
+              and sqrt_features, when the node is in the cache
+@RETURNS    : TRUE if the node was found in the cache
+@DESCRIPTION: the slot of a node is only ever written by the thread
+              estimating that node, so no locking is needed here.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_cached_source_lattice(Nonlin_Context *context)
+{
+  Source_Lattice_Cache *cache;
+  float                *values;
+  unsigned char        *masked;
+  char                 *obj_func;
+  int                   i, f, len;
+
+  cache = context->source_cache;
+
+  if (cache == NULL || cache->n_slots == 0 ||
+      context->node < 0 || context->node >= cache->n_nodes ||
+      cache->slot[context->node] < 0)
+    return(FALSE);
+
+  len      = cache->len;
+  values   = &cache->values[(size_t)cache->slot[context->node] * cache->slot_floats];
+  masked   = &cache->masked[(size_t)cache->slot[context->node] * cache->n_features * len];
+  obj_func = context->globals->features.obj_func;
+
+  context->len = len;
+  for(i=1; i<=len; i++) {
+    context->SX[i] = values[          i-1];
+    context->SY[i] = values[  len   + i-1];
+    context->SZ[i] = values[2*len   + i-1];
+  }
+  values += 3*len;
+
+  for(f=0; f<cache->n_features; f++) {
+    if (is_sampled_in_source(obj_func[f]))
+      for(i=1; i<=len; i++) {
+        context->a1_features[f][i]              = values[f*len + i-1];
+        context->masked_samples_in_source[f][i] = masked[f*len + i-1];
+      }
+    context->sqrt_features[f] = values[cache->n_features*len + f];
+  }
+
+  return(TRUE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : cache_source_lattice
+@INPUT      : context - a context in which build_lattices() has just built
+                        the source side of the sub-lattice of context->node
+@OUTPUT     : context->source_cache
+@RETURNS    :
+@DESCRIPTION: store the source side of the sub-lattice in a free slot, if
+              there is one left.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void cache_source_lattice(Nonlin_Context *context)
+{
+  Source_Lattice_Cache *cache;
+  float                *values;
+  unsigned char        *masked;
+  char                 *obj_func;
+  int                   i, f, len, slot;
+
+  cache = context->source_cache;
+
+  if (cache == NULL || cache->n_slots == 0 ||
+      context->node < 0 || context->node >= cache->n_nodes ||
+      context->len != cache->len)
+    return;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&cache->lock);
+#endif
+  slot = (cache->slots_used < cache->n_slots) ? cache->slots_used++ : -1;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&cache->lock);
+#endif
+
+  if (slot < 0)
+    return;                     /* no room left: rebuild this node
+                                   at each iteration */
+
+  len      = cache->len;
+  values   = &cache->values[(size_t)slot * cache->slot_floats];
+  masked   = &cache->masked[(size_t)slot * cache->n_features * len];
+  obj_func = context->globals->features.obj_func;
+
+  for(i=1; i<=len; i++) {
+    values[          i-1] = context->SX[i];
+    values[  len   + i-1] = context->SY[i];
+    values[2*len   + i-1] = context->SZ[i];
+  }
+  values += 3*len;
+
+  for(f=0; f<cache->n_features; f++) {
+    if (is_sampled_in_source(obj_func[f]))
+      for(i=1; i<=len; i++) {
+        values[f*len + i-1] = context->a1_features[f][i];
+        masked[f*len + i-1] = (unsigned char)(context->masked_samples_in_source[f][i] != FALSE);
+      }
+    values[cache->n_features*len + f] = context->sqrt_features[f];
+  }
+
+  cache->slot[context->node] = slot;
+}
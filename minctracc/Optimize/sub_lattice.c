@@ -10,6 +10,7 @@
                                     in the source volume
      go_get_samples_with_offset() - to interpolate values for sublattice positions, 
                                     given a vector offset for the lattice.
+     go_get_samples_with_offsets() - the same, for a set of offsets at once.
      build_target_lattice() -       map the source sublattice thrugh the current xform
                                     to create a sublattice defined on the target.
      
@@ -83,19 +84,23 @@
 #include "constants.h"
 #include "minctracc_arg_data.h"                /* definition of the global data struct      */
 #include "sub_lattice.h"
+#include "sampling_kernels.h"
 #include "init_lattice.h"
+#include "deformation_field.h"
 
 
 extern Arg_Data *Gglobals;      /* defined in do_nonlinear.c */
 extern VIO_Volume   Gsuper_sampled_vol; /* defined in do_nonlinear.c */
 extern VIO_General_transform 
                 *Glinear_transform;/* defined in do_nonlinear.c */
+extern Deformation_Field
+                Gsuper_sampled_field; /* defined in do_nonlinear.c */
+extern VIO_BOOL Glinear_is_affine;    /* defined in do_nonlinear.c */
+extern Affine_Map
+                Glinear_map;          /* defined in do_nonlinear.c */
 
                                 /* prototypes for functions used here: */
 
-extern float
-  *SX, *SY, *SZ;
-
  void  general_transform_point_in_trans_plane(
     VIO_General_transform   *transform,
     VIO_Real                x,
@@ -269,240 +274,20 @@ void go_get_samples_in_source(VIO_Volume data, VIO_Volume mask,
   
 }
 
-/*********************************************************************** 
-   use the list of voxel coordinates stored in x[], y[], z[] and the
-   voxel offset stored in dx, dy, dz to interpolate len samples from
-   the volume 'data' 
-
-   return the value of the (pseudo) normalized objective function
-   (indicated by obf_func) between the list of values in *a1 and the values
-   interpolated from data.  The value returned _should_ (but is not
-   garenteed) to be between -1.0 and 1.0 with 1.0 indicating a PERFECT FIT
-   (ie, greater values indicate better fits)
-
-   note: the volume is assumed to be in MIzspace, MIyspace, MIxspace
-   order. (since the data is loaded in with default_dim_names as an
-   option to input_volume).
-
-   actually, the order does not matter, except that dx corresponds to
-   the displacement along the 1st dimension x[], dy corresponds to
-   second dimension y[] and dz to z[], the last.  When doing 2D
-   processing, the first dimension (x[]) is assumed to be the slowest
-   varying, and the deformation in dx=0.
-
-   CAVEAT 1: only nearest neighbour and tri-linear interpolation
-             are supported.
+/* finish the computation of the local similarity from the sums
+   accumulated over the sub-lattice (see switch_obj_func.c), normalizing
+   each obj_func where-ever possible */
 
-	     *** AJ + LC: 3/17/2009:  only DOUBLE data now supported.
-   CAVEAT 2: only VIO_Volume data types of UNSIGNED_BYTE, SIGNED_SHORT, and
-             UNSIGNED_SHORT are supported.
-
-*/
-
-float go_get_samples_with_offset(
-				 VIO_Volume data,                  /* The volume of data */
-				 VIO_Volume mask,                  /* The target mask */  
-				 float *x, float *y, float *z,     /* the positions of the sub-lattice */
-				 VIO_Real  dx, VIO_Real  dy, VIO_Real dz,  /* the local displacement to apply  */
-				 int obj_func,                     /* the type of obj function req'd   */
-				 int len,                          /* number of sub-lattice nodes      */
-				 int *sample_target_count,         /* number of nonmasked  sub-lattice nodes */
-				 float normalization,              /* normalization factor for obj func*/
-				 float *a1,                        /* feature value for (x,y,z) nodes  */
-				 VIO_BOOL *m1,                     /* mask flag for (x,y,z) nodes in source */ 
-				 VIO_BOOL use_nearest_neighbour)   /* interpolation flag              */
+static double similarity_from_sums(int obj_func,
+                                   float normalization,
+                                   double s1, double s2, double s3,
+                                   double s4, double s5,
+                                   int number_of_nonzero_samples)
 {
   double
-    sample, r,
-    s1,s2,s3,s4,s5,tmp;                   /* accumulators for inner loop */
-  int 
-    sizes[3],
-    ind0, ind1, ind2, 
-    offset0, offset1, offset2,
-    c,number_of_nonzero_samples;  
-  int xs,ys,zs;
-  float
-    f_trans, f_scale;
-
-  static double v0, v1, v2;
-  static double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
-  static double v000, v001, v010, v011, v100, v101, v110, v111;
+    r,
+    mean_s, mean_t, var_s, var_t, covariance;
 
-  double ***double_ptr;
-  
-  double mean_s = 0.0;		/* init variables for stats */
-  double mean_t = 0.0;
-  double var_s = 0.0;
-  double var_t = 0.0;
-  double covariance = 0.0;
-  
-  number_of_nonzero_samples = 0;
-
-  get_volume_sizes(data, sizes);  
-  xs = sizes[0];  
-  ys = sizes[1];  
-  zs = sizes[2];
-
-
-  s1 = s2 = s3 = s4 = s5 = 0.0;
-  ++a1;   ++m1;                   /* inc pointer, so that we are pointing to
-                                   the first feature value, corresponding
-                                   to the first sub-lattice point x,y,z   */
-
-
-
-  if (use_nearest_neighbour) {
-                                /* then do fast NN interpolation */
-
-    dx += 0.;                        /* to achieve `rounding' for ind0, ind1 and */
-    dy += 0.;                        /* ind2 below */
-    dz += 0.;
-    
-    double_ptr = VOXEL_DATA (data); 
-      
-    /* increment by one as we index from 1...n (but the array is ALLOC'd from 0..n) */
-    x++; y++; z++; 
-      
-    /* for each sub-lattice node */
-    for(c=len; c--;) {
-        
-        /*
-         *  this is code to test timing of David's evaluate_volume_in_world()
-         *  interpolation code.  While it is _VERY_ general, the eval_vol_in_world()'s
-         *  NN interpolation is approximately 8-9 times slower than the bit of 
-         *  fast NN code below.
-         *  
-         *  VIO_Real sampleR, index[5], wx, wy, wz;
-         *  index[0] = (VIO_Real) ( *x + dx );
-         *  index[1] = (VIO_Real) ( *y + dy );
-         *  index[2] = (VIO_Real) ( *z + dz );
-         *  index[3] = index[4] = 0.0;
-         *  convert_voxel_to_world(data, index, &wx, &wy, &wz );
-         *  evaluate_volume_in_world(data, wx, wy, wz,
-         *                            0, TRUE, 0.0, &sampleR,
-         *                            NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
-         *   sample = (double)sampleR;
-         */
-        
-        if (!(*m1) && (voxel_point_not_masked(mask, (VIO_Real)*x, (VIO_Real)*y, (VIO_Real)*z)) && (!(obj_func==NONLIN_CHAMFER) ||  (*a1>0)) ) {
-
-         ind0 = (int) ( *x + dx );
-         ind1 = (int) ( *y + dy );
-         ind2 = (int) ( *z + dz );
-         
-         if (ind0>=0 && ind0<xs &&
-             ind1>=0 && ind1<ys &&
-             ind2>=0 && ind2<zs) {
-	   sample = (double)(double_ptr[ind0][ind1][ind2]);
-         }
-         else{
-            sample = 0.0;
-         }
-
-#include "switch_obj_func.c"	/* contains a case statement to do the sample-to-sample computations required for each possible non-lin objective function */
-      }
-        
-       /* increment the coordinate, value and mask array pointers */  
-       x++;			/* x,y,z are the coords of the sublattice in the fixed (source) image */
-       y++;
-       z++;
-       a1++;			/* a1 is from the fixed image */
-       m1++;			/* m1 is rom the mask on the fixed image */
-     
-    }
-  }
-  else {                        /* then do fast trilinear interpolation */
-    
-    /* set up offsets */
-    offset0 = (Gglobals->count[VIO_Z] > 1) ? 1 : 0;
-    offset1 = (Gglobals->count[VIO_Y] > 1) ? 1 : 0;
-    offset2 = (Gglobals->count[VIO_X] > 1) ? 1 : 0;
-    
-    double_ptr = VOXEL_DATA (data);
-        
-    /* increment by one as we index from 1...n */
-    ++x; ++y; ++z; 
-        
-    /* for each sub-lattice node */
-    for(c=len; c--;) {
-           
-           /*  fast tri-linear interplation */
-           
-      if  (  !(*m1) && (voxel_point_not_masked(mask, (VIO_Real)*x, (VIO_Real)*y, (VIO_Real)*z)) && (!(obj_func==NONLIN_CHAMFER) ||  (*a1>0)) ) {
-              v0 = (VIO_Real) ( *x + dx );
-              v1 = (VIO_Real) ( *y + dy );
-              v2 = (VIO_Real) ( *z + dz );
-              
-              ind0 = (int)v0;
-              ind1 = (int)v1;
-              ind2 = (int)v2;
-              
-              if (ind0>=0 && ind0<(xs-offset0) &&
-                  ind1>=0 && ind1<(ys-offset1) &&
-                  ind2>=0 && ind2<(zs-offset2)) {
-                 
-                 /* get the data */
-                 v000 = (VIO_Real)(double_ptr[ind0        ][ind1        ][ind2        ]);
-                 v001 = (VIO_Real)(double_ptr[ind0        ][ind1        ][ind2+offset2]);
-                 v010 = (VIO_Real)(double_ptr[ind0        ][ind1+offset1][ind2        ]);
-                 v011 = (VIO_Real)(double_ptr[ind0        ][ind1+offset1][ind2+offset2]);
-                 v100 = (VIO_Real)(double_ptr[ind0+offset0][ind1        ][ind2        ]);
-                 v101 = (VIO_Real)(double_ptr[ind0+offset0][ind1        ][ind2+offset2]);
-                 v110 = (VIO_Real)(double_ptr[ind0+offset0][ind1+offset1][ind2        ]);
-                 v111 = (VIO_Real)(double_ptr[ind0+offset0][ind1+offset1][ind2+offset2]);
-                 
-                 /* Get the fraction parts */
-                 f0 = v0 - ind0;
-                 f1 = v1 - ind1;
-                 f2 = v2 - ind2;
-                 r0 = 1.0 - f0;
-                 r1 = 1.0 - f1;
-                 r2 = 1.0 - f2;
-                 
-                 /* Do the interpolation */
-                 r1r2 = r1 * r2;
-                 r1f2 = r1 * f2;
-                 f1r2 = f1 * r2;
-                 f1f2 = f1 * f2;
-                 
-                 sample   = 
-                    r0 *  (r1r2 * v000 +
-                           r1f2 * v001 +
-                           f1r2 * v010 +
-                           f1f2 * v011);
-                 sample  +=
-                    f0 *  (r1r2 * v100 +
-                           r1f2 * v101 +
-                           f1r2 * v110 +
-                           f1f2 * v111);
-                 
-                 sample = sample;
-                 
-                 
-              }
-              else{
-		sample = 0.0;
-	      }
-              
-              
-#include "switch_obj_func.c"
-
-      }
-      
-      /* increment the coordinate, value and mask array pointers */  
-      x++;			/* x,y,z are the coords of the sublattice in the fixed (source) image */
-      y++;
-      z++;
-      a1++;			/* a1 is from the fixed image */
-      m1++;			/* m1 is rom the mask on the fixed image */
-      
-    } 
-  
-
-
-                                /* do the last bits of the similarity function
-                                   calculation here - normalizing each obj_func
-                                   where-ever possible: */
   r = 0.0;
 
   switch (obj_func) {
@@ -607,13 +392,267 @@ float go_get_samples_with_offset(
   
   
   return(r);
+}
+
+/*********************************************************************** 
+   use the list of voxel coordinates stored in x[], y[], z[] and the
+   voxel offset stored in dx, dy, dz to interpolate len samples from
+   the volume 'data' 
+
+   return the value of the (pseudo) normalized objective function
+   (indicated by obf_func) between the list of values in *a1 and the values
+   interpolated from data.  The value returned _should_ (but is not
+   garenteed) to be between -1.0 and 1.0 with 1.0 indicating a PERFECT FIT
+   (ie, greater values indicate better fits)
+
+   note: the volume is assumed to be in MIzspace, MIyspace, MIxspace
+   order. (since the data is loaded in with default_dim_names as an
+   option to input_volume).
+
+   actually, the order does not matter, except that dx corresponds to
+   the displacement along the 1st dimension x[], dy corresponds to
+   second dimension y[] and dz to z[], the last.  When doing 2D
+   processing, the first dimension (x[]) is assumed to be the slowest
+   varying, and the deformation in dx=0.
+
+   the nodes are handled in blocks of SAMPLING_BLOCK_SIZE: the ones
+   that are used are gathered in small contiguous arrays and
+   interpolated together by the kernels of Volume/sampling_kernels.c,
+   then accumulated in their original order.
+
+   CAVEAT 1: only nearest neighbour and tri-linear interpolation
+             are supported.
+
+   CAVEAT 2: only VIO_Volume data types of DOUBLE, FLOAT and
+             SIGNED_SHORT are supported (see get_voxel_array()).
+
+*/
+
+float go_get_samples_with_offset(
+				 VIO_Volume data,                  /* The volume of data */
+				 VIO_Volume mask,                  /* The target mask */  
+				 float *x, float *y, float *z,     /* the positions of the sub-lattice */
+				 VIO_Real  dx, VIO_Real  dy, VIO_Real dz,  /* the local displacement to apply  */
+				 int obj_func,                     /* the type of obj function req'd   */
+				 int len,                          /* number of sub-lattice nodes      */
+				 int *sample_target_count,         /* number of nonmasked  sub-lattice nodes */
+				 float normalization,              /* normalization factor for obj func*/
+				 float *a1,                        /* feature value for (x,y,z) nodes  */
+				 VIO_BOOL *m1,                     /* mask flag for (x,y,z) nodes in source */ 
+				 VIO_BOOL use_nearest_neighbour)   /* interpolation flag              */
+{
+  double
+    sample, r,
+    s1,s2,s3,s4,s5,tmp;                   /* accumulators for inner loop */
+  double
+    samples[SAMPLING_BLOCK_SIZE];
+  float
+    *features,
+    node_x[SAMPLING_BLOCK_SIZE],
+    node_y[SAMPLING_BLOCK_SIZE],
+    node_z[SAMPLING_BLOCK_SIZE],
+    node_a1[SAMPLING_BLOCK_SIZE];
+  int 
+    offsets[3],
+    c, i, n, number_of_nonzero_samples;  
+  Voxel_Array
+    voxels;
+  
+  number_of_nonzero_samples = 0;
+
+  if (!get_voxel_array(data, &voxels))
+    print_error_and_line_num("Unsupported volume data type in go_get_samples_with_offset",
+                             __FILE__, __LINE__);
+
+                                /* set up offsets for trilinear interpolation */
+  offsets[0] = (Gglobals->count[VIO_Z] > 1) ? 1 : 0;
+  offsets[1] = (Gglobals->count[VIO_Y] > 1) ? 1 : 0;
+  offsets[2] = (Gglobals->count[VIO_X] > 1) ? 1 : 0;
+
+  s1 = s2 = s3 = s4 = s5 = 0.0;
+  features = a1;                /* a1 walks over node_a1[] below, for
+                                   switch_obj_func.c */
+
+  c = 1;                        /* the sub-lattice is indexed 1..len */
+  while (c <= len) {
+
+                                /* gather the next block of nodes that are
+                                   used: not masked in source or target, and
+                                   with a feature value for chamfer */
+    n = 0;
+    for(; c<=len && n<SAMPLING_BLOCK_SIZE; c++) {
+      if (!m1[c] && voxel_point_not_masked(mask, (VIO_Real)x[c], (VIO_Real)y[c], (VIO_Real)z[c]) &&
+          (!(obj_func==NONLIN_CHAMFER) || (features[c]>0)) ) {
+        node_x[n]  = x[c];
+        node_y[n]  = y[c];
+        node_z[n]  = z[c];
+        node_a1[n] = features[c];
+        n++;
+      }
+    }
+
+                                /* interpolate them all at once */
+    if (use_nearest_neighbour)
+      nearest_samples_at_offset(&voxels, n, node_x, node_y, node_z,
+                                dx, dy, dz, samples);
+    else
+      trilinear_samples_at_offset(&voxels, offsets, n, node_x, node_y, node_z,
+                                  dx, dy, dz, samples);
+
+                                /* and accumulate, in node order */
+    for(i=0; i<n; i++) {
+      sample = samples[i];
+      a1     = &node_a1[i];
+
+#include "switch_obj_func.c"	/* contains a case statement to do the sample-to-sample computations required for each possible non-lin objective function */
+    }
   }
 
+                                /* do the last bits of the similarity function
+                                   calculation here - normalizing each obj_func
+                                   where-ever possible: */
+  r = similarity_from_sums(obj_func, normalization,
+                           s1, s2, s3, s4, s5, number_of_nonzero_samples);
+  
+  return(r);
 }
 
 
 
 
+/*********************************************************************** 
+   go_get_samples_with_offsets() computes the same local similarity as
+   go_get_samples_with_offset(), but for n_offsets displacements
+   (dx[k],dy[k],dz[k]) of the target sub-lattice at once, returning the
+   n_offsets values in r[].
+
+   This is what is needed by the quadratic fit (27 offsets in 3D, 9 in
+   2D): all displacements are evaluated in a single pass over the
+   sub-lattice, so that the coordinates, source feature values and mask
+   flags of each node (and the test on the target mask, which does not
+   depend on the offset) are only fetched once instead of n_offsets
+   times.  The sums are accumulated in the same node order as
+   go_get_samples_with_offset(), so the results are identical.
+*/
+
+void go_get_samples_with_offsets(
+				 VIO_Volume data,                  /* The volume of data */
+				 VIO_Volume mask,                  /* The target mask */  
+				 float *x, float *y, float *z,     /* the positions of the sub-lattice */
+				 int n_offsets,                    /* number of displacements, <= MAX_SUB_LATTICE_OFFSETS */
+				 VIO_Real dx[], VIO_Real dy[], VIO_Real dz[], /* the local displacements to apply */
+				 int obj_func,                     /* the type of obj function req'd   */
+				 int len,                          /* number of sub-lattice nodes      */
+				 float normalization,              /* normalization factor for obj func*/
+				 float *a1,                        /* feature value for (x,y,z) nodes  */
+				 VIO_BOOL *m1,                     /* mask flag for (x,y,z) nodes in source */ 
+				 VIO_BOOL use_nearest_neighbour,   /* interpolation flag              */
+				 float r[])                        /* the n_offsets similarity values */
+{
+  double
+    samples[MAX_SUB_LATTICE_OFFSETS][SAMPLING_BLOCK_SIZE],
+    sums[MAX_SUB_LATTICE_OFFSETS][5],  /* s1..s5 of each offset */
+    sample,
+    s1,s2,s3,s4,s5,tmp;                /* accumulators of switch_obj_func.c */
+  float
+    *features,
+    node_x[SAMPLING_BLOCK_SIZE],
+    node_y[SAMPLING_BLOCK_SIZE],
+    node_z[SAMPLING_BLOCK_SIZE],
+    node_a1[SAMPLING_BLOCK_SIZE];
+  int 
+    counts[MAX_SUB_LATTICE_OFFSETS],   /* number_of_nonzero_samples of each */
+    offsets[3],
+    c, i, k, n, number_of_nonzero_samples;  
+  Voxel_Array
+    voxels;
+
+  if (n_offsets > MAX_SUB_LATTICE_OFFSETS)
+    print_error_and_line_num("Too many offsets (%d) in go_get_samples_with_offsets",
+                             __FILE__, __LINE__, n_offsets);
+  
+  if (!get_voxel_array(data, &voxels))
+    print_error_and_line_num("Unsupported volume data type in go_get_samples_with_offsets",
+                             __FILE__, __LINE__);
+
+  for(k=0; k<n_offsets; k++) {
+    sums[k][0] = sums[k][1] = sums[k][2] = sums[k][3] = sums[k][4] = 0.0;
+    counts[k]  = 0;
+  }
+  features = a1;                /* a1 walks over node_a1[] below, for
+                                   switch_obj_func.c */
+
+                                /* trilinear interpolation offsets */
+  offsets[0] = (Gglobals->count[VIO_Z] > 1) ? 1 : 0;
+  offsets[1] = (Gglobals->count[VIO_Y] > 1) ? 1 : 0;
+  offsets[2] = (Gglobals->count[VIO_X] > 1) ? 1 : 0;
+
+  c = 1;                        /* the sub-lattice is indexed 1..len */
+  while (c <= len) {
+
+                                /* gather the next block of used nodes,
+                                   as in go_get_samples_with_offset() */
+    n = 0;
+    for(; c<=len && n<SAMPLING_BLOCK_SIZE; c++) {
+      if (!m1[c] && voxel_point_not_masked(mask, (VIO_Real)x[c], (VIO_Real)y[c], (VIO_Real)z[c]) &&
+          (!(obj_func==NONLIN_CHAMFER) || (features[c]>0)) ) {
+        node_x[n]  = x[c];
+        node_y[n]  = y[c];
+        node_z[n]  = z[c];
+        node_a1[n] = features[c];
+        n++;
+      }
+    }
+
+                                /* interpolate the target value of every
+                                   node at each offset */
+    for(k=0; k<n_offsets; k++) {
+      if (use_nearest_neighbour)
+        nearest_samples_at_offset(&voxels, n, node_x, node_y, node_z,
+                                  dx[k], dy[k], dz[k], samples[k]);
+      else
+        trilinear_samples_at_offset(&voxels, offsets, n, node_x, node_y, node_z,
+                                    dx[k], dy[k], dz[k], samples[k]);
+    }
+
+                                /* and accumulate, with the
+                                   switch_obj_func.c of
+                                   go_get_samples_with_offset().  Each
+                                   offset has its own sums, so taking
+                                   them one after the other keeps the
+                                   node order of each sum */
+    for(k=0; k<n_offsets; k++) {
+
+      s1 = sums[k][0];
+      s2 = sums[k][1];
+      s3 = sums[k][2];
+      s4 = sums[k][3];
+      s5 = sums[k][4];
+      number_of_nonzero_samples = counts[k];
+
+      for(i=0; i<n; i++) {
+        sample = samples[k][i];
+        a1     = &node_a1[i];
+
+#include "switch_obj_func.c"	/* contains a case statement to do the sample-to-sample computations required for each possible non-lin objective function */
+      }
+
+      sums[k][0] = s1;
+      sums[k][1] = s2;
+      sums[k][2] = s3;
+      sums[k][3] = s4;
+      sums[k][4] = s5;
+      counts[k]  = number_of_nonzero_samples;
+    }
+  }
+
+  for(k=0; k<n_offsets; k++)
+    r[k] = (float)similarity_from_sums(obj_func, normalization,
+                                       sums[k][0], sums[k][1], sums[k][2],
+                                       sums[k][3], sums[k][4], counts[k]);
+}
+
+
 /* Build the target lattice by transforming the source points through the
    current non-linear transformation stored in:
 
@@ -658,47 +697,30 @@ void    build_target_lattice_using_super_sampled_def(
                                      int len, int dim)
 {
   int 
-    i,j,
-    sizes[VIO_MAX_DIMENSIONS],
-    xyzv[VIO_MAX_DIMENSIONS];
+    i;
   VIO_Real 
     def_vector[VIO_N_DIMENSIONS],
-    voxel[VIO_MAX_DIMENSIONS],
     x,y,z;
-  long 
-    index[VIO_MAX_DIMENSIONS];
-
-  get_volume_sizes(Gsuper_sampled_vol,sizes);
-  get_volume_XYZV_indices(Gsuper_sampled_vol,xyzv);
 
   for(i=1; i<=len; i++) {
 
                                 /* apply linear part of the transformation */
 
-    general_transform_point(Glinear_transform,
-                            (VIO_Real)px[i], (VIO_Real)py[i], (VIO_Real)pz[i], 
-                            &x, &y, &z);
+    if (Glinear_is_affine)
+      apply_affine_map(Glinear_map,
+                       (VIO_Real)px[i], (VIO_Real)py[i], (VIO_Real)pz[i], 
+                       &x, &y, &z);
+    else
+      general_transform_point(Glinear_transform,
+                              (VIO_Real)px[i], (VIO_Real)py[i], (VIO_Real)pz[i], 
+                              &x, &y, &z);
 
                                 /* now get the non-linear part, using
                                    nearest neighbour interpolation in
-                                   the super-sampled deformation
-                                   volume. */
-
-    convert_world_to_voxel(Gsuper_sampled_vol, 
-                           x,y,z, voxel);
-
-    if ((voxel[ xyzv[VIO_X] ] >= -0.5) && (voxel[ xyzv[VIO_X] ] < sizes[xyzv[VIO_X]]-0.5) &&
-        (voxel[ xyzv[VIO_Y] ] >= -0.5) && (voxel[ xyzv[VIO_Y] ] < sizes[xyzv[VIO_Y]]-0.5) &&
-        (voxel[ xyzv[VIO_Z] ] >= -0.5) && (voxel[ xyzv[VIO_Z] ] < sizes[xyzv[VIO_Z]]-0.5) ) {
-
-      for(j=0; j<3; j++) index[ xyzv[j] ] = (long) (voxel[ xyzv[j] ]+0.5);
-      
-      for(index[xyzv[VIO_Z+1]]=0; index[xyzv[VIO_Z+1]]<sizes[xyzv[VIO_Z+1]]; index[xyzv[VIO_Z+1]]++) 
-        GET_VALUE_4D(def_vector[ index[ xyzv[VIO_Z+1] ]  ], \
-                     Gsuper_sampled_vol, \
-                     index[0], index[1], index[2], index[3]);
-
+                                   the float displacements of the
+                                   super-sampled deformation volume. */
 
+    if (nearest_deformation(&Gsuper_sampled_field, x,y,z, def_vector)) {
       x += def_vector[VIO_X];
       y += def_vector[VIO_Y];
       z += def_vector[VIO_Z];
@@ -176,10 +176,14 @@ void create_super_sampled_data_volumes(VIO_General_transform *orig_deformation,
   *super_sampled = *orig_deformation; 
 	super_sampled->displacement_volume_file=NULL;
 
-                                /* copy the GRID_TRANSFORM definition */
+                                /* copy the GRID_TRANSFORM definition,
+                                   with float voxels: the super-sampled
+                                   warp is only read through a
+                                   Deformation_Field, which then uses
+                                   them without a copy                 */
   super_sampled->displacement_volume = 
     copy_volume_definition_no_alloc(orig_deformation->displacement_volume,
-                                    NC_UNSPECIFIED, FALSE, 0.0, 0.0);
+                                    NC_FLOAT, FALSE, 0.0, 0.0);
 
                                 /* prepare to modify the GRID_TRANSFORM */
 
@@ -3,7 +3,8 @@
 @INPUT      : *a1, s1, s3 and sample
 @OUTPUT     : updated values for s1 and s3, updated pointed for *a1
 @DESCRIPTION: this is a case statement that is to be included within the 
-              procedure go_get_samples_with_offset(), inside the loop over
+              procedures go_get_samples_with_offset() and
+              go_get_samples_with_offsets(), inside the loop over
               all nodes of the sublattice, just after interpolation of the 
               value for 'sample'
 @COPYRIGHT  :
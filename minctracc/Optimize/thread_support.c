@@ -0,0 +1,163 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thread_support.c
+@DESCRIPTION: a minimal work-sharing loop used to spread independent
+              pieces of work (lattice nodes, slabs of a volume...) over
+              several POSIX threads.
+
+              Items are handed out in chunks from a shared counter, so
+              that a thread finishing cheap items (masked nodes, say)
+              simply goes back for more while another is still busy
+              with an expensive one.  The caller is responsible for
+              making the work function independent of the order in
+              which items are processed; results that must be combined
+              should be stored per item (or per thread) and reduced
+              afterwards in a fixed order.
+
+              When minctracc is built without pthreads, or when a
+              single thread is requested, the work function is simply
+              called once over the whole range in the calling thread.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "thread_support.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define MAX_THREADS 256
+
+/* return the number of threads that should really be started for
+   n_items pieces of work: never more threads than items, never less
+   than one.  A request <= 0 is taken to mean `serial' */
+
+int get_number_of_threads_to_use(int requested, int n_items)
+{
+  int n;
+
+#ifdef HAVE_PTHREAD
+  n = requested;
+#else
+  n = 1;
+#endif
+
+  if (n > MAX_THREADS) n = MAX_THREADS;
+  if (n > n_items)     n = n_items;
+  if (n < 1)           n = 1;
+
+  return(n);
+}
+
+#ifdef HAVE_PTHREAD
+
+typedef struct {
+  pthread_mutex_t   lock;
+  int               next_item;   /* first item not yet handed out */
+  int               n_items;
+  int               chunk_size;
+  Parallel_Function function;
+  void             *data;
+} Work_Queue;
+
+typedef struct {
+  Work_Queue *queue;
+  int         thread;
+} Worker_Args;
+
+static void *worker(void *arg)
+{
+  Worker_Args *args;
+  Work_Queue  *queue;
+  int          first, last;
+
+  args  = (Worker_Args *)arg;
+  queue = args->queue;
+
+  for(;;) {
+    pthread_mutex_lock(&queue->lock);
+    first = queue->next_item;
+    last  = first + queue->chunk_size;
+    if (last > queue->n_items) last = queue->n_items;
+    queue->next_item = last;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (first >= last) break;
+
+    (*queue->function)(queue->data, args->thread, first, last);
+  }
+
+  return(NULL);
+}
+
+#endif /* HAVE_PTHREAD */
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : run_in_parallel
+@INPUT      : n_threads  - number of threads to use (see
+                           get_number_of_threads_to_use())
+              n_items    - number of independent items of work
+              chunk_size - number of items handed out at once
+              function   - called as function(data, thread, first, last)
+              data       - passed through to function
+@OUTPUT     :
+@RETURNS    : when all items have been processed
+@DESCRIPTION: thread 0 is the calling thread, threads 1..n_threads-1 are
+              created here and joined before returning.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void run_in_parallel(int n_threads,
+                     int n_items,
+                     int chunk_size,
+                     Parallel_Function function,
+                     void *data)
+{
+#ifdef HAVE_PTHREAD
+  Work_Queue   queue;
+  Worker_Args  args[MAX_THREADS];
+  pthread_t    threads[MAX_THREADS];
+  int          i, n_started;
+#endif
+
+  if (n_items <= 0) return;
+
+  n_threads = get_number_of_threads_to_use(n_threads, n_items);
+
+  if (n_threads == 1) {
+    (*function)(data, 0, 0, n_items);
+    return;
+  }
+
+#ifdef HAVE_PTHREAD
+  if (chunk_size < 1) chunk_size = 1;
+
+  pthread_mutex_init(&queue.lock, NULL);
+  queue.next_item  = 0;
+  queue.n_items    = n_items;
+  queue.chunk_size = chunk_size;
+  queue.function   = function;
+  queue.data       = data;
+
+  n_started = 1;
+  for(i=0; i<n_threads; i++) {
+    args[i].queue  = &queue;
+    args[i].thread = i;
+  }
+  for(i=1; i<n_threads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, &args[i]) != 0)
+      break;                    /* carry on with the threads we have */
+    n_started++;
+  }
+
+  (void)worker(&args[0]);
+
+  for(i=1; i<n_started; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&queue.lock);
+#endif
+}
@@ -44,12 +44,9 @@ void delete_voxel_space_struct( Voxel_space_struct *vox_space) {
 
 }
 
-void build_reorder_matrix_vox2xyz(VIO_General_transform *trans, VIO_Volume volume) {
+static void reorder_vox2xyz(VIO_Transform *lin, VIO_Volume volume) {
    
    int axis;
-   VIO_Transform *lin;
-
-   lin = get_linear_transform_ptr(trans);
 
    axis = volume->spatial_axes[VIO_X];
    if( axis >= 0 ) {
@@ -72,12 +69,9 @@ void build_reorder_matrix_vox2xyz(VIO_General_transform *trans, VIO_Volume volum
    
 }
 
-void build_reorder_matrix_xyz2vox(VIO_General_transform *trans, VIO_Volume volume) {
+static void reorder_xyz2vox(VIO_Transform *lin, VIO_Volume volume) {
    
    int axis;
-   VIO_Transform *lin;
-
-   lin = get_linear_transform_ptr(trans);
 
    axis = volume->spatial_axes[VIO_X];
    if( axis >= 0 ) {
@@ -100,30 +94,29 @@ void build_reorder_matrix_xyz2vox(VIO_General_transform *trans, VIO_Volume volum
    
 }
 
-void get_into_voxel_space(Arg_Data *globals,
-                                 Voxel_space_struct *vox,
-                                 VIO_Volume v1, VIO_Volume v2) {
-   VIO_Transform 
-      *lin;
-   VIO_General_transform 
-      *reorder,
-      *w2v;
+void build_reorder_matrix_vox2xyz(VIO_General_transform *trans, VIO_Volume volume) {
+
+   reorder_vox2xyz(get_linear_transform_ptr(trans), volume);
+}
+
+void build_reorder_matrix_xyz2vox(VIO_General_transform *trans, VIO_Volume volume) {
+
+   reorder_xyz2vox(get_linear_transform_ptr(trans), volume);
+}
+
+/* the starting point and the directions of the lattice of globals, in
+   voxel coordinates of v1 */
+
+static void get_lattice_in_voxels(Arg_Data *globals, VIO_Volume v1,
+                                  VIO_Real start[], VectorR directions[]) {
    VIO_Real 
      sign,
-     tx,ty,tz;
-   PointR pnt,tmp_pt;
-   VIO_Real 
-      voxel_vector[VIO_MAX_DIMENSIONS],
-      s_voxel_xyz[VIO_MAX_DIMENSIONS],
-      s_voxel[VIO_MAX_DIMENSIONS],
-      s_world[VIO_N_DIMENSIONS],
-      t_voxel[VIO_MAX_DIMENSIONS],
-      t_world[VIO_N_DIMENSIONS];
+     voxel_vector[VIO_MAX_DIMENSIONS];
    int i;
                                 /* take care of the starting coordinate */
    convert_3D_world_to_voxel(v1,
                              globals->start[VIO_X], globals->start[VIO_Y], globals->start[VIO_Z],
-                             &vox->start[0],    &vox->start[1],    &vox->start[2]);
+                             &start[0],    &start[1],    &start[2]);
 
                                 /* take care of the directions required to step
                                    through the volume */
@@ -143,8 +136,30 @@ void get_into_voxel_space(Arg_Data *globals,
                                    RVector_z(globals->directions[i]) * sign,
                                    voxel_vector);
      
-     fill_Vector(vox->directions[i], voxel_vector[0],voxel_vector[1],voxel_vector[2]);
+     fill_Vector(directions[i], voxel_vector[0],voxel_vector[1],voxel_vector[2]);
    }
+}
+
+void get_into_voxel_space(Arg_Data *globals,
+                                 Voxel_space_struct *vox,
+                                 VIO_Volume v1, VIO_Volume v2) {
+   VIO_Transform 
+      *lin;
+   VIO_General_transform 
+      *reorder,
+      *w2v;
+   VIO_Real 
+     tx,ty,tz;
+   PointR pnt,tmp_pt;
+   VIO_Real 
+      s_voxel_xyz[VIO_MAX_DIMENSIONS],
+      s_voxel[VIO_MAX_DIMENSIONS],
+      s_world[VIO_N_DIMENSIONS],
+      t_voxel[VIO_MAX_DIMENSIONS],
+      t_world[VIO_N_DIMENSIONS];
+   int i;
+
+   get_lattice_in_voxels(globals, v1, vox->start, vox->directions);
 
                                 /* take care of the
                                      voxel-world * world-world * world-voxel
@@ -259,6 +274,70 @@ void get_into_voxel_space(Arg_Data *globals,
    }
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_into_linear_voxel_space
+@INPUT      : globals - the lattice and the transformation
+              v1, v2  - the source and target volumes
+@OUTPUT     : vox     - as get_into_voxel_space(), but with the voxel to
+                        voxel transformation held in the structure
+@RETURNS    : 
+@DESCRIPTION: the objective functions need this once per evaluation.  When
+              the voxel to world transforms of the volumes and the
+              transformation are all linear (the usual case of a linear
+              fit), the 4x4 matrices are composed directly, using the
+              world to voxel inverse that each volume already holds:
+              nothing is allocated.  Otherwise, the general
+              transformations of get_into_voxel_space() are composed.
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+void get_into_linear_voxel_space(Arg_Data *globals,
+                                 Linear_voxel_space *vox,
+                                 VIO_Volume v1, VIO_Volume v2) {
+   VIO_General_transform 
+      *v2w1, *v2w2, *transformation;
+   Voxel_space_struct 
+      *vox_space;
+   VIO_Transform 
+      reorder;
+
+   v2w1           = get_voxel_to_world_transform( v1 );
+   v2w2           = get_voxel_to_world_transform( v2 );
+   transformation = globals->trans_info.transformation;
+
+   if (get_transform_type(v2w1) != LINEAR ||
+       get_transform_type(v2w2) != LINEAR ||
+       get_transform_type(transformation) != LINEAR) {
+
+      vox_space = new_voxel_space_struct();
+      get_into_voxel_space(globals, vox_space, v1, v2);
+      vox->start[0] = vox_space->start[0];
+      vox->start[1] = vox_space->start[1];
+      vox->start[2] = vox_space->start[2];
+      vox->directions[0] = vox_space->directions[0];
+      vox->directions[1] = vox_space->directions[1];
+      vox->directions[2] = vox_space->directions[2];
+      vox->voxel_to_voxel = *get_linear_transform_ptr(vox_space->voxel_to_voxel_space);
+      delete_voxel_space_struct(vox_space);
+      return;
+   }
+
+   get_lattice_in_voxels(globals, v1, vox->start, vox->directions);
+
+                                /* voxel-world * world-world * world-voxel,
+                                   in the order of get_into_voxel_space() */
+   make_identity_transform(&reorder);
+   reorder_vox2xyz(&reorder, v1);
+   concat_transforms(&vox->voxel_to_voxel, &reorder, 
+                     get_linear_transform_ptr(v2w1));
+   concat_transforms(&vox->voxel_to_voxel, &vox->voxel_to_voxel,
+                     get_linear_transform_ptr(transformation));
+   concat_transforms(&vox->voxel_to_voxel, &vox->voxel_to_voxel,
+                     get_inverse_linear_transform_ptr(v2w2));
+   reorder_xyz2vox(&reorder, v2);
+   concat_transforms(&vox->voxel_to_voxel, &vox->voxel_to_voxel, &reorder);
+}
+
  void  my_homogenous_transform_point(
     VIO_Transform  *transform,
     VIO_Real       x,
@@ -0,0 +1,585 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : warp_buffers.c
+@DESCRIPTION: the passes made over the whole deformation field between two
+              nonlinear iterations (add_additional_warp_to_current(),
+              smooth_the_warp() and extrapolate_to_unestimated_nodes() in
+              deform_support.c), working directly on the voxels of the
+              displacement volumes and spread over several threads, one
+              slab of X slices at a time.
+
+              The neighbourhood mean of these passes is the mean over the
+              (up to) 26 neighbours of a node, ie the 3x3x3 box around it
+              clipped to the field, minus the node itself.  The box sums
+              are separable: each slice is first summed along Z, then
+              along Y, and the 3 slices around a node are added up.  A
+              thread keeps the Y-Z sums of the last 3 slices it used, so
+              that each slice is summed only once per slab.
+
+              The callers fall back on the generic volume_io code when a
+              displacement volume is not a single in-memory block of
+              doubles.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "thread_support.h"
+#include "warp_buffers.h"
+
+void get_volume_XYZV_indices(VIO_Volume data, int xyzv[]);
+
+                                /* number of values handed to a thread at
+                                   once by add_warp_buffers() */
+#define VALUES_PER_CHUNK 16384
+
+                                /* number of X slices handed to a thread
+                                   at once; each slab sums 2 slices more
+                                   than it updates */
+#define SLICES_PER_CHUNK 8
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_warp_buffer
+@INPUT      : displacement_volume - the 4D volume of a GRID_TRANSFORM
+@OUTPUT     : buffer
+@RETURNS    : TRUE if the voxels of displacement_volume are doubles stored
+              in memory in a single block, FALSE otherwise (and buffer is
+              not set).
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_warp_buffer(VIO_Volume displacement_volume, Warp_Buffer *buffer)
+{
+  double ****voxels;
+  long     n_values, stride[VIO_MAX_DIMENSIONS];
+  int      sizes[VIO_MAX_DIMENSIONS], xyzv[VIO_MAX_DIMENSIONS], i;
+
+  if (get_volume_n_dimensions(displacement_volume) != 4 ||
+      get_volume_data_type(displacement_volume) != VIO_DOUBLE ||
+      volume_is_cached(displacement_volume) ||
+      VOXEL_DATA(displacement_volume) == NULL)
+    return(FALSE);
+
+  get_volume_sizes(displacement_volume, sizes);
+  get_volume_XYZV_indices(displacement_volume, xyzv);
+
+  if (sizes[ xyzv[VIO_Z+1] ] != VIO_N_DIMENSIONS)
+    return(FALSE);
+
+  n_values = 1;
+  for(i=3; i>=0; i--) {
+    stride[i] = n_values;
+    n_values *= sizes[i];
+  }
+
+  voxels = (double ****)VOXEL_DATA(displacement_volume);
+
+  if (&voxels[sizes[0]-1][sizes[1]-1][sizes[2]-1][sizes[3]-1] -
+      &voxels[0][0][0][0] != n_values - 1)
+    return(FALSE);
+
+  buffer->data          = &voxels[0][0][0][0];
+  buffer->vector_stride = stride[ xyzv[VIO_Z+1] ];
+  buffer->n_values      = n_values;
+  for(i=0; i<VIO_N_DIMENSIONS; i++) {
+    buffer->count[i]  = sizes[ xyzv[i] ];
+    buffer->stride[i] = stride[ xyzv[i] ];
+  }
+
+  return(TRUE);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+  Warp_Buffer *additional, *current;
+  VIO_Real     weight;
+} Add_Work;
+
+static void add_values(void *data, int thread, int first, int last)
+{
+  Add_Work *work;
+  double   *a, *c;
+  long      i, i_end;
+
+  work = (Add_Work *)data;
+  a = work->additional->data;
+  c = work->current->data;
+
+  i_end = MIN((long)last * VALUES_PER_CHUNK, work->additional->n_values);
+  for(i=(long)first * VALUES_PER_CHUNK; i<i_end; i++)
+    a[i] = c[i] + a[i]*work->weight;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : add_warp_buffers
+@INPUT      : additional, current - two fields of the same size and
+                                    dimension order
+              weight
+              n_threads
+@OUTPUT     : additional
+@RETURNS    :
+@DESCRIPTION: additional = current + weight * additional, value by value
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void add_warp_buffers(Warp_Buffer *additional, Warp_Buffer *current,
+                      VIO_Real weight, int n_threads)
+{
+  Add_Work work;
+  int      n_chunks;
+
+  work.additional = additional;
+  work.current    = current;
+  work.weight     = weight;
+
+  n_chunks  = (int)((additional->n_values + VALUES_PER_CHUNK - 1) / VALUES_PER_CHUNK);
+  n_threads = get_number_of_threads_to_use(n_threads, n_chunks);
+
+  run_in_parallel(n_threads, n_chunks, 1, add_values, (void *)&work);
+}
+
+/* ------------------------------------------------------------------------ */
+
+                                /* the Y-Z box sums of the 3 slices last
+                                   used by a thread, slice x in slot x%3 */
+typedef struct {
+  int     slice[3];
+  double *sum[3][VIO_N_DIMENSIONS];   /* [slot][component][y*nz + z]      */
+  double *count[3];                   /* [slot][y*nz + z], masked sums    */
+  double *z_sum[VIO_N_DIMENSIONS];    /* sums along Z of the slice        */
+  double *z_count;
+} Box_Window;
+
+static void alloc_box_window(Box_Window *window, int plane_size, VIO_BOOL masked)
+{
+  int slot, c;
+
+  for(slot=0; slot<3; slot++) {
+    window->slice[slot] = -1;
+    for(c=0; c<VIO_N_DIMENSIONS; c++)
+      ALLOC(window->sum[slot][c], plane_size);
+    window->count[slot] = NULL;
+    if (masked)
+      ALLOC(window->count[slot], plane_size);
+  }
+  for(c=0; c<VIO_N_DIMENSIONS; c++)
+    ALLOC(window->z_sum[c], plane_size);
+  window->z_count = NULL;
+  if (masked)
+    ALLOC(window->z_count, plane_size);
+}
+
+static void free_box_window(Box_Window *window)
+{
+  int slot, c;
+
+  for(slot=0; slot<3; slot++) {
+    for(c=0; c<VIO_N_DIMENSIONS; c++)
+      FREE(window->sum[slot][c]);
+    if (window->count[slot] != NULL)
+      FREE(window->count[slot]);
+  }
+  for(c=0; c<VIO_N_DIMENSIONS; c++)
+    FREE(window->z_sum[c]);
+  if (window->z_count != NULL)
+    FREE(window->z_count);
+}
+
+/* return the slot of window holding the Y-Z box sums of slice x of warp,
+   counting only the nodes flagged in mask (in X,Y,Z node order) if mask
+   is not NULL */
+
+static int get_box_slice(Box_Window *window, Warp_Buffer *warp,
+                         unsigned char *mask, int x)
+{
+  double *data, sum[VIO_N_DIMENSIONS], count;
+  long    offset, node;
+  int     slot, ny, nz, y, z, t, c;
+
+  slot = x % 3;
+  if (window->slice[slot] == x)
+    return(slot);
+
+  data = warp->data;
+  ny   = warp->count[VIO_Y];
+  nz   = warp->count[VIO_Z];
+
+  for(y=0; y<ny; y++)           /* along Z */
+    for(z=0; z<nz; z++) {
+      sum[0] = sum[1] = sum[2] = count = 0.0;
+      for(t=MAX(z-1,0); t<=MIN(z+1,nz-1); t++) {
+        node = ((long)x*ny + y)*nz + t;
+        if (mask == NULL || mask[node]) {
+          offset = x*warp->stride[VIO_X] + y*warp->stride[VIO_Y] + t*warp->stride[VIO_Z];
+          for(c=0; c<VIO_N_DIMENSIONS; c++)
+            sum[c] += data[offset + c*warp->vector_stride];
+          count += 1.0;
+        }
+      }
+      for(c=0; c<VIO_N_DIMENSIONS; c++)
+        window->z_sum[c][y*nz + z] = sum[c];
+      if (mask != NULL)
+        window->z_count[y*nz + z] = count;
+    }
+
+  for(y=0; y<ny; y++)           /* then along Y */
+    for(z=0; z<nz; z++) {
+      sum[0] = sum[1] = sum[2] = count = 0.0;
+      for(t=MAX(y-1,0); t<=MIN(y+1,ny-1); t++) {
+        for(c=0; c<VIO_N_DIMENSIONS; c++)
+          sum[c] += window->z_sum[c][t*nz + z];
+        if (mask != NULL)
+          count += window->z_count[t*nz + z];
+      }
+      for(c=0; c<VIO_N_DIMENSIONS; c++)
+        window->sum[slot][c][y*nz + z] = sum[c];
+      if (mask != NULL)
+        window->count[slot][y*nz + z] = count;
+    }
+
+  window->slice[slot] = x;
+
+  return(slot);
+}
+
+/* get the slots of the (up to) 3 slices around slice x; returns their
+   number */
+
+static int get_box_slices(Box_Window *window, Warp_Buffer *warp,
+                          unsigned char *mask, int x, int slots[])
+{
+  int n, t;
+
+  n = 0;
+  for(t=MAX(x-1,0); t<=MIN(x+1,warp->count[VIO_X]-1); t++)
+    slots[n++] = get_box_slice(window, warp, mask, t);
+
+  return(n);
+}
+
+/* number of nodes of the unmasked 3x3x3 box around node (x,y,z) */
+
+static int box_size(Warp_Buffer *warp, int x, int y, int z)
+{
+  int node[VIO_N_DIMENSIONS], size, i;
+
+  node[VIO_X] = x;
+  node[VIO_Y] = y;
+  node[VIO_Z] = z;
+
+  size = 1;
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    size *= 1 + (node[i] > 0) + (node[i] < warp->count[i]-1);
+
+  return(size);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+  Warp_Buffer *smoothed, *current;
+  int         *start, *end;
+  VIO_Real     smoothing_weight;
+  Box_Window  *windows;         /* one per thread */
+} Smooth_Work;
+
+static void smooth_slices(void *data, int thread, int first, int last)
+{
+  Smooth_Work *work;
+  Warp_Buffer *current, *smoothed;
+  Box_Window  *window;
+  double       value[VIO_N_DIMENSIONS], box, mean;
+  long         offset, smoothed_offset;
+  int          slots[3], n_slots, count, i, s, x, y, z, c, nz;
+
+  work     = (Smooth_Work *)data;
+  current  = work->current;
+  smoothed = work->smoothed;
+  window   = &work->windows[thread];
+  nz       = current->count[VIO_Z];
+
+  for(i=first; i<last; i++) {
+    x = work->start[VIO_X] + i;
+
+    n_slots = get_box_slices(window, current, NULL, x, slots);
+
+    for(y=work->start[VIO_Y]; y<work->end[VIO_Y]; y++)
+      for(z=work->start[VIO_Z]; z<work->end[VIO_Z]; z++) {
+
+        offset = x*current->stride[VIO_X] + y*current->stride[VIO_Y] +
+                 z*current->stride[VIO_Z];
+        for(c=0; c<VIO_N_DIMENSIONS; c++)
+          value[c] = current->data[offset + c*current->vector_stride];
+
+                                /* average the node with the mean of
+                                   its neighbours */
+        count = box_size(current, x, y, z) - 1;
+        if (count > 0)
+          for(c=0; c<VIO_N_DIMENSIONS; c++) {
+            box = 0.0;
+            for(s=0; s<n_slots; s++)
+              box += window->sum[ slots[s] ][c][y*nz + z];
+            mean = (box - value[c]) / count;
+
+            value[c] = (1.0 - work->smoothing_weight) * value[c] +
+                       work->smoothing_weight * mean;
+          }
+
+        smoothed_offset = x*smoothed->stride[VIO_X] + y*smoothed->stride[VIO_Y] +
+                          z*smoothed->stride[VIO_Z];
+        for(c=0; c<VIO_N_DIMENSIONS; c++)
+          smoothed->data[smoothed_offset + c*smoothed->vector_stride] = value[c];
+      }
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : smooth_warp_buffer
+@INPUT      : current   - the field to smooth
+              start,end - nodes to smooth, in X,Y,Z order (see
+                          get_voxel_spatial_loop_limits())
+              smoothing_weight
+              n_threads
+@OUTPUT     : smoothed  - a field of the same size as current, distinct
+                          from it.  Nodes outside start..end are left as
+                          they are.
+@RETURNS    :
+@DESCRIPTION: def' = (1-sw)*def + sw*mean, as in smooth_the_warp()
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void smooth_warp_buffer(Warp_Buffer *smoothed, Warp_Buffer *current,
+                        int start[], int end[],
+                        VIO_Real smoothing_weight, int n_threads)
+{
+  Smooth_Work work;
+  int         n_slices, i;
+
+  n_slices = end[VIO_X] - start[VIO_X];
+  if (n_slices <= 0)
+    return;
+
+  work.smoothed         = smoothed;
+  work.current          = current;
+  work.start            = start;
+  work.end              = end;
+  work.smoothing_weight = smoothing_weight;
+
+  n_threads = get_number_of_threads_to_use(n_threads, n_slices);
+
+  ALLOC(work.windows, n_threads);
+  for(i=0; i<n_threads; i++)
+    alloc_box_window(&work.windows[i], current->count[VIO_Y]*current->count[VIO_Z], FALSE);
+
+  run_in_parallel(n_threads, n_slices, SLICES_PER_CHUNK, smooth_slices, (void *)&work);
+
+  for(i=0; i<n_threads; i++)
+    free_box_window(&work.windows[i]);
+  FREE(work.windows);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+  Warp_Buffer   *current, *additional;
+  VIO_Volume     estimated_flag_vol;
+  unsigned char *estimated;     /* flag >= 0.5: usable neighbour     */
+  unsigned char *unestimated;   /* flag <  1.0: node to extrapolate  */
+  int           *start, *end;
+  Box_Window    *current_windows, *additional_windows; /* per thread */
+  int           *total, *many, *extrapolated;          /* per slice  */
+} Extrapolate_Work;
+
+static void read_flag_slices(void *data, int thread, int first, int last)
+{
+  Extrapolate_Work *work;
+  VIO_Real          flag;
+  long              node;
+  int               x, y, z;
+
+  work = (Extrapolate_Work *)data;
+
+  for(x=first; x<last; x++)
+    for(y=0; y<work->current->count[VIO_Y]; y++)
+      for(z=0; z<work->current->count[VIO_Z]; z++) {
+        node = ((long)x*work->current->count[VIO_Y] + y)*work->current->count[VIO_Z] + z;
+        flag = get_volume_real_value(work->estimated_flag_vol, x, y, z, 0, 0);
+        work->estimated[node]   = (flag >= 0.5);
+        work->unestimated[node] = (flag <  1.0);
+      }
+}
+
+static void extrapolate_slices(void *data, int thread, int first, int last)
+{
+  Extrapolate_Work *work;
+  Warp_Buffer      *current, *additional;
+  Box_Window       *current_window, *additional_window;
+  double            current_deform[VIO_N_DIMENSIONS],
+                    additional_deform[VIO_N_DIMENSIONS],
+                    neighbours, box, mean;
+  long              offset, additional_offset, node;
+  int               current_slots[3], additional_slots[3], n_slots,
+                    count, i, s, x, y, z, c, ny, nz;
+
+  work       = (Extrapolate_Work *)data;
+  current    = work->current;
+  additional = work->additional;
+  current_window    = &work->current_windows[thread];
+  additional_window = &work->additional_windows[thread];
+  ny = current->count[VIO_Y];
+  nz = current->count[VIO_Z];
+
+  for(i=first; i<last; i++) {
+    x = work->start[VIO_X] + i;
+
+    work->total[i] = work->many[i] = work->extrapolated[i] = 0;
+
+    n_slots = get_box_slices(current_window, current, NULL, x, current_slots);
+    (void)get_box_slices(additional_window, additional, work->estimated, x,
+                         additional_slots);
+
+    for(y=work->start[VIO_Y]; y<work->end[VIO_Y]; y++)
+      for(z=work->start[VIO_Z]; z<work->end[VIO_Z]; z++) {
+
+        work->total[i]++;
+
+        node = ((long)x*ny + y)*nz + z;
+        if (!work->unestimated[node])
+          continue;
+
+        work->many[i]++;
+
+        offset = x*current->stride[VIO_X] + y*current->stride[VIO_Y] +
+                 z*current->stride[VIO_Z];
+        additional_offset = x*additional->stride[VIO_X] + y*additional->stride[VIO_Y] +
+                            z*additional->stride[VIO_Z];
+
+        for(c=0; c<VIO_N_DIMENSIONS; c++)
+          current_deform[c] = current->data[offset + c*current->vector_stride];
+
+                                /* sum of the additional deformation of the
+                                   estimated neighbours */
+        neighbours = 0.0;
+        for(s=0; s<n_slots; s++)
+          neighbours += additional_window->count[ additional_slots[s] ][y*nz + z];
+        for(c=0; c<VIO_N_DIMENSIONS; c++) {
+          additional_deform[c] = 0.0;
+          for(s=0; s<n_slots; s++)
+            additional_deform[c] += additional_window->sum[ additional_slots[s] ][c][y*nz + z];
+        }
+        if (work->estimated[node]) {
+          neighbours -= 1.0;
+          for(c=0; c<VIO_N_DIMENSIONS; c++)
+            additional_deform[c] -= additional->data[additional_offset + c*additional->vector_stride];
+        }
+
+        if (neighbours > 0.0) {
+          work->extrapolated[i]++;
+          for(c=0; c<VIO_N_DIMENSIONS; c++)
+            additional_deform[c] /= 26.0;
+        }
+
+                                /* additional_deform += sw*mean + (1-sw)*current
+                                                        - current, with sw = 0.5 */
+        count = box_size(current, x, y, z) - 1;
+        if (count > 0)
+          for(c=0; c<VIO_N_DIMENSIONS; c++) {
+            box = 0.0;
+            for(s=0; s<n_slots; s++)
+              box += current_window->sum[ current_slots[s] ][c][y*nz + z];
+            mean = (box - current_deform[c]) / count;
+
+            additional_deform[c] += (mean - current_deform[c])/2.0;
+          }
+
+        for(c=0; c<VIO_N_DIMENSIONS; c++)
+          additional->data[additional_offset + c*additional->vector_stride] = additional_deform[c];
+      }
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : extrapolate_warp_buffer
+@INPUT      : current            - the current field
+              additional         - the additional field estimated at this
+                                   iteration, same size as current
+              estimated_flag_vol - flags of the estimated nodes, in X,Y,Z
+                                   order
+              start,end          - nodes to visit, in X,Y,Z order
+              n_threads
+@OUTPUT     : additional         - updated at the nodes not estimated
+              total, many, extrapolated - the counts reported by
+                                   extrapolate_to_unestimated_nodes()
+@RETURNS    :
+@DESCRIPTION: the same computation as extrapolate_to_unestimated_nodes().
+              The nodes read from additional are the estimated ones
+              (flag 1), those written are the others (flag 0), so the
+              slices can be done in any order.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void extrapolate_warp_buffer(Warp_Buffer *current, Warp_Buffer *additional,
+                             VIO_Volume estimated_flag_vol,
+                             int start[], int end[], int n_threads,
+                             int *total, int *many, int *extrapolated)
+{
+  Extrapolate_Work work;
+  long             n_nodes;
+  int              n_slices, plane_size, i;
+
+  *total = *many = *extrapolated = 0;
+
+  n_slices = end[VIO_X] - start[VIO_X];
+  if (n_slices <= 0)
+    return;
+
+  work.current            = current;
+  work.additional         = additional;
+  work.estimated_flag_vol = estimated_flag_vol;
+  work.start              = start;
+  work.end                = end;
+
+  n_nodes = (long)current->count[VIO_X] * current->count[VIO_Y] * current->count[VIO_Z];
+  ALLOC(work.estimated,   n_nodes);
+  ALLOC(work.unestimated, n_nodes);
+
+  run_in_parallel(get_number_of_threads_to_use(n_threads, current->count[VIO_X]),
+                  current->count[VIO_X], SLICES_PER_CHUNK,
+                  read_flag_slices, (void *)&work);
+
+  n_threads  = get_number_of_threads_to_use(n_threads, n_slices);
+  plane_size = current->count[VIO_Y] * current->count[VIO_Z];
+
+  ALLOC(work.current_windows,    n_threads);
+  ALLOC(work.additional_windows, n_threads);
+  for(i=0; i<n_threads; i++) {
+    alloc_box_window(&work.current_windows[i],    plane_size, FALSE);
+    alloc_box_window(&work.additional_windows[i], plane_size, TRUE);
+  }
+  ALLOC(work.total,        n_slices);
+  ALLOC(work.many,         n_slices);
+  ALLOC(work.extrapolated, n_slices);
+
+  run_in_parallel(n_threads, n_slices, SLICES_PER_CHUNK, extrapolate_slices, (void *)&work);
+
+  for(i=0; i<n_slices; i++) {
+    *total        += work.total[i];
+    *many         += work.many[i];
+    *extrapolated += work.extrapolated[i];
+  }
+
+  for(i=0; i<n_threads; i++) {
+    free_box_window(&work.current_windows[i]);
+    free_box_window(&work.additional_windows[i]);
+  }
+  FREE(work.current_windows);
+  FREE(work.additional_windows);
+  FREE(work.total);
+  FREE(work.many);
+  FREE(work.extrapolated);
+  FREE(work.estimated);
+  FREE(work.unestimated);
+}
@@ -0,0 +1,247 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : crop_volumes.c
+@DESCRIPTION: crop the source and target volumes, once they are read, to
+              the part that the lattices can sample (-crop_volumes).
+
+              The lattice of a volume only has nodes on its voxels above
+              the threshold that are inside its mask (see init_lattice()),
+              so the voxels outside of the bounding box of these, plus a
+              margin for the neighbours read by the interpolant, are
+              dropped.  The box of the voxels above the threshold is the
+              one of mincbbox, see get_volume_bounding_box() in Proglib.
+
+              The cropped volume keeps the voxel type, the voxel to real
+              value conversion and the voxel to world transformation of
+              the volume: only its first voxel and its sizes change.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <limits.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "crop_volumes.h"
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : make_cropped_volume
+@INPUT      : volume      - a 3D volume
+              first, last - the first and last voxel to keep along each
+                            voxel axis
+@OUTPUT     :
+@RETURNS    : a new volume, of the same type as volume, where voxel
+              [i][j][k] is voxel [first[0]+i][first[1]+j][first[2]+k] of
+              volume, and lies at the same world position.
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_Volume make_cropped_volume(VIO_Volume volume, int first[], int last[])
+{
+  VIO_Volume
+    result;
+  VIO_Real
+    voxel[VIO_MAX_DIMENSIONS],
+    world[VIO_N_DIMENSIONS],
+    value;
+  int
+    new_sizes[VIO_MAX_DIMENSIONS],
+    i, j, k;
+
+  for(i=0; i<VIO_MAX_DIMENSIONS; i++)
+    voxel[i] = 0.0;
+  for(i=0; i<VIO_N_DIMENSIONS; i++) {
+    voxel[i]     = first[i];
+    new_sizes[i] = last[i] - first[i] + 1;
+  }
+  convert_voxel_to_world(volume, voxel, &world[0], &world[1], &world[2]);
+
+                                /* same header, fewer voxels, with voxel
+                                   first of volume as voxel 0 */
+  for(i=0; i<VIO_MAX_DIMENSIONS; i++)
+    voxel[i] = 0.0;
+
+  result = copy_volume_definition_no_alloc(volume, NC_UNSPECIFIED, FALSE, 0.0, 0.0);
+  set_volume_sizes(result, new_sizes);
+  set_volume_translation(result, voxel, world);
+  alloc_volume_data(result);
+
+  for(i=0; i<new_sizes[0]; i++)
+    for(j=0; j<new_sizes[1]; j++)
+      for(k=0; k<new_sizes[2]; k++) {
+        GET_VOXEL_3D(value, volume, first[0]+i, first[1]+j, first[2]+k);
+        SET_VOXEL_3D(result, i, j, k, value);
+      }
+
+  return(result);
+}
+
+/* TRUE if voxel v of volume and of mask lie at the same world position,
+   for all v */
+
+static VIO_BOOL same_voxel_grid(VIO_Volume volume, VIO_Volume mask)
+{
+  VIO_Real
+    voxel[VIO_MAX_DIMENSIONS],
+    world1[VIO_N_DIMENSIONS],
+    world2[VIO_N_DIMENSIONS];
+  int
+    sizes1[VIO_MAX_DIMENSIONS],
+    sizes2[VIO_MAX_DIMENSIONS],
+    i, a;
+
+  get_volume_sizes(volume, sizes1);
+  get_volume_sizes(mask, sizes2);
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++)
+    if (sizes1[i] != sizes2[i])
+      return(FALSE);
+
+                                /* the origin and one voxel along each
+                                   axis fix the (affine) transformation */
+  for(i=0; i<=VIO_N_DIMENSIONS; i++) {
+
+    for(a=0; a<VIO_MAX_DIMENSIONS; a++)
+      voxel[a] = (a == i) ? 1.0 : 0.0;
+
+    convert_voxel_to_world(volume, voxel, &world1[0], &world1[1], &world1[2]);
+    convert_voxel_to_world(mask,   voxel, &world2[0], &world2[1], &world2[2]);
+
+    for(a=0; a<VIO_N_DIMENSIONS; a++)
+      if (fabs(world1[a] - world2[a]) > 1e-6)
+        return(FALSE);
+  }
+
+  return(TRUE);
+}
+
+/* the box of volume voxels [first,last] that holds the mask voxels
+   [mask_first,mask_last] (to their edges) of a mask on another grid */
+
+static void get_mask_box_in_volume(VIO_Volume volume, VIO_Volume mask,
+                                   int mask_first[], int mask_last[],
+                                   int first[], int last[])
+{
+  VIO_Real
+    voxel[VIO_MAX_DIMENSIONS],
+    world[VIO_N_DIMENSIONS];
+  int
+    corner, a, index;
+
+  for(a=0; a<VIO_N_DIMENSIONS; a++) {
+    first[a] = INT_MAX;
+    last[a]  = -INT_MAX;
+  }
+
+  for(a=0; a<VIO_MAX_DIMENSIONS; a++)
+    voxel[a] = 0.0;
+
+  for(corner=0; corner<8; corner++) {
+
+    for(a=0; a<VIO_N_DIMENSIONS; a++)
+      voxel[a] = (corner & (1 << a)) ? mask_last[a] + 0.5 : mask_first[a] - 0.5;
+
+    convert_voxel_to_world(mask, voxel, &world[0], &world[1], &world[2]);
+    convert_world_to_voxel(volume, world[0], world[1], world[2], voxel);
+
+    for(a=0; a<VIO_N_DIMENSIONS; a++) {
+      index = (int) floor(voxel[a]);
+      if (index < first[a]) first[a] = index;
+      index = (int) ceil(voxel[a]);
+      if (index > last[a]) last[a] = index;
+    }
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : crop_volume_and_mask
+@INPUT      : volume    - a source or target volume
+              mask      - its mask, or NULL
+              threshold - its voxels at or below threshold get no node
+              margin    - number of voxels kept around the box, for the
+                          interpolant
+              margin_mm - and the distance (mm) kept around the box
+@OUTPUT     : volume    - cropped
+              mask      - cropped too, when it is on the voxel grid of
+                          volume
+@RETURNS    : TRUE if the volume was cropped, FALSE if it was left as it
+              was (the box covers it, or it has no voxel above threshold in
+              its mask)
+@DESCRIPTION: the volumes replaced are deleted.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL crop_volume_and_mask(VIO_Volume *volume, VIO_Volume *mask,
+                              VIO_Real threshold,
+                              int margin, VIO_Real margin_mm)
+{
+  VIO_Volume
+    cropped;
+  VIO_Real
+    separations[VIO_MAX_DIMENSIONS];
+  VIO_BOOL
+    same_grid;
+  int
+    sizes[VIO_MAX_DIMENSIONS],
+    first[VIO_N_DIMENSIONS], last[VIO_N_DIMENSIONS],
+    mask_first[VIO_N_DIMENSIONS], mask_last[VIO_N_DIMENSIONS],
+    box_first[VIO_N_DIMENSIONS], box_last[VIO_N_DIMENSIONS],
+    a, whole;
+
+  if (!get_volume_bounding_box(*volume, threshold, first, last, NULL, NULL))
+    return(FALSE);
+
+  same_grid = FALSE;
+
+  if (*mask != NULL) {
+
+    if (!get_volume_bounding_box(*mask, 0.0, mask_first, mask_last, NULL, NULL))
+      return(FALSE);
+
+    same_grid = same_voxel_grid(*volume, *mask);
+
+    if (same_grid)
+      for(a=0; a<VIO_N_DIMENSIONS; a++) {
+        box_first[a] = mask_first[a];
+        box_last[a]  = mask_last[a];
+      }
+    else
+      get_mask_box_in_volume(*volume, *mask, mask_first, mask_last,
+                             box_first, box_last);
+
+    for(a=0; a<VIO_N_DIMENSIONS; a++) {
+      first[a] = MAX(first[a], box_first[a]);
+      last[a]  = MIN(last[a],  box_last[a]);
+      if (first[a] > last[a])
+        return(FALSE);
+    }
+  }
+
+  get_volume_sizes(*volume, sizes);
+  get_volume_separations(*volume, separations);
+
+  whole = TRUE;
+  for(a=0; a<VIO_N_DIMENSIONS; a++) {
+    first[a] -= margin + (int)ceil(margin_mm / fabs(separations[a]));
+    last[a]  += margin + (int)ceil(margin_mm / fabs(separations[a]));
+    if (first[a] < 0)         first[a] = 0;
+    if (last[a]  > sizes[a]-1) last[a]  = sizes[a]-1;
+    if (first[a] > 0 || last[a] < sizes[a]-1)
+      whole = FALSE;
+  }
+
+  if (whole)
+    return(FALSE);
+
+  cropped = make_cropped_volume(*volume, first, last);
+  delete_volume(*volume);
+  *volume = cropped;
+
+  if (same_grid) {
+    cropped = make_cropped_volume(*mask, first, last);
+    delete_volume(*mask);
+    *mask = cropped;
+  }
+
+  return(TRUE);
+}
@@ -124,6 +124,7 @@ static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc
 #include "minctracc_arg_data.h"
 
 #include "local_macros.h"
+#include "mask_spans.h"
 
 #include <Proglib.h>
 
@@ -406,6 +407,9 @@ void init_lattice(VIO_Volume d1,
     col,
     voxel;
 
+  Mask_Row
+    mask_row;
+
   double
     tx,ty,tz;
   int
@@ -492,8 +496,15 @@ void init_lattice(VIO_Volume d1,
       ADD_POINT_VECTOR( row, slice, vector_step );
 
       SCALE_POINT( col, row, 1.0); /* init first col position */
+      get_mask_row(m1, TRUE, &row, &scaled_directions1[VIO_X], count1[VIO_X], &mask_row);
+
       for(c=0; c<count1[VIO_X]; c++) {
 
+        if (!node_in_mask_row(&mask_row, c)) {
+          ADD_POINT_VECTOR( col, col, scaled_directions1[VIO_X] );
+          continue;
+        }
+
         convert_3D_world_to_voxel(d1, Point_x(col), Point_y(col), Point_z(col), &tx, &ty, &tz);
         
         fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
@@ -601,8 +612,15 @@ void init_lattice(VIO_Volume d1,
       ADD_POINT_VECTOR( row, slice, vector_step );
 
       SCALE_POINT( col, row, 1.0); /* init first col position */
+      get_mask_row(m2, TRUE, &row, &scaled_directions2[VIO_X], count2[VIO_X], &mask_row);
+
       for(c=0; c<count2[VIO_X]; c++) {
 
+        if (!node_in_mask_row(&mask_row, c)) {
+          ADD_POINT_VECTOR( col, col, scaled_directions2[VIO_X] );
+          continue;
+        }
+
         convert_3D_world_to_voxel(d2, Point_x(col), Point_y(col), Point_z(col), &tx, &ty, &tz);
         
         fill_Point( voxel, tx, ty, tz ); /* build the voxel POINT */
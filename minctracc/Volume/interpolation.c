@@ -70,8 +70,16 @@
 static char rcsid[]="$Header: /static-cvsroot/registration/mni_autoreg/minctracc/Volume/interpolation.c,v 96.7 2006-11-30 09:07:33 rotor Exp $";
 #endif
 
+#include <config.h>
 #include <volume_io.h>
+#include <Proglib.h>
 #include "minctracc_point_vector.h"
+#include "sampling_kernels.h"
+#include "mask_spans.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #define VOL_NDIMS 3
 
@@ -151,8 +159,8 @@ int trilinear_interpolant(VIO_Volume volume,
   int sizes[3];
   int flag;
   double temp_result;
-  static double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
-  static double v000, v001, v010, v011, v100, v101, v110, v111;
+  double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
+  double v000, v001, v010, v011, v100, v101, v110, v111, v[8];
   
   /* Check that the coordinate is inside the volume */
   
@@ -178,15 +186,22 @@ int trilinear_interpolant(VIO_Volume volume,
   if (ind1 >= max[1]-1) ind1 = max[1]-1;
   if (ind2 >= max[2]-1) ind2 = max[2]-1;
   
-  /* Get the relevant voxels */
-  GET_VALUE_3D( v000 ,  volume, ind0  , ind1  , ind2   ); 
-  GET_VALUE_3D( v001 ,  volume, ind0  , ind1  , ind2+1 ); 
-  GET_VALUE_3D( v010 ,  volume, ind0  , ind1+1, ind2   ); 
-  GET_VALUE_3D( v011 ,  volume, ind0  , ind1+1, ind2+1 ); 
-  GET_VALUE_3D( v100 ,  volume, ind0+1, ind1  , ind2   ); 
-  GET_VALUE_3D( v101 ,  volume, ind0+1, ind1  , ind2+1 ); 
-  GET_VALUE_3D( v110 ,  volume, ind0+1, ind1+1, ind2   ); 
-  GET_VALUE_3D( v111 ,  volume, ind0+1, ind1+1, ind2+1 ); 
+  /* Get the relevant voxels, from the bricks of the volume if it has
+     some (-bricked_volumes) */
+  if (get_bricked_neighbours(volume, ind0, ind1, ind2, v)) {
+    v000 = v[0]; v001 = v[1]; v010 = v[2]; v011 = v[3];
+    v100 = v[4]; v101 = v[5]; v110 = v[6]; v111 = v[7];
+  }
+  else {
+    GET_VALUE_3D( v000 ,  volume, ind0  , ind1  , ind2   ); 
+    GET_VALUE_3D( v001 ,  volume, ind0  , ind1  , ind2+1 ); 
+    GET_VALUE_3D( v010 ,  volume, ind0  , ind1+1, ind2   ); 
+    GET_VALUE_3D( v011 ,  volume, ind0  , ind1+1, ind2+1 ); 
+    GET_VALUE_3D( v100 ,  volume, ind0+1, ind1  , ind2   ); 
+    GET_VALUE_3D( v101 ,  volume, ind0+1, ind1  , ind2+1 ); 
+    GET_VALUE_3D( v110 ,  volume, ind0+1, ind1+1, ind2   ); 
+    GET_VALUE_3D( v111 ,  volume, ind0+1, ind1+1, ind2+1 ); 
+  }
 
   /* Get the fraction parts */
   f0 = Point_x( *coord ) - ind0;
@@ -220,82 +235,175 @@ int trilinear_interpolant(VIO_Volume volume,
 
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : do_Ncubic_interpolation
+@NAME       : trilinear_interpolant_with_gradient
 @INPUT      : volume - pointer to volume data
-              index - indices to start point in volume
-                 (bottom of 4x4x4 cube for interpolation)
-              cur_dim - dimension to be interpolated (0 = volume, 1 = slice,
-                 2 = line)
-@OUTPUT     : result - interpolated value.
-@RETURNS    : (nothing)
-@DESCRIPTION: Routine to interpolate a volume, slice or line (specified by
-              cur_dim).
+              coord - point at which volume should be interpolated in voxel 
+                 units (with 0 being first point of the volume).
+@OUTPUT     : result - interpolated TRUE value, the same as the one of
+                 trilinear_interpolant().
+              gradient - the derivatives of the trilinear interpolant
+                 with respect to the three voxel coordinates of coord.
+@RETURNS    : TRUE if coord is within the volume, FALSE otherwise.
+@DESCRIPTION: Routine to interpolate a volume at a point with tri-linear
+              interpolation, and to differentiate the interpolant there
+              from the same 8 voxels.  On the last voxel of an axis,
+              where trilinear_interpolant() falls back on the nearest
+              neighbour, the gradient is zero.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
-@CREATED    : February 12, 1993 (Peter Neelin)
-@MODIFIED   : Fri May 28 09:06:12 EST 1993 Louis Collins
-               mod to use david's volume_struct
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
 ---------------------------------------------------------------------------- */
-void do_Ncubic_interpolation(VIO_Volume volume, 
-                             long index[], int cur_dim, 
-                             double frac[], double *result)
+int trilinear_interpolant_with_gradient(VIO_Volume volume, 
+                                        PointR *coord, double *result,
+                                        double gradient[])
 {
-   long base_index;
-   double v0, v1, v2, v3, u;
-
-   /* Save index that we will change */
-   base_index = index[cur_dim];
-
-   /* If last dimension, then just get the values */
-   if (cur_dim == VOL_NDIMS-1) {
-     GET_VOXEL_3D( v0 ,  volume, index[0] ,index[1], index[2] );
-     index[cur_dim]++;
-     GET_VOXEL_3D( v1 ,  volume, index[0] ,index[1], index[2] );
-     index[cur_dim]++;
-     GET_VOXEL_3D( v2 ,  volume, index[0] ,index[1], index[2] );
-     index[cur_dim]++;
-     GET_VOXEL_3D( v3 ,  volume, index[0] ,index[1], index[2] );
-   }
+  long ind0, ind1, ind2, max[3];
+  int sizes[3];
+  int flag;
+  double temp_result;
+  double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
+  double v000, v001, v010, v011, v100, v101, v110, v111, v[8];
+  
+  get_volume_sizes(volume, sizes);
+  max[0]=sizes[0];
+  max[1]=sizes[1];
+  max[2]=sizes[2];
+  
+  if ((Point_x( *coord ) < 0) || (Point_x( *coord ) >= max[0]-1) ||
+      (Point_y( *coord ) < 0) || (Point_y( *coord ) >= max[1]-1) ||
+      (Point_z( *coord ) < 0) || (Point_z( *coord ) >= max[2]-1)) {
+    
+    flag = nearest_neighbour_interpolant(volume, coord, &temp_result) ;
+    *result = temp_result;
+    gradient[0] = gradient[1] = gradient[2] = 0.0;
+    return(flag);
+  }
+    
+  ind0 = (long) floor(Point_x( *coord ));
+  ind1 = (long) floor(Point_y( *coord ));
+  ind2 = (long) floor(Point_z( *coord ));
+  
+  if (get_bricked_neighbours(volume, ind0, ind1, ind2, v)) {
+    v000 = v[0]; v001 = v[1]; v010 = v[2]; v011 = v[3];
+    v100 = v[4]; v101 = v[5]; v110 = v[6]; v111 = v[7];
+  }
+  else {
+    GET_VALUE_3D( v000 ,  volume, ind0  , ind1  , ind2   ); 
+    GET_VALUE_3D( v001 ,  volume, ind0  , ind1  , ind2+1 ); 
+    GET_VALUE_3D( v010 ,  volume, ind0  , ind1+1, ind2   ); 
+    GET_VALUE_3D( v011 ,  volume, ind0  , ind1+1, ind2+1 ); 
+    GET_VALUE_3D( v100 ,  volume, ind0+1, ind1  , ind2   ); 
+    GET_VALUE_3D( v101 ,  volume, ind0+1, ind1  , ind2+1 ); 
+    GET_VALUE_3D( v110 ,  volume, ind0+1, ind1+1, ind2   ); 
+    GET_VALUE_3D( v111 ,  volume, ind0+1, ind1+1, ind2+1 ); 
+  }
 
-   /* Otherwise, recurse */
-   else {
-      do_Ncubic_interpolation(volume, index, cur_dim+1, frac, &v0);
-      index[cur_dim]++;
-      do_Ncubic_interpolation(volume, index, cur_dim+1, frac, &v1);
-      index[cur_dim]++;
-      do_Ncubic_interpolation(volume, index, cur_dim+1, frac, &v2);
-      index[cur_dim]++;
-      do_Ncubic_interpolation(volume, index, cur_dim+1, frac, &v3);
-   }
+  f0 = Point_x( *coord ) - ind0;
+  f1 = Point_y( *coord ) - ind1;
+  f2 = Point_z( *coord ) - ind2;
+  r0 = 1.0 - f0;
+  r1 = 1.0 - f1;
+  r2 = 1.0 - f2;
+  
+  r1r2 = r1 * r2;
+  r1f2 = r1 * f2;
+  f1r2 = f1 * r2;
+  f1f2 = f1 * f2;
+  
+  *result =
+    r0 *  (r1r2 * v000 +
+           r1f2 * v001 +
+           f1r2 * v010 +
+           f1f2 * v011);
+  *result +=
+    f0 *  (r1r2 * v100 +
+           r1f2 * v101 +
+           f1r2 * v110 +
+           f1f2 * v111);
+
+  gradient[0] = 
+    r1r2 * (v100 - v000) + r1f2 * (v101 - v001) +
+    f1r2 * (v110 - v010) + f1f2 * (v111 - v011);
+  gradient[1] = 
+    r0 * (r2 * (v010 - v000) + f2 * (v011 - v001)) +
+    f0 * (r2 * (v110 - v100) + f2 * (v111 - v101));
+  gradient[2] = 
+    r0 * (r1 * (v001 - v000) + f1 * (v011 - v010)) +
+    f0 * (r1 * (v101 - v100) + f1 * (v111 - v110));
+  
+  return TRUE;
+  
+}
 
-   /* Restore index */
-   index[cur_dim] = base_index;
 
-   /* Scale values for slices */
-   if (cur_dim==0) {
-      v0 = CONVERT_VOXEL_TO_VALUE(volume,v0);
-      v1 = CONVERT_VOXEL_TO_VALUE(volume,v1);
-      v2 = CONVERT_VOXEL_TO_VALUE(volume,v2);
-      v3 = CONVERT_VOXEL_TO_VALUE(volume,v3);
-   }
+/* the weights of the four voxels around u (0 <= u < 1) for the cubic
+   of Dave MacDonald (a Catmull-Rom spline): it gives the voxel values
+   at u = 0 and 1, and continuity of intensity and first derivative. */
+
+inline static void catmull_rom_weights(double u, double w[])
+{
+  w[0] = u * (-0.5 + u * (1.0 - 0.5 * u));
+  w[1] = 1.0 + u * u * (-2.5 + 1.5 * u);
+  w[2] = u * (0.5 + u * (2.0 - 1.5 * u));
+  w[3] = u * u * (-0.5 + 0.5 * u);
+}
+
+/* the same for the cubic B-spline, to be applied to the coefficients
+   of bspline_prefilter_line() */
+
+inline static void bspline_weights(double u, double w[])
+{
+  double r;
+
+  r = 1.0 - u;
+  w[0] = r * r * r / 6.0;
+  w[1] = 2.0/3.0 + u * u * (0.5 * u - 1.0);
+  w[2] = 2.0/3.0 + r * r * (0.5 * r - 1.0);
+  w[3] = u * u * u / 6.0;
+}
+
+/* sum of data[index0[i]][index1[j]][index2[k]] * w[0][i]*w[1][j]*w[2][k]
+   over the 4x4x4 neighbourhood.  The voxels of each of the 16 rows along
+   the last axis are accumulated with weight w[0][i]*w[1][j], then the
+   four partial sums are weighted by w[2][].  With AVX2, and when the
+   row is contiguous, the four voxels of a row are handled at once, with
+   the same arithmetic as the scalar code. */
 
-   /* Get fraction */
-   u = frac[cur_dim];
-
-   /* Do tricubic interpolation (code from Dave MacDonald).
-      Gives v1 and v2 at u = 0 and 1 and gives continuity of intensity
-      and first derivative. */
-   *result =
-     ( (v1) + (u) * (
-       0.5 * ((v2)-(v0)) + (u) * (
-       (v0) - 2.5 * (v1) + 2.0 * (v2) - 0.5 * (v3) + (u) * (
-       -0.5 * (v0) + 1.5 * (v1) - 1.5 * (v2) + 0.5 * (v3)  )
-                                 )
-                    )
-     );
-
-   return;
+inline static double separable_cubic_sum(double ***data,
+                                         long index0[], long index1[], long index2[],
+                                         double w[][4])
+{
+  double acc[4], w01, *row;
+  int    i, j, k;
+
+#if defined(__AVX2__)
+  if (index2[3] == index2[0]+3) {
+    __m256d sum;
+
+    sum = _mm256_setzero_pd();
+    for(i=0; i<4; i++)
+      for(j=0; j<4; j++)
+        sum = _mm256_add_pd(sum, 
+                            _mm256_mul_pd(_mm256_set1_pd(w[0][i] * w[1][j]),
+                                          _mm256_loadu_pd(&data[index0[i]][index1[j]][index2[0]])));
+    _mm256_storeu_pd(acc, sum);
+
+    return( ((acc[0]*w[2][0] + acc[1]*w[2][1]) + acc[2]*w[2][2]) + acc[3]*w[2][3] );
+  }
+#endif
+
+  acc[0] = acc[1] = acc[2] = acc[3] = 0.0;
+  for(i=0; i<4; i++)
+    for(j=0; j<4; j++) {
+      w01 = w[0][i] * w[1][j];
+      row = data[index0[i]][index1[j]];
+      for(k=0; k<4; k++)
+        acc[k] += w01 * row[index2[k]];
+    }
+
+  return( ((acc[0]*w[2][0] + acc[1]*w[2][1]) + acc[2]*w[2][2]) + acc[3]*w[2][3] );
 }
 
 
@@ -308,20 +416,27 @@ void do_Ncubic_interpolation(VIO_Volume volume,
 @RETURNS    : TRUE if coord is within the volume, FALSE otherwise.
 @DESCRIPTION: Routine to interpolate a volume at a point with tri-cubic
               interpolation.
-@METHOD     : 
+@METHOD     : the 4 weights of each axis are computed once, and the 64
+              voxels are summed in one pass (separable_cubic_sum()),
+              straight from the voxel array of double volumes.  The
+              voxel to real conversion is linear and the weights of an
+              axis sum to one, so it is done once, on the sum.
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : February 12, 1993 (Peter Neelin)
 @MODIFIED   : Fri May 28 09:06:12 EST 1993 Louis Collins
                mod to use david's volume_struct
+@MODIFIED   : Oct 18, 2026
+               separable, non-recursive kernel
 ---------------------------------------------------------------------------- */
 int tricubic_interpolant(VIO_Volume volume, 
                                 PointR *coord, double *result)
 {
-   long ind0, ind1, ind2, max[3], index[VOL_NDIMS];
-   double frac[VOL_NDIMS];
+   long ind0, ind1, ind2, max[3];
+   long index[VOL_NDIMS][4];
+   double w[VOL_NDIMS][4], acc[4], w01, value;
    int sizes[3];
-   int flag;
+   int flag, i, j, k;
    double temp_result;
 
    /* Check that the coordinate is inside the volume */
@@ -341,16 +456,11 @@ int tricubic_interpolant(VIO_Volume volume,
    }
 
 
-   /* Get the whole and fractional part of the coordinate */
-   ind0 = (long) floor(Point_x( *coord ));
-   ind1 = (long) floor(Point_y( *coord ));
-   ind2 = (long) floor(Point_z( *coord ));
-   frac[0] = Point_x( *coord ) - ind0;
-   frac[1] = Point_y( *coord ) - ind1;
-   frac[2] = Point_z( *coord ) - ind2;
-   ind0--;
-   ind1--;
-   ind2--;
+   /* Get the whole part of the coordinate, and the start of the
+      4x4x4 neighbourhood */
+   ind0 = (long) floor(Point_x( *coord )) - 1;
+   ind1 = (long) floor(Point_y( *coord )) - 1;
+   ind2 = (long) floor(Point_z( *coord )) - 1;
 
    /* Check for edges - do linear interpolation at edges */
    if ((ind0 >= max[0]-3) || (ind0 < 0) ||
@@ -358,25 +468,277 @@ int tricubic_interpolant(VIO_Volume volume,
        (ind2 >= max[2]-3) || (ind2 < 0)) {
       return trilinear_interpolant(volume, coord, result);
    }
-   index[0]=ind0; index[1]=ind1; index[2]=ind2;
 
-   /* Do the interpolation */
-   do_Ncubic_interpolation(volume, index, 0, frac, result);
+   catmull_rom_weights(Point_x( *coord ) - (ind0+1), w[0]);
+   catmull_rom_weights(Point_y( *coord ) - (ind1+1), w[1]);
+   catmull_rom_weights(Point_z( *coord ) - (ind2+1), w[2]);
+
+   if (get_volume_data_type(volume) == VIO_DOUBLE && !volume_is_cached(volume)) {
+     for(i=0; i<4; i++) {
+       index[0][i] = ind0 + i;
+       index[1][i] = ind1 + i;
+       index[2][i] = ind2 + i;
+     }
+     value = separable_cubic_sum(VOXEL_DATA(volume), index[0], index[1], index[2], w);
+   }
+   else {
+     acc[0] = acc[1] = acc[2] = acc[3] = 0.0;
+     for(i=0; i<4; i++)
+       for(j=0; j<4; j++) {
+         w01 = w[0][i] * w[1][j];
+         for(k=0; k<4; k++) {
+           GET_VOXEL_3D( temp_result, volume, ind0+i, ind1+j, ind2+k );
+           acc[k] += w01 * temp_result;
+         }
+       }
+     value = ((acc[0]*w[2][0] + acc[1]*w[2][1]) + acc[2]*w[2][2]) + acc[3]*w[2][3];
+   }
+
+   *result = CONVERT_VOXEL_TO_VALUE(volume, value);
 
    return TRUE;
 
 }
 
 
+                                /* the pole of the cubic B-spline
+                                   prefilter, sqrt(3)-2               */
+#define BSPLINE_POLE      (-0.26794919243112270)
+#define BSPLINE_TOLERANCE 1e-10
+
+                                /* the volumes that have their B-spline
+                                   coefficients, see prefilter_bspline_volume() */
+#define MAX_BSPLINE_VOLUMES 8
+
+static struct {
+  VIO_Volume volume;
+  double     ***coefficients;
+} bspline_volumes[MAX_BSPLINE_VOLUMES];
+
+static int n_bspline_volumes = 0;
+
+/* replace the n samples of c[] by their cubic B-spline coefficients
+   (Unser's recursive filter, mirror boundaries), so that the B-spline
+   goes through the samples */
+
+static void bspline_prefilter_line(double c[], int n)
+{
+  double z, zn, z2n, iz, sum;
+  int    k, horizon;
+
+  if (n < 2)
+    return;
+
+  z = BSPLINE_POLE;
+
+  for(k=0; k<n; k++)
+    c[k] *= (1.0 - z) * (1.0 - 1.0/z);
+
+                                /* causal initialization */
+  horizon = (int)ceil(log(BSPLINE_TOLERANCE) / log(fabs(z)));
+  if (horizon < n) {
+    zn  = z;
+    sum = c[0];
+    for(k=1; k<horizon; k++) {
+      sum += zn * c[k];
+      zn  *= z;
+    }
+    c[0] = sum;
+  }
+  else {
+    zn  = z;
+    iz  = 1.0 / z;
+    z2n = pow(z, (double)(n-1));
+    sum = c[0] + z2n * c[n-1];
+    z2n *= z2n * iz;
+    for(k=1; k<=n-2; k++) {
+      sum += (zn + z2n) * c[k];
+      zn  *= z;
+      z2n *= iz;
+    }
+    c[0] = sum / (1.0 - zn * zn);
+  }
+
+  for(k=1; k<n; k++)
+    c[k] += z * c[k-1];
+
+                                /* anti-causal initialization */
+  c[n-1] = (z / (z * z - 1.0)) * (z * c[n-2] + c[n-1]);
+
+  for(k=n-2; k>=0; k--)
+    c[k] = z * (c[k+1] - c[k]);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : prefilter_bspline_volume
+@INPUT      : volume - pointer to volume data
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: compute the cubic B-spline coefficients of the real values
+              of volume, for bspline_interpolant().  The coefficients are
+              kept (in double precision, as much memory as an NC_DOUBLE
+              copy of the volume) until delete_bspline_coefficients() is
+              called for the same volume; the volume itself is unchanged.
+@METHOD     : the prefilter is separable: it is applied along each line
+              of each axis in turn.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+void prefilter_bspline_volume(VIO_Volume volume)
+{
+  double ***c, *line;
+  int    sizes[VIO_MAX_DIMENSIONS], i, j, k;
+
+  for(i=0; i<n_bspline_volumes; i++)
+    if (bspline_volumes[i].volume == volume)
+      return;
+
+  if (n_bspline_volumes == MAX_BSPLINE_VOLUMES) {
+    print_error_and_line_num("Too many volumes with B-spline coefficients\n",
+                             __FILE__, __LINE__);
+    return;
+  }
+
+  get_volume_sizes(volume, sizes);
+
+  VIO_ALLOC3D(c, sizes[0], sizes[1], sizes[2]);
+
+  for(i=0; i<sizes[0]; i++)
+    for(j=0; j<sizes[1]; j++) {
+      for(k=0; k<sizes[2]; k++)
+        GET_VALUE_3D( c[i][j][k], volume, i, j, k );
+      bspline_prefilter_line(c[i][j], sizes[2]);
+    }
+
+  ALLOC(line, MAX(sizes[0], sizes[1]));
+
+  for(i=0; i<sizes[0]; i++)
+    for(k=0; k<sizes[2]; k++) {
+      for(j=0; j<sizes[1]; j++) line[j] = c[i][j][k];
+      bspline_prefilter_line(line, sizes[1]);
+      for(j=0; j<sizes[1]; j++) c[i][j][k] = line[j];
+    }
+
+  for(j=0; j<sizes[1]; j++)
+    for(k=0; k<sizes[2]; k++) {
+      for(i=0; i<sizes[0]; i++) line[i] = c[i][j][k];
+      bspline_prefilter_line(line, sizes[0]);
+      for(i=0; i<sizes[0]; i++) c[i][j][k] = line[i];
+    }
+
+  FREE(line);
+
+  bspline_volumes[n_bspline_volumes].volume       = volume;
+  bspline_volumes[n_bspline_volumes].coefficients = c;
+  n_bspline_volumes++;
+}
+
+void delete_bspline_coefficients(VIO_Volume volume)
+{
+  int i;
+
+  for(i=0; i<n_bspline_volumes; i++)
+    if (bspline_volumes[i].volume == volume) {
+      VIO_FREE3D(bspline_volumes[i].coefficients);
+      n_bspline_volumes--;
+      bspline_volumes[i] = bspline_volumes[n_bspline_volumes];
+      return;
+    }
+}
+
+/* the index of voxel i of an axis of n voxels, mirrored at both ends */
+
+inline static long mirror_index(long i, long n)
+{
+  if (i < 0)   i = -i;
+  if (i >= n)  i = 2*(n-1) - i;
+  return( MAX(0, MIN(i, n-1)) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : bspline_interpolant
+@INPUT      : volume - pointer to volume data
+              coord - point at which volume should be interpolated in voxel 
+                 units (with 0 being first point of the volume).
+@OUTPUT     : result - interpolated TRUE value.
+@RETURNS    : TRUE if coord is within the volume, FALSE otherwise.
+@DESCRIPTION: Routine to interpolate a volume at a point with the cubic
+              B-spline of its coefficients (see prefilter_bspline_volume()).
+              Unlike tricubic_interpolant(), it is smooth (C2) and does
+              not fall back on trilinear interpolation near the edges,
+              where the coefficients are mirrored.  Outside the volume, it
+              gives the nearest neighbour, as the other interpolants.  A
+              volume without coefficients is interpolated with
+              tricubic_interpolant().
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct 18, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+int bspline_interpolant(VIO_Volume volume, 
+                        PointR *coord, double *result)
+{
+  long ind0, ind1, ind2, max[3];
+  long index[VOL_NDIMS][4];
+  double w[VOL_NDIMS][4];
+  double ***c;
+  int sizes[3];
+  int i;
+
+  c = NULL;
+  for(i=0; i<n_bspline_volumes; i++)
+    if (bspline_volumes[i].volume == volume)
+      c = bspline_volumes[i].coefficients;
+
+  if (c == NULL)
+    return( tricubic_interpolant(volume, coord, result) );
+
+  get_volume_sizes(volume, sizes);
+  max[0] = sizes[0];
+  max[1] = sizes[1];
+  max[2] = sizes[2];
+   
+  if ((Point_x( *coord ) < 0) || (Point_x( *coord ) >= max[0]-1) ||
+      (Point_y( *coord ) < 0) || (Point_y( *coord ) >= max[1]-1) ||
+      (Point_z( *coord ) < 0) || (Point_z( *coord ) >= max[2]-1)) {
+
+    return( nearest_neighbour_interpolant(volume, coord, result) );
+  }
+
+  ind0 = (long) floor(Point_x( *coord ));
+  ind1 = (long) floor(Point_y( *coord ));
+  ind2 = (long) floor(Point_z( *coord ));
+
+  bspline_weights(Point_x( *coord ) - ind0, w[0]);
+  bspline_weights(Point_y( *coord ) - ind1, w[1]);
+  bspline_weights(Point_z( *coord ) - ind2, w[2]);
+
+  for(i=0; i<4; i++) {
+    index[0][i] = mirror_index(ind0 - 1 + i, max[0]);
+    index[1][i] = mirror_index(ind1 - 1 + i, max[1]);
+    index[2][i] = mirror_index(ind2 - 1 + i, max[2]);
+  }
+
+  *result = separable_cubic_sum(c, index[0], index[1], index[2], w);
+
+  return TRUE;
+}
+
+
 /* A point is not masked if it is a point we should consider.
    If the mask volume is NULL, we consider all points.
    Otherwise, consider a point if the mask volume value is > 0.
+   The bitmap of the mask is read when it has one (see mask_spans.c).
 */
 int point_not_masked( VIO_Volume volume, 
                              VIO_Real wx, VIO_Real wy, VIO_Real wz)
 {
     double result;
     PointR coord;
+    VIO_BOOL not_masked;
 
     if ( volume == NULL )
         return TRUE;
@@ -384,6 +746,10 @@ int point_not_masked( VIO_Volume volume,
     convert_3D_world_to_voxel( volume, wx, wy, wz, 
                                &Point_x(coord), &Point_y(coord), &Point_z(coord) );
     
+    if ( get_mask_voxel(volume, Point_x(coord), Point_y(coord), Point_z(coord),
+                        &not_masked) )
+        return not_masked;
+
     /* interpolation returns TRUE iff coordinate is inside volume */
     if ( nearest_neighbour_interpolant(volume,&coord,&result) ) {
         return (result > 0.0);
@@ -398,10 +764,14 @@ int voxel_point_not_masked( VIO_Volume volume,
 {
     double result;
     PointR coord;
+    VIO_BOOL not_masked;
   
     if ( volume == NULL )
         return TRUE;
 
+    if ( get_mask_voxel(volume, vx, vy, vz, &not_masked) )
+        return not_masked;
+
     fill_Point(coord, vx, vy, vz);
     
     if ( nearest_neighbour_interpolant(volume,&coord,&result) ) {
@@ -0,0 +1,415 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mask_spans.c
+@DESCRIPTION: run-length spans and bitmaps of the mask volumes.
+
+              A node of a lattice is used if the nearest voxel of the
+              mask has a value > 0 (see point_not_masked() and
+              voxel_point_not_masked() in interpolation.c).  The masks
+              are read once but tested at every node of every lattice,
+              for every evaluation of the objective function.
+
+              make_mask_spans(), called once a mask is loaded, keeps
+
+                - a bitmap of the mask, one bit per voxel, which
+                  get_mask_voxel() reads for the tests at random
+                  points (the warped nodes of do_nonlinear.c, the
+                  target nodes of the objective functions), and
+
+                - for each row of the mask along its last (fastest)
+                  voxel axis, the spans of voxels > 0, and the bounding
+                  box of all of them.  get_mask_row() turns these into
+                  the runs of nodes of a lattice row that can fall
+                  inside the mask, so that the lattice loops skip the
+                  nodes outside of them without testing them.
+
+              The runs are a superset of the nodes inside the mask (they
+              are padded by one node on each side), and the nodes inside
+              the runs are still tested one by one, so the nodes that are
+              used do not change.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <limits.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "mask_spans.h"
+
+                                /* the masks with spans: few, and only
+                                   changed between fits, outside of the
+                                   threads of the objective functions */
+#define MAX_MASK_SPANS 16
+
+typedef struct {
+  VIO_Volume   volume;
+  int          sizes[3];
+  unsigned int *bits;           /* voxel (i,j,k) is bit
+                                   (i*sizes[1]+j)*sizes[2]+k           */
+  int          *row_first;      /* the spans of row (i,j) are
+                                   spans[row_first[i*sizes[1]+j]] up
+                                   to spans[row_first[i*sizes[1]+j+1]] */
+  int          (*spans)[2];     /* voxels k=spans[][0] .. spans[][1]-1 */
+  VIO_BOOL     empty;           /* no voxel > 0                        */
+  int          lo[3], hi[3];    /* bounding box of the voxels > 0      */
+} Mask_Spans;
+
+static Mask_Spans mask_spans[MAX_MASK_SPANS];
+static int        n_mask_spans = 0;
+
+static Mask_Spans *find_mask_spans(VIO_Volume volume)
+{
+  int i;
+
+  for(i=0; i<n_mask_spans; i++)
+    if (mask_spans[i].volume == volume)
+      return(&mask_spans[i]);
+
+  return(NULL);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : make_mask_spans
+@INPUT      : mask - a 3D mask volume
+@OUTPUT     :
+@RETURNS    : TRUE if the spans and bitmap of mask were made (or already
+              existed), FALSE if mask is tested voxel by voxel, as before
+@DESCRIPTION: the spans and bitmap are a copy: they have to be made again
+              (after delete_mask_spans()) if the voxels of mask are
+              changed, and delete_mask_spans() has to be called before
+              mask is deleted.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL make_mask_spans(VIO_Volume mask)
+{
+  Mask_Spans *spans;
+  VIO_Real   value;
+  double     n_voxels;
+  long       bit, n_words;
+  int        sizes[3], i, j, k, n_spans, max_spans, in_span;
+
+  if (mask == NULL)
+    return(FALSE);
+
+  if (find_mask_spans(mask) != NULL)
+    return(TRUE);
+
+  if (n_mask_spans >= MAX_MASK_SPANS ||
+      get_volume_n_dimensions(mask) != 3)
+    return(FALSE);
+
+  get_volume_sizes(mask, sizes);
+
+  n_voxels = (double)sizes[0] * sizes[1] * sizes[2];
+  if (n_voxels <= 0.0 || n_voxels >= (double)LONG_MAX)
+    return(FALSE);
+
+  spans = &mask_spans[n_mask_spans];
+
+  spans->volume = mask;
+  for(i=0; i<3; i++) {
+    spans->sizes[i] = sizes[i];
+    spans->lo[i]    = sizes[i];
+    spans->hi[i]    = -1;
+  }
+
+  n_words = ((long)n_voxels + 31) / 32;
+  ALLOC(spans->bits, n_words);
+  for(bit=0; bit<n_words; bit++)
+    spans->bits[bit] = 0;
+
+  ALLOC(spans->row_first, sizes[0]*sizes[1] + 1);
+
+  max_spans = sizes[0]*sizes[1] + 1;
+  ALLOC(spans->spans, max_spans);
+
+  n_spans = 0;
+  bit     = 0;
+
+  for(i=0; i<sizes[0]; i++) {
+    for(j=0; j<sizes[1]; j++) {
+
+      spans->row_first[i*sizes[1]+j] = n_spans;
+      in_span = FALSE;
+
+      for(k=0; k<sizes[2]; k++, bit++) {
+
+        GET_VALUE_3D( value, mask, i, j, k );
+
+        if (value > 0.0) {
+
+          spans->bits[bit >> 5] |= 1U << (bit & 31);
+
+          if (!in_span) {
+            if (n_spans >= max_spans) {
+              max_spans *= 2;
+              REALLOC(spans->spans, max_spans);
+            }
+            spans->spans[n_spans][0] = k;
+            in_span = TRUE;
+          }
+
+          if (i < spans->lo[0]) spans->lo[0] = i;
+          if (i > spans->hi[0]) spans->hi[0] = i;
+          if (j < spans->lo[1]) spans->lo[1] = j;
+          if (j > spans->hi[1]) spans->hi[1] = j;
+          if (k < spans->lo[2]) spans->lo[2] = k;
+          if (k > spans->hi[2]) spans->hi[2] = k;
+        }
+        else if (in_span) {
+          spans->spans[n_spans++][1] = k;
+          in_span = FALSE;
+        }
+      }
+
+      if (in_span)
+        spans->spans[n_spans++][1] = sizes[2];
+    }
+  }
+
+  spans->row_first[sizes[0]*sizes[1]] = n_spans;
+  spans->empty = (n_spans == 0);
+
+  n_mask_spans++;
+
+  return(TRUE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_mask_spans
+@INPUT      : mask
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: free the spans and bitmap of mask, if it has some.  The
+              mask is then tested voxel by voxel again.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void delete_mask_spans(VIO_Volume mask)
+{
+  Mask_Spans *spans;
+
+  if (mask == NULL || (spans = find_mask_spans(mask)) == NULL)
+    return;
+
+  FREE(spans->bits);
+  FREE(spans->row_first);
+  FREE(spans->spans);
+
+  *spans = mask_spans[--n_mask_spans];
+}
+
+/* the voxel nearest to v along an axis of n voxels, or -1 when v is
+   outside of the volume (as nearest_neighbour_interpolant() sees it) */
+
+inline static long nearest_voxel(VIO_Real v, int n)
+{
+  if (v < -0.5 || v >= n - 0.5)
+    return(-1);
+
+  return((long) floor(v + 0.5));
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_mask_voxel
+@INPUT      : mask       - a mask volume
+              vx,vy,vz   - a point, in voxel coordinates of mask
+@OUTPUT     : not_masked - TRUE if the voxel nearest to the point is
+                           inside the volume and > 0
+@RETURNS    : TRUE if not_masked was read from the bitmap of mask, FALSE
+              if mask has none (not_masked is then unchanged)
+@DESCRIPTION: for point_not_masked() and voxel_point_not_masked().
+              Returns FALSE at once when no mask has a bitmap.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_mask_voxel(VIO_Volume mask,
+                        VIO_Real vx, VIO_Real vy, VIO_Real vz,
+                        VIO_BOOL *not_masked)
+{
+  Mask_Spans *spans;
+  long       i, j, k, bit;
+
+  if (n_mask_spans == 0 || (spans = find_mask_spans(mask)) == NULL)
+    return(FALSE);
+
+  i = nearest_voxel(vx, spans->sizes[0]);
+  j = nearest_voxel(vy, spans->sizes[1]);
+  k = nearest_voxel(vz, spans->sizes[2]);
+
+  if (i < 0 || j < 0 || k < 0) {
+    *not_masked = FALSE;
+    return(TRUE);
+  }
+
+  bit = (i * spans->sizes[1] + j) * spans->sizes[2] + k;
+
+  *not_masked = (spans->bits[bit >> 5] >> (bit & 31)) & 1;
+
+  return(TRUE);
+}
+
+/* the nodes c (real, unclipped) for which v0 + c*dv is in [lo,hi),
+   with dv != 0 */
+
+static void nodes_between(VIO_Real v0, VIO_Real dv, VIO_Real lo, VIO_Real hi,
+                          VIO_Real *first, VIO_Real *last)
+{
+  if (dv > 0.0) {
+    *first = (lo - v0) / dv;
+    *last  = (hi - v0) / dv;
+  }
+  else {
+    *first = (hi - v0) / dv;
+    *last  = (lo - v0) / dv;
+  }
+}
+
+/* clip the nodes [*first,*last) to the (real) nodes [c0,c1), padded
+   by a node on each side */
+
+static void clip_nodes(VIO_Real c0, VIO_Real c1, int *first, int *last)
+{
+  if (c0 - 1.0 > *first)
+    *first = (c0 - 1.0 >= *last) ? *last : (int) floor(c0 - 1.0);
+
+  if (c1 + 1.0 < *last)
+    *last = (c1 + 1.0 <= *first) ? *first : (int) ceil(c1 + 1.0);
+}
+
+static void add_row_run(Mask_Row *row, int first, int last)
+{
+  if (first >= last)
+    return;
+
+  if (row->n_runs > 0 && first <= row->run[row->n_runs-1][1]) {
+    if (last > row->run[row->n_runs-1][1])
+      row->run[row->n_runs-1][1] = last;
+  }
+  else if (row->n_runs == MAX_MASK_ROW_RUNS)
+    row->run[row->n_runs-1][1] = last;
+  else {
+    row->run[row->n_runs][0] = first;
+    row->run[row->n_runs][1] = last;
+    row->n_runs++;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_mask_row
+@INPUT      : mask  - a mask volume, or NULL
+              world - TRUE if start and step are in world coordinates,
+                      FALSE if they are in voxel coordinates of mask
+              start - the first node of a lattice row
+              step  - from one node of the row to the next
+              n     - number of nodes in the row
+@OUTPUT     : row   - the runs of nodes (in increasing order) that may be
+                      inside the mask; the nodes outside of all runs are
+                      outside the mask
+@RETURNS    :
+@DESCRIPTION: a row that misses the bounding box of the mask has no run.
+              When the row runs along the last voxel axis of the mask (it
+              stays in a single row of mask voxels), its runs are the
+              spans of that row; otherwise it has a single run, the part
+              of the row inside the bounding box.
+
+              Without a mask, or for a mask without spans, the row has a
+              single run of all its nodes.  Use node_in_mask_row() to
+              walk the nodes of the row.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void get_mask_row(VIO_Volume mask, VIO_BOOL world,
+                  PointR *start, VectorR *step, int n,
+                  Mask_Row *row)
+{
+  Mask_Spans *spans;
+  VIO_Real   v0[3], v1[3], dv[3], c0, c1;
+  long       ind[2][2];
+  int        first, last, a, s, s_first, s_last;
+
+  row->current   = 0;
+  row->n_runs    = 1;
+  row->run[0][0] = 0;
+  row->run[0][1] = n;
+
+  if (mask == NULL || n_mask_spans == 0 ||
+      (spans = find_mask_spans(mask)) == NULL)
+    return;
+
+  row->n_runs = 0;
+
+  if (spans->empty || n <= 0)
+    return;
+
+  if (world) {
+    convert_3D_world_to_voxel(mask, Point_x(*start), Point_y(*start), Point_z(*start),
+                              &v0[0], &v0[1], &v0[2]);
+    convert_3D_world_to_voxel(mask,
+                              Point_x(*start) + Point_x(*step),
+                              Point_y(*start) + Point_y(*step),
+                              Point_z(*start) + Point_z(*step),
+                              &v1[0], &v1[1], &v1[2]);
+    for(a=0; a<3; a++)
+      dv[a] = v1[a] - v0[a];
+  }
+  else {
+    v0[0] = Point_x(*start); dv[0] = Point_x(*step);
+    v0[1] = Point_y(*start); dv[1] = Point_y(*step);
+    v0[2] = Point_z(*start); dv[2] = Point_z(*step);
+  }
+
+                                /* the part of the row in the bounding
+                                   box of the mask */
+  first = 0;
+  last  = n;
+
+  for(a=0; a<3 && first<last; a++) {
+    if (dv[a] == 0.0) {
+      if (v0[a] < spans->lo[a] - 0.5 - 1e-6 || v0[a] >= spans->hi[a] + 0.5 + 1e-6)
+        last = first;
+    }
+    else {
+      nodes_between(v0[a], dv[a], spans->lo[a] - 0.5, spans->hi[a] + 0.5, &c0, &c1);
+      clip_nodes(c0, c1, &first, &last);
+    }
+  }
+
+  if (first >= last)
+    return;
+
+                                /* does the row stay in one row of
+                                   mask voxels? */
+  for(a=0; a<2; a++) {
+    ind[a][0] = (long) floor(v0[a] + first*dv[a] - 1e-6 + 0.5);
+    ind[a][1] = (long) floor(v0[a] + (last-1)*dv[a] + 1e-6 + 0.5);
+    if (ind[a][1] < ind[a][0]) {
+      ind[a][0] = (long) floor(v0[a] + (last-1)*dv[a] - 1e-6 + 0.5);
+      ind[a][1] = (long) floor(v0[a] + first*dv[a] + 1e-6 + 0.5);
+    }
+  }
+
+  if (ind[0][0] != ind[0][1] || ind[1][0] != ind[1][1] ||
+      ind[0][0] < 0 || ind[0][0] >= spans->sizes[0] ||
+      ind[1][0] < 0 || ind[1][0] >= spans->sizes[1] ||
+      dv[2] == 0.0) {
+    add_row_run(row, first, last);
+    return;
+  }
+
+  s_first = spans->row_first[ind[0][0]*spans->sizes[1] + ind[1][0]];
+  s_last  = spans->row_first[ind[0][0]*spans->sizes[1] + ind[1][0] + 1];
+
+  for(s=0; s<s_last-s_first; s++) {
+    a = (dv[2] > 0.0) ? s_first + s : s_last - 1 - s;
+
+    nodes_between(v0[2], dv[2], spans->spans[a][0] - 0.5, spans->spans[a][1] - 0.5, &c0, &c1);
+
+    c0 = (c0 - 1.0 > first) ? floor(c0 - 1.0) : first;
+    c1 = (c1 + 1.0 < last)  ? ceil(c1 + 1.0)  : last;
+
+    if (c0 < c1)
+      add_row_run(row, (int) c0, (int) c1);
+  }
+}
@@ -0,0 +1,213 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : pyramid_volumes.c
+@DESCRIPTION: build the blurred and subsampled volumes used at each level
+              of a multi-resolution nonlinear fit (see
+              Optimize/nonlinear_pyramid.c), directly in memory.
+
+              The blurring is a separable gaussian, applied along each
+              voxel axis in turn.  Only the voxels kept by the subsampling
+              are computed, so each pass works on a volume that is already
+              smaller along the axes done before it.  Near the edges of the
+              volume the kernel is truncated and renormalized, so that the
+              intensities there are not pulled towards zero.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "pyramid_volumes.h"
+
+                                /* FWHM = FWHM_TO_SIGMA * sigma */
+#define FWHM_TO_SIGMA 2.35482004503
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_pyramid_subsampling
+@INPUT      : volume - the full resolution volume
+              fwhm   - width (mm) of the blurring kernel of the level
+@OUTPUT     : factor - subsampling factor along each voxel axis of volume
+@RETURNS    :
+@DESCRIPTION: keep PYRAMID_SAMPLES_PER_FWHM voxels per FWHM, never fewer
+              voxels than in the original volume.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void get_pyramid_subsampling(VIO_Volume volume, VIO_Real fwhm, int factor[])
+{
+  VIO_Real separations[VIO_MAX_DIMENSIONS];
+  int      i;
+
+  get_volume_separations(volume, separations);
+
+  for(i=0; i<VIO_N_DIMENSIONS; i++) {
+    factor[i] = (int)(fwhm / (PYRAMID_SAMPLES_PER_FWHM * fabs(separations[i])));
+    if (factor[i] < 1)
+      factor[i] = 1;
+  }
+}
+
+/* blur line[0..n-1] with kernel[-half..half] and keep every factor'th
+   sample, starting with the first, in result[] */
+
+static void blur_and_subsample_line(double line[], int n,
+                                    double kernel[], int half,
+                                    int factor,
+                                    double result[], int n_result)
+{
+  double sum, weight;
+  int    i, t, center, first, last;
+
+  for(i=0; i<n_result; i++) {
+    center = i * factor;
+    first  = MAX(center - half, 0);
+    last   = MIN(center + half, n-1);
+
+    sum = weight = 0.0;
+    for(t=first; t<=last; t++) {
+      sum    += kernel[t-center] * line[t];
+      weight += kernel[t-center];
+    }
+    result[i] = sum / weight;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : make_pyramid_volume
+@INPUT      : volume - the full resolution volume
+              fwhm   - width (mm) of the gaussian blurring kernel, <= 0 to
+                       only subsample the volume (as done for masks)
+              factor - subsampling factor along each voxel axis
+@OUTPUT     :
+@RETURNS    : a new volume, of the same type as volume, where voxel
+              [i][j][k] is the blurred value of voxel
+              [i*factor[0]][j*factor[1]][k*factor[2]] of volume, and lies
+              at the same world position.
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_Volume make_pyramid_volume(VIO_Volume volume, VIO_Real fwhm, int factor[])
+{
+  VIO_Volume
+    result;
+  VIO_Real
+    separations[VIO_MAX_DIMENSIONS],
+    voxel[VIO_MAX_DIMENSIONS],
+    world[VIO_N_DIMENSIONS],
+    sigma, value;
+  double
+    *pass[VIO_N_DIMENSIONS+1],
+    *kernels[VIO_N_DIMENSIONS],
+    *line, *blurred;
+  int
+    sizes[VIO_MAX_DIMENSIONS],
+    new_sizes[VIO_MAX_DIMENSIONS],
+    stride[VIO_N_DIMENSIONS],
+    new_stride[VIO_N_DIMENSIONS],
+    half[VIO_N_DIMENSIONS],
+    axis, other1, other2, i, j, k, t, longest;
+
+  get_volume_sizes(volume, sizes);
+  get_volume_separations(volume, separations);
+
+  for(i=0; i<VIO_MAX_DIMENSIONS; i++)
+    voxel[i] = 0.0;
+  convert_voxel_to_world(volume, voxel, &world[0], &world[1], &world[2]);
+
+                                /* one gaussian per axis, in voxels of
+                                   the original volume */
+  for(axis=0; axis<VIO_N_DIMENSIONS; axis++) {
+    sigma = (fwhm / FWHM_TO_SIGMA) / fabs(separations[axis]);
+    half[axis] = (fwhm > 0.0) ? (int)ceil(3.0 * sigma) : 0;
+
+    ALLOC(kernels[axis], 2*half[axis]+1);
+    for(t=-half[axis]; t<=half[axis]; t++)
+      kernels[axis][t+half[axis]] = (half[axis] > 0) ? exp(-0.5 * SQR(t/sigma)) : 1.0;
+  }
+
+  longest = 0;
+  for(axis=0; axis<VIO_N_DIMENSIONS; axis++) {
+    new_sizes[axis]    = (sizes[axis] - 1) / factor[axis] + 1;
+    separations[axis] *= factor[axis];
+    if (sizes[axis] > longest) longest = sizes[axis];
+  }
+
+                                /* same header, fewer and larger voxels,
+                                   with voxel 0 left where it was */
+  result = copy_volume_definition_no_alloc(volume, NC_UNSPECIFIED, FALSE, 0.0, 0.0);
+  set_volume_sizes(result, new_sizes);
+  set_volume_separations(result, separations);
+  set_volume_translation(result, voxel, world);
+  alloc_volume_data(result);
+
+                                /* pass[axis] holds the volume blurred and
+                                   subsampled along the axes before axis,
+                                   as a flat array in voxel order */
+  for(axis=0; axis<=VIO_N_DIMENSIONS; axis++) {
+    for(i=0; i<VIO_N_DIMENSIONS; i++)
+      new_sizes[i] = (i < axis) ? (sizes[i] - 1) / factor[i] + 1 : sizes[i];
+    ALLOC(pass[axis], (size_t)new_sizes[0] * new_sizes[1] * new_sizes[2]);
+  }
+
+  for(i=0; i<sizes[0]; i++)
+    for(j=0; j<sizes[1]; j++)
+      for(k=0; k<sizes[2]; k++) {
+        GET_VOXEL_3D(value, volume, i, j, k);
+        pass[0][((size_t)i*sizes[1] + j)*sizes[2] + k] = value;
+      }
+
+  ALLOC(line, longest);
+  ALLOC(blurred, longest);
+
+  for(axis=0; axis<VIO_N_DIMENSIONS; axis++) {
+
+    for(i=0; i<VIO_N_DIMENSIONS; i++)
+      new_sizes[i] = (i < axis) ? (sizes[i] - 1) / factor[i] + 1 : sizes[i];
+
+    stride[2] = 1;
+    stride[1] = new_sizes[2];
+    stride[0] = new_sizes[1] * new_sizes[2];
+
+                                /* the next pass has fewer voxels along
+                                   this axis only */
+    new_sizes[axis] = (sizes[axis] - 1) / factor[axis] + 1;
+
+    new_stride[2] = 1;
+    new_stride[1] = new_sizes[2];
+    new_stride[0] = new_sizes[1] * new_sizes[2];
+
+    other1 = (axis+1) % VIO_N_DIMENSIONS;
+    other2 = (axis+2) % VIO_N_DIMENSIONS;
+
+    for(i=0; i<new_sizes[other1]; i++)
+      for(j=0; j<new_sizes[other2]; j++) {
+
+        for(t=0; t<sizes[axis]; t++)
+          line[t] = pass[axis][(size_t)i*stride[other1] + j*stride[other2] + t*stride[axis]];
+
+        blur_and_subsample_line(line, sizes[axis],
+                                &kernels[axis][half[axis]], half[axis],
+                                factor[axis], blurred, new_sizes[axis]);
+
+        for(t=0; t<new_sizes[axis]; t++)
+          pass[axis+1][(size_t)i*new_stride[other1] + j*new_stride[other2] + t*new_stride[axis]] = blurred[t];
+      }
+  }
+
+  for(i=0; i<new_sizes[0]; i++)
+    for(j=0; j<new_sizes[1]; j++)
+      for(k=0; k<new_sizes[2]; k++) {
+        value = pass[VIO_N_DIMENSIONS][((size_t)i*new_sizes[1] + j)*new_sizes[2] + k];
+        SET_VOXEL_3D(result, i, j, k, value);
+      }
+
+  FREE(line);
+  FREE(blurred);
+  for(axis=0; axis<=VIO_N_DIMENSIONS; axis++)
+    FREE(pass[axis]);
+  for(axis=0; axis<VIO_N_DIMENSIONS; axis++)
+    FREE(kernels[axis]);
+
+  return(result);
+}
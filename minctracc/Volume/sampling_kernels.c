@@ -0,0 +1,535 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : sampling_kernels.c
+@DESCRIPTION: the inner interpolation loops used to sample the target
+              volume at the nodes of a (displaced) sub-lattice, see
+              go_get_samples_with_offset() in Optimize/sub_lattice.c.
+
+              The caller passes a compact list of n voxel coordinates
+              (0-indexed, only the nodes that are to be used) and gets
+              back the n interpolated values.  Nodes that fall outside
+              the volume get a sample of 0.0, as they always have.
+              trilinear_samples_at_points() does the same for points
+              given in double precision, as used by
+              xcorr_objective_with_def() in Optimize/deform_support.c.
+
+              On x86 CPUs with AVX2, the trilinear kernel handles four
+              nodes at a time, gathering the eight corners of each node
+              straight from the (contiguous) voxel array of the volume.
+              This kernel is always compiled (with gcc or clang), for
+              AVX2 only, and chosen at run time when the CPU has AVX2
+              (see vectorized_sampling_available()); other CPUs run the
+              scalar kernel.  The arithmetic is done in double precision
+              in the same order as the scalar code, so both kernels
+              return the same values.
+
+              The volumes may hold double, float (-float_volumes) or
+              signed short (-short_volumes) voxels, see get_voxel_array().
+              The kernels of each type are generated from
+              sampling_kernels_type.c; the arithmetic stays in double
+              precision whatever the type of the voxels.
+
+              With -bricked_volumes, make_bricked_volume() keeps a copy of
+              the voxels of a volume in bricks of 8x8x8 voxels, each one
+              contiguous in memory, and the kernels (and the trilinear
+              interpolant, through get_bricked_neighbours()) read this
+              copy instead.  The 8 neighbours of a point are then in at
+              most 8 bricks, usually one, instead of being spread over
+              two slices of the volume, and the nodes of a rotated
+              lattice that are close in space are also close in memory.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#include <config.h>
+#include <limits.h>
+#include <string.h>
+#include <volume_io.h>
+#include <Proglib.h>
+#include "sampling_kernels.h"
+
+                                /* the AVX2 kernel, compiled for AVX2
+                                   whatever the flags of the rest of the
+                                   build (define MNI_AUTOREG_NO_AVX2 to
+                                   leave it out)                       */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(MNI_AUTOREG_NO_AVX2)
+#define HAVE_AVX2_KERNEL
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : vectorized_sampling_available
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : TRUE if the AVX2 kernel was compiled in and this CPU has
+              AVX2, FALSE otherwise
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL vectorized_sampling_available(void)
+{
+#if defined(HAVE_AVX2_KERNEL)
+  __builtin_cpu_init();
+  return(__builtin_cpu_supports("avx2") ? TRUE : FALSE);
+#else
+  return(FALSE);
+#endif
+}
+
+                                /* the volumes with bricks: few, and only
+                                   changed between fits, outside of the
+                                   threads of the objective functions */
+#define MAX_BRICKED_VOLUMES 16
+
+typedef struct {
+  VIO_Volume  volume;
+  void        *block;           /* as allocated; voxels.bricks is aligned
+                                   on a cache line within it */
+  Voxel_Array voxels;
+} Bricked_Volume;
+
+static Bricked_Volume bricked_volumes[MAX_BRICKED_VOLUMES];
+static int            n_bricked_volumes = 0;
+
+static Bricked_Volume *find_bricked_volume(VIO_Volume volume)
+{
+  int i;
+
+  for(i=0; i<n_bricked_volumes; i++)
+    if (bricked_volumes[i].volume == volume)
+      return(&bricked_volumes[i]);
+
+  return(NULL);
+}
+
+static void set_voxel_bricks(VIO_Volume volume, Voxel_Array *voxels)
+{
+  Bricked_Volume *bricked;
+
+  bricked = (n_bricked_volumes > 0) ? find_bricked_volume(volume) : NULL;
+
+  if (bricked == NULL) {
+    voxels->bricks = NULL;
+    voxels->brick_strides[0] = voxels->brick_strides[1] = voxels->brick_strides[2] = 0;
+  }
+  else {
+    voxels->bricks = bricked->voxels.bricks;
+    voxels->brick_strides[0] = bricked->voxels.brick_strides[0];
+    voxels->brick_strides[1] = bricked->voxels.brick_strides[1];
+    voxels->brick_strides[2] = bricked->voxels.brick_strides[2];
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_voxel_array
+@INPUT      : volume     - a 3D volume
+@OUTPUT     : voxels     - its voxel array, dimensions and the conversion
+                           of voxel values to real values, and its bricks
+                           if make_bricked_volume() was called for it
+@RETURNS    : TRUE if the kernels can sample the volume, FALSE if its
+              voxels are of another type or are not in memory
+@DESCRIPTION:
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_voxel_array(VIO_Volume volume, Voxel_Array *voxels)
+{
+  VIO_Real zero, one;
+
+  if (get_volume_n_dimensions(volume) != 3 ||
+      volume_is_cached(volume) ||
+      VOXEL_DATA(volume) == NULL)
+    return(FALSE);
+
+  voxels->type = get_volume_data_type(volume);
+
+  if (voxels->type != VIO_DOUBLE &&
+      voxels->type != VIO_FLOAT &&
+      voxels->type != VIO_SIGNED_SHORT)
+    return(FALSE);
+
+  voxels->data = VOXEL_DATA(volume);
+  get_volume_sizes(volume, voxels->sizes);
+
+  zero = CONVERT_VOXEL_TO_VALUE(volume, 0.0);
+  one  = CONVERT_VOXEL_TO_VALUE(volume, 1.0);
+
+  voxels->value_scale       = one - zero;
+  voxels->value_translation = zero;
+
+  set_voxel_bricks(volume, voxels);
+
+  return(TRUE);
+}
+
+/* the position of voxel index along axis in the bricks: the voxel
+   (i,j,k) is at brick_offset(0,i) + brick_offset(1,j) + brick_offset(2,k) */
+
+inline static long brick_offset(Voxel_Array *voxels, int axis, int index)
+{
+  return( (index >> BRICK_BITS) * voxels->brick_strides[axis] +
+          ((long)(index & (BRICK_SIZE-1)) << ((2-axis) * BRICK_BITS)) );
+}
+
+#if defined(HAVE_AVX2_KERNEL)
+
+/* the constants of the four-node kernel for one volume */
+
+typedef struct {
+  __m256d one, zero;
+  __m256d value_scale, value_translation;
+  __m128i minus_one;
+  __m128i limit0, limit1, limit2, stride0, stride1, stride2;
+  __m128i step0, step1, step2;  /* stride * offset                   */
+  __m128i offset0, offset1, offset2;
+  VIO_BOOL bricked;
+} Avx2_Lattice;
+
+AVX2_FUNCTION static void init_avx2_lattice(Avx2_Lattice *lattice, Voxel_Array *voxels, int offsets[])
+{
+  int *sizes;
+
+  sizes = voxels->sizes;
+
+  lattice->one               = _mm256_set1_pd(1.0);
+  lattice->zero              = _mm256_setzero_pd();
+  lattice->value_scale       = _mm256_set1_pd(voxels->value_scale);
+  lattice->value_translation = _mm256_set1_pd(voxels->value_translation);
+  lattice->minus_one = _mm_set1_epi32(-1);
+  lattice->limit0    = _mm_set1_epi32(sizes[0] - offsets[0]);
+  lattice->limit1    = _mm_set1_epi32(sizes[1] - offsets[1]);
+  lattice->limit2    = _mm_set1_epi32(sizes[2] - offsets[2]);
+  lattice->offset0   = _mm_set1_epi32(offsets[0]);
+  lattice->offset1   = _mm_set1_epi32(offsets[1]);
+  lattice->offset2   = _mm_set1_epi32(offsets[2]);
+  lattice->bricked   = (voxels->bricks != NULL);
+
+  if (lattice->bricked) {       /* between bricks, see brick_offset() */
+    lattice->stride0 = _mm_set1_epi32((int)voxels->brick_strides[0]);
+    lattice->stride1 = _mm_set1_epi32((int)voxels->brick_strides[1]);
+    lattice->stride2 = _mm_set1_epi32((int)voxels->brick_strides[2]);
+  }
+  else {                        /* between voxels */
+    lattice->stride0 = _mm_set1_epi32(sizes[1] * sizes[2]);
+    lattice->stride1 = _mm_set1_epi32(sizes[2]);
+    lattice->stride2 = _mm_set1_epi32(1);
+  }
+
+  lattice->step0 = _mm_mullo_epi32(lattice->stride0, lattice->offset0);
+  lattice->step1 = _mm_mullo_epi32(lattice->stride1, lattice->offset1);
+  lattice->step2 = _mm_mullo_epi32(lattice->stride2, lattice->offset2);
+}
+
+/* brick_offset() of four indices along the axis with the given brick
+   stride and shift */
+
+AVX2_FUNCTION inline static __m128i brick_offsets_avx2(__m128i index, __m128i brick_stride, int shift)
+{
+  return( _mm_add_epi32(_mm_mullo_epi32(_mm_srai_epi32(index, BRICK_BITS), brick_stride),
+                        _mm_slli_epi32(_mm_and_si128(index, _mm_set1_epi32(BRICK_SIZE-1)),
+                                       shift)) );
+}
+
+#endif /* HAVE_AVX2_KERNEL */
+
+                                /* the kernels for double voxels */
+#define VOXEL_TYPE  double
+#define TYPED(name) name ## _double
+#if defined(HAVE_AVX2_KERNEL)
+#define GATHER_VOXELS(voxels, index, valid, valid_pd) \
+  _mm256_mask_i32gather_pd(_mm256_setzero_pd(), voxels, index, valid_pd, 8)
+#endif
+#include "sampling_kernels_type.c"
+#undef VOXEL_TYPE
+#undef TYPED
+#undef GATHER_VOXELS
+
+                                /* the kernels for float voxels */
+#define VOXEL_TYPE  float
+#define TYPED(name) name ## _float
+#if defined(HAVE_AVX2_KERNEL)
+#define GATHER_VOXELS(voxels, index, valid, valid_pd) \
+  _mm256_cvtps_pd(_mm_mask_i32gather_ps(_mm_setzero_ps(), voxels, index, \
+                                        _mm_castsi128_ps(valid), 4))
+#endif
+#include "sampling_kernels_type.c"
+#undef VOXEL_TYPE
+#undef TYPED
+#undef GATHER_VOXELS
+
+                                /* the kernels for signed short voxels,
+                                   scalar only: AVX2 has no 16 bit gather */
+#define VOXEL_TYPE  short
+#define TYPED(name) name ## _short
+#include "sampling_kernels_type.c"
+#undef VOXEL_TYPE
+#undef TYPED
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : trilinear_samples_at_offset_scalar
+@INPUT      : voxels     - the voxel array of a 3D volume (get_voxel_array())
+              offsets    - 1 along each dimension where the sub-lattice
+                           is not flat, 0 otherwise (2D registration)
+              n          - number of nodes
+              x, y, z    - voxel coordinates of the nodes, 0..n-1
+              dx, dy, dz - the displacement to add to every node
+@OUTPUT     : samples    - the n interpolated values
+@RETURNS    :
+@DESCRIPTION: one node at a time, the reference for the vectorized kernel
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void trilinear_samples_at_offset_scalar(Voxel_Array *voxels, int offsets[],
+                                        int n, float x[], float y[], float z[],
+                                        VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                        double samples[])
+{
+  switch (voxels->type) {
+  case VIO_DOUBLE:
+    trilinear_samples_at_offset_scalar_double(voxels, offsets, n, x, y, z,
+                                              dx, dy, dz, samples);
+    break;
+  case VIO_FLOAT:
+    trilinear_samples_at_offset_scalar_float(voxels, offsets, n, x, y, z,
+                                             dx, dy, dz, samples);
+    break;
+  default:
+    trilinear_samples_at_offset_scalar_short(voxels, offsets, n, x, y, z,
+                                             dx, dy, dz, samples);
+    break;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : trilinear_samples_at_offset
+@INPUT      : see trilinear_samples_at_offset_scalar()
+@OUTPUT     : samples
+@RETURNS    :
+@DESCRIPTION: use the vectorized kernel when available, the scalar one
+              for the remaining nodes (or all of them, otherwise)
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void trilinear_samples_at_offset(Voxel_Array *voxels, int offsets[],
+                                 int n, float x[], float y[], float z[],
+                                 VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                 double samples[])
+{
+  switch (voxels->type) {
+  case VIO_DOUBLE:
+    trilinear_samples_at_offset_double(voxels, offsets, n, x, y, z,
+                                       dx, dy, dz, samples);
+    break;
+  case VIO_FLOAT:
+    trilinear_samples_at_offset_float(voxels, offsets, n, x, y, z,
+                                      dx, dy, dz, samples);
+    break;
+  default:
+    trilinear_samples_at_offset_short(voxels, offsets, n, x, y, z,
+                                      dx, dy, dz, samples);
+    break;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : trilinear_samples_at_points
+@INPUT      : voxels     - the voxel array of a 3D volume (get_voxel_array())
+              n          - number of points
+              x, y, z    - voxel coordinates of the points, 0..n-1
+@OUTPUT     : samples    - the n interpolated values
+@RETURNS    :
+@DESCRIPTION: trilinear interpolation at arbitrary points, given in double
+              precision.  A point gets 0.0 unless its 8 neighbours are all
+              in the volume; callers wanting trilinear_interpolant()'s
+              handling of the edges should only pass points with
+              0 <= x < sizes[0]-1, and likewise for y and z.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void trilinear_samples_at_points(Voxel_Array *voxels,
+                                 int n, double x[], double y[], double z[],
+                                 double samples[])
+{
+  int offsets[VIO_N_DIMENSIONS];
+
+  offsets[0] = offsets[1] = offsets[2] = 1;
+
+  switch (voxels->type) {
+  case VIO_DOUBLE:
+    trilinear_samples_at_points_double(voxels, offsets, n, x, y, z, samples);
+    break;
+  case VIO_FLOAT:
+    trilinear_samples_at_points_float(voxels, offsets, n, x, y, z, samples);
+    break;
+  default:
+    trilinear_samples_at_points_short(voxels, offsets, n, x, y, z, samples);
+    break;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nearest_samples_at_offset
+@INPUT      : see trilinear_samples_at_offset_scalar()
+@OUTPUT     : samples
+@RETURNS    :
+@DESCRIPTION: the same, with nearest neighbour interpolation.  The
+              coordinates are truncated, as they have always been in
+              go_get_samples_with_offset().
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void nearest_samples_at_offset(Voxel_Array *voxels,
+                               int n, float x[], float y[], float z[],
+                               VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                               double samples[])
+{
+  switch (voxels->type) {
+  case VIO_DOUBLE:
+    nearest_samples_at_offset_double(voxels, n, x, y, z, dx, dy, dz, samples);
+    break;
+  case VIO_FLOAT:
+    nearest_samples_at_offset_float(voxels, n, x, y, z, dx, dy, dz, samples);
+    break;
+  default:
+    nearest_samples_at_offset_short(voxels, n, x, y, z, dx, dy, dz, samples);
+    break;
+  }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : make_bricked_volume
+@INPUT      : volume     - a 3D volume
+@OUTPUT     :
+@RETURNS    : TRUE if the volume now has bricks, FALSE if its type is not
+              supported by the kernels (see get_voxel_array()) or it is
+              too large for a 32 bit index
+@DESCRIPTION: copy the voxels of volume into bricks of BRICK_SIZE^3
+              voxels, for the kernels and for get_bricked_neighbours().
+              The bricks are stored brick after brick in the C order of
+              the volume, and so are the voxels of each brick.  The
+              bricks along the edges are padded to a full brick.
+
+              The bricks are a copy: they have to be made again (after
+              delete_bricked_volume()) if the voxels of the volume are
+              changed.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL make_bricked_volume(VIO_Volume volume)
+{
+  Bricked_Volume *bricked;
+  Voxel_Array    voxels;
+  size_t         voxel_size;
+  double         n_voxels;
+  char           *block;
+  int            n_bricks[3], i;
+
+  if (find_bricked_volume(volume) != NULL)
+    return(TRUE);
+
+  if (n_bricked_volumes >= MAX_BRICKED_VOLUMES || !get_voxel_array(volume, &voxels))
+    return(FALSE);
+
+  for(i=0; i<3; i++)
+    n_bricks[i] = (voxels.sizes[i] + BRICK_SIZE - 1) / BRICK_SIZE;
+
+  n_voxels = (double)n_bricks[0] * n_bricks[1] * n_bricks[2] * BRICK_SIZE*BRICK_SIZE*BRICK_SIZE;
+  if (n_voxels >= (double)INT_MAX)
+    return(FALSE);
+
+  switch (voxels.type) {
+  case VIO_DOUBLE: voxel_size = sizeof(double); break;
+  case VIO_FLOAT:  voxel_size = sizeof(float);  break;
+  default:         voxel_size = sizeof(short);  break;
+  }
+
+  ALLOC(block, (size_t)n_voxels * voxel_size + 64);
+  (void)memset(block, 0, (size_t)n_voxels * voxel_size + 64);
+
+  voxels.bricks = block + (64 - (size_t)block % 64) % 64;
+  voxels.brick_strides[2] = BRICK_SIZE*BRICK_SIZE*BRICK_SIZE;
+  voxels.brick_strides[1] = voxels.brick_strides[2] * n_bricks[2];
+  voxels.brick_strides[0] = voxels.brick_strides[1] * n_bricks[1];
+
+  switch (voxels.type) {
+  case VIO_DOUBLE: copy_voxels_to_bricks_double(&voxels); break;
+  case VIO_FLOAT:  copy_voxels_to_bricks_float(&voxels);  break;
+  default:         copy_voxels_to_bricks_short(&voxels);  break;
+  }
+
+  bricked = &bricked_volumes[n_bricked_volumes++];
+  bricked->volume = volume;
+  bricked->block  = block;
+  bricked->voxels = voxels;
+
+  return(TRUE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_bricked_volume
+@INPUT      : volume
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: free the bricks of volume, if it has some.  The kernels read
+              its voxel array again.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void delete_bricked_volume(VIO_Volume volume)
+{
+  Bricked_Volume *bricked;
+  char           *block;
+
+  bricked = find_bricked_volume(volume);
+  if (bricked == NULL)
+    return;
+
+  block = (char *) bricked->block;
+  FREE(block);
+
+  *bricked = bricked_volumes[--n_bricked_volumes];
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_bricked_neighbours
+@INPUT      : volume
+              ind0, ind1, ind2 - a voxel, with ind0+1, ind1+1 and ind2+1
+                                 still in the volume
+@OUTPUT     : values           - the real values of the 2x2x2 voxels from
+                                 (ind0,ind1,ind2): v000, v001, v010, v011,
+                                 v100, v101, v110, v111
+@RETURNS    : TRUE if the values were read from the bricks of volume,
+              FALSE if it has none (values is then unchanged)
+@DESCRIPTION: for trilinear_interpolant() and the interpolants built on
+              it.  Returns FALSE at once when no volume has bricks.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+VIO_BOOL get_bricked_neighbours(VIO_Volume volume,
+                                long ind0, long ind1, long ind2,
+                                VIO_Real values[])
+{
+  Bricked_Volume *bricked;
+
+  if (n_bricked_volumes == 0 || (bricked = find_bricked_volume(volume)) == NULL)
+    return(FALSE);
+
+  switch (bricked->voxels.type) {
+  case VIO_DOUBLE:
+    get_bricked_neighbours_double(&bricked->voxels, (int)ind0, (int)ind1, (int)ind2,
+                                  values);
+    break;
+  case VIO_FLOAT:
+    get_bricked_neighbours_float(&bricked->voxels, (int)ind0, (int)ind1, (int)ind2,
+                                 values);
+    break;
+  default:
+    get_bricked_neighbours_short(&bricked->voxels, (int)ind0, (int)ind1, (int)ind2,
+                                 values);
+    break;
+  }
+
+  return(TRUE);
+}
@@ -0,0 +1,431 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : sampling_kernels_type.c
+@DESCRIPTION: the kernels of sampling_kernels.c for one type of voxel.
+
+              This file is included by sampling_kernels.c once for each
+              type of voxel array, with
+                VOXEL_TYPE    - the C type of the voxels,
+                TYPED(name)   - name, with the type appended,
+                GATHER_VOXELS(voxels, index, valid, valid_pd)
+                              - (optional) the AVX2 gather of four voxels
+                                as doubles; without it, the type only has
+                                the scalar kernels.  The AVX2 functions
+                                are compiled for AVX2 (AVX2_FUNCTION) and
+                                only called when the CPU has it.
+
+              Each kernel interpolates the voxel values and converts the
+              result to a real value, value_scale * voxel +
+              value_translation.  For double and float volumes read as
+              real values these are 1 and 0, and the conversion leaves
+              the samples unchanged.
+
+              The voxels are read from the bricks of the volume when it
+              has some (see make_bricked_volume()), from its usual voxel
+              array otherwise.
+@CREATED    : Oct 18, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+/* trilinear interpolation at voxel (v0,v1,v2), 0.0 outside the volume */
+
+inline static double TYPED(trilinear_sample)(Voxel_Array *voxels, int offsets[],
+                                             double v0, double v1, double v2)
+{
+  VOXEL_TYPE ***data, *bricks;
+  long   x0, x1, y0, y1, z0, z1;
+  int    ind0, ind1, ind2, offset0, offset1, offset2;
+  double f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2, sample;
+  double v000, v001, v010, v011, v100, v101, v110, v111;
+
+  offset0 = offsets[0];
+  offset1 = offsets[1];
+  offset2 = offsets[2];
+
+  ind0 = (int)v0;
+  ind1 = (int)v1;
+  ind2 = (int)v2;
+
+  if (!(ind0>=0 && ind0<(voxels->sizes[0]-offset0) &&
+        ind1>=0 && ind1<(voxels->sizes[1]-offset1) &&
+        ind2>=0 && ind2<(voxels->sizes[2]-offset2)))
+    return(0.0);
+
+  /* get the data */
+  if (voxels->bricks == NULL) {
+    data = (VOXEL_TYPE ***) voxels->data;
+    v000 = data[ind0        ][ind1        ][ind2        ];
+    v001 = data[ind0        ][ind1        ][ind2+offset2];
+    v010 = data[ind0        ][ind1+offset1][ind2        ];
+    v011 = data[ind0        ][ind1+offset1][ind2+offset2];
+    v100 = data[ind0+offset0][ind1        ][ind2        ];
+    v101 = data[ind0+offset0][ind1        ][ind2+offset2];
+    v110 = data[ind0+offset0][ind1+offset1][ind2        ];
+    v111 = data[ind0+offset0][ind1+offset1][ind2+offset2];
+  }
+  else {
+    bricks = (VOXEL_TYPE *) voxels->bricks;
+    x0 = brick_offset(voxels, 0, ind0);
+    x1 = brick_offset(voxels, 0, ind0+offset0);
+    y0 = brick_offset(voxels, 1, ind1);
+    y1 = brick_offset(voxels, 1, ind1+offset1);
+    z0 = brick_offset(voxels, 2, ind2);
+    z1 = brick_offset(voxels, 2, ind2+offset2);
+    v000 = bricks[x0 + y0 + z0];
+    v001 = bricks[x0 + y0 + z1];
+    v010 = bricks[x0 + y1 + z0];
+    v011 = bricks[x0 + y1 + z1];
+    v100 = bricks[x1 + y0 + z0];
+    v101 = bricks[x1 + y0 + z1];
+    v110 = bricks[x1 + y1 + z0];
+    v111 = bricks[x1 + y1 + z1];
+  }
+
+  /* Get the fraction parts */
+  f0 = v0 - ind0;
+  f1 = v1 - ind1;
+  f2 = v2 - ind2;
+  r0 = 1.0 - f0;
+  r1 = 1.0 - f1;
+  r2 = 1.0 - f2;
+
+  /* Do the interpolation */
+  r1r2 = r1 * r2;
+  r1f2 = r1 * f2;
+  f1r2 = f1 * r2;
+  f1f2 = f1 * f2;
+
+  sample  =
+    r0 *  (r1r2 * v000 +
+           r1f2 * v001 +
+           f1r2 * v010 +
+           f1f2 * v011);
+  sample +=
+    f0 *  (r1r2 * v100 +
+           r1f2 * v101 +
+           f1r2 * v110 +
+           f1f2 * v111);
+
+  return(voxels->value_scale * sample + voxels->value_translation);
+}
+
+static void TYPED(trilinear_samples_at_offset_scalar)(Voxel_Array *voxels, int offsets[],
+                                                      int n, float x[], float y[], float z[],
+                                                      VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                                      double samples[])
+{
+  int c;
+
+  for(c=0; c<n; c++)
+    samples[c] = TYPED(trilinear_sample)(voxels, offsets,
+                                         (VIO_Real) ( x[c] + dx ),
+                                         (VIO_Real) ( y[c] + dy ),
+                                         (VIO_Real) ( z[c] + dz ));
+}
+
+#if defined(HAVE_AVX2_KERNEL) && defined(GATHER_VOXELS)
+
+/* return TRUE if the voxels are stored in a single block, in the usual
+   C order, and can be addressed with a 32 bit index */
+
+static VIO_BOOL TYPED(voxels_are_contiguous)(Voxel_Array *voxels)
+{
+  VOXEL_TYPE ***data;
+  int    *sizes;
+  double n_voxels;
+
+  data  = (VOXEL_TYPE ***) voxels->data;
+  sizes = voxels->sizes;
+
+  n_voxels = (double)sizes[0] * (double)sizes[1] * (double)sizes[2];
+
+  if (n_voxels <= 0.0 || n_voxels >= (double)INT_MAX)
+    return(FALSE);
+
+  return( &data[sizes[0]-1][sizes[1]-1][sizes[2]-1] - &data[0][0][0] ==
+          (long)n_voxels - 1 &&
+          data[sizes[0]-1][0] - data[0][0] ==
+          (long)(sizes[0]-1) * sizes[1] * sizes[2] );
+}
+
+/* four nodes at voxel coordinates (v0,v1,v2): the same computation as
+   trilinear_sample(), lane by lane.  Invalid lanes (outside the volume)
+   gather nothing and are cleared to 0.0 at the end. */
+
+AVX2_FUNCTION inline static __m256d TYPED(trilinear_samples_avx2)(VOXEL_TYPE *voxels, Avx2_Lattice *lattice,
+                                                    __m256d v0, __m256d v1, __m256d v2)
+{
+  __m256d f0, f1, f2, r0, r1, r2, r1r2, r1f2, f1r2, f1f2;
+  __m256d v000, v001, v010, v011, v100, v101, v110, v111;
+  __m256d lower, upper, sample, valid_pd, zero;
+  __m128i ind0, ind1, ind2, valid, x0, x1, y0, y1, z0, z1;
+  __m128i i000, i001, i010, i011, i100, i101, i110, i111;
+
+  zero  = lattice->zero;
+
+  ind0 = _mm256_cvttpd_epi32(v0); /* truncation, as (int) */
+  ind1 = _mm256_cvttpd_epi32(v1);
+  ind2 = _mm256_cvttpd_epi32(v2);
+
+  valid = _mm_and_si128(_mm_cmpgt_epi32(ind0, lattice->minus_one),
+                        _mm_cmpgt_epi32(lattice->limit0, ind0));
+  valid = _mm_and_si128(valid, _mm_cmpgt_epi32(ind1, lattice->minus_one));
+  valid = _mm_and_si128(valid, _mm_cmpgt_epi32(lattice->limit1, ind1));
+  valid = _mm_and_si128(valid, _mm_cmpgt_epi32(ind2, lattice->minus_one));
+  valid = _mm_and_si128(valid, _mm_cmpgt_epi32(lattice->limit2, ind2));
+
+  if (_mm_testz_si128(valid, valid))
+    return(zero);
+
+                                /* the offset of each corner along each
+                                   axis, so that corner (a,b,c) is at
+                                   xa + yb + zc */
+  if (lattice->bricked) {
+    x0 = brick_offsets_avx2(ind0, lattice->stride0, 2*BRICK_BITS);
+    x1 = brick_offsets_avx2(_mm_add_epi32(ind0, lattice->offset0), lattice->stride0,
+                            2*BRICK_BITS);
+    y0 = brick_offsets_avx2(ind1, lattice->stride1, BRICK_BITS);
+    y1 = brick_offsets_avx2(_mm_add_epi32(ind1, lattice->offset1), lattice->stride1,
+                            BRICK_BITS);
+    z0 = brick_offsets_avx2(ind2, lattice->stride2, 0);
+    z1 = brick_offsets_avx2(_mm_add_epi32(ind2, lattice->offset2), lattice->stride2, 0);
+  }
+  else {
+    x0 = _mm_mullo_epi32(ind0, lattice->stride0);
+    x1 = _mm_add_epi32(x0, lattice->step0);
+    y0 = _mm_mullo_epi32(ind1, lattice->stride1);
+    y1 = _mm_add_epi32(y0, lattice->step1);
+    z0 = ind2;
+    z1 = _mm_add_epi32(z0, lattice->step2);
+  }
+
+                                /* the invalid lanes are not gathered,
+                                   whatever their index */
+  i000 = _mm_add_epi32(_mm_add_epi32(x0, y0), z0);
+  i001 = _mm_add_epi32(_mm_add_epi32(x0, y0), z1);
+  i010 = _mm_add_epi32(_mm_add_epi32(x0, y1), z0);
+  i011 = _mm_add_epi32(_mm_add_epi32(x0, y1), z1);
+  i100 = _mm_add_epi32(_mm_add_epi32(x1, y0), z0);
+  i101 = _mm_add_epi32(_mm_add_epi32(x1, y0), z1);
+  i110 = _mm_add_epi32(_mm_add_epi32(x1, y1), z0);
+  i111 = _mm_add_epi32(_mm_add_epi32(x1, y1), z1);
+
+  valid_pd = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(valid));
+
+  /* get the data */
+  v000 = GATHER_VOXELS(voxels, i000, valid, valid_pd);
+  v001 = GATHER_VOXELS(voxels, i001, valid, valid_pd);
+  v010 = GATHER_VOXELS(voxels, i010, valid, valid_pd);
+  v011 = GATHER_VOXELS(voxels, i011, valid, valid_pd);
+  v100 = GATHER_VOXELS(voxels, i100, valid, valid_pd);
+  v101 = GATHER_VOXELS(voxels, i101, valid, valid_pd);
+  v110 = GATHER_VOXELS(voxels, i110, valid, valid_pd);
+  v111 = GATHER_VOXELS(voxels, i111, valid, valid_pd);
+
+  /* Get the fraction parts */
+  f0 = _mm256_sub_pd(v0, _mm256_cvtepi32_pd(ind0));
+  f1 = _mm256_sub_pd(v1, _mm256_cvtepi32_pd(ind1));
+  f2 = _mm256_sub_pd(v2, _mm256_cvtepi32_pd(ind2));
+  r0 = _mm256_sub_pd(lattice->one, f0);
+  r1 = _mm256_sub_pd(lattice->one, f1);
+  r2 = _mm256_sub_pd(lattice->one, f2);
+
+  /* Do the interpolation */
+  r1r2 = _mm256_mul_pd(r1, r2);
+  r1f2 = _mm256_mul_pd(r1, f2);
+  f1r2 = _mm256_mul_pd(f1, r2);
+  f1f2 = _mm256_mul_pd(f1, f2);
+
+  lower = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r1r2, v000),
+                                                    _mm256_mul_pd(r1f2, v001)),
+                                      _mm256_mul_pd(f1r2, v010)),
+                        _mm256_mul_pd(f1f2, v011));
+  upper = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r1r2, v100),
+                                                    _mm256_mul_pd(r1f2, v101)),
+                                      _mm256_mul_pd(f1r2, v110)),
+                        _mm256_mul_pd(f1f2, v111));
+
+  sample = _mm256_add_pd(_mm256_mul_pd(r0, lower), _mm256_mul_pd(f0, upper));
+  sample = _mm256_add_pd(_mm256_mul_pd(lattice->value_scale, sample),
+                         lattice->value_translation);
+
+  return(_mm256_and_pd(sample, valid_pd));
+}
+
+/* four nodes per iteration of float coordinates plus a displacement */
+
+AVX2_FUNCTION static int TYPED(trilinear_samples_at_offset_avx2)(Voxel_Array *voxels, int offsets[],
+                                                   int n, float x[], float y[], float z[],
+                                                   VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                                   double samples[])
+{
+  Avx2_Lattice lattice;
+  VOXEL_TYPE   *first;
+  __m256d      displacement0, displacement1, displacement2, v0, v1, v2;
+  int          c;
+
+  init_avx2_lattice(&lattice, voxels, offsets);
+  first = (voxels->bricks != NULL) ? (VOXEL_TYPE *) voxels->bricks :
+                                     &((VOXEL_TYPE ***) voxels->data)[0][0][0];
+
+  displacement0 = _mm256_set1_pd(dx);
+  displacement1 = _mm256_set1_pd(dy);
+  displacement2 = _mm256_set1_pd(dz);
+
+  for(c=0; c+4<=n; c+=4) {
+    v0 = _mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(&x[c])), displacement0);
+    v1 = _mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(&y[c])), displacement1);
+    v2 = _mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(&z[c])), displacement2);
+
+    _mm256_storeu_pd(&samples[c], TYPED(trilinear_samples_avx2)(first, &lattice, v0, v1, v2));
+  }
+
+  return(c);                    /* number of nodes done */
+}
+
+/* four nodes per iteration of double coordinates */
+
+AVX2_FUNCTION static int TYPED(trilinear_samples_at_points_avx2)(Voxel_Array *voxels, int offsets[],
+                                                   int n, double x[], double y[], double z[],
+                                                   double samples[])
+{
+  Avx2_Lattice lattice;
+  VOXEL_TYPE   *first;
+  int          c;
+
+  init_avx2_lattice(&lattice, voxels, offsets);
+  first = (voxels->bricks != NULL) ? (VOXEL_TYPE *) voxels->bricks :
+                                     &((VOXEL_TYPE ***) voxels->data)[0][0][0];
+
+  for(c=0; c+4<=n; c+=4)
+    _mm256_storeu_pd(&samples[c],
+                     TYPED(trilinear_samples_avx2)(first, &lattice,
+                                                   _mm256_loadu_pd(&x[c]),
+                                                   _mm256_loadu_pd(&y[c]),
+                                                   _mm256_loadu_pd(&z[c])));
+
+  return(c);                    /* number of nodes done */
+}
+
+#endif /* HAVE_AVX2_KERNEL && GATHER_VOXELS */
+
+static void TYPED(trilinear_samples_at_offset)(Voxel_Array *voxels, int offsets[],
+                                               int n, float x[], float y[], float z[],
+                                               VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                               double samples[])
+{
+  int done;
+
+  done = 0;
+
+#if defined(HAVE_AVX2_KERNEL) && defined(GATHER_VOXELS)
+  if (n >= 4 && vectorized_sampling_available() &&
+      (voxels->bricks != NULL || TYPED(voxels_are_contiguous)(voxels)))
+    done = TYPED(trilinear_samples_at_offset_avx2)(voxels, offsets,
+                                                   n, x, y, z, dx, dy, dz, samples);
+#endif
+
+  if (done < n)
+    TYPED(trilinear_samples_at_offset_scalar)(voxels, offsets, n-done,
+                                              &x[done], &y[done], &z[done],
+                                              dx, dy, dz, &samples[done]);
+}
+
+static void TYPED(trilinear_samples_at_points)(Voxel_Array *voxels, int offsets[],
+                                               int n, double x[], double y[], double z[],
+                                               double samples[])
+{
+  int c, done;
+
+  done = 0;
+
+#if defined(HAVE_AVX2_KERNEL) && defined(GATHER_VOXELS)
+  if (n >= 4 && vectorized_sampling_available() &&
+      (voxels->bricks != NULL || TYPED(voxels_are_contiguous)(voxels)))
+    done = TYPED(trilinear_samples_at_points_avx2)(voxels, offsets,
+                                                   n, x, y, z, samples);
+#endif
+
+  for(c=done; c<n; c++)
+    samples[c] = TYPED(trilinear_sample)(voxels, offsets, x[c], y[c], z[c]);
+}
+
+static void TYPED(nearest_samples_at_offset)(Voxel_Array *voxels,
+                                             int n, float x[], float y[], float z[],
+                                             VIO_Real dx, VIO_Real dy, VIO_Real dz,
+                                             double samples[])
+{
+  VOXEL_TYPE ***data, *bricks;
+  double voxel;
+  int c, ind0, ind1, ind2;
+
+  data   = (VOXEL_TYPE ***) voxels->data;
+  bricks = (VOXEL_TYPE *) voxels->bricks;
+
+  for(c=0; c<n; c++) {
+
+    ind0 = (int) ( x[c] + dx );
+    ind1 = (int) ( y[c] + dy );
+    ind2 = (int) ( z[c] + dz );
+
+    if (ind0>=0 && ind0<voxels->sizes[0] &&
+        ind1>=0 && ind1<voxels->sizes[1] &&
+        ind2>=0 && ind2<voxels->sizes[2]) {
+      if (bricks == NULL)
+        voxel = data[ind0][ind1][ind2];
+      else
+        voxel = bricks[brick_offset(voxels, 0, ind0) +
+                       brick_offset(voxels, 1, ind1) +
+                       brick_offset(voxels, 2, ind2)];
+      samples[c] = voxels->value_scale * voxel + voxels->value_translation;
+    }
+    else
+      samples[c] = 0.0;
+  }
+}
+
+/* copy the voxels of the volume into its bricks */
+
+static void TYPED(copy_voxels_to_bricks)(Voxel_Array *voxels)
+{
+  VOXEL_TYPE ***data, *bricks;
+  long x, y;
+  int  i, j, k;
+
+  data   = (VOXEL_TYPE ***) voxels->data;
+  bricks = (VOXEL_TYPE *) voxels->bricks;
+
+  for(i=0; i<voxels->sizes[0]; i++) {
+    x = brick_offset(voxels, 0, i);
+    for(j=0; j<voxels->sizes[1]; j++) {
+      y = brick_offset(voxels, 1, j);
+      for(k=0; k<voxels->sizes[2]; k++)
+        bricks[x + y + brick_offset(voxels, 2, k)] = data[i][j][k];
+    }
+  }
+}
+
+/* the real values of the 2x2x2 voxels from (ind0,ind1,ind2), in the
+   order v000, v001, v010, v011, v100, ... */
+
+static void TYPED(get_bricked_neighbours)(Voxel_Array *voxels,
+                                          int ind0, int ind1, int ind2,
+                                          VIO_Real values[])
+{
+  VOXEL_TYPE *bricks;
+  long x[2], y[2], z[2];
+  int  i, j, k;
+
+  bricks = (VOXEL_TYPE *) voxels->bricks;
+
+  for(i=0; i<2; i++) {
+    x[i] = brick_offset(voxels, 0, ind0+i);
+    y[i] = brick_offset(voxels, 1, ind1+i);
+    z[i] = brick_offset(voxels, 2, ind2+i);
+  }
+
+  for(i=0; i<2; i++)
+    for(j=0; j<2; j++)
+      for(k=0; k<2; k++)
+        values[4*i + 2*j + k] = voxels->value_scale * bricks[x[i] + y[j] + z[k]] +
+                                voxels->value_translation;
+}